@@ -38,7 +38,8 @@ macro(nRF52_setup)
             )
 
     # nRF52 (we use same board identifier as nRF52-DK => PCA10040)
-    set(NRF5_LINKER_SCRIPT "${CMAKE_SOURCE_DIR}/gcc_nrf52.ld")
+    # generated from gcc_nrf52.ld.in with the application RAM start, see CMakeLists.txt
+    set(NRF5_LINKER_SCRIPT "${CMAKE_BINARY_DIR}/gcc_nrf52.ld")
     set(CPU_FLAGS "-mcpu=cortex-m4 -mfloat-abi=hard -mfpu=fpv4-sp-d16")
     add_definitions(-DNRF52 -DNRF52832 -DNRF52_PAN_64 -DNRF52_PAN_12 -DNRF52_PAN_58 -DNRF52_PAN_54 -DNRF52_PAN_31 -DNRF52_PAN_51 -DNRF52_PAN_36 -DNRF52_PAN_15 -DNRF52_PAN_20 -DNRF52_PAN_55 -DBOARD_PCA10040)
     add_definitions(-DSOFTDEVICE_PRESENT -DS132 -DBLE_STACK_SUPPORT_REQD -DNRF_SD_BLE_API_VERSION=3)
@@ -57,7 +58,7 @@ macro(nRF52_setup)
     set(CMAKE_C_FLAGS "${COMMON_FLAGS}")
     set(CMAKE_CXX_FLAGS "${COMMON_FLAGS}")
     set(CMAKE_ASM_FLAGS "-MP -MD -std=c99 -x assembler-with-cpp")
-    set(CMAKE_EXE_LINKER_FLAGS "-mthumb -mabi=aapcs -std=gnu++98 -std=c99 -L ${NRF5_SDK_PATH}/components/toolchain/gcc -T${NRF5_LINKER_SCRIPT} ${CPU_FLAGS} -Wl,--gc-sections --specs=nano.specs -lc -lnosys -lm")
+    set(CMAKE_EXE_LINKER_FLAGS "-mthumb -mabi=aapcs -std=gnu++98 -std=c99 -L ${NRF5_SDK_PATH}/components/toolchain/gcc ${CPU_FLAGS} -Wl,--gc-sections --specs=nano.specs -lc -lnosys -lm")
     # note: we must override the default cmake linker flags so that CMAKE_C_FLAGS are not added implicitly
     set(CMAKE_C_LINK_EXECUTABLE "${CMAKE_C_COMPILER} <LINK_FLAGS> <OBJECTS> -o <TARGET>")
     set(CMAKE_CXX_LINK_EXECUTABLE "${CMAKE_C_COMPILER} <LINK_FLAGS> <OBJECTS> -lstdc++ -o <TARGET>")
@@ -180,7 +181,8 @@ macro(nRF52_addExecutable EXECUTABLE_NAME SOURCE_FILES)
     # executable
     add_executable(${EXECUTABLE_NAME} ${SDK_SOURCE_FILES} ${SOURCE_FILES})
     set_target_properties(${EXECUTABLE_NAME} PROPERTIES SUFFIX ".out")
-    set_target_properties(${EXECUTABLE_NAME} PROPERTIES LINK_FLAGS "-Wl,-Map=${EXECUTABLE_NAME}.map")
+    # the linker script is per executable (NRF5_LINKER_SCRIPT when this is called), see the bootloader
+    set_target_properties(${EXECUTABLE_NAME} PROPERTIES LINK_FLAGS "-T${NRF5_LINKER_SCRIPT} -Wl,-Map=${EXECUTABLE_NAME}.map")
 
     # additional POST BUILD setps to create the .bin and .hex files
     add_custom_command(TARGET ${EXECUTABLE_NAME}
@@ -199,3 +201,31 @@ macro(nRF52_addExecutable EXECUTABLE_NAME SOURCE_FILES)
             COMMENT "flashing ${EXECUTABLE_NAME}.hex"
             )
 endmacro()
+
+# adds a post build step storing the static RAM per module from the linker map in the .ram_map section of the
+# executable (see host/tools/ram_map.cpp), the .bin and .hex are written again afterwards
+macro(nRF52_addRamMap EXECUTABLE_NAME)
+    if (NOT RAM_MAP)
+        message(FATAL_ERROR "The path to the host tool ram_map (RAM_MAP) must be set.")
+    endif ()
+    add_custom_command(TARGET ${EXECUTABLE_NAME}
+            POST_BUILD
+            COMMAND ${RAM_MAP} --blob ${EXECUTABLE_NAME}.ram_map ${EXECUTABLE_NAME}.map
+            COMMAND ${ARM_NONE_EABI_TOOLCHAIN_PATH}/bin/arm-none-eabi-objcopy --update-section .ram_map=${EXECUTABLE_NAME}.ram_map ${EXECUTABLE_NAME}.out
+            COMMAND ${ARM_NONE_EABI_TOOLCHAIN_PATH}/bin/arm-none-eabi-objcopy -O binary ${EXECUTABLE_NAME}.out "${EXECUTABLE_NAME}.bin"
+            COMMAND ${ARM_NONE_EABI_TOOLCHAIN_PATH}/bin/arm-none-eabi-objcopy -O ihex ${EXECUTABLE_NAME}.out "${EXECUTABLE_NAME}.hex"
+            COMMENT "storing the RAM map of ${EXECUTABLE_NAME}")
+endmacro()
+
+# adds a post build step writing a factory image per identity in IDENTITIES_CSV (see host/tools/factory_image.cpp),
+# the .hex of the executable is merged with the additional hex files (SoftDevice, bootloader)
+macro(nRF52_addFactoryImages EXECUTABLE_NAME IDENTITIES_CSV EXTRA_HEX_FILES)
+    if (NOT FACTORY_IMAGE)
+        message(FATAL_ERROR "The path to the host tool factory_image (FACTORY_IMAGE) must be set.")
+    endif ()
+    add_custom_command(TARGET ${EXECUTABLE_NAME}
+            POST_BUILD
+            COMMAND ${CMAKE_COMMAND} -E make_directory factory
+            COMMAND ${FACTORY_IMAGE} --out-dir factory ${IDENTITIES_CSV} ${EXECUTABLE_NAME}.hex ${EXTRA_HEX_FILES}
+            COMMENT "writing factory images of ${EXECUTABLE_NAME}")
+endmacro()
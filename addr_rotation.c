@@ -0,0 +1,62 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "addr_rotation.h"
+
+#include <string.h>
+
+#include "nrf_soc.h"
+
+// Module state
+static uint8_t m_pool[ADDR_ROTATION_POOL_SIZE][ADDR_ROTATION_ADDR_SIZE];
+static uint8_t m_pool_count;
+
+// The random part of a static address must neither be all zeros nor all ones
+static bool addr_valid(const uint8_t *p_addr) {
+    bool zeros = (p_addr[ADDR_ROTATION_ADDR_SIZE - 1] & 0x3f) == 0;
+    bool ones = (p_addr[ADDR_ROTATION_ADDR_SIZE - 1] & 0x3f) == 0x3f;
+    for (int i = 0; i < ADDR_ROTATION_ADDR_SIZE - 1; i++) {
+        zeros = zeros && p_addr[i] == 0x00;
+        ones = ones && p_addr[i] == 0xff;
+    }
+    return !zeros && !ones;
+}
+
+uint8_t addr_rotation_fill(void) {
+    uint8_t available;
+
+    while (m_pool_count < ADDR_ROTATION_POOL_SIZE) {
+        uint8_t *p_addr = m_pool[m_pool_count];
+        if (sd_rand_application_bytes_available_get(&available) != NRF_SUCCESS ||
+            available < ADDR_ROTATION_ADDR_SIZE ||
+            sd_rand_application_vector_get(p_addr, ADDR_ROTATION_ADDR_SIZE) != NRF_SUCCESS) {
+            break;
+        }
+        // the two most significant bits of a random static address are set
+        p_addr[ADDR_ROTATION_ADDR_SIZE - 1] |= 0xc0;
+        if (addr_valid(p_addr)) {
+            m_pool_count++;
+        }
+    }
+    return m_pool_count;
+}
+
+bool addr_rotation_take(uint8_t *p_addr) {
+    if (m_pool_count == 0) {
+        return false;
+    }
+    memcpy(p_addr, m_pool[--m_pool_count], ADDR_ROTATION_ADDR_SIZE);
+    return true;
+}
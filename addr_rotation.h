@@ -0,0 +1,34 @@
+#ifndef _ADDR_ROTATION_H
+#define _ADDR_ROTATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Pool of random static device addresses for address rotation. The addresses are generated ahead of
+// time from the SoftDevice's hardware RNG pool, so a rotation never waits for random numbers.
+
+#define ADDR_ROTATION_POOL_SIZE         8
+#define ADDR_ROTATION_ADDR_SIZE         6
+
+// Limits of the rotation period in seconds
+#define ADDR_ROTATION_MIN_PERIOD_S      10
+#define ADDR_ROTATION_MAX_PERIOD_S      86400
+
+typedef enum {
+    ADDR_ROTATION_OFF,              // the factory address is used
+    ADDR_ROTATION_STATIC,           // a new random static address every period
+    ADDR_ROTATION_MODE_COUNT
+} addr_rotation_mode_t;
+
+typedef struct {
+    uint8_t mode;
+    uint8_t reserved[3];
+    uint32_t period_s;
+} addr_rotation_config_t;
+
+// Tops up the pool with the random bytes available, returns the number of addresses in the pool
+uint8_t addr_rotation_fill(void);
+// Takes an address from the pool (least significant byte first), false if the pool is empty
+bool addr_rotation_take(uint8_t *p_addr);
+
+#endif // _ADDR_ROTATION_H
@@ -0,0 +1,95 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "bloom.h"
+
+#include <string.h>
+
+// error codes, numerically the same as the corresponding NRF_ERROR_* codes
+#define BLOOM_SUCCESS                   0
+#define BLOOM_ERROR_NO_MEM              4
+#define BLOOM_ERROR_INVALID_PARAM       7
+
+#define FNV_OFFSET_BASIS                0xcbf29ce484222325ULL
+#define FNV_PRIME                       0x100000001b3ULL
+
+static uint64_t fnv1a_64(const uint8_t *p_data, uint16_t len) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (uint16_t i = 0; i < len; i++) {
+        hash ^= p_data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+void bloom_init(bloom_filter_t *p_filter, uint8_t *p_bits, uint32_t capacity_bytes) {
+    memset(p_filter, 0, sizeof(bloom_filter_t));
+    p_filter->p_bits = p_bits;
+    p_filter->capacity_bytes = capacity_bytes;
+}
+
+uint32_t bloom_size_bytes(const bloom_filter_t *p_filter) {
+    return (p_filter->num_bits + 7) / 8;
+}
+
+uint32_t bloom_configure(bloom_filter_t *p_filter, uint32_t num_bits, uint8_t num_hashes) {
+    if (num_bits == 0 || num_hashes == 0) return BLOOM_ERROR_INVALID_PARAM;
+    if ((num_bits + 7) / 8 > p_filter->capacity_bytes) return BLOOM_ERROR_NO_MEM;
+
+    p_filter->num_bits = num_bits;
+    p_filter->num_hashes = num_hashes;
+    memset(p_filter->p_bits, 0, bloom_size_bytes(p_filter));
+    return BLOOM_SUCCESS;
+}
+
+uint32_t bloom_write(bloom_filter_t *p_filter, uint32_t offset, const uint8_t *p_data, uint16_t len) {
+    if (offset > bloom_size_bytes(p_filter) || len > bloom_size_bytes(p_filter) - offset) {
+        return BLOOM_ERROR_INVALID_PARAM;
+    }
+    memcpy(&p_filter->p_bits[offset], p_data, len);
+    return BLOOM_SUCCESS;
+}
+
+void bloom_add(bloom_filter_t *p_filter, const uint8_t *p_key, uint16_t len) {
+    uint64_t hash = fnv1a_64(p_key, len);
+    uint32_t h = (uint32_t) hash;
+    uint32_t step = (uint32_t) (hash >> 32) | 1;
+    for (uint8_t i = 0; i < p_filter->num_hashes; i++, h += step) {
+        uint32_t bit = h % p_filter->num_bits;
+        p_filter->p_bits[bit / 8] |= (uint8_t) (1 << (bit % 8));
+    }
+}
+
+bool bloom_contains(const bloom_filter_t *p_filter, const uint8_t *p_key, uint16_t len) {
+    if (p_filter->num_bits == 0) return false;
+    uint64_t hash = fnv1a_64(p_key, len);
+    uint32_t h = (uint32_t) hash;
+    uint32_t step = (uint32_t) (hash >> 32) | 1;
+    for (uint8_t i = 0; i < p_filter->num_hashes; i++, h += step) {
+        uint32_t bit = h % p_filter->num_bits;
+        if (!(p_filter->p_bits[bit / 8] & (1 << (bit % 8)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void bloom_ibeacon_key(const uint8_t *uuid, uint16_t major, uint16_t minor, uint8_t *p_key) {
+    memcpy(p_key, uuid, 16);
+    p_key[16] = (uint8_t) (major >> 8);
+    p_key[17] = (uint8_t) major;
+    p_key[18] = (uint8_t) (minor >> 8);
+    p_key[19] = (uint8_t) minor;
+}
@@ -0,0 +1,31 @@
+#ifndef _BLOOM_H
+#define _BLOOM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Key of an iBeacon identity: proximity UUID, major and minor (big endian)
+#define BLOOM_IBEACON_KEY_SIZE          20
+
+// Bloom filter over byte strings. Bit i of the filter is bit (i % 8) of byte (i / 8).
+// The k bit positions of a key are derived by double hashing from a 64-bit FNV-1a hash:
+//   position_i = ((h_low + i * (h_high | 1)) mod 2^32) % num_bits
+typedef struct {
+    uint8_t *p_bits;
+    uint32_t capacity_bytes;
+    uint32_t num_bits;
+    uint8_t num_hashes;
+} bloom_filter_t;
+
+void bloom_init(bloom_filter_t *p_filter, uint8_t *p_bits, uint32_t capacity_bytes);
+// Clears the filter and sets its geometry, fails if it does not fit into the storage
+uint32_t bloom_configure(bloom_filter_t *p_filter, uint32_t num_bits, uint8_t num_hashes);
+uint32_t bloom_size_bytes(const bloom_filter_t *p_filter);
+// Copies a chunk of a filter built elsewhere into the filter
+uint32_t bloom_write(bloom_filter_t *p_filter, uint32_t offset, const uint8_t *p_data, uint16_t len);
+void bloom_add(bloom_filter_t *p_filter, const uint8_t *p_key, uint16_t len);
+bool bloom_contains(const bloom_filter_t *p_filter, const uint8_t *p_key, uint16_t len);
+
+void bloom_ibeacon_key(const uint8_t *uuid, uint16_t major, uint16_t minor, uint8_t *p_key);
+
+#endif // _BLOOM_H
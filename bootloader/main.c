@@ -0,0 +1,102 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Minimal bootloader for the serial firmware update (see dfu_image.h). The MBR starts it at every
+// reset as its address is set in the UICR. If the application has marked a verified image in bank 1,
+// it is copied to bank 0 before the application is started. Has no UART or BLE of its own, the
+// transfer is done by the application, so there is nothing to update in the bootloader itself.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nrf.h"
+#include "nrf_mbr.h"
+#include "nrf_sdm.h"
+#include "nrf_nvmc.h"
+
+#include "dfu_image.h"
+
+#define COPY_ATTEMPTS                   3
+
+// tells the MBR where the bootloader is, programmed together with the bootloader
+static const uint32_t m_uicr_bootloader_start_address __attribute__((section(".uicr_bootloader_start_address"), used)) =
+        DFU_BOOTLOADER_ADDR;
+
+// copies whole pages, the rest of the last one is erased flash in bank 1
+static void copy_image(uint32_t image_size) {
+    uint32_t offset;
+
+    for (offset = 0; offset < image_size; offset += DFU_PAGE_SIZE) {
+        nrf_nvmc_page_erase(DFU_BANK0_ADDR + offset);
+        nrf_nvmc_write_words(DFU_BANK0_ADDR + offset, (const uint32_t *) (DFU_BANK1_ADDR + offset),
+                             DFU_PAGE_SIZE / sizeof(uint32_t));
+    }
+}
+
+static void install_update(void) {
+    const dfu_descriptor_t *p_descriptor = (const dfu_descriptor_t *) DFU_DESCRIPTOR_ADDR;
+    uint32_t image_size = p_descriptor->image_size;
+    uint32_t image_crc = p_descriptor->image_crc;
+    uint32_t attempt;
+
+    if (!dfu_swap_requested(p_descriptor)) {
+        return;
+    }
+    // the application has verified bank 1 before requesting the swap, check again in case of flash errors
+    if (dfu_crc32((const uint8_t *) DFU_BANK1_ADDR, image_size, 0) == image_crc) {
+        for (attempt = 0; attempt < COPY_ATTEMPTS; attempt++) {
+            copy_image(image_size);
+            if (dfu_crc32((const uint8_t *) DFU_BANK0_ADDR, image_size, 0) == image_crc) {
+                break;
+            }
+        }
+        if (attempt == COPY_ATTEMPTS) {
+            // bank 0 is broken but bank 1 is still intact, the copy is tried again at the next reset
+            for (;;) {
+                __WFE();
+            }
+        }
+    }
+    nrf_nvmc_page_erase(DFU_DESCRIPTOR_ADDR);
+}
+
+static void __attribute__((noreturn, naked)) jump_to(uint32_t sp, uint32_t pc) {
+    __asm volatile(
+    "msr msp, r0\n"
+    "bx r1\n"
+    );
+}
+
+static void start_application(void) {
+    const uint32_t *p_vectors = (const uint32_t *) DFU_BANK0_ADDR;
+    sd_mbr_command_t command = {.command = SD_MBR_COMMAND_INIT_SD};
+
+    if (!dfu_image_plausible((const uint8_t *) DFU_BANK0_ADDR, DFU_BANK_SIZE)) {
+        // nothing installed, the application has to be programmed with a debugger
+        for (;;) {
+            __WFE();
+        }
+    }
+    // the MBR forwards interrupts to the bootloader, let the SoftDevice forward them to the application
+    sd_mbr_command(&command);
+    sd_softdevice_vector_table_base_set(DFU_BANK0_ADDR);
+    jump_to(p_vectors[0], p_vectors[1]);
+}
+
+int main(void) {
+    install_update();
+    start_application();
+}
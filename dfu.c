@@ -0,0 +1,299 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dfu.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <nrf.h>
+#include <nrf_fstorage.h>
+#include <nrf_fstorage_sd.h>
+#include <app_util_platform.h>
+#include <app_scheduler.h>
+#include <sdk_errors.h>
+
+#include "stats.h"
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t *p_evt);
+
+NRF_FSTORAGE_DEF(nrf_fstorage_t m_bank_fs) = {
+        .evt_handler = fstorage_evt_handler,
+        .start_addr  = DFU_BANK1_ADDR,
+        .end_addr    = DFU_BANK1_ADDR + DFU_BANK_SIZE
+};
+
+NRF_FSTORAGE_DEF(nrf_fstorage_t m_descriptor_fs) = {
+        .evt_handler = fstorage_evt_handler,
+        .start_addr  = DFU_DESCRIPTOR_ADDR,
+        .end_addr    = DFU_DESCRIPTOR_ADDR + DFU_PAGE_SIZE
+};
+
+// Module state
+static dfu_evt_handler_t m_evt_handler;
+static volatile dfu_state_t m_state;
+static dfu_descriptor_t m_descriptor;       // source of the descriptor write
+static uint32_t m_swap_word = DFU_SWAP_MAGIC;
+static uint32_t m_queued_end;               // end of the data accepted so far
+static volatile uint32_t m_written;         // end of the data in flash
+static bool m_session;                      // m_written belongs to the stored descriptor
+static uint32_t m_erased_end;               // pages of bank 1 erased in this transfer end here
+static volatile uint8_t m_pending;
+static volatile uint8_t m_pending_chunks;
+static uint8_t m_next_chunk;
+static uint32_t m_chunks[DFU_MAX_PENDING_CHUNKS][DFU_CHUNK_MAX_SIZE / 4];
+
+static const dfu_descriptor_t *flash_descriptor(void) {
+    return (const dfu_descriptor_t *) DFU_DESCRIPTOR_ADDR;
+}
+
+static void send_evt(dfu_evt_type_t type, uint32_t offset, uint32_t result) {
+    dfu_evt_t evt = {.type = type, .offset = offset, .result = result};
+    m_evt_handler(&evt);
+}
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t *p_evt) {
+    bool chunk = p_evt->id == NRF_FSTORAGE_EVT_WRITE_RESULT && p_evt->addr >= DFU_BANK1_ADDR &&
+                 p_evt->addr < DFU_BANK1_ADDR + DFU_BANK_SIZE;
+
+    CRITICAL_REGION_ENTER();
+    m_pending--;
+    if (chunk) {
+        m_pending_chunks--;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (p_evt->result != NRF_SUCCESS) {
+        // later operations may still complete, m_written stays below the gap
+        if (m_state != DFU_STATE_IDLE) {
+            m_state = DFU_STATE_IDLE;
+            send_evt(DFU_EVT_ERROR, m_written, p_evt->result);
+        }
+        return;
+    }
+    if (chunk && m_state == DFU_STATE_RECEIVING) {
+        uint32_t end = p_evt->addr + p_evt->len - DFU_BANK1_ADDR;
+        // the last chunk is padded to a multiple of 4 bytes
+        m_written = end < m_descriptor.image_size ? end : m_descriptor.image_size;
+        STATS_INC(DFU_CHUNKS);
+        send_evt(DFU_EVT_WRITTEN, m_written, NRF_SUCCESS);
+    } else if (p_evt->id == NRF_FSTORAGE_EVT_WRITE_RESULT && p_evt->addr == DFU_DESCRIPTOR_ADDR &&
+               m_state == DFU_STATE_STARTING) {
+        m_state = DFU_STATE_RECEIVING;
+        send_evt(DFU_EVT_STARTED, 0, NRF_SUCCESS);
+    } else if (p_evt->id == NRF_FSTORAGE_EVT_WRITE_RESULT && m_state == DFU_STATE_ACTIVATING) {
+        m_state = DFU_STATE_ACTIVATED;
+        send_evt(DFU_EVT_ACTIVATED, m_written, NRF_SUCCESS);
+    }
+}
+
+// Queues a flash operation, counted until its result arrives
+static ret_code_t queue_erase(nrf_fstorage_t *p_fs, uint32_t addr, uint32_t pages) {
+    CRITICAL_REGION_ENTER();
+    m_pending++;
+    CRITICAL_REGION_EXIT();
+    ret_code_t err_code = nrf_fstorage_erase(p_fs, addr, pages, NULL);
+    if (err_code != NRF_SUCCESS) {
+        CRITICAL_REGION_ENTER();
+        m_pending--;
+        CRITICAL_REGION_EXIT();
+    }
+    return err_code;
+}
+
+static ret_code_t queue_write(nrf_fstorage_t *p_fs, uint32_t addr, const void *p_src, uint32_t len) {
+    CRITICAL_REGION_ENTER();
+    m_pending++;
+    CRITICAL_REGION_EXIT();
+    ret_code_t err_code = nrf_fstorage_write(p_fs, addr, p_src, len, NULL);
+    if (err_code != NRF_SUCCESS) {
+        CRITICAL_REGION_ENTER();
+        m_pending--;
+        CRITICAL_REGION_EXIT();
+    }
+    return err_code;
+}
+
+static bool bootloader_present(void) {
+    return NRF_UICR->NRFFW[0] == DFU_BOOTLOADER_ADDR;
+}
+
+ret_code_t dfu_init(dfu_evt_handler_t evt_handler) {
+    ret_code_t err_code;
+
+    m_evt_handler = evt_handler;
+    err_code = nrf_fstorage_init(&m_bank_fs, &nrf_fstorage_sd, NULL);
+    if (err_code != NRF_SUCCESS) return err_code;
+    err_code = nrf_fstorage_init(&m_descriptor_fs, &nrf_fstorage_sd, NULL);
+    if (err_code != NRF_SUCCESS) return err_code;
+
+    // the bootloader has not run yet, e.g. it is missing
+    m_state = dfu_swap_requested(flash_descriptor()) ? DFU_STATE_ACTIVATED : DFU_STATE_IDLE;
+    return NRF_SUCCESS;
+}
+
+ret_code_t dfu_start(uint32_t image_size, uint32_t image_crc) {
+    const dfu_descriptor_t *p_stored = flash_descriptor();
+    ret_code_t err_code;
+
+    if (!bootloader_present()) {
+        return NRF_ERROR_NOT_SUPPORTED;
+    }
+    if (image_size == 0 || image_size > DFU_BANK_SIZE) {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (m_pending > 0 || m_state == DFU_STATE_STARTING || m_state == DFU_STATE_ACTIVATING) {
+        return NRF_ERROR_BUSY;
+    }
+
+    if (dfu_descriptor_valid(p_stored) && !dfu_swap_requested(p_stored) && p_stored->image_size == image_size &&
+        p_stored->image_crc == image_crc) {
+        // resume: bank 1 tells how far the transfer got, data written in this session is known to be complete
+        uint32_t offset = dfu_resume_offset((const uint8_t *) DFU_BANK1_ADDR, image_size);
+        if (m_session && m_descriptor.image_crc == image_crc && m_written < offset) {
+            offset = m_written / DFU_PAGE_SIZE * DFU_PAGE_SIZE;
+        }
+        m_descriptor = *p_stored;
+        m_queued_end = offset;
+        m_written = offset;
+        m_erased_end = offset;
+        m_session = true;
+        m_state = DFU_STATE_RECEIVING;
+        send_evt(DFU_EVT_STARTED, offset, NRF_SUCCESS);
+        return NRF_SUCCESS;
+    }
+
+    // a new image, possibly replacing an activated one. Bank 1 still holds data of earlier transfers, it is
+    // erased over the whole image before the descriptor is written, as a resume after a reset takes the
+    // last programmed word for the end of the transfer. The old descriptor goes first, so a reset during
+    // the erase leaves nothing to resume.
+    uint32_t image_pages = (image_size + DFU_PAGE_SIZE - 1) / DFU_PAGE_SIZE;
+    m_descriptor.image_size = image_size;
+    m_descriptor.image_crc = image_crc;
+    m_descriptor.magic = DFU_DESCRIPTOR_MAGIC;
+    m_descriptor.swap = 0xFFFFFFFF;
+    m_queued_end = 0;
+    m_written = 0;
+    m_erased_end = image_pages * DFU_PAGE_SIZE;
+    m_session = true;
+    m_state = DFU_STATE_STARTING;
+    err_code = queue_erase(&m_descriptor_fs, DFU_DESCRIPTOR_ADDR, 1);
+    if (err_code == NRF_SUCCESS) {
+        err_code = queue_erase(&m_bank_fs, DFU_BANK1_ADDR, image_pages);
+    }
+    if (err_code == NRF_SUCCESS) {
+        // the swap word stays erased
+        err_code = queue_write(&m_descriptor_fs, DFU_DESCRIPTOR_ADDR, &m_descriptor,
+                               offsetof(dfu_descriptor_t, swap));
+    }
+    if (err_code != NRF_SUCCESS) {
+        m_state = DFU_STATE_IDLE;
+    }
+    return err_code;
+}
+
+ret_code_t dfu_write(uint32_t offset, const uint8_t *p_data, uint32_t len) {
+    ret_code_t err_code;
+
+    if (m_state != DFU_STATE_RECEIVING) {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (offset != m_queued_end || len == 0 || len > DFU_CHUNK_MAX_SIZE ||
+        offset + len > m_descriptor.image_size || (len % 4 != 0 && offset + len != m_descriptor.image_size)) {
+        STATS_INC(DFU_CHUNKS_REJECTED);
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (m_pending_chunks >= DFU_MAX_PENDING_CHUNKS) {
+        STATS_INC(DFU_CHUNKS_REJECTED);
+        return NRF_ERROR_NO_MEM;
+    }
+
+    // erase the pages the chunk reaches into first, fstorage executes the operations in order
+    while (m_erased_end < offset + len) {
+        err_code = queue_erase(&m_bank_fs, DFU_BANK1_ADDR + m_erased_end, 1);
+        if (err_code != NRF_SUCCESS) return err_code;
+        m_erased_end += DFU_PAGE_SIZE;
+    }
+
+    uint32_t *p_chunk = m_chunks[m_next_chunk];
+    uint32_t padded_len = (len + 3) & ~3UL;
+    memset(p_chunk, 0xFF, padded_len);
+    memcpy(p_chunk, p_data, len);
+    CRITICAL_REGION_ENTER();
+    m_pending_chunks++;
+    CRITICAL_REGION_EXIT();
+    err_code = queue_write(&m_bank_fs, DFU_BANK1_ADDR + offset, p_chunk, padded_len);
+    if (err_code != NRF_SUCCESS) {
+        CRITICAL_REGION_ENTER();
+        m_pending_chunks--;
+        CRITICAL_REGION_EXIT();
+        return err_code;
+    }
+    m_next_chunk = (uint8_t) ((m_next_chunk + 1) % DFU_MAX_PENDING_CHUNKS);
+    m_queued_end = offset + len;
+    return NRF_SUCCESS;
+}
+
+// Deferred to the idle loop (see power.h), the CRC takes about 30 ms for a full bank, which would block
+// the UART and timers if it ran in the command handler
+static void verify_handler(void *p_event_data, uint16_t event_size) {
+    const uint8_t *p_image = (const uint8_t *) DFU_BANK1_ADDR;
+    ret_code_t err_code = NRF_ERROR_INVALID_DATA;
+
+    if (dfu_crc32(p_image, m_descriptor.image_size, 0) == m_descriptor.image_crc &&
+        dfu_image_plausible(p_image, m_descriptor.image_size)) {
+        err_code = queue_write(&m_descriptor_fs, DFU_DESCRIPTOR_ADDR + offsetof(dfu_descriptor_t, swap),
+                               &m_swap_word, sizeof(m_swap_word));
+    }
+    if (err_code != NRF_SUCCESS) {
+        m_state = DFU_STATE_RECEIVING;
+        send_evt(DFU_EVT_ERROR, m_written, err_code);
+    }
+}
+
+ret_code_t dfu_activate(void) {
+    if (m_state != DFU_STATE_RECEIVING || m_pending > 0 || m_written != m_descriptor.image_size) {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    m_state = DFU_STATE_ACTIVATING;
+    ret_code_t err_code = app_sched_event_put(NULL, 0, verify_handler);
+    if (err_code != NRF_SUCCESS) {
+        m_state = DFU_STATE_RECEIVING;
+    }
+    return err_code;
+}
+
+ret_code_t dfu_cancel(void) {
+    if (m_pending > 0 || m_state == DFU_STATE_ACTIVATING) {
+        return NRF_ERROR_BUSY;
+    }
+    m_state = DFU_STATE_IDLE;
+    m_session = false;
+    if (flash_descriptor()->magic == 0xFFFFFFFF) {
+        return NRF_SUCCESS;
+    }
+    return queue_erase(&m_descriptor_fs, DFU_DESCRIPTOR_ADDR, 1);
+}
+
+void dfu_get_status(dfu_status_t *p_status) {
+    const dfu_descriptor_t *p_descriptor = m_state == DFU_STATE_IDLE ? flash_descriptor() : &m_descriptor;
+    bool valid = dfu_descriptor_valid(p_descriptor);
+
+    p_status->state = m_state;
+    p_status->image_size = valid ? p_descriptor->image_size : 0;
+    p_status->image_crc = valid ? p_descriptor->image_crc : 0;
+    p_status->written = m_state == DFU_STATE_IDLE ? 0 : m_written;
+    p_status->pending = m_pending;
+}
@@ -0,0 +1,64 @@
+#ifndef _DFU_H
+#define _DFU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "dfu_image.h"
+
+// Application side of the serial firmware update (see dfu_image.h): writes the received image to
+// bank 1 with fstorage and requests the swap from the bootloader. Chunks are queued and written in
+// the background, so the host can send the next ones while flash operations are in progress.
+
+// Chunks waiting for or being written to flash
+#define DFU_MAX_PENDING_CHUNKS          4
+#define DFU_CHUNK_MAX_SIZE              100
+
+typedef enum {
+    DFU_STATE_IDLE,
+    DFU_STATE_STARTING,             // writing the descriptor
+    DFU_STATE_RECEIVING,
+    DFU_STATE_ACTIVATING,           // verifying the image, writing the swap word
+    DFU_STATE_ACTIVATED             // the bootloader installs the image at the next reset
+} dfu_state_t;
+
+typedef enum {
+    DFU_EVT_STARTED,                // offset: where the host continues
+    DFU_EVT_WRITTEN,                // offset: end of the data in flash
+    DFU_EVT_ACTIVATED,
+    DFU_EVT_ERROR                   // result: error of a flash operation, the transfer has to be restarted, or
+                                    // NRF_ERROR_INVALID_DATA when the image does not verify
+} dfu_evt_type_t;
+
+typedef struct {
+    dfu_evt_type_t type;
+    uint32_t offset;
+    uint32_t result;
+} dfu_evt_t;
+
+typedef struct {
+    dfu_state_t state;
+    uint32_t image_size;
+    uint32_t image_crc;
+    uint32_t written;               // bytes in flash
+    uint8_t pending;                // flash operations in progress
+} dfu_status_t;
+
+// Called from the SoftDevice's event context, or from the idle loop after verifying the image
+typedef void (*dfu_evt_handler_t)(const dfu_evt_t *p_evt);
+
+// Module interface
+uint32_t dfu_init(dfu_evt_handler_t evt_handler);
+// Starts receiving an image, or resumes the transfer of the image with the same size and CRC.
+// NRF_ERROR_NOT_SUPPORTED without a bootloader, NRF_ERROR_BUSY while flash operations are pending.
+uint32_t dfu_start(uint32_t image_size, uint32_t image_crc);
+// Queues a chunk, which has to continue the data queued before. Chunks are multiples of 4 bytes
+// except the last one. NRF_ERROR_NO_MEM if DFU_MAX_PENDING_CHUNKS are queued.
+uint32_t dfu_write(uint32_t offset, const uint8_t *p_data, uint32_t len);
+// Verifies the received image against the descriptor in the idle loop and requests the swap
+uint32_t dfu_activate(void);
+// Discards the transfer
+uint32_t dfu_cancel(void);
+void dfu_get_status(dfu_status_t *p_status);
+
+#endif // _DFU_H
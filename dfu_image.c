@@ -0,0 +1,69 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dfu_image.h"
+
+#include <stddef.h>
+
+uint32_t dfu_crc32(const uint8_t *p_data, uint32_t len, uint32_t crc) {
+    // reflected polynomial 0xEDB88320, four bits at a time keeps the table small for the bootloader
+    static const uint32_t table[16] = {
+            0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+            0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= p_data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+bool dfu_descriptor_valid(const dfu_descriptor_t *p_descriptor) {
+    return p_descriptor->magic == DFU_DESCRIPTOR_MAGIC && p_descriptor->image_size > 0 &&
+           p_descriptor->image_size <= DFU_BANK_SIZE;
+}
+
+bool dfu_swap_requested(const dfu_descriptor_t *p_descriptor) {
+    return dfu_descriptor_valid(p_descriptor) && p_descriptor->swap == DFU_SWAP_MAGIC;
+}
+
+static uint32_t read_word(const uint8_t *p) {
+    return p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+bool dfu_image_plausible(const uint8_t *p_image, uint32_t image_size) {
+    if (image_size < 8 || image_size > DFU_BANK_SIZE) {
+        return false;
+    }
+    uint32_t sp = read_word(p_image);
+    uint32_t reset_handler = read_word(p_image + 4);
+    return sp > DFU_RAM_START && sp <= DFU_RAM_END && (sp & 3) == 0 && (reset_handler & 1) &&
+           reset_handler >= DFU_BANK0_ADDR && reset_handler < DFU_BANK0_ADDR + image_size;
+}
+
+uint32_t dfu_resume_offset(const uint8_t *p_bank, uint32_t image_size) {
+    uint32_t end = (image_size + 3) & ~3UL;
+
+    while (end > 0 && read_word(p_bank + end - 4) == 0xFFFFFFFF) {
+        end -= 4;
+    }
+    if (end == 0) {
+        return 0;
+    }
+    return (end - 1) / DFU_PAGE_SIZE * DFU_PAGE_SIZE;
+}
@@ -0,0 +1,59 @@
+#ifndef _DFU_IMAGE_H
+#define _DFU_IMAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Serial firmware update: the application receives a new image into bank 1 and marks it for the
+// bootloader (see bootloader/), which copies it to bank 0 at the next reset. This module holds the
+// flash layout and the checks shared by application, bootloader and host tools.
+//
+// Flash layout (nRF52832 with S132 v5.0.0):
+//
+//   0x00000  MBR and SoftDevice
+//   0x23000  bank 0, the running application
+//   0x4C000  bank 1, the image being received
+//   0x75000  flash data storage (FDS places its pages right below the bootloader)
+//   0x78000  bootloader
+//   0x7F000  update descriptor
+//
+// The descriptor is written when a transfer starts and identifies the image by size and CRC32, so
+// an interrupted transfer can be resumed. Bank 1 is erased over the image size before, so after a
+// reset its last programmed word marks how far the transfer got. Once the received image has been verified, the swap word is
+// programmed without erasing the page. The bootloader erases the descriptor after the copy has been
+// verified, a copy interrupted by a reset starts over as bank 1 is still intact.
+
+#define DFU_PAGE_SIZE                   0x1000
+#define DFU_BANK0_ADDR                  0x23000
+#define DFU_BANK1_ADDR                  0x4C000
+#define DFU_BANK_SIZE                   0x29000
+#define DFU_BOOTLOADER_ADDR             0x78000
+#define DFU_BOOTLOADER_SIZE             0x7000
+#define DFU_DESCRIPTOR_ADDR             0x7F000
+
+#define DFU_DESCRIPTOR_MAGIC            0x55464442UL    // "BDFU"
+#define DFU_SWAP_MAGIC                  0x50415753UL    // "SWAP"
+
+// Range of initial stack pointers accepted by dfu_image_plausible
+#define DFU_RAM_START                   0x20000000UL
+#define DFU_RAM_END                     0x20010000UL
+
+typedef struct {
+    uint32_t image_size;
+    uint32_t image_crc;             // CRC32 of the image (the zlib one)
+    uint32_t magic;                 // written last, the descriptor is valid once it is set
+    uint32_t swap;                  // DFU_SWAP_MAGIC once the image in bank 1 has been verified
+} dfu_descriptor_t;
+
+// CRC32 as used by zlib, start with crc 0 and pass the result to continue
+uint32_t dfu_crc32(const uint8_t *p_data, uint32_t len, uint32_t crc);
+bool dfu_descriptor_valid(const dfu_descriptor_t *p_descriptor);
+bool dfu_swap_requested(const dfu_descriptor_t *p_descriptor);
+// Checks the vector table at the start of an image linked for bank 0: the initial stack pointer has
+// to point into RAM and the reset handler into the image
+bool dfu_image_plausible(const uint8_t *p_image, uint32_t image_size);
+// Where to continue an interrupted transfer into bank (erased flash reads 0xFF): the start of the
+// page holding the last programmed word. That page is erased again, so no word is programmed twice.
+uint32_t dfu_resume_offset(const uint8_t *p_bank, uint32_t image_size);
+
+#endif // _DFU_IMAGE_H
@@ -0,0 +1,174 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "eddystone.h"
+
+#include <string.h>
+
+#define EDDYSTONE_UUID                  0xFEAA
+
+#define FRAME_TYPE_UID                  0x00
+#define FRAME_TYPE_URL                  0x10
+#define FRAME_TYPE_TLM                  0x20
+#define TLM_VERSION                     0x00
+
+#define AD_TYPE_FLAGS                   0x01
+#define AD_TYPE_UUID16_COMPLETE         0x03
+#define AD_TYPE_SERVICE_DATA            0x16
+// LE general discoverable, BR/EDR not supported
+#define AD_FLAGS                        0x06
+
+static const char *const m_url_schemes[] = {"http://www.", "https://www.", "http://", "https://"};
+static const char *const m_url_expansions[] = {
+        ".com/", ".org/", ".edu/", ".net/", ".info/", ".biz/", ".gov/",
+        ".com", ".org", ".edu", ".net", ".info", ".biz", ".gov"
+};
+
+#define ARRAY_LEN(a)                    (sizeof(a) / sizeof((a)[0]))
+
+bool eddystone_url_encode(const char *url, uint8_t *p_encoded, uint8_t *p_len) {
+    uint8_t len = 0;
+    size_t i;
+
+    // the first matching scheme, "http://www." before "http://"
+    for (i = 0; i < ARRAY_LEN(m_url_schemes); i++) {
+        size_t scheme_len = strlen(m_url_schemes[i]);
+        if (strncmp(url, m_url_schemes[i], scheme_len) == 0) {
+            p_encoded[len++] = (uint8_t) i;
+            url += scheme_len;
+            break;
+        }
+    }
+    if (len == 0) {
+        return false;
+    }
+
+    while (*url) {
+        if (len >= EDDYSTONE_URL_MAX_LEN) {
+            return false;
+        }
+        for (i = 0; i < ARRAY_LEN(m_url_expansions); i++) {
+            size_t expansion_len = strlen(m_url_expansions[i]);
+            if (strncmp(url, m_url_expansions[i], expansion_len) == 0) {
+                p_encoded[len++] = (uint8_t) i;
+                url += expansion_len;
+                break;
+            }
+        }
+        if (i == ARRAY_LEN(m_url_expansions)) {
+            // printable characters only, the others are expansion codes or reserved
+            if (*url <= 0x20 || *url >= 0x7F) {
+                return false;
+            }
+            p_encoded[len++] = (uint8_t) *url++;
+        }
+    }
+    *p_len = len;
+    return true;
+}
+
+// flags, service UUID list and the header of the service data, returns the offset of the frame type
+static uint8_t header_encode(uint8_t service_data_len, uint8_t *p_frame) {
+    uint8_t pos = 0;
+
+    p_frame[pos++] = 2;
+    p_frame[pos++] = AD_TYPE_FLAGS;
+    p_frame[pos++] = AD_FLAGS;
+    p_frame[pos++] = 3;
+    p_frame[pos++] = AD_TYPE_UUID16_COMPLETE;
+    p_frame[pos++] = (uint8_t) EDDYSTONE_UUID;
+    p_frame[pos++] = (uint8_t) (EDDYSTONE_UUID >> 8);
+    // AD type, UUID and the Eddystone frame
+    p_frame[pos++] = (uint8_t) (3 + service_data_len);
+    p_frame[pos++] = AD_TYPE_SERVICE_DATA;
+    p_frame[pos++] = (uint8_t) EDDYSTONE_UUID;
+    p_frame[pos++] = (uint8_t) (EDDYSTONE_UUID >> 8);
+    return pos;
+}
+
+static void put_u16_be(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t) (value >> 8);
+    p[1] = (uint8_t) value;
+}
+
+static void put_u32_be(uint8_t *p, uint32_t value) {
+    put_u16_be(p, (uint16_t) (value >> 16));
+    put_u16_be(&p[2], (uint16_t) value);
+}
+
+uint8_t eddystone_uid_encode(const eddystone_config_t *p_config, int8_t ranging_data, uint8_t *p_frame) {
+    // frame type, ranging data, namespace, instance, 2 reserved bytes
+    uint8_t pos = header_encode(2 + EDDYSTONE_NAMESPACE_SIZE + EDDYSTONE_INSTANCE_SIZE + 2, p_frame);
+
+    p_frame[pos++] = FRAME_TYPE_UID;
+    p_frame[pos++] = (uint8_t) ranging_data;
+    memcpy(&p_frame[pos], p_config->namespace_id, EDDYSTONE_NAMESPACE_SIZE);
+    pos += EDDYSTONE_NAMESPACE_SIZE;
+    memcpy(&p_frame[pos], p_config->instance_id, EDDYSTONE_INSTANCE_SIZE);
+    pos += EDDYSTONE_INSTANCE_SIZE;
+    p_frame[pos++] = 0;
+    p_frame[pos++] = 0;
+    return pos;
+}
+
+uint8_t eddystone_url_frame_encode(const eddystone_config_t *p_config, int8_t ranging_data, uint8_t *p_frame) {
+    uint8_t url_len = p_config->url_len <= EDDYSTONE_URL_MAX_LEN ? p_config->url_len : EDDYSTONE_URL_MAX_LEN;
+    uint8_t pos = header_encode(2 + url_len, p_frame);
+
+    p_frame[pos++] = FRAME_TYPE_URL;
+    p_frame[pos++] = (uint8_t) ranging_data;
+    memcpy(&p_frame[pos], p_config->url, url_len);
+    return pos + url_len;
+}
+
+uint8_t eddystone_tlm_encode(const eddystone_tlm_t *p_tlm, uint8_t *p_frame) {
+    // frame type, version, battery voltage, temperature, PDU count, uptime
+    uint8_t pos = header_encode(14, p_frame);
+
+    p_frame[pos++] = FRAME_TYPE_TLM;
+    p_frame[pos++] = TLM_VERSION;
+    put_u16_be(&p_frame[pos], p_tlm->battery_mv);
+    // INT16_MIN is 0x8000, the value for an unsupported temperature
+    put_u16_be(&p_frame[pos + 2], (uint16_t) p_tlm->temperature);
+    put_u32_be(&p_frame[pos + 4], p_tlm->adv_count);
+    put_u32_be(&p_frame[pos + 8], p_tlm->uptime_100ms);
+    return pos + 12;
+}
+
+uint8_t eddystone_build_sequence(const uint8_t *p_ratio, uint8_t *p_sequence) {
+    int16_t current[ADV_FRAME_COUNT] = {0};
+    int16_t total = 0;
+    uint8_t len;
+
+    for (int frame = 0; frame < ADV_FRAME_COUNT; frame++) {
+        total += p_ratio[frame] <= ADV_FRAME_MAX_RATIO ? p_ratio[frame] : ADV_FRAME_MAX_RATIO;
+    }
+    if (total == 0) {
+        p_sequence[0] = ADV_FRAME_IBEACON;
+        return 1;
+    }
+    for (len = 0; len < total; len++) {
+        int best = 0;
+        for (int frame = 0; frame < ADV_FRAME_COUNT; frame++) {
+            current[frame] += p_ratio[frame] <= ADV_FRAME_MAX_RATIO ? p_ratio[frame] : ADV_FRAME_MAX_RATIO;
+            if (current[frame] > current[best]) {
+                best = frame;
+            }
+        }
+        current[best] -= total;
+        p_sequence[len] = (uint8_t) best;
+    }
+    return len;
+}
@@ -0,0 +1,53 @@
+#ifndef _EDDYSTONE_H
+#define _EDDYSTONE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Encoders for the Eddystone UID, URL and (unencrypted) TLM frames. The frames are complete
+// advertising data (flags, service UUID list, service data) ready for sd_ble_gap_adv_data_set.
+
+#define EDDYSTONE_FRAME_MAX_LEN         31
+#define EDDYSTONE_NAMESPACE_SIZE        10
+#define EDDYSTONE_INSTANCE_SIZE         6
+// URL scheme prefix and up to 17 bytes of compressed URL
+#define EDDYSTONE_URL_MAX_LEN           18
+
+// Frames interleaved by the advertiser, the iBeacon frame is not Eddystone but rotates with them
+typedef enum {
+    ADV_FRAME_IBEACON,
+    ADV_FRAME_UID,
+    ADV_FRAME_URL,
+    ADV_FRAME_TLM,
+    ADV_FRAME_COUNT
+} adv_frame_t;
+
+// Frames per interleave cycle are limited to this, a cycle has at most 4 * 10 advertising events
+#define ADV_FRAME_MAX_RATIO             10
+
+typedef struct {
+    uint8_t namespace_id[EDDYSTONE_NAMESPACE_SIZE];
+    uint8_t instance_id[EDDYSTONE_INSTANCE_SIZE];
+    uint8_t url[EDDYSTONE_URL_MAX_LEN];     // compressed, see eddystone_url_encode
+    uint8_t url_len;
+    uint8_t ratio[ADV_FRAME_COUNT];         // advertising events per cycle, all 0: iBeacon only
+    uint8_t reserved[3];
+} eddystone_config_t;
+
+typedef struct {
+    uint16_t battery_mv;            // 0 for USB powered devices
+    int16_t temperature;            // degrees Celsius in 8.8 fixed point, INT16_MIN if unknown
+    uint32_t adv_count;             // advertising PDUs sent since power-up
+    uint32_t uptime_100ms;          // time since power-up
+} eddystone_tlm_t;
+
+// Compresses a URL with the scheme and expansion codes, false if it is not supported or too long
+bool eddystone_url_encode(const char *url, uint8_t *p_encoded, uint8_t *p_len);
+// The encoders return the length of the frame. The ranging data is the received power at 0 m in dBm.
+uint8_t eddystone_uid_encode(const eddystone_config_t *p_config, int8_t ranging_data, uint8_t *p_frame);
+uint8_t eddystone_url_frame_encode(const eddystone_config_t *p_config, int8_t ranging_data, uint8_t *p_frame);
+uint8_t eddystone_tlm_encode(const eddystone_tlm_t *p_tlm, uint8_t *p_frame);
+// Spreads the frames of one cycle evenly (smooth weighted round robin), returns the cycle length
+uint8_t eddystone_build_sequence(const uint8_t *p_ratio, uint8_t *p_sequence);
+
+#endif // _EDDYSTONE_H
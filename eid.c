@@ -0,0 +1,76 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "eid.h"
+
+#include <string.h>
+
+uint32_t eid_counter(const eid_config_t *p_config, uint64_t unix_time_us) {
+    uint64_t unix_time_s = unix_time_us / 1000000;
+    if (unix_time_s <= p_config->epoch_s) {
+        return 0;
+    }
+    uint64_t counter = unix_time_s - p_config->epoch_s;
+    return counter > UINT32_MAX ? UINT32_MAX : (uint32_t) counter;
+}
+
+uint64_t eid_next_rotation_us(const eid_config_t *p_config, uint32_t counter) {
+    uint64_t period_mask = (1UL << p_config->rotation_exponent) - 1;
+    uint64_t next_counter = ((uint64_t) counter | period_mask) + 1;
+    return ((uint64_t) p_config->epoch_s + next_counter) * 1000000;
+}
+
+void eid_compute(const eid_config_t *p_config, eid_cache_t *p_cache, uint32_t counter,
+                 eid_block_encrypt_t block_encrypt, uint8_t *p_eid) {
+    uint8_t block[16];
+    uint8_t result[16];
+
+    if (!p_cache->valid || p_cache->counter_high != (uint16_t) (counter >> 16)) {
+        memset(block, 0, sizeof(block));
+        block[11] = 0xFF;
+        block[14] = (uint8_t) (counter >> 24);
+        block[15] = (uint8_t) (counter >> 16);
+        block_encrypt(p_config->identity_key, block, p_cache->temporary_key);
+        p_cache->counter_high = (uint16_t) (counter >> 16);
+        p_cache->valid = true;
+    }
+
+    counter &= ~((1UL << p_config->rotation_exponent) - 1);
+    memset(block, 0, sizeof(block));
+    block[11] = p_config->rotation_exponent;
+    block[12] = (uint8_t) (counter >> 24);
+    block[13] = (uint8_t) (counter >> 16);
+    block[14] = (uint8_t) (counter >> 8);
+    block[15] = (uint8_t) counter;
+    block_encrypt(p_cache->temporary_key, block, result);
+    memcpy(p_eid, result, EID_SIZE);
+}
+
+void eid_apply(uint8_t mode, const uint8_t *p_eid, uint8_t *p_uuid, uint16_t *p_major, uint16_t *p_minor) {
+    switch (mode) {
+        case EID_MODE_MINOR:
+            *p_minor = (uint16_t) ((p_eid[0] << 8) | p_eid[1]);
+            break;
+        case EID_MODE_MAJOR_MINOR:
+            *p_major = (uint16_t) ((p_eid[0] << 8) | p_eid[1]);
+            *p_minor = (uint16_t) ((p_eid[2] << 8) | p_eid[3]);
+            break;
+        case EID_MODE_UUID:
+            memcpy(&p_uuid[16 - EID_SIZE], p_eid, EID_SIZE);
+            break;
+        default:
+            break;
+    }
+}
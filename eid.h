@@ -0,0 +1,54 @@
+#ifndef _EID_H
+#define _EID_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Rotating ephemeral identifiers computed like Eddystone-EID: a temporary key is derived from the
+// identity key and the upper 16 bits of the beacon time counter, the 8 byte identifier from the
+// temporary key and the counter with its lower rotation exponent bits cleared. The AES-128 block
+// cipher is provided by the caller (the ECB peripheral on the device).
+
+#define EID_KEY_SIZE                    16
+#define EID_SIZE                        8
+// Identifiers rotate every 2^exponent seconds
+#define EID_MIN_ROTATION_EXPONENT       0
+#define EID_MAX_ROTATION_EXPONENT       15
+
+// Which of the iBeacon identifiers are replaced by the EID
+typedef enum {
+    EID_MODE_OFF,
+    EID_MODE_MINOR,                 // first 2 bytes as the minor
+    EID_MODE_MAJOR_MINOR,           // first 4 bytes as major and minor
+    EID_MODE_UUID,                  // all 8 bytes as the last half of the proximity UUID
+    EID_MODE_COUNT
+} eid_mode_t;
+
+typedef struct {
+    uint8_t identity_key[EID_KEY_SIZE];
+    uint8_t mode;
+    uint8_t rotation_exponent;
+    uint16_t reserved;
+    uint32_t epoch_s;               // Unix time at which the beacon time counter was 0
+} eid_config_t;
+
+// The temporary key only changes every 2^16 seconds
+typedef struct {
+    uint8_t temporary_key[EID_KEY_SIZE];
+    uint16_t counter_high;
+    bool valid;
+} eid_cache_t;
+
+// Encrypts one 16 byte block with AES-128
+typedef void (*eid_block_encrypt_t)(const uint8_t *p_key, const uint8_t *p_cleartext, uint8_t *p_ciphertext);
+
+// Beacon time counter in seconds, 0 before the epoch
+uint32_t eid_counter(const eid_config_t *p_config, uint64_t unix_time_us);
+// Unix time in microseconds at which the rotation period following counter starts
+uint64_t eid_next_rotation_us(const eid_config_t *p_config, uint32_t counter);
+void eid_compute(const eid_config_t *p_config, eid_cache_t *p_cache, uint32_t counter,
+                 eid_block_encrypt_t block_encrypt, uint8_t *p_eid);
+// Replaces the identifiers selected by the mode with the EID
+void eid_apply(uint8_t mode, const uint8_t *p_eid, uint8_t *p_uuid, uint16_t *p_major, uint16_t *p_minor);
+
+#endif // _EID_H
@@ -0,0 +1,31 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "factory_id.h"
+
+#include <stddef.h>
+
+#include "dfu_image.h"
+
+void factory_id_seal(factory_id_t *p_id) {
+    p_id->magic = FACTORY_ID_MAGIC;
+    p_id->reserved = 0xFFFF;
+    p_id->crc = dfu_crc32((const uint8_t *) p_id, offsetof(factory_id_t, crc), 0);
+}
+
+bool factory_id_valid(const factory_id_t *p_id) {
+    return p_id->magic == FACTORY_ID_MAGIC &&
+           p_id->crc == dfu_crc32((const uint8_t *) p_id, offsetof(factory_id_t, crc), 0);
+}
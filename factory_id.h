@@ -0,0 +1,36 @@
+#ifndef _FACTORY_ID_H
+#define _FACTORY_ID_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "mac_derive.h"
+
+// Beacon identity baked into the factory image of a device (see factory_image in host/). The record is
+// programmed into the customer registers of the UICR together with the firmware, so a single flashing
+// pass provisions the device. It is only used as the default configuration: once a configuration has
+// been stored in flash (first boot, 'C'), that one wins. The UICR survives firmware updates and is only
+// cleared by erasing the chip.
+
+// NRF_UICR->CUSTOMER[0], 32 words are available
+#define FACTORY_ID_ADDR                 0x10001080UL
+#define FACTORY_ID_MAGIC                0x44494346UL    // "FCID"
+
+typedef struct {
+    uint32_t magic;
+    uint8_t beacon_uuid[16];
+    uint16_t beacon_major;          // fixed values, or the value passed to the rules
+    uint16_t beacon_minor;
+    mac_derive_rule_t major_rule;
+    mac_derive_rule_t minor_rule;
+    uint16_t adv_interval_ms;       // 0: firmware default
+    uint16_t reserved;
+    uint32_t crc;                   // CRC32 of the fields above (see dfu_image.h)
+} factory_id_t;
+
+// Sets the magic and CRC of a record with the identity filled in
+void factory_id_seal(factory_id_t *p_id);
+// False for erased UICR and damaged records
+bool factory_id_valid(const factory_id_t *p_id);
+
+#endif // _FACTORY_ID_H
@@ -0,0 +1,101 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "fault.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "app_error.h"
+#include "crc16.h"
+
+#include "timebase.h"
+#include "trace.h"
+
+#define FAULT_MAGIC                     0x544C4146UL // "FALT"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    bool valid;                     // info holds a record
+    fault_info_t info;
+    uint16_t crc;                   // of the fields above
+} fault_store_t;
+
+// not initialized by the startup code, the content is kept across resets
+static fault_store_t m_fault __attribute__((section(".noinit")));
+
+static uint16_t store_crc(void) {
+    return crc16_compute((const uint8_t *) &m_fault, offsetof(fault_store_t, crc), NULL);
+}
+
+void fault_init(void) {
+    if (m_fault.magic != FAULT_MAGIC || m_fault.crc != store_crc()) {
+        memset(&m_fault, 0, sizeof(m_fault));
+        m_fault.magic = FAULT_MAGIC;
+        m_fault.crc = store_crc();
+    }
+}
+
+void fault_record(uint32_t id, uint32_t pc, uint32_t info) {
+    const char *p_file = NULL;
+    fault_info_t *p_info = &m_fault.info;
+
+    memset(p_info, 0, sizeof(fault_info_t));
+    p_info->id = id;
+    p_info->pc = pc;
+    p_info->info = info;
+    if (id == NRF_FAULT_ID_SDK_ERROR) {
+        const error_info_t *p_error = (const error_info_t *) info;
+        p_info->info = p_error->err_code;
+        p_info->line = p_error->line_num;
+        p_file = (const char *) p_error->p_file_name;
+    } else if (id == NRF_FAULT_ID_SDK_ASSERT) {
+        const assert_info_t *p_assert = (const assert_info_t *) info;
+        p_info->info = 0;
+        p_info->line = p_assert->line_num;
+        p_file = (const char *) p_assert->p_file_name;
+    }
+    if (p_file != NULL) {
+        size_t len = strlen(p_file);
+        if (len >= FAULT_FILE_LEN) {
+            p_file += len - (FAULT_FILE_LEN - 1);
+        }
+        strncpy(p_info->file, p_file, FAULT_FILE_LEN - 1);
+    }
+    p_info->uptime_ms = (uint32_t) (timebase_now_us() / 1000);
+    p_info->boot = trace_boot_count();
+    m_fault.valid = true;
+    m_fault.count++;
+    m_fault.crc = store_crc();
+}
+
+bool fault_last(fault_info_t *p_info) {
+    if (!m_fault.valid) {
+        return false;
+    }
+    *p_info = m_fault.info;
+    return true;
+}
+
+uint32_t fault_count(void) {
+    return m_fault.count;
+}
+
+void fault_clear(void) {
+    m_fault.valid = false;
+    memset(&m_fault.info, 0, sizeof(fault_info_t));
+    m_fault.crc = store_crc();
+}
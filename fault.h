@@ -0,0 +1,34 @@
+#ifndef _FAULT_H
+#define _FAULT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Record of the last fatal error. Errors the firmware can recover from locally are counted in the
+// statistics instead (see stats.h). The record lives in RAM which is not initialized by the startup
+// code, so it survives the reset following the error and can be read after the next boot ('K').
+// It is kept until cleared, the number of fatal errors keeps counting until power is lost.
+
+// Trailing part of the source file name
+#define FAULT_FILE_LEN                  20
+
+typedef struct {
+    uint32_t id;                    // NRF_FAULT_ID_*
+    uint32_t pc;
+    uint32_t info;                  // error code of SDK errors, otherwise the fault's info word
+    uint32_t line;
+    uint32_t uptime_ms;
+    uint32_t boot;                  // trace boot count (see trace.h) when the error occurred
+    char file[FAULT_FILE_LEN];      // 0 terminated, empty if unknown
+} fault_info_t;
+
+// Discards the record after power-on, when the RAM content is random
+void fault_init(void);
+// Called by the error handler before resetting
+void fault_record(uint32_t id, uint32_t pc, uint32_t info);
+// False if there is no record
+bool fault_last(fault_info_t *p_info);
+uint32_t fault_count(void);
+void fault_clear(void);
+
+#endif // _FAULT_H
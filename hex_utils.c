@@ -37,3 +37,25 @@ void hex_string_to_uint8_array(const char *str, int str_len, uint8_t *buf) {
         buf[pos / 2] = (uint8_t) b;
     }
 }
+
+void uint64_to_dec_string(uint64_t value, char *buf) {
+    char tmp[20];
+    int len = 0;
+    do {
+        tmp[len++] = (char) ('0' + (value % 10));
+        value /= 10;
+    } while (value > 0);
+    for (int i = 0; i < len; i++) {
+        buf[i] = tmp[len - 1 - i];
+    }
+    buf[len] = '\0';
+}
+
+void int64_to_dec_string(int64_t value, char *buf) {
+    if (value < 0) {
+        *buf++ = '-';
+        uint64_to_dec_string((uint64_t) 0 - (uint64_t) value, buf);
+    } else {
+        uint64_to_dec_string((uint64_t) value, buf);
+    }
+}
@@ -3,6 +3,9 @@
 
 void uint8_to_hex_char(uint8_t b, char* buf);
 void hex_string_to_uint8_array(const char *str, int str_len, uint8_t *buf);
+// newlib nano printf has no 64-bit support, buf must hold at least 21 characters
+void uint64_to_dec_string(uint64_t value, char *buf);
+void int64_to_dec_string(int64_t value, char *buf);
 
 #endif // HEX_UTILS_H__
 
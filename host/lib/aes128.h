@@ -0,0 +1,24 @@
+#ifndef ABSNIFFER_AES128_H
+#define ABSNIFFER_AES128_H
+
+#include <cstdint>
+
+namespace absniffer {
+
+// AES-128 block encryption, what the device's ECB peripheral computes. A plain
+// implementation for resolving rotating identifiers on the host, not hardened against timing side channels.
+class Aes128 {
+public:
+    explicit Aes128(const uint8_t *key);
+    void encrypt(const uint8_t *in, uint8_t *out) const;
+
+    // one-shot variant with the signature of eid_block_encrypt_t
+    static void encrypt_block(const uint8_t *key, const uint8_t *in, uint8_t *out);
+
+private:
+    uint8_t round_keys_[11][16];
+};
+
+}
+
+#endif // ABSNIFFER_AES128_H
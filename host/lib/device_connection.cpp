@@ -0,0 +1,144 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "device_connection.h"
+
+#include <algorithm>
+
+#include <sys/epoll.h>
+
+namespace absniffer {
+
+namespace {
+const size_t READ_CHUNK = 4096;
+// an unterminated line longer than this is garbage (e.g. wrong baud rate)
+const size_t MAX_PENDING = 64 * 1024;
+// shorter than UART_IDLE_TIMEOUT_MS in uart_cmd.c, the device may have been reset in the meantime
+const auto WAKE_IDLE_TIME = std::chrono::seconds(1);
+// the preamble has to outlast the device's wake up latency and UART_WAKE_GUARD_US
+const unsigned WAKE_PREAMBLE_US = 3000;
+const size_t WAKE_PREAMBLE_MIN = 8;
+}
+
+bool DeviceConnection::open(const std::string &path, unsigned baud_rate, bool hardware_flow_control) {
+    close();
+    if (!port_.open(path, baud_rate, hardware_flow_control)) return false;
+    baud_rate_ = baud_rate;
+    // a freshly opened device is assumed to be suspended
+    last_activity_ = std::chrono::steady_clock::time_point();
+    if (!loop_.add(port_.fd(), EPOLLIN, [this](uint32_t events) { handle_events(events); })) {
+        port_.close();
+        return false;
+    }
+    return true;
+}
+
+void DeviceConnection::close() {
+    if (port_.is_open()) {
+        loop_.remove(port_.fd());
+        port_.close();
+    }
+    tx_.clear();
+    tx_pos_ = 0;
+    // the parser is still walking the buffer, handle_events clears it afterwards
+    if (!dispatching_) rx_.clear();
+}
+
+bool DeviceConnection::set_baud_rate(unsigned baud_rate, bool hardware_flow_control) {
+    if (!port_.is_open()) return false;
+    tx_.clear();
+    tx_pos_ = 0;
+    loop_.modify(port_.fd(), EPOLLIN);
+    if (!dispatching_) rx_.clear();
+    port_.discard_input();
+    if (!port_.set_baud_rate(baud_rate, hardware_flow_control)) return false;
+    baud_rate_ = baud_rate;
+    return true;
+}
+
+void DeviceConnection::send(std::string_view command) {
+    if (!port_.is_open()) return;
+    bool idle = !tx_pending();
+    auto now = std::chrono::steady_clock::now();
+    if (wake_preamble_ && idle && now - last_activity_ >= WAKE_IDLE_TIME) {
+        // 10 bits per byte on the line
+        size_t bytes = (size_t) ((uint64_t) baud_rate_ * WAKE_PREAMBLE_US / 10000000);
+        tx_.append(std::max(bytes, WAKE_PREAMBLE_MIN), '\n');
+    }
+    last_activity_ = now;
+    tx_.append(command);
+    tx_ += '\n';
+    if (idle) flush_tx();
+}
+
+void DeviceConnection::flush_tx() {
+    while (tx_pending()) {
+        ssize_t n = port_.write(reinterpret_cast<const uint8_t *>(tx_.data()) + tx_pos_, tx_.size() - tx_pos_);
+        if (n < 0) {
+            fail();
+            return;
+        }
+        if (n == 0) break;
+        tx_pos_ += n;
+        bytes_sent_ += n;
+    }
+    if (tx_pending()) {
+        loop_.modify(port_.fd(), EPOLLIN | EPOLLOUT);
+    } else {
+        tx_.clear();
+        tx_pos_ = 0;
+        loop_.modify(port_.fd(), EPOLLIN);
+    }
+}
+
+void DeviceConnection::handle_events(uint32_t events) {
+    if (events & EPOLLOUT) {
+        flush_tx();
+        if (!port_.is_open()) return;
+    }
+    if (!(events & (EPOLLIN | EPOLLERR | EPOLLHUP))) return;
+
+    size_t old_size = rx_.size();
+    rx_.resize(old_size + READ_CHUNK);
+    ssize_t n = port_.read(rx_.data() + old_size, READ_CHUNK);
+    if (n < 0) {
+        rx_.resize(old_size);
+        fail();
+        return;
+    }
+    rx_.resize(old_size + n);
+    bytes_received_ += n;
+    if (n > 0) last_activity_ = std::chrono::steady_clock::now();
+
+    dispatching_ = true;
+    size_t consumed = parser_.parse(rx_.data(), rx_.size(), [this](const Message &msg) {
+        if (port_.is_open() && on_message_) on_message_(msg);
+    });
+    dispatching_ = false;
+    if (!port_.is_open()) {
+        rx_.clear();
+    } else {
+        rx_.erase(rx_.begin(), rx_.begin() + consumed);
+        if (rx_.size() > MAX_PENDING) rx_.clear();
+    }
+}
+
+void DeviceConnection::fail() {
+    std::string error = port_.error();
+    close();
+    if (on_error_) on_error_(error);
+}
+
+}
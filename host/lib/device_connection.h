@@ -0,0 +1,76 @@
+#ifndef ABSNIFFER_DEVICE_CONNECTION_H
+#define ABSNIFFER_DEVICE_CONNECTION_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "event_loop.h"
+#include "serial_port.h"
+#include "stream_parser.h"
+
+namespace absniffer {
+
+// A device attached to an EventLoop: buffers outgoing commands until the port accepts them and
+// splits incoming data into messages with StreamParser.
+class DeviceConnection {
+public:
+    using MessageHandler = std::function<void(const Message &msg)>;
+    using ErrorHandler = std::function<void(const std::string &error)>;
+
+    explicit DeviceConnection(EventLoop &loop) : loop_(loop) {}
+    ~DeviceConnection() { close(); }
+    DeviceConnection(const DeviceConnection &) = delete;
+    DeviceConnection &operator=(const DeviceConnection &) = delete;
+
+    void on_message(MessageHandler handler) { on_message_ = std::move(handler); }
+    // called once when the port fails, the connection is closed afterwards
+    void on_error(ErrorHandler handler) { on_error_ = std::move(handler); }
+
+    bool open(const std::string &path, unsigned baud_rate = 115200, bool hardware_flow_control = false);
+    // May be called from within the handlers
+    void close();
+    // Queues a command, the line break is appended. When the port has been quiet for a while, line
+    // breaks are sent first to wake up the device's UART (see "UART Power Saving" in the README).
+    void send(std::string_view command);
+    void set_wake_preamble(bool enabled) { wake_preamble_ = enabled; }
+    // Switches the port to another rate (see 'H' in the README), data still queued or received at the
+    // old rate is discarded
+    bool set_baud_rate(unsigned baud_rate, bool hardware_flow_control = false);
+    unsigned baud_rate() const { return baud_rate_; }
+
+    bool is_open() const { return port_.is_open(); }
+    SerialPort &port() { return port_; }
+    const std::string &error() const { return port_.error(); }
+    uint64_t bytes_sent() const { return bytes_sent_; }
+    uint64_t bytes_received() const { return bytes_received_; }
+    // true while commands are still waiting for the port
+    bool tx_pending() const { return tx_pos_ < tx_.size(); }
+
+private:
+    void handle_events(uint32_t events);
+    void flush_tx();
+    void fail();
+
+    EventLoop &loop_;
+    SerialPort port_;
+    StreamParser parser_;
+    MessageHandler on_message_;
+    ErrorHandler on_error_;
+    std::vector<uint8_t> rx_;
+    std::string tx_;
+    size_t tx_pos_ = 0;
+    unsigned baud_rate_ = 115200;
+    bool wake_preamble_ = true;
+    std::chrono::steady_clock::time_point last_activity_;
+    bool dispatching_ = false;
+    uint64_t bytes_sent_ = 0;
+    uint64_t bytes_received_ = 0;
+};
+
+}
+
+#endif // ABSNIFFER_DEVICE_CONNECTION_H
@@ -0,0 +1,147 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "eid_resolver.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "aes128.h"
+
+namespace absniffer {
+
+namespace {
+
+// observations are grouped by minute, each group is resolved with one index
+constexpr uint64_t BUCKET_US = 60000000;
+
+uint64_t encryptions = 0;
+
+void counting_block_encrypt(const uint8_t *key, const uint8_t *in, uint8_t *out) {
+    encryptions++;
+    Aes128::encrypt_block(key, in, out);
+}
+
+uint64_t big_endian(const uint8_t *data, size_t len) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < len; i++) value = (value << 8) | data[i];
+    return value;
+}
+
+}
+
+uint64_t eid_identifier(uint8_t mode, const uint8_t *eid) {
+    switch (mode) {
+        case EID_MODE_MINOR:
+            return big_endian(eid, 2);
+        case EID_MODE_MAJOR_MINOR:
+            return big_endian(eid, 4);
+        case EID_MODE_UUID:
+            return big_endian(eid, EID_SIZE);
+        default:
+            return 0;
+    }
+}
+
+uint64_t eid_identifier(uint8_t mode, const EidObservation &observation) {
+    switch (mode) {
+        case EID_MODE_MINOR:
+            return observation.minor;
+        case EID_MODE_MAJOR_MINOR:
+            return ((uint64_t) observation.major << 16) | observation.minor;
+        case EID_MODE_UUID:
+            return big_endian(&observation.uuid[16 - EID_SIZE], EID_SIZE);
+        default:
+            return 0;
+    }
+}
+
+EidResolver::EidResolver(std::vector<EidDevice> devices, uint32_t max_skew_s)
+        : devices_(std::move(devices)), states_(devices_.size()), max_skew_s_(max_skew_s) {
+    for (const EidDevice &device : devices_) {
+        if (device.config.mode > EID_MODE_OFF && device.config.mode < EID_MODE_COUNT) {
+            mode_used_[device.config.mode] = true;
+        }
+    }
+}
+
+uint64_t EidResolver::block_encryptions() const {
+    return encryptions;
+}
+
+void EidResolver::update_periods(size_t device, uint32_t first, uint32_t last) {
+    const eid_config_t &config = devices_[device].config;
+    std::vector<Period> &periods = states_[device].periods;
+    uint32_t mask = (uint32_t) ((1ULL << config.rotation_exponent) - 1);
+    first &= ~mask;
+
+    periods.erase(periods.begin(), std::find_if(periods.begin(), periods.end(),
+                                                [first](const Period &p) { return p.counter >= first; }));
+    if (!periods.empty() && periods.front().counter != first) periods.clear();
+    uint64_t counter = periods.empty() ? first : (uint64_t) periods.back().counter + mask + 1;
+    for (; counter <= last; counter += (uint64_t) mask + 1) {
+        Period period;
+        period.counter = (uint32_t) counter;
+        eid_compute(&config, &states_[device].cache, period.counter, counting_block_encrypt, period.eid);
+        periods.push_back(period);
+    }
+}
+
+void EidResolver::build_index(uint64_t from_us, uint64_t to_us) {
+    for (auto &index : index_) index.clear();
+    for (size_t i = 0; i < devices_.size(); i++) {
+        const eid_config_t &config = devices_[i].config;
+        if (config.mode <= EID_MODE_OFF || config.mode >= EID_MODE_COUNT) continue;
+        update_periods(i, eid_counter(&config, from_us), eid_counter(&config, to_us));
+        for (const Period &period : states_[i].periods) {
+            auto inserted = index_[config.mode].emplace(eid_identifier(config.mode, period.eid), (int) i);
+            if (!inserted.second && inserted.first->second != (int) i) inserted.first->second = AMBIGUOUS;
+        }
+    }
+}
+
+int EidResolver::lookup(const EidObservation &observation) const {
+    int result = UNKNOWN;
+    for (uint8_t mode = EID_MODE_MINOR; mode < EID_MODE_COUNT; mode++) {
+        if (!mode_used_[mode]) continue;
+        auto it = index_[mode].find(eid_identifier(mode, observation));
+        if (it == index_[mode].end()) continue;
+        result = result == UNKNOWN || result == it->second ? it->second : AMBIGUOUS;
+    }
+    return result;
+}
+
+std::vector<int> EidResolver::resolve(const std::vector<EidObservation> &observations) {
+    std::vector<size_t> order(observations.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return observations[a].time_us < observations[b].time_us; });
+
+    std::vector<int> results(observations.size(), UNKNOWN);
+    uint64_t bucket = UINT64_MAX;
+    const uint64_t skew_us = (uint64_t) max_skew_s_ * 1000000;
+    for (size_t i : order) {
+        uint64_t time_us = observations[i].time_us;
+        if (time_us / BUCKET_US != bucket) {
+            bucket = time_us / BUCKET_US;
+            uint64_t from_us = bucket * BUCKET_US;
+            build_index(from_us > skew_us ? from_us - skew_us : 0, from_us + BUCKET_US + skew_us);
+        }
+        results[i] = lookup(observations[i]);
+    }
+    return results;
+}
+
+}
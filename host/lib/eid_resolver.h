@@ -0,0 +1,75 @@
+#ifndef ABSNIFFER_EID_RESOLVER_H
+#define ABSNIFFER_EID_RESOLVER_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include "eid.h"
+}
+
+namespace absniffer {
+
+struct EidDevice {
+    std::string name;
+    eid_config_t config;
+};
+
+struct EidObservation {
+    uint64_t time_us = 0;           // Unix time
+    std::array<uint8_t, 16> uuid{};
+    uint16_t major = 0;
+    uint16_t minor = 0;
+};
+
+// Maps observed rotating identifiers back to devices. Observations are resolved in bulk: for each
+// minute containing observations, the identifiers of all devices for the rotation periods within the
+// clock skew are indexed. Identifiers of periods still in range are kept from the previous minute,
+// so a device costs about one AES block per rotation period of the observed time span.
+class EidResolver {
+public:
+    static constexpr int UNKNOWN = -1;
+    static constexpr int AMBIGUOUS = -2;
+
+    // max_skew_s: accepted difference between the device and observation clocks
+    explicit EidResolver(std::vector<EidDevice> devices, uint32_t max_skew_s = 60);
+
+    // Returns the device index for each observation, UNKNOWN or AMBIGUOUS
+    std::vector<int> resolve(const std::vector<EidObservation> &observations);
+
+    const std::vector<EidDevice> &devices() const { return devices_; }
+    uint64_t block_encryptions() const;
+
+private:
+    struct Period {
+        uint32_t counter;           // first counter of the rotation period
+        uint8_t eid[EID_SIZE];
+    };
+
+    struct DeviceState {
+        eid_cache_t cache{};
+        std::vector<Period> periods;    // ascending
+    };
+
+    void build_index(uint64_t from_us, uint64_t to_us);
+    void update_periods(size_t device, uint32_t first, uint32_t last);
+    int lookup(const EidObservation &observation) const;
+
+    std::vector<EidDevice> devices_;
+    std::vector<DeviceState> states_;
+    uint32_t max_skew_s_;
+    bool mode_used_[EID_MODE_COUNT] = {};
+    // per mode: identifier bits -> device index or AMBIGUOUS
+    std::unordered_map<uint64_t, int> index_[EID_MODE_COUNT];
+};
+
+// Identifier bits an EID contributes in the given mode, as they appear in an observation
+uint64_t eid_identifier(uint8_t mode, const uint8_t *eid);
+uint64_t eid_identifier(uint8_t mode, const EidObservation &observation);
+
+}
+
+#endif // ABSNIFFER_EID_RESOLVER_H
@@ -0,0 +1,39 @@
+#ifndef ABSNIFFER_EVENT_LOOP_H
+#define ABSNIFFER_EVENT_LOOP_H
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+namespace absniffer {
+
+// Thin epoll wrapper dispatching readiness events to per-descriptor handlers
+class EventLoop {
+public:
+    using Handler = std::function<void(uint32_t events)>;
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    // events is a mask of EPOLLIN, EPOLLOUT, ...
+    bool add(int fd, uint32_t events, Handler handler);
+    bool modify(int fd, uint32_t events);
+    // Safe to call from within a handler
+    void remove(int fd);
+
+    // Waits up to timeout_ms (-1: forever) and dispatches ready descriptors.
+    // Returns the number of dispatched events or -1 on errors.
+    int poll(int timeout_ms);
+
+    bool empty() const { return handlers_.empty(); }
+
+private:
+    int epoll_fd_;
+    std::unordered_map<int, Handler> handlers_;
+};
+
+}
+
+#endif // ABSNIFFER_EVENT_LOOP_H
@@ -0,0 +1,76 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "frame.h"
+
+namespace absniffer {
+
+namespace {
+
+// same algorithm as crc16_compute in the nRF5 SDK (CCITT, polynomial 0x1021), one table lookup per byte
+struct Crc16Table {
+    uint16_t entries[256];
+
+    constexpr Crc16Table() : entries() {
+        for (int i = 0; i < 256; i++) {
+            uint16_t crc = (uint16_t) (i << 8);
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (uint16_t) ((crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1);
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+constexpr Crc16Table crc16_table;
+
+}
+
+uint16_t crc16_ccitt(const uint8_t *data, size_t len, uint16_t crc) {
+    for (size_t i = 0; i < len; i++) {
+        crc = (uint16_t) ((crc << 8) ^ crc16_table.entries[(uint8_t) ((crc >> 8) ^ data[i])]);
+    }
+    return crc;
+}
+
+FrameStatus parse_frame(const uint8_t *data, size_t len, Frame &frame, size_t &consumed) {
+    if (len < 3) return FrameStatus::Incomplete;
+    if (data[0] != FRAME_SYNC) return FrameStatus::Invalid;
+    size_t total = FRAME_OVERHEAD + data[2];
+    if (len < total) return FrameStatus::Incomplete;
+
+    uint16_t crc = crc16_ccitt(data + 1, total - 3);
+    uint16_t received = (uint16_t) (data[total - 2] | (data[total - 1] << 8));
+    if (crc != received) return FrameStatus::Invalid;
+
+    frame.type = data[1];
+    frame.length = data[2];
+    frame.payload = data + 3;
+    consumed = total;
+    return FrameStatus::Ok;
+}
+
+void append_frame(std::string &out, uint8_t type, const uint8_t *payload, uint8_t length) {
+    uint8_t header[2] = {type, length};
+    uint16_t crc = crc16_ccitt(header, sizeof(header));
+    crc = crc16_ccitt(payload, length, crc);
+    out += (char) FRAME_SYNC;
+    out.append(reinterpret_cast<const char *>(header), sizeof(header));
+    out.append(reinterpret_cast<const char *>(payload), length);
+    out += (char) (uint8_t) crc;
+    out += (char) (uint8_t) (crc >> 8);
+}
+
+}
@@ -0,0 +1,41 @@
+#ifndef ABSNIFFER_FRAME_H
+#define ABSNIFFER_FRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace absniffer {
+
+// Binary frame as sent by uart_cmd_send_frame: 0xFE <type> <length> <payload> <CRC16>
+constexpr uint8_t FRAME_SYNC = 0xFE;
+constexpr size_t FRAME_OVERHEAD = 5;
+
+constexpr uint8_t FRAME_SCAN_REPORT = 0x01;
+constexpr uint8_t FRAME_TRACE = 0x02;
+constexpr uint8_t FRAME_TEST = 0x03;
+
+// Points into the buffer the frame was parsed from
+struct Frame {
+    uint8_t type;
+    const uint8_t *payload;
+    uint8_t length;
+};
+
+enum class FrameStatus {
+    Ok,
+    Incomplete,     // more data is needed
+    Invalid         // not a frame or CRC mismatch, skip the sync byte and resynchronize
+};
+
+uint16_t crc16_ccitt(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF);
+
+// Parses a frame starting at data[0] (which must be FRAME_SYNC), sets consumed to the frame size on success
+FrameStatus parse_frame(const uint8_t *data, size_t len, Frame &frame, size_t &consumed);
+
+// Appends a frame the way the device sends it
+void append_frame(std::string &out, uint8_t type, const uint8_t *payload, uint8_t length);
+
+}
+
+#endif // ABSNIFFER_FRAME_H
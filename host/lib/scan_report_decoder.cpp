@@ -0,0 +1,200 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "scan_report_decoder.h"
+
+#include <cstring>
+
+namespace absniffer {
+
+namespace {
+
+// keep in sync with scan_report.h
+constexpr uint8_t KEYFRAME = 0x00;
+constexpr uint8_t FLAG_RECORD = 0x01;
+constexpr uint8_t FLAG_ADDR_REF = 0x02;
+constexpr uint8_t FLAG_IDENT_SAME = 0x04;
+constexpr uint8_t FLAG_IDENT = 0x08;
+constexpr uint8_t FLAG_UUID_REF = 0x10;
+constexpr int RSSI_SHIFT = 5;
+constexpr uint8_t RSSI_EXPLICIT = 7;
+
+class Reader {
+public:
+    Reader(const uint8_t *data, size_t len) : p_(data), end_(data + len) {}
+
+    bool at_end() const { return p_ == end_; }
+    bool ok() const { return ok_; }
+
+    uint8_t u8() {
+        if (p_ >= end_) {
+            ok_ = false;
+            return 0;
+        }
+        return *p_++;
+    }
+
+    void bytes(uint8_t *dst, size_t n) {
+        if ((size_t) (end_ - p_) < n) {
+            ok_ = false;
+            return;
+        }
+        std::memcpy(dst, p_, n);
+        p_ += n;
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = u8();
+            value |= (uint64_t) (b & 0x7F) << shift;
+            if (!(b & 0x80)) return value;
+        }
+        ok_ = false;
+        return 0;
+    }
+
+private:
+    const uint8_t *p_;
+    const uint8_t *end_;
+    bool ok_ = true;
+};
+
+}
+
+bool ScanRecord::operator==(const ScanRecord &other) const {
+    return timestamp_us == other.timestamp_us && addr_type == other.addr_type && addr == other.addr &&
+           rssi == other.rssi && is_ibeacon == other.is_ibeacon &&
+           (!is_ibeacon || (uuid == other.uuid && major == other.major && minor == other.minor));
+}
+
+void ScanReportDecoder::reset_dictionaries() {
+    addr_count_ = addr_next_ = 0;
+    uuid_count_ = uuid_next_ = 0;
+}
+
+bool ScanReportDecoder::decode(const uint8_t *payload, size_t len, std::vector<ScanRecord> &out) {
+    if (len < 2) return false;
+    Reader r(payload, len);
+    uint8_t seq = r.u8();
+    bool starts_with_keyframe = payload[1] == KEYFRAME;
+    if (synchronized_ && seq != next_seq_) {
+        synchronized_ = false; // a frame was lost, the dictionaries can no longer be trusted
+    }
+    next_seq_ = (uint8_t) (seq + 1);
+    if (!synchronized_ && !starts_with_keyframe) {
+        frames_skipped_++;
+        return false;
+    }
+
+    size_t first_new = out.size();
+    bool malformed = false;
+    while (!r.at_end() && r.ok() && !malformed) {
+        uint8_t header = r.u8();
+        if (header == KEYFRAME) {
+            uint64_t ts = 0;
+            for (int i = 0; i < 8; i++) ts |= (uint64_t) r.u8() << (8 * i);
+            last_timestamp_us_ = ts;
+            reset_dictionaries();
+            synchronized_ = true;
+            continue;
+        }
+        if (!(header & FLAG_RECORD)) {
+            malformed = true;
+            break;
+        }
+
+        ScanRecord rec;
+        AddrEntry *entry;
+        if (header & FLAG_ADDR_REF) {
+            uint8_t index = r.u8();
+            if (index >= addr_count_) {
+                malformed = true;
+                break;
+            }
+            entry = &addr_dict_[index];
+        } else {
+            entry = &addr_dict_[addr_next_];
+            *entry = AddrEntry();
+            entry->addr_type = r.u8();
+            r.bytes(entry->addr.data(), 6);
+            addr_next_ = (addr_next_ + 1) % ADDR_DICT_SIZE;
+            if (addr_count_ < ADDR_DICT_SIZE) addr_count_++;
+        }
+        rec.addr_type = entry->addr_type;
+        rec.addr = entry->addr;
+
+        if (header & FLAG_IDENT_SAME) {
+            if (!entry->has_ident) {
+                malformed = true;
+                break;
+            }
+            rec.is_ibeacon = true;
+        } else if (header & FLAG_IDENT) {
+            if (header & FLAG_UUID_REF) {
+                uint8_t index = r.u8();
+                if (index >= uuid_count_) {
+                    malformed = true;
+                    break;
+                }
+                entry->uuid_index = index;
+            } else {
+                r.bytes(uuid_dict_[uuid_next_].data(), 16);
+                entry->uuid_index = (uint8_t) uuid_next_;
+                uuid_next_ = (uuid_next_ + 1) % UUID_DICT_SIZE;
+                if (uuid_count_ < UUID_DICT_SIZE) uuid_count_++;
+            }
+            entry->major = (uint16_t) (r.u8() << 8);
+            entry->major |= r.u8();
+            entry->minor = (uint16_t) (r.u8() << 8);
+            entry->minor |= r.u8();
+            entry->has_ident = true;
+            rec.is_ibeacon = true;
+        }
+        if (rec.is_ibeacon) {
+            rec.uuid = uuid_dict_[entry->uuid_index];
+            rec.major = entry->major;
+            rec.minor = entry->minor;
+        }
+
+        uint8_t rssi_code = header >> RSSI_SHIFT;
+        if (rssi_code == RSSI_EXPLICIT) {
+            entry->rssi = (int8_t) r.u8();
+        } else {
+            entry->rssi = (int8_t) (entry->rssi + rssi_code - 3);
+        }
+        rec.rssi = entry->rssi;
+
+        uint64_t zigzag = r.varint();
+        int64_t delta = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+        last_timestamp_us_ += (uint64_t) delta;
+        rec.timestamp_us = last_timestamp_us_;
+
+        if (!r.ok()) break;
+        out.push_back(rec);
+    }
+
+    if (malformed || !r.ok() || !r.at_end()) {
+        // malformed frame, drop what it produced and wait for the next keyframe
+        out.resize(first_new);
+        synchronized_ = false;
+        frames_skipped_++;
+        return false;
+    }
+    frames_decoded_++;
+    return true;
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef ABSNIFFER_SCAN_REPORT_DECODER_H
+#define ABSNIFFER_SCAN_REPORT_DECODER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace absniffer {
+
+struct ScanRecord {
+    uint64_t timestamp_us = 0;
+    uint8_t addr_type = 0;
+    std::array<uint8_t, 6> addr{};
+    int8_t rssi = 0;
+    bool is_ibeacon = false;
+    std::array<uint8_t, 16> uuid{};
+    uint16_t major = 0;
+    uint16_t minor = 0;
+
+    bool operator==(const ScanRecord &other) const;
+};
+
+// Mirrors the dictionaries of the firmware encoder (scan_report.c). After a lost or corrupt frame the
+// decoder drops frames until the next one which starts with a keyframe.
+class ScanReportDecoder {
+public:
+    // Decodes the payload of a FRAME_SCAN_REPORT frame and appends its records to out.
+    // Returns false if the frame was skipped because the decoder is not synchronized.
+    bool decode(const uint8_t *payload, size_t len, std::vector<ScanRecord> &out);
+
+    bool synchronized() const { return synchronized_; }
+    uint64_t frames_decoded() const { return frames_decoded_; }
+    uint64_t frames_skipped() const { return frames_skipped_; }
+
+private:
+    static constexpr size_t ADDR_DICT_SIZE = 64;
+    static constexpr size_t UUID_DICT_SIZE = 8;
+
+    struct AddrEntry {
+        uint8_t addr_type = 0;
+        std::array<uint8_t, 6> addr{};
+        int8_t rssi = 0;
+        bool has_ident = false;
+        uint8_t uuid_index = 0;
+        uint16_t major = 0;
+        uint16_t minor = 0;
+    };
+
+    void reset_dictionaries();
+
+    bool synchronized_ = false;
+    uint8_t next_seq_ = 0;
+    uint64_t last_timestamp_us_ = 0;
+    std::array<AddrEntry, ADDR_DICT_SIZE> addr_dict_{};
+    std::array<std::array<uint8_t, 16>, UUID_DICT_SIZE> uuid_dict_{};
+    size_t addr_count_ = 0;
+    size_t addr_next_ = 0;
+    size_t uuid_count_ = 0;
+    size_t uuid_next_ = 0;
+    uint64_t frames_decoded_ = 0;
+    uint64_t frames_skipped_ = 0;
+};
+
+}
+
+#endif // ABSNIFFER_SCAN_REPORT_DECODER_H
@@ -0,0 +1,140 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "serial_port.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace absniffer {
+
+namespace {
+
+bool baud_constant(unsigned baud_rate, speed_t &speed) {
+    switch (baud_rate) {
+        case 9600: speed = B9600; return true;
+        case 19200: speed = B19200; return true;
+        case 38400: speed = B38400; return true;
+        case 57600: speed = B57600; return true;
+        case 115200: speed = B115200; return true;
+        case 230400: speed = B230400; return true;
+        case 460800: speed = B460800; return true;
+        case 921600: speed = B921600; return true;
+        case 1000000: speed = B1000000; return true;
+        default: return false;
+    }
+}
+
+}
+
+SerialPort::~SerialPort() {
+    close();
+}
+
+SerialPort::SerialPort(SerialPort &&other) noexcept
+        : fd_(other.fd_), path_(std::move(other.path_)), error_(std::move(other.error_)) {
+    other.fd_ = -1;
+}
+
+SerialPort &SerialPort::operator=(SerialPort &&other) noexcept {
+    if (this != &other) {
+        close();
+        fd_ = other.fd_;
+        path_ = std::move(other.path_);
+        error_ = std::move(other.error_);
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+bool SerialPort::open(const std::string &path, unsigned baud_rate, bool hardware_flow_control) {
+    close();
+    path_ = path;
+    fd_ = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd_ < 0) {
+        error_ = std::strerror(errno);
+        return false;
+    }
+    if (!set_baud_rate(baud_rate, hardware_flow_control)) {
+        close();
+        return false;
+    }
+    tcflush(fd_, TCIOFLUSH);
+    return true;
+}
+
+bool SerialPort::set_baud_rate(unsigned baud_rate, bool hardware_flow_control) {
+    speed_t speed;
+    if (!baud_constant(baud_rate, speed)) {
+        error_ = "unsupported baud rate";
+        return false;
+    }
+    termios tio{};
+    if (tcgetattr(fd_, &tio) != 0) {
+        error_ = std::strerror(errno);
+        return false;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | PARENB);
+    if (hardware_flow_control) {
+        tio.c_cflag |= CRTSCTS;
+    } else {
+        tio.c_cflag &= ~CRTSCTS;
+    }
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd_, TCSANOW, &tio) != 0) {
+        error_ = std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void SerialPort::discard_input() {
+    if (fd_ >= 0) tcflush(fd_, TCIFLUSH);
+}
+
+void SerialPort::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+ssize_t SerialPort::read(uint8_t *data, size_t len) {
+    ssize_t n = ::read(fd_, data, len);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return 0;
+    if (n == 0) {
+        error_ = "port closed";
+        return -1;
+    }
+    if (n < 0) error_ = std::strerror(errno);
+    return n;
+}
+
+ssize_t SerialPort::write(const uint8_t *data, size_t len) {
+    ssize_t n = ::write(fd_, data, len);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return 0;
+    if (n < 0) error_ = std::strerror(errno);
+    return n;
+}
+
+}
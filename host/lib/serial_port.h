@@ -0,0 +1,47 @@
+#ifndef ABSNIFFER_SERIAL_PORT_H
+#define ABSNIFFER_SERIAL_PORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+namespace absniffer {
+
+// Non-blocking serial port in raw 8-N-1 mode, as used by the device (see README)
+class SerialPort {
+public:
+    SerialPort() = default;
+    ~SerialPort();
+    SerialPort(const SerialPort &) = delete;
+    SerialPort &operator=(const SerialPort &) = delete;
+    SerialPort(SerialPort &&other) noexcept;
+    SerialPort &operator=(SerialPort &&other) noexcept;
+
+    // Returns false and sets error() if the port cannot be opened or configured
+    bool open(const std::string &path, unsigned baud_rate = 115200, bool hardware_flow_control = false);
+    void close();
+    // Changes the baud rate of an open port, takes effect immediately (output still in the driver's
+    // buffer is sent at the new rate)
+    bool set_baud_rate(unsigned baud_rate, bool hardware_flow_control = false);
+    // Drops data received but not read yet
+    void discard_input();
+
+    // Both return the number of bytes transferred, 0 if the call would block and -1 on errors
+    ssize_t read(uint8_t *data, size_t len);
+    ssize_t write(const uint8_t *data, size_t len);
+
+    int fd() const { return fd_; }
+    bool is_open() const { return fd_ >= 0; }
+    const std::string &path() const { return path_; }
+    const std::string &error() const { return error_; }
+
+private:
+    int fd_ = -1;
+    std::string path_;
+    std::string error_;
+};
+
+}
+
+#endif // ABSNIFFER_SERIAL_PORT_H
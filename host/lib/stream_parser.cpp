@@ -0,0 +1,133 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stream_parser.h"
+
+#include <charconv>
+
+namespace absniffer {
+
+Message StreamParser::classify(std::string_view line) {
+    if (line.size() >= 2 && line[0] == 'O' && line[1] == 'K' && (line.size() == 2 || line[2] == ' ')) {
+        return Message{Message::Type::Ok, trim(line.substr(2)), {}};
+    }
+    if (line.size() >= 4 && line.compare(0, 4, "ERR:") == 0) {
+        return Message{Message::Type::Error, trim(line.substr(4)), {}};
+    }
+    return Message{Message::Type::Other, line, {}};
+}
+
+bool Tokenizer::next(std::string_view &token) {
+    while (!rest_.empty() && rest_.front() == ' ') rest_.remove_prefix(1);
+    if (rest_.empty()) return false;
+    size_t end = rest_.find(' ');
+    if (end == std::string_view::npos) end = rest_.size();
+    token = rest_.substr(0, end);
+    rest_.remove_prefix(end);
+    return true;
+}
+
+template<typename T>
+bool Tokenizer::next_number(T &value) {
+    std::string_view token;
+    if (!next(token)) return false;
+    auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+    return result.ec == std::errc() && result.ptr == token.data() + token.size();
+}
+
+template bool Tokenizer::next_number(uint16_t &);
+template bool Tokenizer::next_number(uint32_t &);
+template bool Tokenizer::next_number(int32_t &);
+template bool Tokenizer::next_number(uint64_t &);
+template bool Tokenizer::next_number(int64_t &);
+
+bool parse_info(std::string_view body, InfoView &info) {
+    Tokenizer t(body);
+    std::string_view version;
+    if (!t.next(version) || version.size() < 2 || version[0] != 'V') return false;
+    info.version = version.substr(1);
+    if (!t.next(info.mac) || info.mac.size() != 17) return false;
+    if (!t.next(info.uuid) || info.uuid.size() != 32) return false;
+    if (!t.next_number(info.major) || !t.next_number(info.minor)) return false;
+    info.major_rule = {};
+    info.minor_rule = {};
+    if (t.next(info.major_rule) && !t.next(info.minor_rule)) return false;
+    info.adv_mac = {};
+    Tokenizer before_mac = t;
+    if (!t.next(info.adv_mac) || info.adv_mac.size() != 17) {
+        info.adv_mac = {};
+        t = before_mac;
+    }
+    info.extra = t.rest();
+    while (!info.extra.empty() && info.extra.front() == ' ') info.extra.remove_prefix(1);
+    return true;
+}
+
+bool parse_time_sync(std::string_view body, TimeSyncView &sync) {
+    Tokenizer t(body);
+    return t.next_number(sync.device_time_us) && t.next_number(sync.offset_us) && t.next_number(sync.drift_ppb) &&
+           t.next_number(sync.samples);
+}
+
+bool parse_airtime(std::string_view body, AirtimeView &airtime) {
+    Tokenizer t(body);
+    return t.next_number(airtime.adv_interval_ms) && t.next_number(airtime.scan_interval_ms) &&
+           t.next_number(airtime.scan_window_ms) && t.next_number(airtime.adv_events) &&
+           t.next_number(airtime.adv_events_skipped) && t.next_number(airtime.scan_events) &&
+           t.next_number(airtime.scan_records) && t.next_number(airtime.scan_raw_bytes) &&
+           t.next_number(airtime.scan_encoded_bytes) && t.next_number(airtime.scan_cycles_per_record);
+}
+
+bool parse_bloom_status(std::string_view body, BloomStatusView &status) {
+    Tokenizer t(body);
+    uint32_t enabled;
+    if (!t.next_number(enabled)) return false;
+    status.enabled = enabled != 0;
+    return t.next_number(status.num_bits) && t.next_number(status.num_hashes) && t.next_number(status.passed) &&
+           t.next_number(status.rejected);
+}
+
+bool parse_stats(std::string_view body, std::vector<StatsEntry> &entries) {
+    auto parse_number = [](std::string_view s, uint64_t &value) {
+        auto result = std::from_chars(s.data(), s.data() + s.size(), value);
+        return result.ec == std::errc() && result.ptr == s.data() + s.size();
+    };
+
+    Tokenizer t(body);
+    std::string_view token;
+    entries.clear();
+    while (t.next(token)) {
+        size_t eq = token.find('=');
+        if (eq == std::string_view::npos || eq == 0) return false;
+        StatsEntry entry{token.substr(0, eq), 0, false, 0, {}};
+        std::string_view value = token.substr(eq + 1);
+        size_t colon = value.find(':');
+        if (!parse_number(value.substr(0, colon), entry.value)) return false;
+        if (colon != std::string_view::npos) {
+            entry.histogram = true;
+            std::string_view buckets = value.substr(colon + 1);
+            while (!buckets.empty()) {
+                if (entry.bucket_count == STATS_HIST_BUCKETS) return false;
+                size_t comma = buckets.find(',');
+                if (!parse_number(buckets.substr(0, comma), entry.buckets[entry.bucket_count++])) return false;
+                buckets = comma == std::string_view::npos ? std::string_view() : buckets.substr(comma + 1);
+            }
+        }
+        entries.push_back(entry);
+    }
+    return !entries.empty();
+}
+
+}
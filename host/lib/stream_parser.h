@@ -0,0 +1,183 @@
+#ifndef ABSNIFFER_STREAM_PARSER_H
+#define ABSNIFFER_STREAM_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "frame.h"
+
+namespace absniffer {
+
+// One message of the device's serial output. All views point into the buffer passed to
+// StreamParser::parse and are only valid as long as that buffer is.
+struct Message {
+    enum class Type {
+        Ok,         // "OK" or "OK <body>", text holds the body
+        Error,      // "ERR: <message>", text holds the message
+        Frame,      // binary frame, see frame.h
+        Other       // any other line, text holds the whole line
+    };
+
+    Type type;
+    std::string_view text;
+    Frame frame;
+};
+
+// Splits the device's output into messages without copying. Text responses are terminated by
+// line breaks, binary frames start with FRAME_SYNC (which never occurs in text responses).
+//
+//   size_t consumed = parser.parse(buf, len, [](const Message &msg) { ... });
+//   // keep buf[consumed..len) and append the next read to it
+class StreamParser {
+public:
+    // Calls on_message for every complete message in data and returns the number of bytes consumed.
+    template<typename F>
+    size_t parse(const uint8_t *data, size_t len, F &&on_message);
+
+    uint64_t messages() const { return messages_; }
+    // bytes dropped because they belonged to corrupt frames
+    uint64_t bytes_skipped() const { return bytes_skipped_; }
+
+private:
+    static std::string_view trim(std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\r')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\r')) s.remove_suffix(1);
+        return s;
+    }
+
+    static Message classify(std::string_view line);
+
+    uint64_t messages_ = 0;
+    uint64_t bytes_skipped_ = 0;
+};
+
+template<typename F>
+size_t StreamParser::parse(const uint8_t *data, size_t len, F &&on_message) {
+    size_t pos = 0;
+    while (pos < len) {
+        const uint8_t *p = data + pos;
+        size_t remaining = len - pos;
+
+        if (*p == FRAME_SYNC) {
+            Message msg{Message::Type::Frame, {}, {}};
+            size_t consumed = 0;
+            FrameStatus status = parse_frame(p, remaining, msg.frame, consumed);
+            if (status == FrameStatus::Incomplete) break;
+            if (status == FrameStatus::Invalid) {
+                pos++;
+                bytes_skipped_++;
+                continue;
+            }
+            pos += consumed;
+            messages_++;
+            on_message(msg);
+            continue;
+        }
+
+        // a text line ends at the line break, a sync byte means the line was cut off by a reset
+        const uint8_t *eol = static_cast<const uint8_t *>(std::memchr(p, '\n', remaining));
+        const uint8_t *sync = static_cast<const uint8_t *>(std::memchr(p, FRAME_SYNC, eol ? eol - p : remaining));
+        if (sync) {
+            bytes_skipped_ += sync - p;
+            pos += sync - p;
+            continue;
+        }
+        if (!eol) break;
+
+        std::string_view line(reinterpret_cast<const char *>(p), eol - p);
+        pos += line.size() + 1;
+        line = trim(line);
+        if (line.empty()) continue;
+        messages_++;
+        on_message(classify(line));
+    }
+    return pos;
+}
+
+// Typed views of the text responses. The parse functions return false if the body does not match.
+
+// Response to 'I': V<version> <MAC> <UUID> <major> <minor> <major rule> <minor rule> [...]
+struct InfoView {
+    std::string_view version;
+    std::string_view mac;
+    std::string_view uuid;
+    uint16_t major;
+    uint16_t minor;
+    std::string_view major_rule;    // see mac_derive.h, "-" for fixed values, empty for older firmware
+    std::string_view minor_rule;
+    std::string_view adv_mac;   // address currently advertised (see 'P'), empty for older firmware
+    std::string_view extra;     // fields appended by newer firmware
+};
+
+// Response to 'T': <device time> <offset> <drift ppb> <samples>
+struct TimeSyncView {
+    uint64_t device_time_us;
+    int64_t offset_us;
+    int32_t drift_ppb;
+    uint32_t samples;
+};
+
+// Response to 'A' without arguments
+struct AirtimeView {
+    uint32_t adv_interval_ms;
+    uint32_t scan_interval_ms;
+    uint32_t scan_window_ms;
+    uint32_t adv_events;
+    uint32_t adv_events_skipped;
+    uint32_t scan_events;
+    uint32_t scan_records;
+    uint32_t scan_raw_bytes;            // records in their uncompressed form
+    uint32_t scan_encoded_bytes;        // frame payloads
+    uint32_t scan_cycles_per_record;    // spent in the encoder
+};
+
+// Response to 'B' without arguments
+struct BloomStatusView {
+    bool enabled;
+    uint32_t num_bits;
+    uint32_t num_hashes;
+    uint32_t passed;
+    uint32_t rejected;
+};
+
+// keep in sync with STATS_HIST_BUCKETS and STATS_HIST_MIN_LOG2 in stats.h
+constexpr unsigned STATS_HIST_BUCKETS = 16;
+constexpr unsigned STATS_HIST_MIN_LOG2 = 6;
+
+// One entry of the response to 'S': a counter (<name>=<value>) or a histogram of CPU cycles
+// (<name>=<sum>:<bucket 0>,<bucket 1>,...). Bucket i counts durations below
+// 2^(i + STATS_HIST_MIN_LOG2 + 1) cycles, the last one everything above.
+struct StatsEntry {
+    std::string_view name;
+    uint64_t value;             // counter value or sum of cycles
+    bool histogram;
+    unsigned bucket_count;      // trailing empty buckets are omitted by the device
+    uint64_t buckets[STATS_HIST_BUCKETS];
+};
+
+bool parse_info(std::string_view body, InfoView &info);
+bool parse_time_sync(std::string_view body, TimeSyncView &sync);
+bool parse_airtime(std::string_view body, AirtimeView &airtime);
+bool parse_bloom_status(std::string_view body, BloomStatusView &status);
+bool parse_stats(std::string_view body, std::vector<StatsEntry> &entries);
+
+// Splits a response body at spaces
+class Tokenizer {
+public:
+    explicit Tokenizer(std::string_view s) : rest_(s) {}
+
+    bool next(std::string_view &token);
+    template<typename T>
+    bool next_number(T &value);
+    std::string_view rest() const { return rest_; }
+
+private:
+    std::string_view rest_;
+};
+
+}
+
+#endif // ABSNIFFER_STREAM_PARSER_H
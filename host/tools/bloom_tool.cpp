@@ -0,0 +1,227 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Sizes, builds and benchmarks the allowlist Bloom filter used by the firmware (bloom.c).
+//
+//   $ bloom_tool [--capacity bytes] size <identities> <false positive rate>
+//   $ bloom_tool [--capacity bytes] build <identities.csv> <false positive rate> > upload.txt
+//   $ bloom_tool bench <identities> <false positive rate>
+//
+// The CSV has one identity per line: <proximity UUID as hex>,<major>,<minor>. The output of "build"
+// is the sequence of 'B' commands which uploads the filter to the device. The capacity is the filter
+// size of the firmware, 24 KB by default and 29 KB for MINIMAL_SOFTDEVICE_RAM builds (29696).
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "bloom.h"
+}
+
+#include "frame.h"
+
+namespace {
+
+// keep in sync with BLOOM_FILTER_MAX_BYTES in main.c for the default APP_RAM_START
+constexpr uint32_t DEFAULT_CAPACITY_BYTES = 24 * 1024;
+// bytes per 'B W' command, limited by UART_CMD_MAX_DATA
+constexpr uint32_t CHUNK_BYTES = 100;
+
+struct Geometry {
+    uint32_t num_bits;
+    uint8_t num_hashes;
+};
+
+Geometry optimal_geometry(uint64_t n, double p) {
+    double m = std::ceil(-(double) n * std::log(p) / (std::log(2.0) * std::log(2.0)));
+    double k = std::round(m / (double) n * std::log(2.0));
+    return {(uint32_t) std::max(8.0, m), (uint8_t) std::max(1.0, std::min(32.0, k))};
+}
+
+double expected_fp_rate(const Geometry &g, uint64_t n) {
+    return std::pow(1.0 - std::exp(-(double) g.num_hashes * n / g.num_bits), g.num_hashes);
+}
+
+int cmd_size(uint64_t n, double p, uint32_t capacity) {
+    Geometry g = optimal_geometry(n, p);
+    uint32_t bytes = (g.num_bits + 7) / 8;
+    std::printf("bits           %u\n", g.num_bits);
+    std::printf("hashes         %u\n", g.num_hashes);
+    std::printf("bytes          %u (%.1f bits per identity)\n", bytes, (double) g.num_bits / n);
+    std::printf("expected fp    %.4f %%\n", expected_fp_rate(g, n) * 100);
+    std::printf("fits device    %s (%u bytes available)\n", bytes <= capacity ? "yes" : "NO", capacity);
+    return bytes <= capacity ? 0 : 1;
+}
+
+bool parse_identity(const std::string &line, uint8_t *key) {
+    std::string hex;
+    size_t pos = 0;
+    for (; pos < line.size() && line[pos] != ','; pos++) {
+        if (std::isxdigit((unsigned char) line[pos])) hex += line[pos];
+    }
+    if (hex.size() != 32 || pos >= line.size()) return false;
+    uint8_t uuid[16];
+    for (int i = 0; i < 16; i++) uuid[i] = (uint8_t) std::stoul(hex.substr(2 * i, 2), nullptr, 16);
+    char *end;
+    unsigned long major = std::strtoul(line.c_str() + pos + 1, &end, 10);
+    if (*end != ',') return false;
+    unsigned long minor = std::strtoul(end + 1, nullptr, 10);
+    if (major > 0xFFFF || minor > 0xFFFF) return false;
+    bloom_ibeacon_key(uuid, (uint16_t) major, (uint16_t) minor, key);
+    return true;
+}
+
+int cmd_build(const char *path, double p, uint32_t capacity) {
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+    std::vector<std::array<uint8_t, BLOOM_IBEACON_KEY_SIZE>> keys;
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        if (line.empty() || line[0] == '#') continue;
+        std::array<uint8_t, BLOOM_IBEACON_KEY_SIZE> key;
+        if (!parse_identity(line, key.data())) {
+            std::fprintf(stderr, "%s:%zu: malformed identity\n", path, line_no);
+            return 1;
+        }
+        keys.push_back(key);
+    }
+    if (keys.empty()) {
+        std::fprintf(stderr, "no identities\n");
+        return 1;
+    }
+
+    Geometry g = optimal_geometry(keys.size(), p);
+    uint32_t bytes = (g.num_bits + 7) / 8;
+    if (bytes > capacity) {
+        std::fprintf(stderr, "filter needs %u bytes, the device has %u\n", bytes, capacity);
+        return 1;
+    }
+    std::vector<uint8_t> bits(bytes);
+    bloom_filter_t filter;
+    bloom_init(&filter, bits.data(), bytes);
+    bloom_configure(&filter, g.num_bits, g.num_hashes);
+    for (const auto &key : keys) bloom_add(&filter, key.data(), BLOOM_IBEACON_KEY_SIZE);
+
+    std::printf("B N %u %u\n", g.num_bits, g.num_hashes);
+    for (uint32_t offset = 0; offset < bytes; offset += CHUNK_BYTES) {
+        uint32_t len = std::min(CHUNK_BYTES, bytes - offset);
+        bool all_zero = true;
+        for (uint32_t i = 0; i < len; i++) all_zero = all_zero && bits[offset + i] == 0;
+        if (all_zero) continue; // 'B N' cleared the filter
+        std::printf("B W %u ", offset);
+        for (uint32_t i = 0; i < len; i++) std::printf("%02X", bits[offset + i]);
+        std::printf("\n");
+    }
+    std::printf("B E %u\n", absniffer::crc16_ccitt(bits.data(), bytes));
+    std::fprintf(stderr, "%zu identities, %u bits, %u hashes, expected false positive rate %.4f %%\n", keys.size(),
+                 g.num_bits, g.num_hashes, expected_fp_rate(g, keys.size()) * 100);
+    return 0;
+}
+
+int cmd_bench(uint64_t n, double p) {
+    Geometry g = optimal_geometry(n, p);
+    uint32_t bytes = (g.num_bits + 7) / 8;
+    std::vector<uint8_t> bits(bytes);
+    bloom_filter_t filter;
+    bloom_init(&filter, bits.data(), bytes);
+    bloom_configure(&filter, g.num_bits, g.num_hashes);
+
+    std::mt19937_64 rng(1);
+    auto random_keys = [&](uint64_t count) {
+        std::vector<std::array<uint8_t, BLOOM_IBEACON_KEY_SIZE>> keys(count);
+        for (auto &key : keys) for (auto &b : key) b = (uint8_t) rng();
+        return keys;
+    };
+    auto members = random_keys(n);
+    auto others = random_keys(std::max<uint64_t>(n, 100000));
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (const auto &key : members) bloom_add(&filter, key.data(), BLOOM_IBEACON_KEY_SIZE);
+    auto t1 = std::chrono::steady_clock::now();
+    uint64_t false_negatives = 0;
+    for (const auto &key : members) false_negatives += !bloom_contains(&filter, key.data(), BLOOM_IBEACON_KEY_SIZE);
+    auto t2 = std::chrono::steady_clock::now();
+    uint64_t false_positives = 0;
+    for (const auto &key : others) false_positives += bloom_contains(&filter, key.data(), BLOOM_IBEACON_KEY_SIZE);
+    auto t3 = std::chrono::steady_clock::now();
+
+    auto ns = [](auto a, auto b) { return std::chrono::duration<double, std::nano>(b - a).count(); };
+    std::printf("geometry           %u bits, %u hashes, %u bytes\n", g.num_bits, g.num_hashes, bytes);
+    std::printf("insert             %.1f ns/key\n", ns(t0, t1) / members.size());
+    std::printf("query (members)    %.1f ns/key\n", ns(t1, t2) / members.size());
+    std::printf("query (others)     %.1f ns/key\n", ns(t2, t3) / others.size());
+    std::printf("false negatives    %llu\n", (unsigned long long) false_negatives);
+    std::printf("false positives    %.4f %% (target %.4f %%, expected %.4f %%)\n",
+                100.0 * false_positives / others.size(), p * 100, expected_fp_rate(g, n) * 100);
+    return false_negatives == 0 ? 0 : 1;
+}
+
+void usage(const char *name) {
+    std::fprintf(stderr, "usage: %s [--capacity bytes] size <identities> <fp rate>\n"
+                         "       %s [--capacity bytes] build <identities.csv> <fp rate>\n"
+                         "       %s bench <identities> <fp rate>\n", name, name, name);
+}
+
+}
+
+int main(int argc, char **argv) {
+    const char *name = argv[0];
+    uint32_t capacity = DEFAULT_CAPACITY_BYTES;
+    if (argc > 2 && !std::strcmp(argv[1], "--capacity")) {
+        capacity = (uint32_t) std::strtoul(argv[2], nullptr, 10);
+        argc -= 2;
+        argv += 2;
+        if (capacity == 0) {
+            usage(name);
+            return 1;
+        }
+    }
+    if (argc != 4) {
+        usage(name);
+        return 1;
+    }
+    double p = std::atof(argv[3]);
+    if (p <= 0 || p >= 1) {
+        std::fprintf(stderr, "false positive rate must be between 0 and 1\n");
+        return 1;
+    }
+    if (!std::strcmp(argv[1], "build")) return cmd_build(argv[2], p, capacity);
+
+    uint64_t n = std::strtoull(argv[2], nullptr, 10);
+    if (n == 0) {
+        usage(name);
+        return 1;
+    }
+    if (!std::strcmp(argv[1], "size")) return cmd_size(n, p, capacity);
+    if (!std::strcmp(argv[1], "bench")) return cmd_bench(n, p);
+    usage(name);
+    return 1;
+}
@@ -0,0 +1,183 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Simulates the firmware timebase (32 kHz RTC + 1 MHz TIMER) with a drifting crystal and
+// feeds the timesync estimator with sync commands that suffer from UART/USB latency jitter.
+// Reports the error of corrected timestamps against true time and fails if any of them is off by
+// more than the limit.
+//
+//   $ clock_sim --duration 3600 --sync-interval 10 --drift-ppm 35 --wander-ppm 2 --usb-jitter-us 1000
+//               --max-error-us 1000
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "timesync.h"
+}
+
+namespace {
+
+struct Options {
+    double duration_s = 3600;
+    double sync_interval_s = 10;
+    double drift_ppm = 35;
+    double wander_ppm = 2;          // random walk of the crystal error (temperature), per hour
+    double usb_jitter_us = 1000;    // CP2104 USB polling jitter, uniform
+    double queries_per_s = 50;
+    double warmup_s = 60;
+    double max_error_us = 1000;     // timestamps are meant to be sub-millisecond
+    unsigned seed = 1;
+};
+
+// Local clock: integrates the crystal frequency error over true time
+class DeviceClock {
+public:
+    DeviceClock(double drift_ppm, double wander_ppm, std::mt19937_64 &rng)
+            : error_ppm_(drift_ppm), wander_ppm_(wander_ppm), rng_(rng) {}
+
+    // advances to true time t (seconds), returns the local timebase value in microseconds
+    uint64_t advance(double t) {
+        double dt = t - last_t_;
+        if (dt > 0) {
+            std::normal_distribution<double> step(0.0, wander_ppm_ * std::sqrt(dt / 3600.0));
+            error_ppm_ += step(rng_);
+            local_s_ += dt * (1.0 + error_ppm_ * 1e-6);
+            last_t_ = t;
+        }
+        // same quantization as timebase_now_us: RTC ticks plus whole microseconds since the last tick
+        double ticks_f = local_s_ * 32768.0;
+        uint64_t ticks = (uint64_t) ticks_f;
+        uint64_t coarse = (ticks * 15625) >> 9;
+        uint64_t next = ((ticks + 1) * 15625) >> 9;
+        uint64_t fine = (uint64_t) ((ticks_f - (double) ticks) * (1e6 / 32768.0));
+        return std::min(coarse + fine, next - 1);
+    }
+
+private:
+    double error_ppm_;
+    double wander_ppm_;
+    std::mt19937_64 &rng_;
+    double last_t_ = 0;
+    double local_s_ = 0;
+};
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) return false;
+        double value = std::atof(argv[i + 1]);
+        if (!std::strcmp(argv[i], "--duration")) opt.duration_s = value;
+        else if (!std::strcmp(argv[i], "--sync-interval")) opt.sync_interval_s = value;
+        else if (!std::strcmp(argv[i], "--drift-ppm")) opt.drift_ppm = value;
+        else if (!std::strcmp(argv[i], "--wander-ppm")) opt.wander_ppm = value;
+        else if (!std::strcmp(argv[i], "--usb-jitter-us")) opt.usb_jitter_us = value;
+        else if (!std::strcmp(argv[i], "--queries-per-s")) opt.queries_per_s = value;
+        else if (!std::strcmp(argv[i], "--warmup")) opt.warmup_s = value;
+        else if (!std::strcmp(argv[i], "--max-error-us")) opt.max_error_us = value;
+        else if (!std::strcmp(argv[i], "--seed")) opt.seed = (unsigned) value;
+        else return false;
+        i++;
+    }
+    return opt.duration_s > 0 && opt.sync_interval_s > 0 && opt.queries_per_s > 0 && opt.max_error_us > 0;
+}
+
+double percentile(std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = (size_t) std::min<double>(sorted.size() - 1, std::floor(p * (sorted.size() - 1) + 0.5));
+    return sorted[idx];
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--duration s] [--sync-interval s] [--drift-ppm ppm] [--wander-ppm ppm/h]"
+                             " [--usb-jitter-us us] [--queries-per-s n] [--warmup s] [--max-error-us us] [--seed n]\n", argv[0]);
+        return 1;
+    }
+
+    std::mt19937_64 rng(opt.seed);
+    std::uniform_real_distribution<double> jitter(0.0, opt.usb_jitter_us * 1e-6);
+    std::exponential_distribution<double> query_gap(opt.queries_per_s);
+    DeviceClock clock(opt.drift_ppm, opt.wander_ppm, rng);
+
+    timesync_t sync;
+    timesync_init(&sync);
+
+    // host time epoch, anything large enough to exercise 64-bit offsets
+    const uint64_t host_epoch_us = 1700000000ULL * 1000000ULL;
+    // "T <16 digits>\n" at 115200 8-N-1, the host compensates the nominal serialization time
+    const double serialization_s = 19 * 10 / 115200.0;
+
+    std::vector<double> errors;
+    // events run in true time order, a sync command is handled when its terminator arrives
+    double next_sync = 0;
+    double next_sync_rx = serialization_s + jitter(rng);
+    double next_query = 0;
+    while (true) {
+        double t = std::min(next_sync_rx, next_query);
+        if (t > opt.duration_s) break;
+        if (next_sync_rx <= next_query) {
+            // the host stamps the command with its clock when it expects the terminator to arrive
+            uint64_t host_us = host_epoch_us + (uint64_t) llround((next_sync + serialization_s) * 1e6);
+            timesync_add_sample(&sync, clock.advance(next_sync_rx), host_us);
+            next_sync += opt.sync_interval_s;
+            next_sync_rx = next_sync + serialization_s + jitter(rng);
+        } else {
+            uint64_t corrected = timesync_local_to_host(&sync, clock.advance(next_query));
+            double truth_us = (double) host_epoch_us + next_query * 1e6;
+            if (next_query >= opt.warmup_s && timesync_is_synchronized(&sync)) {
+                errors.push_back((double) (int64_t) (corrected - (uint64_t) truth_us));
+            }
+            next_query += query_gap(rng);
+        }
+    }
+
+    if (errors.empty()) {
+        std::fprintf(stderr, "no samples after warmup\n");
+        return 1;
+    }
+    double sum = 0, sum_sq = 0;
+    for (double e : errors) {
+        sum += e;
+        sum_sq += e * e;
+    }
+    double mean = sum / errors.size();
+    double stddev = std::sqrt(std::max(0.0, sum_sq / errors.size() - mean * mean));
+    std::vector<double> abs_errors;
+    abs_errors.reserve(errors.size());
+    for (double e : errors) abs_errors.push_back(std::fabs(e));
+    std::sort(abs_errors.begin(), abs_errors.end());
+
+    std::printf("queries          %zu\n", errors.size());
+    std::printf("crystal error    %.1f ppm initially, correction slope %.1f ppm at the end\n", opt.drift_ppm,
+                sync.drift_ppb / 1000.0);
+    std::printf("mean error       %.1f us\n", mean);
+    std::printf("jitter (stddev)  %.1f us\n", stddev);
+    std::printf("|error| p50      %.1f us\n", percentile(abs_errors, 0.50));
+    std::printf("|error| p99      %.1f us\n", percentile(abs_errors, 0.99));
+    std::printf("|error| max      %.1f us\n", abs_errors.back());
+    bool ok = abs_errors.back() <= opt.max_error_us;
+    std::printf("result           %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,506 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Updates the firmware of many devices in parallel over their serial ports with 'F' (see "Firmware
+// Update" in the README). The image is sent in CRC-checked chunks, several of them in flight at once,
+// so the transfer is limited by the flash writes of the device rather than by the round trips.
+//
+//   $ dfu_update [--retries n] [--timeout-ms ms] [--parallel n] [--window n] [--baud rate]
+//                [--fast-baud rate] <image.bin> <port>...
+//
+// The image is the .bin of the application. After an error the tool waits for the chunks in flight,
+// asks the device how much has been written and continues from there; a new attempt (e.g. after the
+// device has been unplugged) resumes where the previous one got. Once the device has verified the image,
+// it is installed by the bootloader at the reset following 'F E', and the tool checks that the device
+// comes back with the update applied. With --fast-baud the transfer runs at a higher rate (see 'H'), the
+// device is back at its default rate after the reset. Use fake_dongle to try it without hardware.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+extern "C" {
+#include "dfu.h"
+}
+
+#include "device_connection.h"
+#include "event_loop.h"
+#include "frame.h"
+#include "stream_parser.h"
+
+using namespace absniffer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// time the device needs to come back after 'F E': reset, bootloader copying a full bank, application start
+constexpr unsigned REBOOT_DELAY_MS = 500;
+constexpr unsigned REBOOT_TIMEOUT_MS = 10000;
+// a new transfer erases bank 1 over the image size before it answers 'F N', about 85 ms per page at most
+constexpr unsigned ERASE_TIMEOUT_MS = DFU_BANK_SIZE / DFU_PAGE_SIZE * 85;
+// status polls while flash operations are pending
+constexpr unsigned RESYNC_POLL_MS = 20;
+
+struct Options {
+    unsigned retries = 3;
+    unsigned timeout_ms = 2000;
+    unsigned parallel = 0;      // 0: all devices at once
+    unsigned window = DFU_MAX_PENDING_CHUNKS;
+    unsigned baud_rate = 115200;
+    unsigned fast_baud_rate = 0;
+    const char *image_path = nullptr;
+    std::vector<std::string> ports;
+};
+
+struct Image {
+    std::vector<uint8_t> data;
+    uint32_t crc;
+};
+
+// the body of 'F': <state> <size> <crc32> <written> <pending>
+struct UpdateStatus {
+    unsigned state;
+    uint32_t image_size;
+    uint32_t image_crc;
+    uint32_t written;
+    unsigned pending;
+};
+
+bool parse_status(std::string_view body, UpdateStatus &status) {
+    std::string str(body);
+    char end;
+    return std::sscanf(str.c_str(), "%u %u %u %u %u%c", &status.state, &status.image_size, &status.image_crc,
+                       &status.written, &status.pending, &end) == 5;
+}
+
+// the body of the responses to 'F N' and 'F W': a single offset
+bool parse_offset(std::string_view body, uint32_t &offset) {
+    std::string str(body);
+    char end;
+    return std::sscanf(str.c_str(), "%u%c", &offset, &end) == 1;
+}
+
+class Device {
+public:
+    enum class State {
+        Pending, Switching, Confirming, Starting, Sending, Resyncing, Cancelling, Activating, Rebooting,
+        Verifying, Identifying, Backoff, Done, Failed
+    };
+
+    Device(EventLoop &loop, std::string port, const Image &image, const Options &opt)
+            : port_(std::move(port)), image_(image), opt_(opt), conn_(loop) {
+        conn_.on_message([this](const Message &msg) { handle_message(msg); });
+        conn_.on_error([this](const std::string &error) { retry("port error: " + error); });
+    }
+
+    void start(Clock::time_point now) {
+        started_ = now;
+        attempt(now);
+    }
+
+    // drives timeouts, status polls and backoff, returns the next point in time this device needs attention
+    Clock::time_point poll(Clock::time_point now) {
+        if (is_active() && state_ != State::Pending && now >= deadline_) {
+            switch (state_) {
+                case State::Backoff:
+                    attempt(now);
+                    break;
+                case State::Sending:
+                    // chunks or their responses got lost
+                    in_flight_ = 0;
+                    resync(now);
+                    break;
+                case State::Resyncing:
+                    if (poll_again_) {
+                        poll_again_ = false;
+                        request("F", now, opt_.timeout_ms);
+                    } else {
+                        retry("timeout waiting for 'F'");
+                    }
+                    break;
+                case State::Rebooting:
+                    state_ = State::Verifying;
+                    request("F", now, opt_.timeout_ms);
+                    break;
+                case State::Verifying:
+                    // still busy or booting
+                    if (now - reboot_ > std::chrono::milliseconds(REBOOT_TIMEOUT_MS)) {
+                        retry("device did not come back after the update");
+                    } else {
+                        request("F", now, opt_.timeout_ms);
+                    }
+                    break;
+                default:
+                    retry("timeout waiting for a response");
+                    break;
+            }
+        }
+        return is_active() ? deadline_ : Clock::time_point::max();
+    }
+
+    bool is_active() const { return state_ != State::Pending && !is_finished(); }
+    bool is_finished() const { return state_ == State::Done || state_ == State::Failed; }
+    bool succeeded() const { return state_ == State::Done; }
+
+    const std::string &port() const { return port_; }
+    unsigned attempts() const { return attempts_; }
+    unsigned resyncs() const { return resyncs_; }
+    uint32_t resumed_at() const { return resumed_at_; }
+    const std::string &version() const { return version_; }
+    const std::string &last_error() const { return last_error_; }
+    double duration_ms() const { return std::chrono::duration<double, std::milli>(finished_ - started_).count(); }
+    double transfer_ms() const { return std::chrono::duration<double, std::milli>(transferred_ - started_).count(); }
+    uint64_t bytes_sent() const { return conn_.bytes_sent(); }
+
+private:
+    void attempt(Clock::time_point now) {
+        attempts_++;
+        in_flight_ = 0;
+        draining_ = false;
+        if (!conn_.is_open()) {
+            if (!conn_.open(port_, opt_.baud_rate)) {
+                retry("cannot open port: " + conn_.error());
+                return;
+            }
+        } else if (conn_.baud_rate() != opt_.baud_rate) {
+            conn_.set_baud_rate(opt_.baud_rate);
+        }
+        if (opt_.fast_baud_rate && opt_.fast_baud_rate != opt_.baud_rate) {
+            state_ = State::Switching;
+            request("H " + std::to_string(opt_.fast_baud_rate), now, opt_.timeout_ms);
+        } else {
+            start_transfer(now);
+        }
+    }
+
+    void start_transfer(Clock::time_point now) {
+        state_ = State::Starting;
+        request("F N " + std::to_string(image_.data.size()) + " " + std::to_string(image_.crc), now,
+                opt_.timeout_ms + ERASE_TIMEOUT_MS);
+    }
+
+    void request(const std::string &cmd, Clock::time_point now, unsigned timeout_ms) {
+        deadline_ = now + std::chrono::milliseconds(timeout_ms);
+        conn_.send(cmd);
+    }
+
+    void handle_message(const Message &msg) {
+        if (msg.type == Message::Type::Frame || msg.type == Message::Type::Other) return;
+        Clock::time_point now = Clock::now();
+        if (state_ == State::Sending) {
+            handle_chunk_response(msg, now);
+            return;
+        }
+        if (msg.type == Message::Type::Error) {
+            handle_error(msg, now);
+            return;
+        }
+        UpdateStatus status;
+        uint32_t offset;
+        switch (state_) {
+            case State::Switching:
+                // the device answers at the old rate and switches afterwards
+                if (!conn_.set_baud_rate(opt_.fast_baud_rate)) {
+                    retry("cannot switch the port: " + conn_.error());
+                    return;
+                }
+                state_ = State::Confirming;
+                request("H C", now, opt_.timeout_ms);
+                break;
+            case State::Confirming:
+                start_transfer(now);
+                break;
+            case State::Starting:
+                if (!parse_offset(msg.text, offset) || offset > image_.data.size()) {
+                    retry("malformed 'F N' response");
+                    return;
+                }
+                if (attempts_ > 1 || offset > 0) resumed_at_ = offset;
+                sent_ = offset;
+                state_ = State::Sending;
+                continue_transfer(now);
+                break;
+            case State::Resyncing:
+                // late responses to chunks have a single value
+                if (!parse_status(msg.text, status)) return;
+                if (status.state != DFU_STATE_RECEIVING || status.image_size != image_.data.size() ||
+                    status.image_crc != image_.crc) {
+                    retry("transfer aborted by the device");
+                } else if (status.pending > 0) {
+                    poll_again_ = true;
+                    deadline_ = now + std::chrono::milliseconds(RESYNC_POLL_MS);
+                } else {
+                    sent_ = status.written;
+                    state_ = State::Sending;
+                    continue_transfer(now);
+                }
+                break;
+            case State::Cancelling:
+                start_transfer(now);
+                break;
+            case State::Activating:
+                transferred_ = now;
+                reboot_ = now;
+                state_ = State::Rebooting;
+                deadline_ = now + std::chrono::milliseconds(REBOOT_DELAY_MS);
+                // the device starts at its default rate
+                if (conn_.baud_rate() != opt_.baud_rate) conn_.set_baud_rate(opt_.baud_rate);
+                break;
+            case State::Verifying:
+                if (!parse_status(msg.text, status)) return;
+                if (status.state == DFU_STATE_ACTIVATED) {
+                    // the application is still the old one, retrying will not help
+                    last_error_ = "image not installed, is the bootloader missing?";
+                    finish(State::Failed, now);
+                } else if (status.state != DFU_STATE_IDLE || status.image_size != 0) {
+                    retry("unexpected state after the update");
+                } else {
+                    state_ = State::Identifying;
+                    request("I", now, opt_.timeout_ms);
+                }
+                break;
+            case State::Identifying: {
+                InfoView info;
+                if (!parse_info(msg.text, info)) {
+                    retry("malformed 'I' response");
+                } else {
+                    version_ = std::string(info.version);
+                    finish(State::Done, now);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void handle_error(const Message &msg, Clock::time_point now) {
+        switch (state_) {
+            case State::Activating:
+                // bank 1 does not hold the image, start over
+                last_error_ = "verification failed: " + std::string(msg.text);
+                state_ = State::Cancelling;
+                request("F C", now, opt_.timeout_ms);
+                break;
+            case State::Resyncing:
+            case State::Verifying:
+                // late responses to chunks, or the device is still busy
+                break;
+            default:
+                retry("device error: " + std::string(msg.text));
+                break;
+        }
+    }
+
+    void handle_chunk_response(const Message &msg, Clock::time_point now) {
+        uint32_t offset;
+        if (in_flight_ > 0) in_flight_--;
+        if (msg.type == Message::Type::Error) {
+            // rejected chunk (CRC, queue full), the following ones are rejected as well
+            last_error_ = "chunk rejected: " + std::string(msg.text);
+            draining_ = true;
+        } else if (!parse_offset(msg.text, offset)) {
+            draining_ = true;
+        }
+        if (draining_) {
+            if (in_flight_ == 0) resync(now);
+            return;
+        }
+        continue_transfer(now);
+    }
+
+    void continue_transfer(Clock::time_point now) {
+        if (sent_ == image_.data.size() && in_flight_ == 0) {
+            state_ = State::Activating;
+            // the device computes the CRC of the whole bank first
+            request("F E", now, opt_.timeout_ms);
+        } else {
+            send_chunks(now);
+        }
+    }
+
+    void send_chunks(Clock::time_point now) {
+        char cmd[64];
+        while (in_flight_ < opt_.window && sent_ < image_.data.size()) {
+            uint32_t len = std::min<uint32_t>(DFU_CHUNK_MAX_SIZE, (uint32_t) image_.data.size() - sent_);
+            const uint8_t *p_chunk = &image_.data[sent_];
+            std::snprintf(cmd, sizeof(cmd), "F W %u %u ", sent_, crc16_ccitt(p_chunk, len));
+            std::string line(cmd);
+            for (uint32_t i = 0; i < len; i++) {
+                std::snprintf(cmd, sizeof(cmd), "%02X", p_chunk[i]);
+                line += cmd;
+            }
+            conn_.send(line);
+            sent_ += len;
+            in_flight_++;
+        }
+        deadline_ = now + std::chrono::milliseconds(opt_.timeout_ms);
+    }
+
+    void resync(Clock::time_point now) {
+        resyncs_++;
+        draining_ = false;
+        poll_again_ = false;
+        state_ = State::Resyncing;
+        request("F", now, opt_.timeout_ms);
+    }
+
+    void retry(const std::string &error) {
+        Clock::time_point now = Clock::now();
+        last_error_ = error;
+        if (attempts_ > opt_.retries) {
+            finish(State::Failed, now);
+            return;
+        }
+        // back off a little, a port error usually means the device is re-enumerating
+        state_ = State::Backoff;
+        deadline_ = now + std::chrono::milliseconds(50 * attempts_);
+    }
+
+    void finish(State state, Clock::time_point now) {
+        state_ = state;
+        finished_ = now;
+        conn_.close();
+    }
+
+    std::string port_;
+    const Image &image_;
+    const Options &opt_;
+    DeviceConnection conn_;
+    State state_ = State::Pending;
+    uint32_t sent_ = 0;             // image data sent, as far as the device has not rejected it
+    unsigned in_flight_ = 0;        // chunks without response
+    bool draining_ = false;         // waiting for the responses to the chunks in flight before resyncing
+    bool poll_again_ = false;
+    unsigned attempts_ = 0;
+    unsigned resyncs_ = 0;
+    uint32_t resumed_at_ = 0;
+    std::string version_;
+    std::string last_error_;
+    Clock::time_point started_;
+    Clock::time_point transferred_;
+    Clock::time_point reboot_;
+    Clock::time_point finished_;
+    Clock::time_point deadline_;
+};
+
+bool read_image(const char *path, Image &image) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    image.data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    // the device refuses to activate anything else, better find out before sending it to all devices
+    if (!dfu_image_plausible(image.data.data(), (uint32_t) image.data.size())) {
+        std::fprintf(stderr, "%s: not an application image for 0x%X (size %zu)\n", path, DFU_BANK0_ADDR,
+                     image.data.size());
+        return false;
+    }
+    image.crc = dfu_crc32(image.data.data(), (uint32_t) image.data.size(), 0);
+    return true;
+}
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || argv[i][1] != '-') {
+            if (!opt.image_path) opt.image_path = argv[i];
+            else opt.ports.push_back(argv[i]);
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        unsigned value = (unsigned) std::strtoul(argv[i + 1], nullptr, 10);
+        if (!std::strcmp(argv[i], "--retries")) opt.retries = value;
+        else if (!std::strcmp(argv[i], "--timeout-ms")) opt.timeout_ms = value;
+        else if (!std::strcmp(argv[i], "--parallel")) opt.parallel = value;
+        else if (!std::strcmp(argv[i], "--window")) opt.window = value;
+        else if (!std::strcmp(argv[i], "--baud")) opt.baud_rate = value;
+        else if (!std::strcmp(argv[i], "--fast-baud")) opt.fast_baud_rate = value;
+        else return false;
+        i++;
+    }
+    return opt.image_path && !opt.ports.empty() && opt.timeout_ms > 0 && opt.window > 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--retries n] [--timeout-ms ms] [--parallel n] [--window n] [--baud rate]"
+                             " [--fast-baud rate] <image.bin> <port>...\n", argv[0]);
+        return 1;
+    }
+    Image image;
+    if (!read_image(opt.image_path, image)) return 1;
+
+    EventLoop loop;
+    std::vector<std::unique_ptr<Device>> devices;
+    for (const auto &port : opt.ports) devices.push_back(std::make_unique<Device>(loop, port, image, opt));
+    size_t parallel = opt.parallel ? opt.parallel : devices.size();
+
+    Clock::time_point t0 = Clock::now();
+    size_t next = 0;
+    size_t active = 0;
+    while (true) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point wake = Clock::time_point::max();
+        active = 0;
+        for (auto &device : devices) {
+            wake = std::min(wake, device->poll(now));
+            active += device->is_active();
+        }
+        while (active < parallel && next < devices.size()) {
+            devices[next]->start(now);
+            wake = std::min(wake, devices[next]->poll(now));
+            active += devices[next]->is_active();
+            next++;
+        }
+        if (active == 0 && next == devices.size()) break;
+
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wake - Clock::now()).count() + 1;
+        if (loop.poll((int) std::max<long long>(0, std::min<long long>(timeout, 1000))) < 0) {
+            std::perror("epoll_wait");
+            return 1;
+        }
+    }
+    double wall_s = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    size_t succeeded = 0;
+    std::printf("image              %zu B, CRC32 %08X\n\n", image.data.size(), image.crc);
+    std::printf("%-24s %-6s %8s %7s %8s %10s %10s %10s %-8s  %s\n", "port", "result", "attempts", "resyncs",
+                "resumed", "time [ms]", "xfer [ms]", "xfer [B/s]", "version", "last error");
+    for (const auto &device : devices) {
+        double xfer_ms = device->succeeded() ? device->transfer_ms() : 0;
+        std::printf("%-24s %-6s %8u %7u %8u %10.1f %10.1f %10.0f %-8s  %s\n", device->port().c_str(),
+                    device->succeeded() ? "ok" : "FAILED", device->attempts(), device->resyncs(),
+                    device->resumed_at(), device->duration_ms(), xfer_ms,
+                    xfer_ms > 0 ? image.data.size() * 1000.0 / xfer_ms : 0.0, device->version().c_str(),
+                    device->last_error().c_str());
+        succeeded += device->succeeded();
+    }
+    std::printf("\ndevices            %zu ok, %zu failed\n", succeeded, devices.size() - succeeded);
+    std::printf("wall time          %.3f s (%.1f kB/s aggregate)\n", wall_s,
+                succeeded * image.data.size() / 1000.0 / wall_s);
+    return succeeded == devices.size() ? 0 : 1;
+}
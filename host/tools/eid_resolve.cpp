@@ -0,0 +1,238 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Maps rotating beacon identifiers (see eid.h and the 'E' command) back to devices.
+//
+//   $ eid_resolve commands <keys.csv>
+//   $ eid_resolve resolve <keys.csv> [max skew s] < observations.txt
+//   $ eid_resolve bench <devices> <observations> [mode] [rotation exponent]
+//
+// The keys CSV has one device per line: <name>,<identity key as hex>,<mode>,<rotation exponent>,<epoch>
+// with the mode as for 'E S' (1: minor, 2: major and minor, 3: UUID). "commands" prints the 'E S' command
+// provisioning each device. Observations have one advertisement per line: <Unix time in seconds>
+// <proximity UUID as hex> <major> <minor>, "resolve" appends the device name, '?' if the identifier is
+// unknown or '*' if it matches several devices. "bench" resolves random observations of random devices,
+// half of them foreign beacons, and reports the accuracy and throughput.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "aes128.h"
+#include "eid_resolver.h"
+
+using absniffer::EidDevice;
+using absniffer::EidObservation;
+using absniffer::EidResolver;
+
+namespace {
+
+bool parse_hex(const std::string &hex, uint8_t *out, size_t len) {
+    if (hex.size() != 2 * len) return false;
+    for (size_t i = 0; i < len; i++) {
+        char *end;
+        std::string byte = hex.substr(2 * i, 2);
+        out[i] = (uint8_t) std::strtoul(byte.c_str(), &end, 16);
+        if (*end != 0) return false;
+    }
+    return true;
+}
+
+bool load_keys(const char *path, std::vector<EidDevice> &devices) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::stringstream fields(line);
+        std::string name, key, mode, exponent, epoch;
+        if (!std::getline(fields, name, ',') || !std::getline(fields, key, ',') || !std::getline(fields, mode, ',') ||
+            !std::getline(fields, exponent, ',') || !std::getline(fields, epoch)) {
+            std::fprintf(stderr, "malformed line: %s\n", line.c_str());
+            return false;
+        }
+        EidDevice device{name, {}};
+        device.config.mode = (uint8_t) std::atoi(mode.c_str());
+        device.config.rotation_exponent = (uint8_t) std::atoi(exponent.c_str());
+        device.config.epoch_s = (uint32_t) std::strtoul(epoch.c_str(), nullptr, 10);
+        if (!parse_hex(key, device.config.identity_key, EID_KEY_SIZE) || device.config.mode <= EID_MODE_OFF ||
+            device.config.mode >= EID_MODE_COUNT || device.config.rotation_exponent > EID_MAX_ROTATION_EXPONENT) {
+            std::fprintf(stderr, "invalid device: %s\n", line.c_str());
+            return false;
+        }
+        devices.push_back(device);
+    }
+    return true;
+}
+
+int print_commands(const char *keys_path) {
+    std::vector<EidDevice> devices;
+    if (!load_keys(keys_path, devices)) return 1;
+    for (const EidDevice &device : devices) {
+        std::printf("E S %u %u %lu ", device.config.mode, device.config.rotation_exponent,
+                    (unsigned long) device.config.epoch_s);
+        for (uint8_t b : device.config.identity_key) std::printf("%02X", b);
+        std::printf("\n");
+    }
+    return 0;
+}
+
+int resolve(const char *keys_path, uint32_t max_skew_s) {
+    std::vector<EidDevice> devices;
+    if (!load_keys(keys_path, devices)) return 1;
+
+    std::vector<EidObservation> observations;
+    std::vector<std::string> lines;
+    char line[256];
+    while (std::fgets(line, sizeof(line), stdin)) {
+        double time_s;
+        char uuid[64];
+        unsigned major, minor;
+        EidObservation observation;
+        if (std::sscanf(line, "%lf %63s %u %u", &time_s, uuid, &major, &minor) != 4 ||
+            !parse_hex(uuid, observation.uuid.data(), observation.uuid.size())) {
+            std::fprintf(stderr, "malformed observation: %s", line);
+            return 1;
+        }
+        observation.time_us = (uint64_t) (time_s * 1e6);
+        observation.major = (uint16_t) major;
+        observation.minor = (uint16_t) minor;
+        observations.push_back(observation);
+        lines.emplace_back(line, std::strcspn(line, "\r\n"));
+    }
+
+    EidResolver resolver(devices, max_skew_s);
+    std::vector<int> results = resolver.resolve(observations);
+    for (size_t i = 0; i < results.size(); i++) {
+        const char *name = results[i] == EidResolver::UNKNOWN ? "?" :
+                           results[i] == EidResolver::AMBIGUOUS ? "*" : devices[results[i]].name.c_str();
+        std::printf("%s %s\n", lines[i].c_str(), name);
+    }
+    return 0;
+}
+
+int bench(size_t device_count, size_t observation_count, uint8_t mode, uint8_t exponent) {
+    const uint32_t epoch_s = 1700000000;
+    const double span_s = 24 * 3600;
+    // device clocks are off by up to this much
+    const double skew_s = 30;
+
+    std::mt19937_64 rng(1);
+    std::vector<EidDevice> devices(device_count);
+    for (size_t i = 0; i < device_count; i++) {
+        devices[i].name = "beacon" + std::to_string(i);
+        devices[i].config.mode = mode;
+        devices[i].config.rotation_exponent = exponent;
+        devices[i].config.epoch_s = epoch_s;
+        for (uint8_t &b : devices[i].config.identity_key) b = (uint8_t) rng();
+    }
+
+    std::uniform_int_distribution<size_t> pick(0, device_count - 1);
+    std::uniform_real_distribution<double> when(1000, span_s);
+    std::uniform_real_distribution<double> skew(-skew_s, skew_s);
+    std::vector<EidObservation> observations(observation_count);
+    std::vector<int> truth(observation_count);
+    for (size_t i = 0; i < observation_count; i++) {
+        EidObservation &observation = observations[i];
+        double time_s = epoch_s + when(rng);
+        observation.time_us = (uint64_t) (time_s * 1e6);
+        for (uint8_t &b : observation.uuid) b = (uint8_t) rng();
+        observation.major = (uint16_t) rng();
+        observation.minor = (uint16_t) rng();
+        // every other observation is a foreign beacon with random identifiers
+        if (i % 2 == 1) {
+            truth[i] = EidResolver::UNKNOWN;
+            continue;
+        }
+        size_t device = pick(rng);
+        const eid_config_t &config = devices[device].config;
+        eid_cache_t cache{};
+        uint8_t eid[EID_SIZE];
+        uint32_t counter = eid_counter(&config, (uint64_t) ((time_s + skew(rng)) * 1e6));
+        eid_compute(&config, &cache, counter, absniffer::Aes128::encrypt_block, eid);
+        eid_apply(config.mode, eid, observation.uuid.data(), &observation.major, &observation.minor);
+        truth[i] = (int) device;
+    }
+
+    EidResolver resolver(devices, (uint32_t) skew_s + 1);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int> results = resolver.resolve(observations);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t correct = 0, wrong = 0, ambiguous = 0, missed = 0, false_matches = 0;
+    for (size_t i = 0; i < observation_count; i++) {
+        if (truth[i] == EidResolver::UNKNOWN) {
+            if (results[i] != EidResolver::UNKNOWN) false_matches++;
+        } else if (results[i] == truth[i]) {
+            correct++;
+        } else if (results[i] == EidResolver::AMBIGUOUS) {
+            ambiguous++;
+        } else if (results[i] == EidResolver::UNKNOWN) {
+            missed++;
+        } else {
+            wrong++;
+        }
+    }
+    size_t own = (observation_count + 1) / 2;
+    std::printf("devices          %zu, mode %u, rotation every %u s\n", device_count, mode, 1u << exponent);
+    std::printf("observations     %zu over %.0f h, %zu of devices\n", observation_count, span_s / 3600, own);
+    std::printf("correct          %zu (%.2f%%)\n", correct, 100.0 * correct / own);
+    std::printf("ambiguous        %zu\n", ambiguous);
+    std::printf("missed           %zu\n", missed);
+    std::printf("wrong device     %zu\n", wrong);
+    std::printf("false matches    %zu of %zu foreign\n", false_matches, observation_count - own);
+    std::printf("time             %.3f s (%.0f observations/s, %llu AES blocks)\n", elapsed,
+                observation_count / elapsed, (unsigned long long) resolver.block_encryptions());
+    return 0;
+}
+
+void usage(const char *name) {
+    std::fprintf(stderr, "usage: %s commands <keys.csv>\n"
+                         "       %s resolve <keys.csv> [max skew s] < observations\n"
+                         "       %s bench <devices> <observations> [mode] [rotation exponent]\n", name, name, name);
+}
+
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 3 && !std::strcmp(argv[1], "commands")) {
+        return print_commands(argv[2]);
+    }
+    if (argc >= 3 && !std::strcmp(argv[1], "resolve")) {
+        return resolve(argv[2], argc > 3 ? (uint32_t) std::atoi(argv[3]) : 60);
+    }
+    if (argc >= 4 && !std::strcmp(argv[1], "bench")) {
+        size_t devices = std::strtoul(argv[2], nullptr, 10);
+        size_t observations = std::strtoul(argv[3], nullptr, 10);
+        int mode = argc > 4 ? std::atoi(argv[4]) : EID_MODE_MAJOR_MINOR;
+        int exponent = argc > 5 ? std::atoi(argv[5]) : 10;
+        if (devices == 0 || mode <= EID_MODE_OFF || mode >= EID_MODE_COUNT || exponent < 0 ||
+            exponent > EID_MAX_ROTATION_EXPONENT) {
+            usage(argv[0]);
+            return 1;
+        }
+        return bench(devices, observations, (uint8_t) mode, (uint8_t) exponent);
+    }
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,267 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Generates one factory image per device: the firmware hex files merged with a beacon identity in the
+// UICR (see factory_id.h), so a single flashing pass provisions the device.
+//
+//   $ factory_image [--out-dir dir] <identities.csv> <firmware.hex>...
+//
+// The CSV has one device per line: <name>,<proximity UUID as hex>,<major>,<minor>[,<advertising interval>].
+// Major and minor may be rules deriving them from the device address (see mac_derive.h), the firmware
+// applies them at the first boot. <dir>/<name>.hex is written for every line. Pass the SoftDevice and
+// bootloader as well to get complete images; the images program the UICR, so flash them after erasing the
+// chip (nrfjprog --program <name>.hex --chiperase --reset). Called by the firmware build when
+// FACTORY_IDENTITIES is set (see CMake_nRF52.cmake).
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "factory_id.h"
+#include "mac_derive.h"
+}
+
+namespace {
+
+constexpr unsigned MIN_ADV_INTERVAL_MS = 100;
+constexpr unsigned MAX_ADV_INTERVAL_MS = 10240;
+constexpr unsigned BYTES_PER_RECORD = 16;
+
+struct Options {
+    const char *out_dir = ".";
+    const char *csv = nullptr;
+    std::vector<const char *> hex_files;
+};
+
+// flash content by address, merged from all input files
+using Memory = std::map<uint32_t, uint8_t>;
+
+bool parse_hex_byte(const std::string &line, size_t pos, uint8_t &value) {
+    if (pos + 2 > line.size() || !std::isxdigit((unsigned char) line[pos]) ||
+        !std::isxdigit((unsigned char) line[pos + 1])) {
+        return false;
+    }
+    value = (uint8_t) std::strtoul(line.substr(pos, 2).c_str(), nullptr, 16);
+    return true;
+}
+
+bool store(Memory &memory, uint32_t addr, uint8_t value, const char *path) {
+    auto it = memory.find(addr);
+    if (it != memory.end() && it->second != value) {
+        std::fprintf(stderr, "%s: overlaps other data at 0x%08X\n", path, addr);
+        return false;
+    }
+    memory[addr] = value;
+    return true;
+}
+
+// Intel HEX as written by objcopy and used for the SoftDevice
+bool read_hex(const char *path, Memory &memory) {
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    std::string line;
+    size_t line_no = 0;
+    uint32_t base = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        std::vector<uint8_t> record;
+        uint8_t value;
+        for (size_t pos = 1; pos < line.size(); pos += 2) {
+            if (!parse_hex_byte(line, pos, value)) break;
+            record.push_back(value);
+        }
+        uint8_t sum = 0;
+        for (uint8_t b : record) sum += b;
+        if (line[0] != ':' || record.size() < 5 || record.size() != 5u + record[0] ||
+            2 * record.size() + 1 != line.size() || sum != 0) {
+            std::fprintf(stderr, "%s:%zu: malformed record\n", path, line_no);
+            return false;
+        }
+        uint32_t offset = (uint32_t) record[1] << 8 | record[2];
+        const uint8_t *data = &record[4];
+        switch (record[3]) {
+            case 0x00:
+                for (uint8_t i = 0; i < record[0]; i++) {
+                    if (!store(memory, base + offset + i, data[i], path)) return false;
+                }
+                break;
+            case 0x01:
+                return true;
+            case 0x02:
+                base = ((uint32_t) data[0] << 8 | data[1]) << 4;
+                break;
+            case 0x04:
+                base = ((uint32_t) data[0] << 8 | data[1]) << 16;
+                break;
+            default:
+                // start addresses, not used by the programmer
+                break;
+        }
+    }
+    std::fprintf(stderr, "%s: no end of file record\n", path);
+    return false;
+}
+
+void write_record(FILE *f, uint8_t type, uint16_t offset, const uint8_t *data, uint8_t len) {
+    uint8_t sum = (uint8_t) (len + (offset >> 8) + offset + type);
+    std::fprintf(f, ":%02X%04X%02X", len, offset, type);
+    for (uint8_t i = 0; i < len; i++) {
+        std::fprintf(f, "%02X", data[i]);
+        sum += data[i];
+    }
+    std::fprintf(f, "%02X\n", (uint8_t) -sum);
+}
+
+bool write_hex(const std::string &path, const Memory &memory) {
+    FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) {
+        std::perror(path.c_str());
+        return false;
+    }
+    uint32_t upper = UINT32_MAX;
+    auto it = memory.begin();
+    while (it != memory.end()) {
+        // contiguous bytes up to the next record boundary
+        uint32_t start = it->first;
+        uint8_t data[BYTES_PER_RECORD];
+        uint8_t len = 0;
+        while (it != memory.end() && it->first == start + len && len < BYTES_PER_RECORD &&
+               (len == 0 || (start + len) % BYTES_PER_RECORD != 0)) {
+            data[len++] = it->second;
+            ++it;
+        }
+        if (start >> 16 != upper) {
+            upper = start >> 16;
+            uint8_t ext[2] = {(uint8_t) (upper >> 8), (uint8_t) upper};
+            write_record(f, 0x04, 0, ext, 2);
+        }
+        write_record(f, 0x00, (uint16_t) start, data, len);
+    }
+    write_record(f, 0x01, 0, nullptr, 0);
+    return std::fclose(f) == 0;
+}
+
+bool parse_identity(const std::string &line, std::string &name, factory_id_t &id) {
+    std::vector<std::string> fields;
+    size_t pos = 0;
+    while (true) {
+        size_t comma = line.find(',', pos);
+        fields.push_back(line.substr(pos, comma - pos));
+        if (comma == std::string::npos) break;
+        pos = comma + 1;
+    }
+    if (fields.size() < 4 || fields.size() > 5 || fields[0].empty()) return false;
+    // the name becomes a file name
+    for (char c : fields[0]) {
+        if (!std::isalnum((unsigned char) c) && c != '-' && c != '_' && c != '.') return false;
+    }
+    name = fields[0];
+
+    std::memset(&id, 0xFF, sizeof(id));
+    std::string uuid;
+    for (char c : fields[1]) {
+        if (std::isxdigit((unsigned char) c)) uuid += c;
+        else if (c != '-') return false;
+    }
+    if (uuid.size() != 32) return false;
+    for (int i = 0; i < 16; i++) {
+        id.beacon_uuid[i] = (uint8_t) std::strtoul(uuid.substr(2 * i, 2).c_str(), nullptr, 16);
+    }
+    if (!mac_derive_parse(fields[2].c_str(), &id.major_rule, &id.beacon_major) ||
+        !mac_derive_parse(fields[3].c_str(), &id.minor_rule, &id.beacon_minor)) {
+        return false;
+    }
+    id.adv_interval_ms = 0;
+    if (fields.size() == 5) {
+        unsigned long interval = std::strtoul(fields[4].c_str(), nullptr, 10);
+        if (interval < MIN_ADV_INTERVAL_MS || interval > MAX_ADV_INTERVAL_MS) return false;
+        id.adv_interval_ms = (uint16_t) interval;
+    }
+    factory_id_seal(&id);
+    return true;
+}
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--out-dir")) {
+            if (++i >= argc) return false;
+            opt.out_dir = argv[i];
+        } else if (!opt.csv) {
+            opt.csv = argv[i];
+        } else {
+            opt.hex_files.push_back(argv[i]);
+        }
+    }
+    return opt.csv && !opt.hex_files.empty();
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--out-dir dir] <identities.csv> <firmware.hex>...\n", argv[0]);
+        return 1;
+    }
+    Memory firmware;
+    for (const char *path : opt.hex_files) {
+        if (!read_hex(path, firmware)) return 1;
+    }
+    // the UICR may already hold the bootloader address, but not another identity
+    auto uicr = firmware.lower_bound(FACTORY_ID_ADDR);
+    if (uicr != firmware.end() && uicr->first < FACTORY_ID_ADDR + sizeof(factory_id_t)) {
+        std::fprintf(stderr, "the firmware already programs the identity area at 0x%08lX\n", FACTORY_ID_ADDR);
+        return 1;
+    }
+
+    std::ifstream in(opt.csv);
+    if (!in) {
+        std::fprintf(stderr, "cannot open %s\n", opt.csv);
+        return 1;
+    }
+    std::string line;
+    size_t line_no = 0;
+    size_t count = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        std::string name;
+        factory_id_t id;
+        if (!parse_identity(line, name, id)) {
+            std::fprintf(stderr, "%s:%zu: malformed identity\n", opt.csv, line_no);
+            return 1;
+        }
+        Memory image = firmware;
+        const uint8_t *p_id = (const uint8_t *) &id;
+        for (uint32_t i = 0; i < sizeof(id); i++) image[FACTORY_ID_ADDR + i] = p_id[i];
+        if (!write_hex(std::string(opt.out_dir) + "/" + name + ".hex", image)) return 1;
+        count++;
+    }
+    std::printf("%zu factory images written to %s\n", count, opt.out_dir);
+    return count > 0 ? 0 : 1;
+}
@@ -0,0 +1,532 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Emulates devices on pseudo terminals so that host tools (e.g. provision) can be exercised without
+// hardware. Each fake device answers 'I', 'C', 'S', 'D', 'H' and 'F' like the firmware and can be told to reject
+// configurations and firmware chunks, lose responses or answer late. Baud rate changes are only simulated:
+// the rate paces the test frames of 'H T', it does not change the pseudo terminal. Flash writes of 'F' complete
+// at once, an activated image is "installed" by ignoring commands for a moment as if the device was resetting.
+//
+//   $ fake_dongle [--count n] [--error-rate p] [--drop-rate p] [--latency-ms ms] [--seed n]
+//                 [--csv devices.csv [--major value] [--minor value]]
+//
+// The paths of the pseudo terminals are printed to stdout, one per line. With --csv a device list with
+// random configurations for those paths is written, which can be passed to provision directly. --major
+// and --minor put a fixed value or a rule (see mac_derive.h) into every line instead. Runs until
+// interrupted.
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/epoll.h>
+
+extern "C" {
+#include "dfu.h"
+#include "mac_derive.h"
+#include "trace.h"
+}
+
+#include "event_loop.h"
+#include "frame.h"
+
+using namespace absniffer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+volatile std::sig_atomic_t m_stop = 0;
+
+struct Options {
+    unsigned count = 8;
+    double error_rate = 0;
+    double drop_rate = 0;
+    unsigned latency_ms = 5;
+    const char *csv = nullptr;
+    const char *major = nullptr;
+    const char *minor = nullptr;
+    unsigned seed = 1;
+};
+
+class FakeDevice {
+public:
+    FakeDevice(const Options &opt, std::mt19937_64 &rng) : opt_(opt), rng_(rng) {
+        // random static address, the two most significant bits are set
+        char mac[18];
+        for (auto &b : addr_) b = (uint8_t) rng();
+        addr_[5] |= 0xC0;
+        std::snprintf(mac, sizeof(mac), "%02X:%02X:%02X:%02X:%02X:%02X", addr_[5], addr_[4], addr_[3], addr_[2],
+                      addr_[1], addr_[0]);
+        mac_ = mac;
+        uuid_ = std::string(32, '0');
+        trace(TRACE_BOOT, 0, 0, 1);
+    }
+
+    ~FakeDevice() {
+        if (slave_fd_ >= 0) close(slave_fd_);
+        if (master_fd_ >= 0) close(master_fd_);
+    }
+
+    bool open_pty() {
+        master_fd_ = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (master_fd_ < 0 || grantpt(master_fd_) != 0 || unlockpt(master_fd_) != 0) return false;
+        const char *name = ptsname(master_fd_);
+        if (!name) return false;
+        path_ = name;
+        // keep the slave open so that the master does not see a hangup between host sessions, and
+        // switch it to raw mode before the host gets a chance to send anything
+        slave_fd_ = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (slave_fd_ < 0) return false;
+        termios tio{};
+        tcgetattr(slave_fd_, &tio);
+        cfmakeraw(&tio);
+        return tcsetattr(slave_fd_, TCSANOW, &tio) == 0;
+    }
+
+    void handle_input() {
+        char buf[256];
+        ssize_t n;
+        while ((n = read(master_fd_, buf, sizeof(buf))) > 0) {
+            rx_bytes_ += n;
+            // resetting after 'F E', the UART is not running
+            if (Clock::now() < boot_until_) {
+                line_.clear();
+                continue;
+            }
+            for (ssize_t i = 0; i < n; i++) {
+                if (buf[i] == '\n') {
+                    trace(TRACE_UART_RX_LINE, 0, (uint16_t) (line_.size() + 1), 0);
+                    handle_command(line_);
+                    line_.clear();
+                } else if (line_.size() < 256) {
+                    line_ += buf[i];
+                }
+            }
+        }
+    }
+
+    // sends responses which are due, returns when the next one is
+    Clock::time_point flush(Clock::time_point now) {
+        if (baud_pending_ && now >= baud_deadline_) {
+            baud_ = prev_baud_;
+            baud_pending_ = false;
+            trace(TRACE_UART_BAUD, 1, 0, baud_);
+        }
+        stream_test_frames(now);
+        while (!responses_.empty() && responses_.front().first <= now) {
+            const std::string &response = responses_.front().second;
+            // like the UART, output is lost when nobody reads it
+            if (write(master_fd_, response.data(), response.size()) < 0 && errno != EAGAIN) {
+                std::perror("write");
+            }
+            responses_.pop_front();
+        }
+        Clock::time_point next = responses_.empty() ? Clock::time_point::max() : responses_.front().first;
+        if (test_remaining_ > 0) next = std::min(next, test_next_);
+        if (baud_pending_) next = std::min(next, baud_deadline_);
+        return next;
+    }
+
+    int fd() const { return master_fd_; }
+    const std::string &path() const { return path_; }
+
+private:
+    void handle_command(std::string cmd) {
+        if (!cmd.empty() && cmd.back() == '\r') cmd.pop_back();
+        if (cmd.empty()) return;
+        trace(TRACE_CMD_BEGIN, (uint8_t) cmd[0], 0, 0);
+        dispatch(cmd);
+        trace(TRACE_CMD_END, (uint8_t) cmd[0], 0, 0);
+    }
+
+    void dispatch(const std::string &cmd) {
+        std::uniform_real_distribution<double> uniform(0, 1);
+        commands_++;
+        if (cmd[0] == 'I') {
+            char buf[128];
+            char major_rule[MAC_DERIVE_RULE_STR_LEN];
+            char minor_rule[MAC_DERIVE_RULE_STR_LEN];
+            mac_derive_format(&major_rule_, major_rule);
+            mac_derive_format(&minor_rule_, minor_rule);
+            // the fake dongle does not rotate its address, it advertises with the factory one
+            std::snprintf(buf, sizeof(buf), "OK V1.0.0 %s %s %u %u %s %s %s\n", mac_.c_str(), uuid_.c_str(), major_,
+                          minor_, major_rule, minor_rule, mac_.c_str());
+            respond(buf);
+        } else if (cmd[0] == 'C') {
+            char uuid[64], major_token[16], minor_token[16];
+            mac_derive_rule_t major_rule, minor_rule;
+            uint16_t major = 0, minor = 0;
+            if (std::sscanf(cmd.c_str(), "C %63s %15s %15s", uuid, major_token, minor_token) != 3 ||
+                std::strlen(uuid) != 32 || std::strspn(uuid, "0123456789abcdefABCDEF") != 32 ||
+                !mac_derive_parse(major_token, &major_rule, &major) ||
+                !mac_derive_parse(minor_token, &minor_rule, &minor)) {
+                invalid_++;
+                respond("ERR: Invalid arguments\n");
+                return;
+            }
+            if (uniform(rng_) < opt_.error_rate) {
+                respond("ERR: Configuration not accepted\n");
+                return;
+            }
+            uuid_ = uuid;
+            for (auto &c : uuid_) c = (char) std::toupper((unsigned char) c);
+            major_ = mac_derive_value(&major_rule, addr_, major);
+            minor_ = mac_derive_value(&minor_rule, addr_, minor);
+            major_rule_ = major_rule;
+            minor_rule_ = minor_rule;
+            flash_writes_++;
+            trace(TRACE_FDS_BEGIN, TRACE_FDS_UPDATE, 0, 0);
+            trace(TRACE_FDS_END, TRACE_FDS_UPDATE, 0, 0);
+            respond("OK\n");
+        } else if (cmd[0] == 'S') {
+            // a subset of the firmware's counters and a plausible histogram
+            auto uptime_us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - created_).count();
+            char buf[256];
+            std::snprintf(buf, sizeof(buf), "OK uptime_us=%lld boots_cold=%u boots_warm=0 uart_rx_bytes=%llu"
+                                            " uart_tx_bytes=%llu cmd_received=%u cmd_unknown=%u cmd_invalid=%u"
+                                            " flash_writes=%u cycles_cmd_c=%u:0,0,%u\n",
+                          (long long) uptime_us, cold_boots_, (unsigned long long) rx_bytes_,
+                          (unsigned long long) tx_bytes_, commands_, unknown_, invalid_, flash_writes_, flash_writes_ * 300, flash_writes_);
+            respond(buf);
+        } else if (cmd[0] == 'D') {
+            dump_trace(cmd);
+        } else if (cmd[0] == 'H') {
+            handle_baud(cmd);
+        } else if (cmd[0] == 'F') {
+            handle_update(cmd);
+        } else {
+            unknown_++;
+            respond("ERR: Unknown command\n");
+        }
+    }
+
+    void trace(uint8_t type, uint8_t arg8, uint16_t arg16, uint32_t arg32) {
+        auto now_us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - created_).count();
+        trace_[trace_seq_++ % TRACE_CAPACITY] = {(uint32_t) now_us, type, arg8, arg16, arg32};
+    }
+
+    void dump_trace(const std::string &cmd) {
+        uint32_t first_seq = trace_seq_ > TRACE_CAPACITY ? trace_seq_ - TRACE_CAPACITY : 0;
+        char buf[64];
+        if (cmd == "D") {
+            std::snprintf(buf, sizeof(buf), "OK %u %u 1 %u\n", first_seq, trace_seq_, TRACE_CAPACITY);
+            respond(buf);
+            return;
+        }
+        if (cmd == "D C") {
+            trace_seq_ = 0;
+            respond("OK\n");
+            return;
+        }
+        uint32_t seq = std::max(first_seq, (uint32_t) std::strtoul(cmd.c_str() + 1, nullptr, 10));
+        // little endian layout of trace_event_t
+        uint8_t payload[4 + TRACE_EVENTS_PER_FRAME * 12];
+        uint32_t count = 0;
+        for (int i = 0; i < 4; i++) payload[i] = (uint8_t) (seq >> (8 * i));
+        for (; count < TRACE_EVENTS_PER_FRAME && seq + count < trace_seq_; count++) {
+            const trace_event_t &ev = trace_[(seq + count) % TRACE_CAPACITY];
+            uint8_t *p = &payload[4 + 12 * count];
+            for (int i = 0; i < 4; i++) p[i] = (uint8_t) (ev.timestamp_us >> (8 * i));
+            p[4] = ev.type;
+            p[5] = ev.arg8;
+            p[6] = (uint8_t) ev.arg16;
+            p[7] = (uint8_t) (ev.arg16 >> 8);
+            for (int i = 0; i < 4; i++) p[8 + i] = (uint8_t) (ev.arg32 >> (8 * i));
+        }
+        std::string response;
+        append_frame(response, FRAME_TRACE, payload, (uint8_t) (4 + 12 * count));
+        std::snprintf(buf, sizeof(buf), "OK %u %u\n", seq, count);
+        respond(response + buf);
+    }
+
+    // like process_baud_command in uart_cmd.c, without RTS/CTS
+    void handle_baud(const std::string &cmd) {
+        char buf[64];
+        if (cmd == "H") {
+            std::snprintf(buf, sizeof(buf), "OK %u 0 %d %u\n", baud_, baud_pending_, test_remaining_);
+            respond(buf);
+        } else if (cmd == "H C") {
+            if (!baud_pending_) {
+                respond("ERR: Configuration not accepted\n");
+                return;
+            }
+            baud_pending_ = false;
+            respond("OK\n");
+        } else if (cmd.compare(0, 4, "H T ") == 0) {
+            if (baud_pending_) {
+                respond("ERR: Configuration not accepted\n");
+                return;
+            }
+            test_remaining_ = (uint32_t) std::strtoul(cmd.c_str() + 4, nullptr, 10);
+            test_seq_ = 0;
+            respond("OK\n");
+            // the stream starts after the response
+            test_next_ = Clock::now() + std::chrono::milliseconds(opt_.latency_ms);
+        } else {
+            char *end;
+            unsigned long baud = std::strtoul(cmd.c_str() + 1, &end, 10);
+            static const unsigned rates[] = {115200, 230400, 460800, 921600, 1000000};
+            if (*end != '\0' || std::find(std::begin(rates), std::end(rates), baud) == std::end(rates)) {
+                invalid_++;
+                respond(*end == ' ' && end[1] == 'F' && end[2] == '\0' ? "ERR: Configuration not accepted\n"
+                                                                        : "ERR: Invalid arguments\n");
+                return;
+            }
+            if (baud_pending_ || test_remaining_ > 0) {
+                respond("ERR: Configuration not accepted\n");
+                return;
+            }
+            respond("OK\n");
+            prev_baud_ = baud_;
+            baud_ = (unsigned) baud;
+            baud_pending_ = true;
+            baud_deadline_ = Clock::now() + std::chrono::milliseconds(opt_.latency_ms + 2000);
+            trace(TRACE_UART_BAUD, 0, 0, baud_);
+        }
+    }
+
+    // like process_update_command in uart_cmd.c and dfu.c, the bootloader is always present
+    void handle_update(const std::string &cmd) {
+        std::uniform_real_distribution<double> uniform(0, 1);
+        char buf[64];
+        char sub = 0;
+        unsigned long a = 0, b = 0;
+        char data[2 * DFU_CHUNK_MAX_SIZE + 2] = "";
+        int fields = std::sscanf(cmd.c_str(), "F %c %lu %lu %201s", &sub, &a, &b, data);
+        if (cmd == "F") {
+            bool idle = dfu_state_ == DFU_STATE_IDLE;
+            std::snprintf(buf, sizeof(buf), "OK %d %u %u %u 0\n", dfu_state_, dfu_descriptor_.image_size,
+                          dfu_descriptor_.image_crc, idle ? 0 : dfu_written_);
+            respond(buf);
+        } else if (sub == 'N' && fields == 3) {
+            if (a == 0 || a > DFU_BANK_SIZE) {
+                respond("ERR: Configuration not accepted\n");
+                return;
+            }
+            if (dfu_descriptor_.image_size == a && dfu_descriptor_.image_crc == b &&
+                dfu_state_ != DFU_STATE_ACTIVATED) {
+                dfu_written_ = dfu_resume_offset(dfu_bank_.data(), (uint32_t) a);
+            } else {
+                dfu_descriptor_.image_size = (uint32_t) a;
+                dfu_descriptor_.image_crc = (uint32_t) b;
+                dfu_written_ = 0;
+            }
+            dfu_erased_end_ = dfu_written_;
+            dfu_state_ = DFU_STATE_RECEIVING;
+            std::snprintf(buf, sizeof(buf), "OK %u\n", dfu_written_);
+            respond(buf);
+        } else if (sub == 'W' && fields == 4) {
+            uint8_t chunk[DFU_CHUNK_MAX_SIZE];
+            size_t len = std::strlen(data) / 2;
+            if (std::strlen(data) % 2 != 0 || len == 0 || len > sizeof(chunk)) {
+                invalid_++;
+                respond("ERR: Invalid arguments\n");
+                return;
+            }
+            for (size_t i = 0; i < len; i++) {
+                chunk[i] = (uint8_t) std::strtoul(std::string(data + 2 * i, 2).c_str(), nullptr, 16);
+            }
+            uint32_t end = (uint32_t) (a + len);
+            if (crc16_ccitt(chunk, len) != b || dfu_state_ != DFU_STATE_RECEIVING || a != dfu_written_ ||
+                end > dfu_descriptor_.image_size || uniform(rng_) < opt_.error_rate) {
+                respond("ERR: Configuration not accepted\n");
+                return;
+            }
+            for (; dfu_erased_end_ < end; dfu_erased_end_ += DFU_PAGE_SIZE) {
+                std::fill_n(dfu_bank_.begin() + dfu_erased_end_, DFU_PAGE_SIZE, 0xFF);
+            }
+            std::copy(chunk, chunk + len, dfu_bank_.begin() + a);
+            dfu_written_ = end;
+            flash_writes_++;
+            std::snprintf(buf, sizeof(buf), "OK %u\n", dfu_written_);
+            respond(buf);
+        } else if (sub == 'E' && fields == 1) {
+            if (dfu_state_ != DFU_STATE_RECEIVING || dfu_written_ != dfu_descriptor_.image_size ||
+                dfu_crc32(dfu_bank_.data(), dfu_written_, 0) != dfu_descriptor_.image_crc ||
+                !dfu_image_plausible(dfu_bank_.data(), dfu_written_)) {
+                respond("ERR: Configuration not accepted\n");
+                return;
+            }
+            respond("OK\n");
+            // reset, the bootloader copies the image and erases the descriptor
+            dfu_state_ = DFU_STATE_IDLE;
+            dfu_descriptor_ = {};
+            baud_ = 115200;
+            baud_pending_ = false;
+            boot_until_ = Clock::now() + std::chrono::milliseconds(opt_.latency_ms + 300);
+            // the configuration kept in RAM is dropped before resetting into new firmware
+            cold_boots_++;
+            trace(TRACE_BOOT, 0, 0, 1);
+        } else if (sub == 'C' && fields == 1) {
+            dfu_state_ = DFU_STATE_IDLE;
+            dfu_descriptor_ = {};
+            respond("OK\n");
+        } else {
+            invalid_++;
+            respond("ERR: Invalid arguments\n");
+        }
+    }
+
+    // test frames as sent by test_stream_fill in uart_cmd.c, paced by the simulated baud rate
+    void stream_test_frames(Clock::time_point now) {
+        while (test_remaining_ > 0 && test_next_ <= now) {
+            uint8_t payload[200];
+            uint8_t len = (uint8_t) std::max<uint32_t>(4, std::min<uint32_t>(test_remaining_, sizeof(payload)));
+            for (unsigned i = 0; i < len; i++) payload[i] = (uint8_t) (test_seq_ + i);
+            for (int i = 0; i < 4; i++) payload[i] = (uint8_t) (test_seq_ >> (8 * i));
+            std::string frame;
+            append_frame(frame, FRAME_TEST, payload, len);
+            if (write(master_fd_, frame.data(), frame.size()) < 0 && errno != EAGAIN) {
+                std::perror("write");
+            }
+            tx_bytes_ += frame.size();
+            test_seq_++;
+            test_remaining_ = test_remaining_ > len ? test_remaining_ - len : 0;
+            // 10 bits per byte on the line
+            test_next_ += std::chrono::microseconds(frame.size() * 10000000ULL / baud_);
+        }
+    }
+
+    void respond(std::string response) {
+        std::uniform_real_distribution<double> uniform(0, 1);
+        if (uniform(rng_) < opt_.drop_rate) return;
+        tx_bytes_ += response.size();
+        responses_.emplace_back(Clock::now() + std::chrono::milliseconds(opt_.latency_ms), std::move(response));
+    }
+
+    const Options &opt_;
+    std::mt19937_64 &rng_;
+    int master_fd_ = -1;
+    int slave_fd_ = -1;
+    std::string path_;
+    std::string line_;
+    uint8_t addr_[6];
+    std::string mac_;
+    std::string uuid_;
+    uint16_t major_ = 0;
+    uint16_t minor_ = 0;
+    mac_derive_rule_t major_rule_{};
+    mac_derive_rule_t minor_rule_{};
+    std::deque<std::pair<Clock::time_point, std::string>> responses_;
+    Clock::time_point created_ = Clock::now();
+    uint64_t rx_bytes_ = 0;
+    uint64_t tx_bytes_ = 0;
+    unsigned commands_ = 0;
+    unsigned unknown_ = 0;
+    unsigned invalid_ = 0;
+    unsigned flash_writes_ = 0;
+    unsigned cold_boots_ = 1;
+    unsigned baud_ = 115200;
+    unsigned prev_baud_ = 115200;
+    bool baud_pending_ = false;
+    Clock::time_point baud_deadline_;
+    uint32_t test_remaining_ = 0;
+    uint32_t test_seq_ = 0;
+    Clock::time_point test_next_;
+    trace_event_t trace_[TRACE_CAPACITY];
+    uint32_t trace_seq_ = 0;
+    dfu_state_t dfu_state_ = DFU_STATE_IDLE;
+    dfu_descriptor_t dfu_descriptor_{};
+    std::vector<uint8_t> dfu_bank_ = std::vector<uint8_t>(DFU_BANK_SIZE, 0xFF);
+    uint32_t dfu_written_ = 0;
+    uint32_t dfu_erased_end_ = 0;
+    Clock::time_point boot_until_;
+};
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) return false;
+        const char *value = argv[i + 1];
+        if (!std::strcmp(argv[i], "--count")) opt.count = (unsigned) std::atoi(value);
+        else if (!std::strcmp(argv[i], "--error-rate")) opt.error_rate = std::atof(value);
+        else if (!std::strcmp(argv[i], "--drop-rate")) opt.drop_rate = std::atof(value);
+        else if (!std::strcmp(argv[i], "--latency-ms")) opt.latency_ms = (unsigned) std::atoi(value);
+        else if (!std::strcmp(argv[i], "--csv")) opt.csv = value;
+        else if (!std::strcmp(argv[i], "--major")) opt.major = value;
+        else if (!std::strcmp(argv[i], "--minor")) opt.minor = value;
+        else if (!std::strcmp(argv[i], "--seed")) opt.seed = (unsigned) std::atoi(value);
+        else return false;
+        i++;
+    }
+    return opt.count > 0;
+}
+
+bool write_csv(const Options &opt, const std::vector<std::unique_ptr<FakeDevice>> &devices, std::mt19937_64 &rng) {
+    FILE *f = std::fopen(opt.csv, "w");
+    if (!f) {
+        std::perror(opt.csv);
+        return false;
+    }
+    for (const auto &device : devices) {
+        std::string major = opt.major ? opt.major : std::to_string(rng() & 0xFFFF);
+        std::string minor = opt.minor ? opt.minor : std::to_string(rng() & 0xFFFF);
+        std::fprintf(f, "%s,%016llX%016llX,%s,%s\n", device->path().c_str(), (unsigned long long) rng(),
+                     (unsigned long long) rng(), major.c_str(), minor.c_str());
+    }
+    std::fclose(f);
+    return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--count n] [--error-rate p] [--drop-rate p] [--latency-ms ms] [--seed n]"
+                             " [--csv devices.csv [--major value] [--minor value]]\n", argv[0]);
+        return 1;
+    }
+    std::signal(SIGINT, [](int) { m_stop = 1; });
+    std::signal(SIGTERM, [](int) { m_stop = 1; });
+
+    std::mt19937_64 rng(opt.seed);
+    EventLoop loop;
+    std::vector<std::unique_ptr<FakeDevice>> devices;
+    for (unsigned i = 0; i < opt.count; i++) {
+        auto device = std::make_unique<FakeDevice>(opt, rng);
+        if (!device->open_pty()) {
+            std::perror("pty");
+            return 1;
+        }
+        FakeDevice *p = device.get();
+        loop.add(p->fd(), EPOLLIN, [p](uint32_t) { p->handle_input(); });
+        std::printf("%s\n", p->path().c_str());
+        devices.push_back(std::move(device));
+    }
+    std::fflush(stdout);
+    if (opt.csv && !write_csv(opt, devices, rng)) return 1;
+
+    while (!m_stop) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point wake = now + std::chrono::milliseconds(100);
+        for (auto &device : devices) wake = std::min(wake, device->flush(now));
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count();
+        loop.poll((int) std::max<long long>(0, timeout));
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the throughput of StreamParser on a synthetic device output which mixes text responses
+// and compressed scan report frames, with and without decoding into typed views.
+//
+//   $ parse_bench [--megabytes 64] [--rounds 5]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "scan_report.h"
+}
+
+#include "frame.h"
+#include "scan_report_decoder.h"
+#include "stream_parser.h"
+
+namespace {
+
+std::vector<uint8_t> *g_output;
+
+void append_frame(uint8_t type, const uint8_t *payload, size_t len) {
+    uint8_t header[2] = {type, (uint8_t) len};
+    uint16_t crc = absniffer::crc16_ccitt(header, 2);
+    crc = absniffer::crc16_ccitt(payload, len, crc);
+    g_output->push_back(absniffer::FRAME_SYNC);
+    g_output->insert(g_output->end(), header, header + 2);
+    g_output->insert(g_output->end(), payload, payload + len);
+    g_output->push_back((uint8_t) crc);
+    g_output->push_back((uint8_t) (crc >> 8));
+}
+
+void scan_report_write(const uint8_t *p_payload, uint16_t len) {
+    append_frame(absniffer::FRAME_SCAN_REPORT, p_payload, len);
+}
+
+void append_text(const std::string &s) {
+    g_output->insert(g_output->end(), s.begin(), s.end());
+}
+
+std::vector<uint8_t> generate(size_t target_bytes) {
+    std::vector<uint8_t> out;
+    out.reserve(target_bytes + 1024);
+    g_output = &out;
+    std::mt19937 rng(1);
+
+    static scan_report_encoder_t encoder;
+    scan_report_init(&encoder, scan_report_write);
+    scan_record_t rec{};
+    uint64_t t = 1700000000ULL * 1000000ULL;
+
+    while (out.size() < target_bytes) {
+        switch (rng() % 8) {
+            case 0:
+                append_text("OK V1.0.0 ED:CB:9C:B8:60:4E CCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCC " +
+                            std::to_string(rng() % 65536) + " " + std::to_string(rng() % 65536) + "\n");
+                break;
+            case 1:
+                append_text("OK 100 1000 50 5821 17 582 " + std::to_string(rng()) + "\n");
+                break;
+            case 2:
+                append_text(rng() % 2 ? "ERR: Unknown command\n" : "OK\n");
+                break;
+            default:
+                // a burst of scan records
+                for (int i = 0; i < 20; i++) {
+                    unsigned device = rng() % 60;
+                    std::memset(rec.addr, 0, 6);
+                    rec.addr[0] = (uint8_t) device;
+                    rec.is_ibeacon = device < 40;
+                    std::memset(rec.uuid, 0xAA + (device % 3), 16);
+                    rec.minor = (uint16_t) device;
+                    rec.rssi = (int8_t) (-60 - (int) (rng() % 8));
+                    t += 1000 + rng() % 5000;
+                    rec.timestamp_us = t;
+                    scan_report_add(&encoder, &rec);
+                }
+                break;
+        }
+    }
+    scan_report_flush(&encoder);
+    return out;
+}
+
+template<typename F>
+double measure(const std::vector<uint8_t> &data, int rounds, F &&body) {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) body();
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return (double) data.size() * rounds / s / 1e6;
+}
+
+}
+
+int main(int argc, char **argv) {
+    size_t megabytes = 64;
+    int rounds = 5;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--megabytes")) megabytes = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--rounds")) rounds = std::atoi(argv[i + 1]);
+    }
+    if (megabytes == 0 || rounds <= 0) {
+        std::fprintf(stderr, "usage: %s [--megabytes n] [--rounds n]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> data = generate(megabytes << 20);
+    uint64_t messages = 0, frames = 0, infos = 0, records = 0;
+
+    // framing only: split into messages, nothing is copied
+    double split = measure(data, rounds, [&] {
+        absniffer::StreamParser parser;
+        parser.parse(data.data(), data.size(), [&](const absniffer::Message &msg) {
+            messages++;
+            frames += msg.type == absniffer::Message::Type::Frame;
+        });
+    });
+
+    // typed views for text responses
+    double typed = measure(data, rounds, [&] {
+        absniffer::StreamParser parser;
+        parser.parse(data.data(), data.size(), [&](const absniffer::Message &msg) {
+            absniffer::InfoView info;
+            if (msg.type == absniffer::Message::Type::Ok && absniffer::parse_info(msg.text, info)) infos++;
+        });
+    });
+
+    // full decoding, including the scan report decompression
+    std::vector<absniffer::ScanRecord> decoded;
+    double full = measure(data, rounds, [&] {
+        absniffer::StreamParser parser;
+        absniffer::ScanReportDecoder decoder;
+        parser.parse(data.data(), data.size(), [&](const absniffer::Message &msg) {
+            if (msg.type == absniffer::Message::Type::Frame && msg.frame.type == absniffer::FRAME_SCAN_REPORT) {
+                decoder.decode(msg.frame.payload, msg.frame.length, decoded);
+                records += decoded.size();
+                decoded.clear();
+            }
+        });
+    });
+
+    std::printf("input              %.1f MB, %llu messages (%llu frames) per round\n", data.size() / 1e6,
+                (unsigned long long) (messages / rounds), (unsigned long long) (frames / rounds));
+    std::printf("split messages     %.0f MB/s\n", split);
+    std::printf("+ typed info view  %.0f MB/s (%llu info responses)\n", typed, (unsigned long long) (infos / rounds));
+    std::printf("+ scan decoding    %.0f MB/s (%llu records)\n", full, (unsigned long long) (records / rounds));
+    return 0;
+}
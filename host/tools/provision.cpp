@@ -0,0 +1,343 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Provisions many devices in parallel: applies an iBeacon configuration to each device with 'C', reads
+// it back with 'I' and retries devices that answer with an error, time out or report a different
+// configuration.
+//
+//   $ provision [--retries n] [--timeout-ms ms] [--parallel n] [--baud rate] <devices.csv>
+//
+// The CSV has one device per line: <serial port>,<proximity UUID as hex>,<major>,<minor>. Major and minor
+// may be rules deriving them from the device address (see mac_derive.h), so the same template can be
+// used for all devices of a batch; they are verified against the address reported by 'I'. All ports are
+// driven from a single epoll loop, so the run time is dominated by the slowest device rather than
+// by the number of devices. Use fake_dongle to try it without hardware.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+extern "C" {
+#include "mac_derive.h"
+}
+
+#include "device_connection.h"
+#include "event_loop.h"
+#include "stream_parser.h"
+
+using namespace absniffer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    unsigned retries = 3;
+    unsigned timeout_ms = 2000;
+    unsigned parallel = 0;      // 0: all devices at once
+    unsigned baud_rate = 115200;
+    const char *csv = nullptr;
+};
+
+struct DeviceConfig {
+    std::string port;
+    std::string uuid;           // 32 upper case hex digits, as printed by 'I'
+    std::string major_token;    // as sent with 'C'
+    std::string minor_token;
+    mac_derive_rule_t major_rule;
+    mac_derive_rule_t minor_rule;
+    uint16_t major;             // fixed values
+    uint16_t minor;
+};
+
+bool parse_mac(std::string_view str, uint8_t *addr) {
+    if (str.size() != 17) return false;
+    for (int i = 0; i < 6; i++) {
+        unsigned value;
+        if (std::sscanf(std::string(str.substr(3 * i, 2)).c_str(), "%2x", &value) != 1) return false;
+        addr[5 - i] = (uint8_t) value;
+    }
+    return true;
+}
+
+class Device {
+public:
+    enum class State { Pending, Configuring, Verifying, Backoff, Done, Failed };
+
+    Device(EventLoop &loop, DeviceConfig config, const Options &opt)
+            : config_(std::move(config)), opt_(opt), conn_(loop) {
+        conn_.on_message([this](const Message &msg) { handle_message(msg); });
+        conn_.on_error([this](const std::string &error) { retry("port error: " + error); });
+    }
+
+    void start(Clock::time_point now) {
+        started_ = now;
+        attempt(now);
+    }
+
+    // drives timeouts and backoff, returns the next point in time this device needs attention
+    Clock::time_point poll(Clock::time_point now) {
+        if (state_ == State::Configuring || state_ == State::Verifying || state_ == State::Backoff) {
+            if (now >= deadline_) {
+                if (state_ == State::Backoff) {
+                    attempt(now);
+                } else {
+                    retry(state_ == State::Configuring ? "timeout waiting for 'C'" : "timeout waiting for 'I'");
+                }
+            }
+        }
+        return is_active() ? deadline_ : Clock::time_point::max();
+    }
+
+    bool is_active() const { return state_ != State::Pending && !is_finished(); }
+    bool is_finished() const { return state_ == State::Done || state_ == State::Failed; }
+    bool succeeded() const { return state_ == State::Done; }
+
+    const DeviceConfig &config() const { return config_; }
+    unsigned attempts() const { return attempts_; }
+    const std::string &last_error() const { return last_error_; }
+    double duration_ms() const { return std::chrono::duration<double, std::milli>(finished_ - started_).count(); }
+    uint64_t bytes_sent() const { return conn_.bytes_sent(); }
+    uint64_t bytes_received() const { return conn_.bytes_received(); }
+
+private:
+    void attempt(Clock::time_point now) {
+        attempts_++;
+        if (!conn_.is_open()) {
+            if (!conn_.open(config_.port, opt_.baud_rate)) {
+                retry("cannot open port: " + conn_.error());
+                return;
+            }
+        }
+        char cmd[64];
+        std::snprintf(cmd, sizeof(cmd), "C %s %s %s", config_.uuid.c_str(), config_.major_token.c_str(),
+                      config_.minor_token.c_str());
+        state_ = State::Configuring;
+        deadline_ = now + std::chrono::milliseconds(opt_.timeout_ms);
+        conn_.send(cmd);
+    }
+
+    void handle_message(const Message &msg) {
+        if (msg.type == Message::Type::Frame || msg.type == Message::Type::Other) return;
+        if (msg.type == Message::Type::Error) {
+            retry("device error: " + std::string(msg.text));
+            return;
+        }
+        Clock::time_point now = Clock::now();
+        if (state_ == State::Configuring) {
+            state_ = State::Verifying;
+            deadline_ = now + std::chrono::milliseconds(opt_.timeout_ms);
+            conn_.send("I");
+        } else if (state_ == State::Verifying) {
+            InfoView info;
+            if (!parse_info(msg.text, info)) {
+                retry("malformed 'I' response");
+            } else if (!verify(info)) {
+                retry("read back " + std::string(info.uuid) + " " + std::to_string(info.major) + " " +
+                      std::to_string(info.minor));
+            } else {
+                finish(State::Done, now);
+            }
+        }
+    }
+
+    bool verify(const InfoView &info) const {
+        uint8_t addr[6];
+        if (!parse_mac(info.mac, addr)) return false;
+        if (info.major != mac_derive_value(&config_.major_rule, addr, config_.major)) return false;
+        if (info.minor != mac_derive_value(&config_.minor_rule, addr, config_.minor)) return false;
+        // older firmware does not report rules and cannot derive values
+        char rule[MAC_DERIVE_RULE_STR_LEN];
+        mac_derive_format(&config_.major_rule, rule);
+        if (!info.major_rule.empty() && info.major_rule != rule) return false;
+        mac_derive_format(&config_.minor_rule, rule);
+        if (!info.minor_rule.empty() && info.minor_rule != rule) return false;
+        if (info.uuid.size() != config_.uuid.size()) return false;
+        for (size_t i = 0; i < info.uuid.size(); i++) {
+            if (std::toupper((unsigned char) info.uuid[i]) != config_.uuid[i]) return false;
+        }
+        return true;
+    }
+
+    void retry(const std::string &error) {
+        Clock::time_point now = Clock::now();
+        last_error_ = error;
+        if (attempts_ > opt_.retries) {
+            finish(State::Failed, now);
+            return;
+        }
+        // back off a little, a port error usually means the device is re-enumerating
+        state_ = State::Backoff;
+        deadline_ = now + std::chrono::milliseconds(50 * attempts_);
+    }
+
+    void finish(State state, Clock::time_point now) {
+        state_ = state;
+        finished_ = now;
+        conn_.close();
+    }
+
+    DeviceConfig config_;
+    const Options &opt_;
+    DeviceConnection conn_;
+    State state_ = State::Pending;
+    unsigned attempts_ = 0;
+    std::string last_error_;
+    Clock::time_point started_;
+    Clock::time_point finished_;
+    Clock::time_point deadline_;
+};
+
+bool parse_device(const std::string &line, DeviceConfig &config) {
+    size_t comma = line.find(',');
+    if (comma == std::string::npos || comma == 0) return false;
+    config.port = line.substr(0, comma);
+    size_t pos = comma + 1;
+    config.uuid.clear();
+    for (; pos < line.size() && line[pos] != ','; pos++) {
+        if (std::isxdigit((unsigned char) line[pos])) config.uuid += (char) std::toupper((unsigned char) line[pos]);
+    }
+    if (config.uuid.size() != 32 || pos >= line.size()) return false;
+    size_t comma2 = line.find(',', pos + 1);
+    if (comma2 == std::string::npos) return false;
+    config.major_token = line.substr(pos + 1, comma2 - pos - 1);
+    config.minor_token = line.substr(comma2 + 1);
+    return mac_derive_parse(config.major_token.c_str(), &config.major_rule, &config.major) &&
+           mac_derive_parse(config.minor_token.c_str(), &config.minor_rule, &config.minor);
+}
+
+bool read_devices(const char *path, std::vector<DeviceConfig> &configs) {
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        DeviceConfig config;
+        if (!parse_device(line, config)) {
+            std::fprintf(stderr, "%s:%zu: malformed device\n", path, line_no);
+            return false;
+        }
+        configs.push_back(std::move(config));
+    }
+    if (configs.empty()) {
+        std::fprintf(stderr, "no devices\n");
+        return false;
+    }
+    return true;
+}
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || argv[i][1] != '-') {
+            if (opt.csv) return false;
+            opt.csv = argv[i];
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        unsigned value = (unsigned) std::strtoul(argv[i + 1], nullptr, 10);
+        if (!std::strcmp(argv[i], "--retries")) opt.retries = value;
+        else if (!std::strcmp(argv[i], "--timeout-ms")) opt.timeout_ms = value;
+        else if (!std::strcmp(argv[i], "--parallel")) opt.parallel = value;
+        else if (!std::strcmp(argv[i], "--baud")) opt.baud_rate = value;
+        else return false;
+        i++;
+    }
+    return opt.csv && opt.timeout_ms > 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--retries n] [--timeout-ms ms] [--parallel n] [--baud rate] <devices.csv>\n",
+                     argv[0]);
+        return 1;
+    }
+    std::vector<DeviceConfig> configs;
+    if (!read_devices(opt.csv, configs)) return 1;
+
+    EventLoop loop;
+    std::vector<std::unique_ptr<Device>> devices;
+    for (auto &config : configs) devices.push_back(std::make_unique<Device>(loop, std::move(config), opt));
+    size_t parallel = opt.parallel ? opt.parallel : devices.size();
+
+    Clock::time_point t0 = Clock::now();
+    size_t next = 0;
+    size_t active = 0;
+    while (true) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point wake = Clock::time_point::max();
+        active = 0;
+        for (auto &device : devices) {
+            wake = std::min(wake, device->poll(now));
+            active += device->is_active();
+        }
+        while (active < parallel && next < devices.size()) {
+            devices[next]->start(now);
+            wake = std::min(wake, devices[next]->poll(now));
+            active += devices[next]->is_active();
+            next++;
+        }
+        if (active == 0 && next == devices.size()) break;
+
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wake - Clock::now()).count() + 1;
+        if (loop.poll((int) std::max<long long>(0, std::min<long long>(timeout, 1000))) < 0) {
+            std::perror("epoll_wait");
+            return 1;
+        }
+    }
+    double wall_s = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    size_t succeeded = 0;
+    uint64_t bytes_sent = 0;
+    uint64_t bytes_received = 0;
+    std::vector<double> durations;
+    std::printf("%-24s %-6s %8s %10s %8s %8s %10s  %s\n", "port", "result", "attempts", "time [ms]", "tx [B]",
+                "rx [B]", "rx [B/s]", "last error");
+    for (const auto &device : devices) {
+        double ms = device->duration_ms();
+        std::printf("%-24s %-6s %8u %10.1f %8llu %8llu %10.0f  %s\n", device->config().port.c_str(),
+                    device->succeeded() ? "ok" : "FAILED", device->attempts(), ms,
+                    (unsigned long long) device->bytes_sent(), (unsigned long long) device->bytes_received(),
+                    ms > 0 ? device->bytes_received() * 1000.0 / ms : 0.0, device->last_error().c_str());
+        succeeded += device->succeeded();
+        bytes_sent += device->bytes_sent();
+        bytes_received += device->bytes_received();
+        durations.push_back(ms);
+    }
+    std::sort(durations.begin(), durations.end());
+    std::printf("\ndevices            %zu ok, %zu failed\n", succeeded, devices.size() - succeeded);
+    std::printf("wall time          %.3f s (%.1f devices/s)\n", wall_s, devices.size() / wall_s);
+    std::printf("per device         median %.1f ms, max %.1f ms\n", durations[durations.size() / 2],
+                durations.back());
+    std::printf("traffic            %llu B sent, %llu B received (%.0f B/s aggregate)\n",
+                (unsigned long long) bytes_sent, (unsigned long long) bytes_received,
+                (bytes_sent + bytes_received) / wall_s);
+    return succeeded == devices.size() ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Generates the SoftDevice radio notifications for an advertising and scanning schedule and feeds them
+// to the firmware's radio accounting. Reports the accounted radio on-time, event counts and charge
+// against the simulated truth. The TX power changes halfway through, like at the start of a schedule
+// window. Exits with 1 if an error exceeds the tolerance.
+//
+//   $ radio_sim --duration 3600 --adv-interval 100 --scan-interval 1000 --scan-window 50 --miss-rate 0.001
+//               --tx-power -16 --tx-power-later 0
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+extern "C" {
+#include "radio_accounting.h"
+}
+
+namespace {
+
+struct Options {
+    double duration_s = 3600;
+    double adv_interval_ms = 100;
+    double scan_interval_ms = 1000;
+    double scan_window_ms = 50;     // 0 disables scanning
+    double adv_event_us = 1200;     // three non-connectable PDUs including ramp up
+    double irq_latency_us = 50;     // delivery delay of the notification interrupt, uniform
+    double miss_rate = 0;           // probability of a lost notification
+    double tolerance = 0.01;        // relative error accepted for the on-time and charge
+    int tx_power = -16;             // dBm, TX_POWER in main.c
+    int tx_power_later = 0;         // from half of the duration on
+    unsigned seed = 1;
+};
+
+struct Truth {
+    uint64_t active_us[RADIO_MODE_COUNT] = {};
+    uint32_t events[RADIO_MODE_COUNT] = {};
+    uint32_t adv_skipped = 0;
+};
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) return false;
+        double value = std::atof(argv[i + 1]);
+        if (!std::strcmp(argv[i], "--duration")) opt.duration_s = value;
+        else if (!std::strcmp(argv[i], "--adv-interval")) opt.adv_interval_ms = value;
+        else if (!std::strcmp(argv[i], "--scan-interval")) opt.scan_interval_ms = value;
+        else if (!std::strcmp(argv[i], "--scan-window")) opt.scan_window_ms = value;
+        else if (!std::strcmp(argv[i], "--adv-event-us")) opt.adv_event_us = value;
+        else if (!std::strcmp(argv[i], "--irq-latency-us")) opt.irq_latency_us = value;
+        else if (!std::strcmp(argv[i], "--miss-rate")) opt.miss_rate = value;
+        else if (!std::strcmp(argv[i], "--tolerance")) opt.tolerance = value;
+        else if (!std::strcmp(argv[i], "--tx-power")) opt.tx_power = (int) value;
+        else if (!std::strcmp(argv[i], "--tx-power-later")) opt.tx_power_later = (int) value;
+        else if (!std::strcmp(argv[i], "--seed")) opt.seed = (unsigned) value;
+        else return false;
+        i++;
+    }
+    return opt.duration_s > 0 && opt.adv_interval_ms >= 20 && opt.adv_event_us > 0 &&
+           (opt.scan_window_ms == 0 || (opt.scan_window_ms * 1000 >= RADIO_ACCOUNTING_ADV_EVENT_MAX_US &&
+                                        opt.scan_window_ms <= opt.scan_interval_ms));
+}
+
+double relative_error(double value, double truth) {
+    return truth == 0 ? (value == 0 ? 0 : 1) : std::fabs(value - truth) / truth;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--duration s] [--adv-interval ms] [--scan-interval ms] [--scan-window ms]"
+                             " [--adv-event-us us] [--irq-latency-us us] [--miss-rate p] [--tolerance r]"
+                             " [--tx-power dBm] [--tx-power-later dBm] [--seed n]\n",
+                     argv[0]);
+        return 1;
+    }
+
+    std::mt19937_64 rng(opt.seed);
+    // the advertiser adds a pseudo-random delay of 0-10 ms to every interval
+    std::uniform_real_distribution<double> adv_delay(0, 10000);
+    std::uniform_real_distribution<double> adv_length(0.9 * opt.adv_event_us, 1.1 * opt.adv_event_us);
+    std::uniform_real_distribution<double> latency(0, opt.irq_latency_us);
+    std::bernoulli_distribution missed(opt.miss_rate);
+
+    // any non-zero start, 0 marks an idle radio in the accounting
+    const double start_us = 1000000;
+    const double end_us = start_us + opt.duration_s * 1e6;
+    const double scan_interval_us = opt.scan_interval_ms * 1000;
+    const double scan_window_us = opt.scan_window_ms * 1000;
+
+    radio_accounting_t acc = {};
+    radio_accounting_reset(&acc, (uint64_t) start_us);
+    radio_accounting_set_tx_power(&acc, (int8_t) opt.tx_power);
+    Truth truth;
+    double truth_charge_pc = 0;
+    uint32_t tx_current_ua = radio_accounting_tx_current_ua((int8_t) opt.tx_power);
+    bool tx_power_changed = false;
+
+    auto notify = [&](bool active, double t_us) {
+        if (!missed(rng)) radio_accounting_notify(&acc, active, (uint64_t) (t_us + latency(rng)));
+    };
+    auto radio_event = [&](radio_mode_t mode, double begin_us, double end_event_us) {
+        notify(true, begin_us - RADIO_ACCOUNTING_NOTIFICATION_DISTANCE_US);
+        notify(false, end_event_us);
+        truth.active_us[mode] += (uint64_t) std::llround(end_event_us - begin_us);
+        truth.events[mode]++;
+        truth_charge_pc += (end_event_us - begin_us) *
+                           (mode == RADIO_MODE_ADV ? tx_current_ua : RADIO_ACCOUNTING_RX_CURRENT_UA);
+    };
+
+    double next_adv = start_us;
+    double next_scan = scan_window_us > 0 ? start_us + scan_interval_us / 2 : end_us;
+    while (std::min(next_adv, next_scan) < end_us) {
+        // main.c changes the TX power while advertising is stopped
+        if (!tx_power_changed && std::min(next_adv, next_scan) >= (start_us + end_us) / 2) {
+            tx_power_changed = true;
+            tx_current_ua = radio_accounting_tx_current_ua((int8_t) opt.tx_power_later);
+            radio_accounting_set_tx_power(&acc, (int8_t) opt.tx_power_later);
+        }
+        if (next_scan <= next_adv) {
+            radio_event(RADIO_MODE_SCAN, next_scan, next_scan + scan_window_us);
+            next_scan += scan_interval_us;
+            continue;
+        }
+        double length = adv_length(rng);
+        // events overlapping a scan window (including its notification) are skipped by the scheduler
+        double scan_begin = next_scan - RADIO_ACCOUNTING_NOTIFICATION_DISTANCE_US - opt.irq_latency_us;
+        if (scan_window_us > 0 && next_adv + length >= scan_begin) {
+            truth.adv_skipped++;
+        } else {
+            radio_event(RADIO_MODE_ADV, next_adv, next_adv + length);
+        }
+        next_adv += opt.adv_interval_ms * 1000 + adv_delay(rng);
+    }
+
+    const char *mode_names[RADIO_MODE_COUNT] = {"advertising", "scanning"};
+    bool ok = true;
+    std::printf("%-12s %10s %10s %14s %14s %8s\n", "mode", "events", "truth", "on-time us", "truth us", "error");
+    for (int mode = 0; mode < RADIO_MODE_COUNT; mode++) {
+        double error = relative_error((double) acc.active_us[mode], (double) truth.active_us[mode]);
+        std::printf("%-12s %10u %10u %14llu %14llu %7.3f%%\n", mode_names[mode], acc.events[mode], truth.events[mode],
+                    (unsigned long long) acc.active_us[mode], (unsigned long long) truth.active_us[mode],
+                    error * 100);
+        ok = ok && error <= opt.tolerance;
+    }
+    uint64_t charge_uc = radio_accounting_charge_uc(&acc);
+    double charge_error = relative_error((double) charge_uc, truth_charge_pc / 1e6);
+    uint32_t average_ua = radio_accounting_average_ua(&acc, (uint64_t) end_us);
+    ok = ok && charge_error <= opt.tolerance;
+
+    std::printf("skipped adv  %u\n", truth.adv_skipped);
+    std::printf("unpaired     %u notifications\n", acc.unpaired);
+    std::printf("charge       %llu uC, truth %.0f uC (%.3f%%)\n", (unsigned long long) charge_uc,
+                truth_charge_pc / 1e6, charge_error * 100);
+    std::printf("average      %u uA, truth %.1f uA\n", average_ua, truth_charge_pc / (end_us - start_us));
+    std::printf("result       %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
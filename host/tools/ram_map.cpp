@@ -0,0 +1,222 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Reports the static RAM per module (object file or library) from the GNU ld map file of the firmware,
+// and optionally writes it as the table the firmware reports with 'M R' (see ram_map.h).
+//
+//   $ ram_map [--blob <file>] <firmware.map>
+//
+// Only input sections within the RAM region of the map's memory configuration are counted, the stack
+// and heap are listed as "(stack)" and "(heap)", alignment padding as "(fill)". Called by the firmware
+// build when RAM_MAP is set, which stores the blob in the .ram_map section (see CMake_nRF52.cmake).
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "ram_map.h"
+}
+
+namespace {
+
+struct Options {
+    const char *blob = nullptr;
+    const char *map = nullptr;
+};
+
+bool parse_hex(const std::string &s, uint32_t &value) {
+    if (s.size() < 3 || s.compare(0, 2, "0x") != 0) return false;
+    char *end;
+    unsigned long long v = std::strtoull(s.c_str() + 2, &end, 16);
+    if (*end != 0 || v > UINT32_MAX) return false;
+    value = (uint32_t) v;
+    return true;
+}
+
+std::vector<std::string> split(const std::string &line) {
+    std::istringstream in(line);
+    std::vector<std::string> tokens;
+    std::string token;
+    while (in >> token) tokens.push_back(token);
+    return tokens;
+}
+
+// "CMakeFiles/x.dir/main.c.obj" -> "main.c", "/path/libc_nano.a(lib_a-memcpy.o)" -> "libc_nano.a"
+std::string module_name(const std::string &file) {
+    std::string name = file;
+    size_t paren = name.find('(');
+    if (paren != std::string::npos) name.erase(paren);
+    size_t slash = name.find_last_of("/\\");
+    if (slash != std::string::npos) name.erase(0, slash + 1);
+    for (const char *suffix : {".obj", ".o"}) {
+        size_t len = std::strlen(suffix);
+        if (name.size() > len && name.compare(name.size() - len, len, suffix) == 0) {
+            name.erase(name.size() - len);
+            break;
+        }
+    }
+    return name;
+}
+
+std::string classify(const std::string &section, const std::string &file) {
+    if (section == "*fill*") return "(fill)";
+    if (section.compare(0, 6, ".stack") == 0) return "(stack)";
+    if (section.compare(0, 5, ".heap") == 0) return "(heap)";
+    return file.empty() ? "(linker)" : module_name(file);
+}
+
+bool read_map(const char *path, std::map<std::string, uint32_t> &modules) {
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    enum { PREAMBLE, MEMORY, SECTIONS } part = PREAMBLE;
+    uint32_t ram_start = 0;
+    uint32_t ram_end = 0;
+    std::string pending;        // input section name on a line of its own, the numbers follow on the next
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line == "Memory Configuration") {
+            part = MEMORY;
+            continue;
+        }
+        if (line == "Linker script and memory map") {
+            if (ram_end == 0) {
+                std::fprintf(stderr, "%s: no RAM region in the memory configuration\n", path);
+                return false;
+            }
+            part = SECTIONS;
+            continue;
+        }
+        std::vector<std::string> tokens = split(line);
+        if (part == MEMORY) {
+            uint32_t origin, length;
+            if (tokens.size() >= 3 && tokens[0] == "RAM" && parse_hex(tokens[1], origin) &&
+                parse_hex(tokens[2], length)) {
+                ram_start = origin;
+                ram_end = origin + length;
+            }
+            continue;
+        }
+        if (part != SECTIONS || tokens.empty()) continue;
+
+        // input sections are indented by one space, their continuation and symbols by more,
+        // output sections and script statements are not
+        if (line[0] != ' ') {
+            pending.clear();
+            continue;
+        }
+        std::string section;
+        size_t first = 0;
+        if (line[1] != ' ') {
+            section = tokens[0];
+            if (section.compare(0, 2, "*(") == 0 || section.find("(*") != std::string::npos) {
+                pending.clear();
+                continue;
+            }
+            if (tokens.size() == 1) {
+                pending = section;
+                continue;
+            }
+            first = 1;
+        } else {
+            if (pending.empty()) continue;
+            section = pending;
+        }
+        pending.clear();
+        uint32_t addr, size;
+        if (tokens.size() < first + 2 || !parse_hex(tokens[first], addr) || !parse_hex(tokens[first + 1], size)) {
+            continue;
+        }
+        if (size == 0 || addr < ram_start || addr >= ram_end) continue;
+        std::string file = tokens.size() > first + 2 ? tokens[first + 2] : "";
+        modules[classify(section, file)] += size;
+    }
+    if (part != SECTIONS) {
+        std::fprintf(stderr, "%s: not a linker map\n", path);
+        return false;
+    }
+    return true;
+}
+
+void build_table(const std::map<std::string, uint32_t> &modules, ram_map_t &table) {
+    std::vector<std::pair<std::string, uint32_t>> sorted(modules.begin(), modules.end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const auto &a, const auto &b) { return a.second > b.second; });
+    std::memset(&table, 0, sizeof(table));
+    table.magic = RAM_MAP_MAGIC;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        table.total_bytes += sorted[i].second;
+        size_t index = std::min(i, (size_t) RAM_MAP_MAX_ENTRIES - 1);
+        bool other = sorted.size() > RAM_MAP_MAX_ENTRIES && index == RAM_MAP_MAX_ENTRIES - 1;
+        const std::string &name = other ? "(other)" : sorted[i].first;
+        std::strncpy(table.entries[index].name, name.c_str(), RAM_MAP_NAME_LEN - 1);
+        table.entries[index].bytes += sorted[i].second;
+        table.count = (uint16_t) (index + 1);
+    }
+}
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--blob")) {
+            if (++i >= argc) return false;
+            opt.blob = argv[i];
+        } else if (!opt.map) {
+            opt.map = argv[i];
+        } else {
+            return false;
+        }
+    }
+    return opt.map != nullptr;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--blob <file>] <firmware.map>\n", argv[0]);
+        return 1;
+    }
+    std::map<std::string, uint32_t> modules;
+    if (!read_map(opt.map, modules)) return 1;
+
+    ram_map_t table;
+    build_table(modules, table);
+    for (uint16_t i = 0; i < table.count; i++) {
+        std::printf("%-24s %8u\n", table.entries[i].name, table.entries[i].bytes);
+    }
+    std::printf("%-24s %8u\n", "total", table.total_bytes);
+
+    if (opt.blob) {
+        // the host and the firmware are both little endian and lay out the table the same way
+        FILE *f = std::fopen(opt.blob, "wb");
+        if (!f || std::fwrite(&table, sizeof(table), 1, f) != 1 || std::fclose(f) != 0) {
+            std::perror(opt.blob);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks the scan report compression (scan_report.c) on a synthetic but realistic scan stream:
+// a number of fixed iBeacons sharing a few proximity UUIDs, plus phones and other devices with
+// rotating random addresses. Every encoded frame is decoded again and checked against the input.
+//
+//   $ scan_report_bench --beacons 40 --others 15 --duration 120
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "scan_report.h"
+}
+
+#include "frame.h"
+#include "scan_report_decoder.h"
+
+namespace {
+
+struct Options {
+    int beacons = 40;
+    int uuids = 3;
+    int others = 15;
+    double duration_s = 120;
+    double reception = 0.7;         // probability that an advertising event is received
+    unsigned seed = 1;
+};
+
+struct Device {
+    scan_record_t record;
+    double interval_s;
+    double next_s;
+    double rotate_s;                // address rotation period, 0 for fixed addresses
+    double next_rotation_s;
+};
+
+std::vector<std::vector<uint8_t>> g_frames;
+
+void collect_frame(const uint8_t *p_payload, uint16_t len) {
+    g_frames.emplace_back(p_payload, p_payload + len);
+}
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        double value = std::atof(argv[i + 1]);
+        if (!std::strcmp(argv[i], "--beacons")) opt.beacons = (int) value;
+        else if (!std::strcmp(argv[i], "--uuids")) opt.uuids = (int) value;
+        else if (!std::strcmp(argv[i], "--others")) opt.others = (int) value;
+        else if (!std::strcmp(argv[i], "--duration")) opt.duration_s = value;
+        else if (!std::strcmp(argv[i], "--reception")) opt.reception = value;
+        else if (!std::strcmp(argv[i], "--seed")) opt.seed = (unsigned) value;
+        else return false;
+    }
+    return argc % 2 == 1 && opt.uuids > 0;
+}
+
+void random_addr(scan_record_t &rec, std::mt19937_64 &rng) {
+    for (auto &b : rec.addr) b = (uint8_t) rng();
+}
+
+std::vector<scan_record_t> generate(const Options &opt, std::mt19937_64 &rng) {
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<std::array<uint8_t, 16>> uuids(opt.uuids);
+    for (auto &uuid : uuids) for (auto &b : uuid) b = (uint8_t) rng();
+
+    std::vector<Device> devices;
+    for (int i = 0; i < opt.beacons + opt.others; i++) {
+        Device d{};
+        random_addr(d.record, rng);
+        d.record.rssi = (int8_t) (-50 - (int) (unit(rng) * 45));
+        if (i < opt.beacons) {
+            d.record.addr_type = 0;
+            d.record.is_ibeacon = true;
+            std::memcpy(d.record.uuid, uuids[i % opt.uuids].data(), 16);
+            d.record.major = (uint16_t) (1 + i / 100);
+            d.record.minor = (uint16_t) i;
+            d.interval_s = 0.1;
+        } else {
+            d.record.addr_type = 3; // random private non-resolvable
+            d.interval_s = 0.2 + unit(rng) * 0.8;
+            d.rotate_s = 900;
+            d.next_rotation_s = unit(rng) * d.rotate_s;
+        }
+        d.next_s = unit(rng) * d.interval_s;
+        devices.push_back(d);
+    }
+
+    using Event = std::pair<double, size_t>;
+    std::priority_queue<Event, std::vector<Event>, std::greater<>> events;
+    for (size_t i = 0; i < devices.size(); i++) events.push({devices[i].next_s, i});
+
+    std::vector<scan_record_t> records;
+    const uint64_t epoch_us = 1700000000ULL * 1000000ULL;
+    while (!events.empty() && events.top().first < opt.duration_s) {
+        auto [t, i] = events.top();
+        events.pop();
+        Device &d = devices[i];
+        if (d.rotate_s > 0 && t >= d.next_rotation_s) {
+            random_addr(d.record, rng);
+            d.next_rotation_s += d.rotate_s;
+        }
+        // slow fading with occasional larger steps
+        int step = (int) (unit(rng) * 5) - 2;
+        if (unit(rng) < 0.05) step *= 4;
+        d.record.rssi = (int8_t) std::max(-100, std::min(-30, d.record.rssi + step));
+        if (unit(rng) < opt.reception) {
+            scan_record_t rec = d.record;
+            rec.timestamp_us = epoch_us + (uint64_t) (t * 1e6);
+            records.push_back(rec);
+        }
+        // advertising interval plus the random advDelay of 0-10 ms
+        events.push({t + d.interval_s + unit(rng) * 0.01, i});
+    }
+    return records;
+}
+
+absniffer::ScanRecord to_host(const scan_record_t &rec) {
+    absniffer::ScanRecord r;
+    r.timestamp_us = rec.timestamp_us;
+    r.addr_type = rec.addr_type;
+    std::memcpy(r.addr.data(), rec.addr, 6);
+    r.rssi = rec.rssi;
+    r.is_ibeacon = rec.is_ibeacon;
+    std::memcpy(r.uuid.data(), rec.uuid, 16);
+    r.major = rec.major;
+    r.minor = rec.minor;
+    return r;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--beacons n] [--uuids n] [--others n] [--duration s] [--reception p] [--seed n]\n",
+                     argv[0]);
+        return 1;
+    }
+    std::mt19937_64 rng(opt.seed);
+    std::vector<scan_record_t> records = generate(opt, rng);
+    if (records.empty()) {
+        std::fprintf(stderr, "no records generated\n");
+        return 1;
+    }
+
+    static scan_report_encoder_t encoder;
+    scan_report_init(&encoder, collect_frame);
+    auto encode_start = std::chrono::steady_clock::now();
+    for (const auto &rec : records) scan_report_add(&encoder, &rec);
+    scan_report_flush(&encoder);
+    auto encode_end = std::chrono::steady_clock::now();
+
+    absniffer::ScanReportDecoder decoder;
+    std::vector<absniffer::ScanRecord> decoded;
+    decoded.reserve(records.size());
+    auto decode_start = std::chrono::steady_clock::now();
+    for (const auto &frame : g_frames) decoder.decode(frame.data(), frame.size(), decoded);
+    auto decode_end = std::chrono::steady_clock::now();
+
+    size_t mismatches = decoded.size() == records.size() ? 0 : records.size();
+    for (size_t i = 0; i < decoded.size() && i < records.size(); i++) {
+        if (!(decoded[i] == to_host(records[i]))) mismatches++;
+    }
+
+    const scan_report_stats_t &stats = encoder.stats;
+    uint64_t wire_bytes = stats.encoded_bytes + stats.frames * absniffer::FRAME_OVERHEAD;
+    double encode_ns = std::chrono::duration<double, std::nano>(encode_end - encode_start).count();
+    double decode_ns = std::chrono::duration<double, std::nano>(decode_end - decode_start).count();
+
+    std::printf("records              %u (%.0f/s)\n", stats.records, stats.records / opt.duration_s);
+    std::printf("frames               %u\n", stats.frames);
+    std::printf("raw bytes            %u\n", stats.raw_bytes);
+    std::printf("wire bytes           %llu (incl. framing)\n", (unsigned long long) wire_bytes);
+    std::printf("compression ratio    %.2f\n", (double) stats.raw_bytes / wire_bytes);
+    std::printf("bytes per record     %.2f\n", (double) wire_bytes / stats.records);
+    std::printf("UART load @115200    %.1f %% (raw %.1f %%)\n", wire_bytes * 10 / opt.duration_s / 115200 * 100,
+                stats.raw_bytes * 10 / opt.duration_s / 115200 * 100);
+    std::printf("host encode          %.1f ns/record\n", encode_ns / stats.records);
+    std::printf("host decode          %.1f ns/record\n", decode_ns / stats.records);
+    std::printf("round trip           %s\n", mismatches ? "MISMATCH" : "ok");
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fast-forwards the firmware's advertising schedule through simulated weeks: the schedule timer is
+// emulated like in main.c (re-evaluation at the next window boundary, at least once a minute) and the
+// advertiser generates events while the applied state is on. Checks the transitions against a minute by
+// minute evaluation and the advertising event counts per day against the expected counts. Exits with 1
+// on a mismatch.
+//
+//   $ schedule_sim --utc-offset 60 --window 31,480,1080,100,0 --window 32,600,840,500,-8 --weeks 1
+//
+// Windows are <days>,<start>,<end>,<interval ms>,<tx power> as for the 'W S' command: days is a mask
+// with bit 0 for Monday, start and end are minutes after midnight local time. Without --window, the
+// example above is used.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "schedule.h"
+}
+
+namespace {
+
+// keep in sync with main.c
+const uint32_t MAX_TIMEOUT_MS = 60000;
+// the advertiser adds a pseudo-random delay of 0-10 ms to every advertising interval
+const double ADV_DELAY_MAX_US = 10000;
+// a transition may happen this late, the timer lands just after the boundary
+const uint64_t MAX_LATENESS_US = 2000;
+
+const char *const DAY_NAMES[7] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+
+struct Options {
+    schedule_t schedule;
+    unsigned weeks = 1;
+    double tolerance = 0.01;        // relative error of the event count per day
+    unsigned seed = 1;
+};
+
+struct Transition {
+    uint64_t time_us;
+    schedule_state_t state;
+};
+
+bool parse_window(const char *text, schedule_t &schedule) {
+    int days, start, end, interval, tx_power;
+    if (std::sscanf(text, "%d,%d,%d,%d,%d", &days, &start, &end, &interval, &tx_power) != 5) return false;
+    if (days < 0 || start < 0 || end < 0 || interval < 0 || interval > 10240) return false;
+    schedule_window_t window = {(uint8_t) days, (int8_t) tx_power, (uint16_t) start, (uint16_t) end,
+                                (uint16_t) interval};
+    return schedule_set_window(&schedule, schedule.window_count, &window);
+}
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    schedule_clear(&opt.schedule);
+    int utc_offset = 0;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) return false;
+        const char *value = argv[i + 1];
+        if (!std::strcmp(argv[i], "--window")) {
+            if (!parse_window(value, opt.schedule)) return false;
+        } else if (!std::strcmp(argv[i], "--utc-offset")) utc_offset = std::atoi(value);
+        else if (!std::strcmp(argv[i], "--weeks")) opt.weeks = (unsigned) std::atoi(value);
+        else if (!std::strcmp(argv[i], "--tolerance")) opt.tolerance = std::atof(value);
+        else if (!std::strcmp(argv[i], "--seed")) opt.seed = (unsigned) std::atoi(value);
+        else return false;
+        i++;
+    }
+    if (opt.schedule.window_count == 0) {
+        utc_offset = utc_offset ? utc_offset : 60;
+        parse_window("31,480,1080,100,0", opt.schedule);
+        parse_window("32,600,840,500,-8", opt.schedule);
+    }
+    if (utc_offset < SCHEDULE_MIN_UTC_OFFSET || utc_offset > SCHEDULE_MAX_UTC_OFFSET) return false;
+    opt.schedule.utc_offset_min = (int16_t) utc_offset;
+    return opt.weeks > 0;
+}
+
+bool same_state(const schedule_state_t &a, const schedule_state_t &b) {
+    return a.window == b.window && a.adv_interval_ms == b.adv_interval_ms && a.tx_power == b.tx_power;
+}
+
+void print_time(const schedule_t &schedule, uint64_t time_us) {
+    uint32_t minute = schedule_minute_of_week(&schedule, time_us);
+    std::printf("%s %02u:%02u:%06.3f", DAY_NAMES[minute / SCHEDULE_MINUTES_PER_DAY],
+                minute % SCHEDULE_MINUTES_PER_DAY / 60, minute % 60, (double) (time_us % 60000000) / 1e6);
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--window days,start,end,interval,tx_power]... [--utc-offset min] [--weeks n]"
+                             " [--tolerance r] [--seed n]\n", argv[0]);
+        return 1;
+    }
+    const schedule_t &schedule = opt.schedule;
+
+    // Monday 2023-11-20 00:00 local time
+    const uint64_t start_us = (1700438400LL - schedule.utc_offset_min * 60LL) * 1000000ULL;
+    const uint64_t end_us = start_us + opt.weeks * SCHEDULE_MINUTES_PER_WEEK * 60000000ULL;
+    const unsigned days = opt.weeks * 7;
+
+    // reference: transitions from evaluating every minute
+    std::vector<Transition> expected;
+    std::vector<double> expected_events(days, 0.0);
+    schedule_state_t previous = {-2, 0, 0};
+    for (uint64_t t = start_us; t < end_us; t += 60000000ULL) {
+        schedule_state_t state;
+        schedule_evaluate(&schedule, t, &state);
+        if (!same_state(state, previous)) expected.push_back({t, state});
+        previous = state;
+        if (state.adv_interval_ms > 0) {
+            expected_events[(t - start_us) / 86400000000ULL] +=
+                    60e6 / (state.adv_interval_ms * 1000.0 + ADV_DELAY_MAX_US / 2);
+        }
+    }
+
+    // the firmware: timer driven re-evaluation and an advertiser following the applied state
+    std::mt19937_64 rng(opt.seed);
+    std::uniform_real_distribution<double> adv_delay(0, ADV_DELAY_MAX_US);
+    std::vector<Transition> actual;
+    std::vector<uint64_t> events(days, 0);
+    uint64_t events_while_off = 0;
+    uint64_t wakeups = 0;
+    schedule_state_t applied = {-2, 0, 0};
+    double next_adv_us = 0;
+    uint64_t t = start_us;
+    while (t < end_us) {
+        schedule_state_t state;
+        schedule_evaluate(&schedule, t, &state);
+        if (!same_state(state, applied)) {
+            actual.push_back({t, state});
+            if (state.adv_interval_ms != applied.adv_interval_ms) next_adv_us = (double) t;
+            applied = state;
+        }
+        uint64_t until_ms = (schedule_next_change_us(&schedule, t) - t) / 1000;
+        uint32_t timeout_ms = until_ms < MAX_TIMEOUT_MS ? (uint32_t) until_ms + 1 : MAX_TIMEOUT_MS;
+        // APP_TIMER_TICKS rounds to ticks of the 32768 Hz RTC
+        uint64_t ticks = ((uint64_t) timeout_ms * 32768 + 500) / 1000;
+        uint64_t next_t = t + ticks * 1000000 / 32768;
+
+        while (applied.adv_interval_ms > 0 && next_adv_us < (double) std::min(next_t, end_us)) {
+            uint64_t event_us = (uint64_t) next_adv_us;
+            schedule_state_t truth;
+            schedule_evaluate(&schedule, event_us, &truth);
+            if (truth.adv_interval_ms == 0) events_while_off++;
+            events[(event_us - start_us) / 86400000000ULL]++;
+            next_adv_us += applied.adv_interval_ms * 1000.0 + adv_delay(rng);
+        }
+        t = next_t;
+        wakeups++;
+    }
+
+    std::printf("transitions\n");
+    bool ok = actual.size() == expected.size();
+    for (size_t i = 0; i < actual.size(); i++) {
+        const Transition &a = actual[i];
+        bool match = i < expected.size() && same_state(a.state, expected[i].state) &&
+                     a.time_us >= expected[i].time_us && a.time_us - expected[i].time_us <= MAX_LATENESS_US;
+        ok = ok && match;
+        std::printf("  ");
+        print_time(schedule, a.time_us);
+        if (a.state.adv_interval_ms == 0) {
+            std::printf("  off%s\n", match ? "" : "  MISMATCH");
+        } else {
+            std::printf("  window %d, %u ms, %d dBm%s\n", a.state.window, a.state.adv_interval_ms, a.state.tx_power,
+                        match ? "" : "  MISMATCH");
+        }
+    }
+    if (actual.size() != expected.size()) {
+        std::printf("  %zu transitions, expected %zu\n", actual.size(), expected.size());
+    }
+
+    std::printf("advertising events\n");
+    for (unsigned day = 0; day < days; day++) {
+        double error = std::fabs((double) events[day] - expected_events[day]);
+        bool match = error <= opt.tolerance * expected_events[day] + 2;
+        ok = ok && match;
+        std::printf("  %s %10llu  expected %10.0f%s\n", DAY_NAMES[day % 7], (unsigned long long) events[day],
+                    expected_events[day], match ? "" : "  MISMATCH");
+    }
+    ok = ok && events_while_off == 0;
+    std::printf("events while off  %llu\n", (unsigned long long) events_while_off);
+    std::printf("timer wakeups     %llu\n", (unsigned long long) wakeups);
+    std::printf("result            %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
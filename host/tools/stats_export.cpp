@@ -0,0 +1,264 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Exports the runtime statistics of devices ('S' command, see stats.h) as OpenMetrics text, e.g. for
+// the textfile collector of the Prometheus node exporter.
+//
+//   $ stats_export [--baud rate] [--timeout-ms ms] <serial port>... > absniffer.prom
+//   $ stats_export < s_response.txt
+//
+// All ports are queried in parallel, the samples are labelled with the port. The device answers with
+// pages of entries ending with next=<entry> while more are left, which are requested with 'S <entry>'.
+// Without ports the last dump read from stdin is converted (labelled "stdin").
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "device_connection.h"
+#include "event_loop.h"
+#include "stream_parser.h"
+
+using namespace absniffer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    unsigned baud_rate = 115200;
+    unsigned timeout_ms = 2000;
+    std::vector<std::string> ports;
+};
+
+struct DeviceStats {
+    std::string device;
+    std::string response;       // body of the 'S' response, the entries point into it
+    std::vector<StatsEntry> entries;
+};
+
+// Removes the trailing next=<entry> of a page, returns the entry or 0 for the last page
+unsigned long take_next_page(std::string &body) {
+    size_t pos = body.rfind("next=");
+    if (pos == std::string::npos || (pos > 0 && body[pos - 1] != ' ')) return 0;
+    unsigned long next = std::strtoul(body.c_str() + pos + 5, nullptr, 10);
+    body.erase(pos > 0 ? pos - 1 : 0);
+    return next;
+}
+
+std::string escape_label(const std::string &value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') escaped += '\\';
+        if (c == '\n') {
+            escaped += "\\n";
+            continue;
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+void print_counter(const std::string &name, const std::vector<std::pair<const DeviceStats *, const StatsEntry *>> &samples) {
+    // the uptime is the only counter which is not a count of events
+    if (name == "uptime_us") {
+        std::printf("# TYPE absniffer_uptime_seconds gauge\n# UNIT absniffer_uptime_seconds seconds\n");
+        for (const auto &sample : samples) {
+            std::printf("absniffer_uptime_seconds{device=\"%s\"} %.6f\n", escape_label(sample.first->device).c_str(),
+                        sample.second->value / 1e6);
+        }
+        return;
+    }
+    std::printf("# TYPE absniffer_%s counter\n", name.c_str());
+    for (const auto &sample : samples) {
+        std::printf("absniffer_%s_total{device=\"%s\"} %llu\n", name.c_str(),
+                    escape_label(sample.first->device).c_str(), (unsigned long long) sample.second->value);
+    }
+}
+
+void print_histogram(const std::string &name,
+                     const std::vector<std::pair<const DeviceStats *, const StatsEntry *>> &samples) {
+    std::printf("# TYPE absniffer_%s histogram\n", name.c_str());
+    for (const auto &sample : samples) {
+        std::string device = escape_label(sample.first->device);
+        const StatsEntry &entry = *sample.second;
+        uint64_t count = 0;
+        // the last bucket has no upper bound, it only shows up in +Inf
+        for (unsigned i = 0; i + 1 < STATS_HIST_BUCKETS; i++) {
+            if (i < entry.bucket_count) count += entry.buckets[i];
+            std::printf("absniffer_%s_bucket{device=\"%s\",le=\"%llu\"} %llu\n", name.c_str(), device.c_str(),
+                        1ULL << (i + STATS_HIST_MIN_LOG2 + 1), (unsigned long long) count);
+        }
+        if (entry.bucket_count == STATS_HIST_BUCKETS) count += entry.buckets[STATS_HIST_BUCKETS - 1];
+        std::printf("absniffer_%s_bucket{device=\"%s\",le=\"+Inf\"} %llu\n", name.c_str(), device.c_str(),
+                    (unsigned long long) count);
+        std::printf("absniffer_%s_count{device=\"%s\"} %llu\n", name.c_str(), device.c_str(),
+                    (unsigned long long) count);
+        std::printf("absniffer_%s_sum{device=\"%s\"} %llu\n", name.c_str(), device.c_str(),
+                    (unsigned long long) entry.value);
+    }
+}
+
+void print_open_metrics(const std::vector<DeviceStats> &stats) {
+    // group the samples of all devices by metric, in the order the first device reported them
+    std::vector<std::string> names;
+    for (const auto &device : stats) {
+        for (const auto &entry : device.entries) {
+            std::string name(entry.name);
+            if (std::find(names.begin(), names.end(), name) == names.end()) names.push_back(name);
+        }
+    }
+    for (const auto &name : names) {
+        std::vector<std::pair<const DeviceStats *, const StatsEntry *>> samples;
+        bool histogram = false;
+        for (const auto &device : stats) {
+            for (const auto &entry : device.entries) {
+                if (entry.name == name) {
+                    samples.emplace_back(&device, &entry);
+                    histogram = entry.histogram;
+                }
+            }
+        }
+        if (histogram) {
+            print_histogram(name, samples);
+        } else {
+            print_counter(name, samples);
+        }
+    }
+    std::printf("# EOF\n");
+}
+
+// Queries all ports in parallel, devices which do not respond in time are left out
+std::vector<DeviceStats> query_devices(const Options &opt) {
+    EventLoop loop;
+    std::vector<DeviceStats> stats;
+    std::vector<std::unique_ptr<DeviceConnection>> connections;
+    size_t pending = 0;
+
+    for (const auto &port : opt.ports) {
+        auto conn = std::make_unique<DeviceConnection>(loop);
+        if (!conn->open(port, opt.baud_rate)) {
+            std::fprintf(stderr, "%s: %s\n", port.c_str(), conn->error().c_str());
+            continue;
+        }
+        DeviceConnection *p = conn.get();
+        auto body = std::make_shared<std::string>();
+        conn->on_message([&, p, port, body](const Message &msg) {
+            if (msg.type == Message::Type::Error) {
+                std::fprintf(stderr, "%s: %.*s\n", port.c_str(), (int) msg.text.size(), msg.text.data());
+            } else if (msg.type == Message::Type::Ok && msg.text.find('=') != std::string_view::npos) {
+                std::string page(msg.text);
+                unsigned long next = take_next_page(page);
+                if (!body->empty()) *body += ' ';
+                *body += page;
+                if (next > 0) {
+                    p->send("S " + std::to_string(next));
+                    return;
+                }
+                stats.push_back({port, *body, {}});
+            } else {
+                return;
+            }
+            p->close();
+            pending--;
+        });
+        conn->on_error([&, port](const std::string &error) {
+            std::fprintf(stderr, "%s: %s\n", port.c_str(), error.c_str());
+            pending--;
+        });
+        conn->send("S");
+        connections.push_back(std::move(conn));
+        pending++;
+    }
+
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(opt.timeout_ms);
+    while (pending > 0) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        if (remaining <= 0) {
+            std::fprintf(stderr, "%zu device(s) did not respond\n", pending);
+            break;
+        }
+        if (loop.poll((int) remaining) < 0) break;
+    }
+    return stats;
+}
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--", 2) != 0) {
+            opt.ports.emplace_back(argv[i]);
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        unsigned value = (unsigned) std::strtoul(argv[i + 1], nullptr, 10);
+        if (!std::strcmp(argv[i], "--baud")) opt.baud_rate = value;
+        else if (!std::strcmp(argv[i], "--timeout-ms")) opt.timeout_ms = value;
+        else return false;
+        i++;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--baud rate] [--timeout-ms ms] [<serial port>...]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<DeviceStats> stats;
+    if (opt.ports.empty()) {
+        std::string line;
+        std::string last;
+        bool more = false;
+        while (std::getline(std::cin, line)) {
+            if (line.compare(0, 3, "OK ") != 0) continue;
+            // a dump starts with the uptime, following pages are appended
+            std::string page = line.substr(3);
+            if (page.compare(0, 10, "uptime_us=") == 0) {
+                last.clear();
+            } else if (!more) {
+                continue;
+            }
+            more = take_next_page(page) > 0;
+            if (!last.empty()) last += ' ';
+            last += page;
+        }
+        if (!last.empty()) stats.push_back({"stdin", last, {}});
+    } else {
+        stats = query_devices(opt);
+    }
+
+    // parse once all responses are stored, the entries point into them
+    for (auto &device : stats) {
+        if (!parse_stats(device.response, device.entries)) {
+            std::fprintf(stderr, "%s: malformed statistics\n", device.device.c_str());
+            return 1;
+        }
+    }
+    if (stats.empty()) {
+        std::fprintf(stderr, "no statistics\n");
+        return 1;
+    }
+    print_open_metrics(stats);
+    return stats.size() == std::max<size_t>(opt.ports.size(), 1) ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs the firmware's swarm planner against simulated radio timeslots: requests are granted with a
+// random latency, some are blocked and retried like in swarm.c, and every signal is handled after a
+// random interrupt latency. Reports the achieved event and PDU rates against the target and checks
+// that no event overruns its timeslot, that the identities are served evenly and, if the target rate
+// is well below the capacity of the timeslots, that no event is dropped. Exits with 1 on a violation.
+// A target rate near or above the capacity is reported as degraded (exit code 2), the planner then
+// drops events by design and only the overrun check applies.
+//
+//   $ swarm_sim --count 200 --interval 400 --duration 60 --grant-latency-us 500 --block-rate 0.01
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "swarm_plan.h"
+}
+
+namespace {
+
+struct Options {
+    // the scenario of the README (500 events/s), about two thirds of the capacity
+    unsigned count = 200;
+    double interval_ms = 400;
+    double duration_s = 60;
+    double grant_latency_us = 500;  // from an earliest request (or the end of the slot) to the next start, uniform
+    double block_rate = 0;          // probability of a request being blocked
+    double block_delay_us = 2000;   // until NRF_EVT_RADIO_BLOCKED reaches the application
+    double irq_latency_us = 20;     // per signal, uniform
+    unsigned seed = 1;
+};
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) return false;
+        double value = std::atof(argv[i + 1]);
+        if (!std::strcmp(argv[i], "--count")) opt.count = (unsigned) value;
+        else if (!std::strcmp(argv[i], "--interval")) opt.interval_ms = value;
+        else if (!std::strcmp(argv[i], "--duration")) opt.duration_s = value;
+        else if (!std::strcmp(argv[i], "--grant-latency-us")) opt.grant_latency_us = value;
+        else if (!std::strcmp(argv[i], "--block-rate")) opt.block_rate = value;
+        else if (!std::strcmp(argv[i], "--block-delay-us")) opt.block_delay_us = value;
+        else if (!std::strcmp(argv[i], "--irq-latency-us")) opt.irq_latency_us = value;
+        else if (!std::strcmp(argv[i], "--seed")) opt.seed = (unsigned) value;
+        else return false;
+        i++;
+    }
+    return opt.count > 0 && opt.count <= SWARM_PLAN_MAX_IDENTITIES && opt.interval_ms >= 1 && opt.duration_s > 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--count n] [--interval ms] [--duration s] [--grant-latency-us us]"
+                             " [--block-rate p] [--block-delay-us us] [--irq-latency-us us] [--seed n]\n", argv[0]);
+        return 1;
+    }
+
+    std::mt19937_64 rng(opt.seed);
+    std::uniform_real_distribution<double> grant_latency(0, opt.grant_latency_us);
+    std::uniform_real_distribution<double> irq_latency(0, opt.irq_latency_us);
+    std::bernoulli_distribution blocked(opt.block_rate);
+
+    const uint64_t start_us = 1000000;
+    const uint64_t end_us = start_us + (uint64_t) (opt.duration_s * 1e6);
+    swarm_plan_t plan;
+    swarm_plan_init(&plan, (uint16_t) opt.count, (uint32_t) (opt.interval_ms * 1000), start_us);
+
+    std::vector<uint32_t> sent(opt.count);
+    uint64_t pdus = 0;
+    uint32_t slots = 0;
+    uint32_t blocks = 0;
+    uint32_t overruns = 0;
+    uint64_t max_late_us = 0;
+    uint64_t radio_us = 0;
+
+    // time of the next timeslot start, the first request is an earliest one
+    double next_start = start_us + grant_latency(rng);
+    while (next_start < end_us) {
+        if (blocked(rng)) {
+            // swarm.c requests the earliest timeslot again when the blocked event arrives
+            blocks++;
+            next_start += opt.block_delay_us + grant_latency(rng);
+            continue;
+        }
+        uint64_t slot_start = (uint64_t) next_start;
+        uint64_t slot_end = slot_start + SWARM_PLAN_SLOT_LENGTH_US - SWARM_PLAN_SLOT_MARGIN_US;
+        uint64_t now = slot_start + (uint64_t) irq_latency(rng);
+        slots++;
+
+        uint16_t identity;
+        uint64_t tx_us;
+        while (true) {
+            uint64_t due_us = plan.next_due_us;
+            if (!swarm_plan_next(&plan, now, slot_end, &identity, &tx_us)) {
+                break;
+            }
+            // the TIMER0 compare or the start of the first channel, then one signal per PDU
+            uint64_t begin = tx_us + (tx_us > now ? (uint64_t) irq_latency(rng) : 0);
+            uint64_t end = begin + SWARM_PLAN_EVENT_AIRTIME_US;
+            for (int channel = 0; channel < 3; channel++) {
+                end += (uint64_t) irq_latency(rng);
+            }
+            if (end > slot_start + SWARM_PLAN_SLOT_LENGTH_US) {
+                overruns++;
+            }
+            max_late_us = std::max(max_late_us, begin > due_us ? begin - due_us : 0);
+            sent[identity]++;
+            pdus += 3;
+            radio_us += end - begin;
+            now = end;
+        }
+
+        swarm_plan_request_t request;
+        swarm_plan_request(&plan, slot_start, now, &request);
+        if (request.earliest) {
+            next_start = (double) now + grant_latency(rng);
+        } else {
+            next_start = (double) (slot_start + request.distance_us);
+        }
+    }
+
+    const double duration_s = (double) (end_us - start_us) / 1e6;
+    const double target_eps = opt.count / (opt.interval_ms / 1000);
+    const double achieved_eps = plan.events / duration_s;
+    // events fitting into a timeslot, and timeslots per second when they follow each other
+    const double events_per_slot = (SWARM_PLAN_SLOT_LENGTH_US - SWARM_PLAN_SLOT_MARGIN_US) /
+                                   (SWARM_PLAN_EVENT_AIRTIME_US + 2.0 * opt.irq_latency_us);
+    const double capacity_eps = (int) events_per_slot * 1e6 / (SWARM_PLAN_SLOT_LENGTH_US + opt.grant_latency_us / 2);
+    auto minmax = std::minmax_element(sent.begin(), sent.end());
+
+    bool ok = overruns == 0;
+    bool overloaded = target_eps >= 0.8 * capacity_eps;
+    // identities are served round robin, drops skip whole runs of events
+    if (plan.dropped == 0) {
+        ok = ok && *minmax.second - *minmax.first <= 1;
+    }
+    if (!overloaded && opt.block_rate == 0) {
+        ok = ok && plan.dropped == 0 && achieved_eps >= 0.99 * target_eps;
+    }
+
+    std::printf("target       %.1f events/s, %.1f PDUs/s\n", target_eps, 3 * target_eps);
+    std::printf("capacity     %.1f events/s (estimate)\n", capacity_eps);
+    std::printf("achieved     %.1f events/s, %.1f PDUs/s (%.1f%%)\n", achieved_eps, pdus / duration_s,
+                100 * achieved_eps / target_eps);
+    std::printf("dropped      %u events\n", plan.dropped);
+    std::printf("per identity %u..%u events\n", *minmax.first, *minmax.second);
+    std::printf("max late     %llu us\n", (unsigned long long) max_late_us);
+    std::printf("timeslots    %u, %u blocked, radio %.1f%% of the time\n", slots, blocks,
+                100.0 * radio_us / (end_us - start_us));
+    std::printf("overruns     %u\n", overruns);
+    if (!ok) {
+        std::printf("result       FAILED\n");
+        return 1;
+    }
+    if (overloaded) {
+        std::printf("result       degraded (target %.0f%% of the capacity)\n", 100 * target_eps / capacity_eps);
+        return 2;
+    }
+    std::printf("result       ok\n");
+    return 0;
+}
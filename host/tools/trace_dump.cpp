@@ -0,0 +1,347 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Reads the trace buffer of a device ('D' command, see trace.h) and converts it to the Chrome trace
+// event format, which can be viewed in chrome://tracing or https://ui.perfetto.dev.
+//
+//   $ trace_dump [--baud rate] [--timeout-ms ms] [--save trace.bin] <serial port> > trace.json
+//   $ trace_dump --load trace.bin > trace.json
+//
+// Every boot recorded in the buffer is shown as a process of its own, since the device's clock
+// restarts with every reset. --save stores the raw events (sequence number and event, 16 bytes each)
+// for converting them later with --load.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "trace.h"
+}
+
+#include "device_connection.h"
+#include "event_loop.h"
+#include "frame.h"
+#include "stream_parser.h"
+
+using namespace absniffer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr size_t EVENT_SIZE = 12;
+
+struct Options {
+    unsigned baud_rate = 115200;
+    unsigned timeout_ms = 2000;
+    const char *port = nullptr;
+    const char *save = nullptr;
+    const char *load = nullptr;
+};
+
+struct Event {
+    uint32_t seq;
+    trace_event_t event;
+};
+
+uint32_t read_u32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+trace_event_t decode_event(const uint8_t *p) {
+    trace_event_t event;
+    event.timestamp_us = read_u32(p);
+    event.type = p[4];
+    event.arg8 = p[5];
+    event.arg16 = (uint16_t) (p[6] | (p[7] << 8));
+    event.arg32 = read_u32(p + 8);
+    return event;
+}
+
+// Sends commands to a single device and waits for their responses
+class Session {
+public:
+    explicit Session(const Options &opt) : opt_(opt), conn_(loop_) {
+        conn_.on_message([this](const Message &msg) {
+            if (msg.type == Message::Type::Frame) {
+                if (msg.frame.type != FRAME_TRACE) return;
+                frames_.emplace_back(msg.frame.payload, msg.frame.payload + msg.frame.length);
+            } else if (msg.type == Message::Type::Ok || msg.type == Message::Type::Error) {
+                response_ = std::string(msg.text);
+                ok_ = msg.type == Message::Type::Ok;
+                done_ = true;
+            }
+        });
+        conn_.on_error([this](const std::string &) { done_ = true; });
+    }
+
+    bool open() {
+        if (conn_.open(opt_.port, opt_.baud_rate)) return true;
+        std::fprintf(stderr, "%s: %s\n", opt_.port, conn_.error().c_str());
+        return false;
+    }
+
+    // returns false on errors and timeouts
+    bool request(const std::string &cmd) {
+        done_ = false;
+        ok_ = false;
+        frames_.clear();
+        conn_.send(cmd);
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(opt_.timeout_ms);
+        while (!done_) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (remaining <= 0 || loop_.poll((int) remaining) < 0) {
+                std::fprintf(stderr, "%s: no response to '%s'\n", opt_.port, cmd.c_str());
+                return false;
+            }
+        }
+        if (!ok_) std::fprintf(stderr, "%s: '%s' failed: %s\n", opt_.port, cmd.c_str(), response_.c_str());
+        return ok_;
+    }
+
+    const std::string &response() const { return response_; }
+    const std::vector<std::vector<uint8_t>> &frames() const { return frames_; }
+
+private:
+    const Options &opt_;
+    EventLoop loop_;
+    DeviceConnection conn_;
+    bool done_ = false;
+    bool ok_ = false;
+    std::string response_;
+    std::vector<std::vector<uint8_t>> frames_;
+};
+
+bool read_device(const Options &opt, std::vector<Event> &events) {
+    Session session(opt);
+    if (!session.open() || !session.request("D")) return false;
+    uint32_t first_seq, next_seq;
+    if (std::sscanf(session.response().c_str(), "%u %u", &first_seq, &next_seq) != 2) {
+        std::fprintf(stderr, "%s: malformed response to 'D'\n", opt.port);
+        return false;
+    }
+    // events recorded while dumping (including those of the dump itself) are left out
+    uint32_t seq = first_seq;
+    while (seq < next_seq) {
+        if (!session.request("D " + std::to_string(seq))) return false;
+        size_t count = 0;
+        for (const auto &frame : session.frames()) {
+            if (frame.size() < 4 || (frame.size() - 4) % EVENT_SIZE != 0) continue;
+            uint32_t frame_seq = read_u32(frame.data());
+            // the oldest events may have been overwritten in the meantime
+            if (frame_seq > seq) seq = frame_seq;
+            for (size_t pos = 4; pos < frame.size() && seq < next_seq; pos += EVENT_SIZE, count++) {
+                events.push_back({seq++, decode_event(&frame[pos])});
+            }
+        }
+        if (count == 0) break;
+    }
+    return true;
+}
+
+bool save_events(const char *path, const std::vector<Event> &events) {
+    std::ofstream out(path, std::ios::binary);
+    for (const auto &e : events) {
+        uint8_t record[16] = {(uint8_t) e.seq, (uint8_t) (e.seq >> 8), (uint8_t) (e.seq >> 16), (uint8_t) (e.seq >> 24)};
+        const trace_event_t &ev = e.event;
+        uint8_t *p = &record[4];
+        for (int i = 0; i < 4; i++) p[i] = (uint8_t) (ev.timestamp_us >> (8 * i));
+        p[4] = ev.type;
+        p[5] = ev.arg8;
+        p[6] = (uint8_t) ev.arg16;
+        p[7] = (uint8_t) (ev.arg16 >> 8);
+        for (int i = 0; i < 4; i++) p[8 + i] = (uint8_t) (ev.arg32 >> (8 * i));
+        out.write(reinterpret_cast<const char *>(record), sizeof(record));
+    }
+    if (!out) std::fprintf(stderr, "cannot write %s\n", path);
+    return (bool) out;
+}
+
+bool load_events(const char *path, std::vector<Event> &events) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    uint8_t record[16];
+    while (in.read(reinterpret_cast<char *>(record), sizeof(record))) {
+        events.push_back({read_u32(record), decode_event(&record[4])});
+    }
+    return true;
+}
+
+std::string reset_reason(uint32_t resetreas) {
+    static const char *const names[] = {"pin", "watchdog", "soft reset", "lockup"};
+    std::string reason;
+    for (int i = 0; i < 4; i++) {
+        if (resetreas & (1u << i)) reason += (reason.empty() ? "" : ", ") + std::string(names[i]);
+    }
+    if (resetreas & (0xFu << 16)) reason += (reason.empty() ? "" : ", ") + std::string("wake up from off");
+    return reason.empty() ? "power on" : reason;
+}
+
+// threads of the timeline
+enum { TID_COMMANDS = 1, TID_FLASH, TID_RADIO, TID_ERRORS };
+
+const char *fds_op(uint8_t op) {
+    switch (op) {
+        case TRACE_FDS_WRITE: return "fds write";
+        case TRACE_FDS_UPDATE: return "fds update";
+        case TRACE_FDS_GC: return "fds gc";
+        default: return "fds";
+    }
+}
+
+void print_chrome_trace(const std::vector<Event> &events) {
+    std::printf("{\"traceEvents\":[\n");
+    bool first = true;
+    auto emit = [&](const char *fmt, auto... args) {
+        std::printf(first ? "  " : ",\n  ");
+        std::printf(fmt, args...);
+        first = false;
+    };
+    auto thread_names = [&](unsigned pid) {
+        emit("{\"ph\":\"M\",\"pid\":%u,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"commands\"}}", pid, TID_COMMANDS);
+        emit("{\"ph\":\"M\",\"pid\":%u,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"flash\"}}", pid, TID_FLASH);
+        emit("{\"ph\":\"M\",\"pid\":%u,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"radio\"}}", pid, TID_RADIO);
+        emit("{\"ph\":\"M\",\"pid\":%u,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"errors\"}}", pid, TID_ERRORS);
+    };
+
+    // the buffer usually starts in the middle of a boot
+    unsigned pid = 0;
+    uint64_t epoch = 0;
+    uint32_t last_ts = 0;
+    if (events.empty() || events.front().event.type != TRACE_BOOT) {
+        emit("{\"ph\":\"M\",\"pid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"boot (partial)\"}}");
+        thread_names(0);
+    }
+    for (const auto &e : events) {
+        const trace_event_t &ev = e.event;
+        if (ev.type == TRACE_BOOT) {
+            pid++;
+            epoch = 0;
+            last_ts = ev.timestamp_us;
+            emit("{\"ph\":\"M\",\"pid\":%u,\"name\":\"process_name\",\"args\":{\"name\":\"boot %u (%s)\"}}", pid,
+                 pid, reset_reason(ev.arg32).c_str());
+            emit("{\"ph\":\"M\",\"pid\":%u,\"name\":\"process_sort_index\",\"args\":{\"sort_index\":%u}}", pid, pid);
+            thread_names(pid);
+        }
+        // the timestamps are the low 32 bits of the device's microsecond clock
+        if (ev.timestamp_us < last_ts && last_ts - ev.timestamp_us > 0x80000000u) epoch += 1ULL << 32;
+        last_ts = ev.timestamp_us;
+        unsigned long long ts = epoch + ev.timestamp_us;
+
+        switch (ev.type) {
+            case TRACE_BOOT:
+                emit("{\"ph\":\"i\",\"s\":\"p\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"boot\",\"args\":{\"seq\":%u,\"resetreas\":%u}}",
+                     pid, TID_COMMANDS, ts, e.seq, ev.arg32);
+                break;
+            case TRACE_UART_RX_LINE:
+                emit("{\"ph\":\"i\",\"s\":\"t\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"rx line\",\"args\":{\"seq\":%u,\"length\":%u}}",
+                     pid, TID_COMMANDS, ts, e.seq, ev.arg16);
+                break;
+            case TRACE_CMD_BEGIN:
+            case TRACE_CMD_END:
+                emit("{\"ph\":\"%s\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"cmd %c\",\"args\":{\"seq\":%u}}",
+                     ev.type == TRACE_CMD_BEGIN ? "B" : "E", pid, TID_COMMANDS, ts,
+                     ev.arg8 >= 0x20 && ev.arg8 < 0x7f && ev.arg8 != '"' && ev.arg8 != '\\' ? ev.arg8 : '?', e.seq);
+                break;
+            case TRACE_FDS_BEGIN:
+                emit("{\"ph\":\"B\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"%s\",\"args\":{\"seq\":%u}}", pid,
+                     TID_FLASH, ts, fds_op(ev.arg8), e.seq);
+                break;
+            case TRACE_FDS_END:
+                emit("{\"ph\":\"E\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"%s\",\"args\":{\"seq\":%u,\"result\":%u}}",
+                     pid, TID_FLASH, ts, fds_op(ev.arg8), e.seq, ev.arg32);
+                break;
+            case TRACE_ADV_START:
+            case TRACE_ADV_STOP:
+                emit("{\"ph\":\"%s\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"advertising\",\"args\":{\"seq\":%u,\"interval_ms\":%u}}",
+                     ev.type == TRACE_ADV_START ? "B" : "E", pid, TID_RADIO, ts, e.seq, ev.arg16);
+                break;
+            case TRACE_SCAN_START:
+            case TRACE_SCAN_STOP:
+                emit("{\"ph\":\"i\",\"s\":\"t\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"%s\",\"args\":{\"seq\":%u,\"window_ms\":%u}}",
+                     pid, TID_RADIO, ts, ev.type == TRACE_SCAN_START ? "scan start" : "scan stop", e.seq, ev.arg16);
+                break;
+            case TRACE_ERROR:
+                emit("{\"ph\":\"i\",\"s\":\"p\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"error\",\"args\":{\"seq\":%u,\"line\":%u,\"err_code\":%u}}",
+                     pid, TID_ERRORS, ts, e.seq, ev.arg16, ev.arg32);
+                break;
+            case TRACE_ERROR_PC:
+                emit("{\"ph\":\"i\",\"s\":\"p\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"fault\",\"args\":{\"seq\":%u,\"id\":%u,\"pc\":\"0x%08x\"}}",
+                     pid, TID_ERRORS, ts, e.seq, ev.arg16, ev.arg32);
+                break;
+            case TRACE_UART_SUSPEND:
+            case TRACE_UART_RESUME:
+                emit("{\"ph\":\"%s\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"uart suspended\",\"args\":{\"seq\":%u}}",
+                     ev.type == TRACE_UART_SUSPEND ? "B" : "E", pid, TID_COMMANDS, ts, e.seq);
+                break;
+            case TRACE_UART_BAUD:
+                emit("{\"ph\":\"i\",\"s\":\"t\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"%s\",\"args\":{\"seq\":%u,\"baud\":%u,\"flow_control\":%u}}",
+                     pid, TID_COMMANDS, ts, ev.arg8 ? "baud reverted" : "baud switched", e.seq, ev.arg32, ev.arg16);
+                break;
+            case TRACE_RAM_LAYOUT:
+                emit("{\"ph\":\"i\",\"s\":\"p\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"ram layout\",\"args\":{\"seq\":%u,\"min_app_ram_start\":\"0x%08x\",\"mismatch\":%u}}",
+                     pid, TID_COMMANDS, ts, e.seq, ev.arg32, ev.arg8);
+                break;
+            default:
+                emit("{\"ph\":\"i\",\"s\":\"t\",\"pid\":%u,\"tid\":%d,\"ts\":%llu,\"name\":\"event %u\",\"args\":{\"seq\":%u,\"arg8\":%u,\"arg16\":%u,\"arg32\":%u}}",
+                     pid, TID_COMMANDS, ts, ev.type, e.seq, ev.arg8, ev.arg16, ev.arg32);
+                break;
+        }
+    }
+    std::printf("\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--", 2) != 0) {
+            if (opt.port) return false;
+            opt.port = argv[i];
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        const char *value = argv[i + 1];
+        if (!std::strcmp(argv[i], "--baud")) opt.baud_rate = (unsigned) std::atoi(value);
+        else if (!std::strcmp(argv[i], "--timeout-ms")) opt.timeout_ms = (unsigned) std::atoi(value);
+        else if (!std::strcmp(argv[i], "--save")) opt.save = value;
+        else if (!std::strcmp(argv[i], "--load")) opt.load = value;
+        else return false;
+        i++;
+    }
+    return (opt.port != nullptr) != (opt.load != nullptr);
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--baud rate] [--timeout-ms ms] [--save trace.bin] <serial port>\n"
+                             "       %s --load trace.bin\n", argv[0], argv[0]);
+        return 1;
+    }
+    std::vector<Event> events;
+    if (opt.load ? !load_events(opt.load, events) : !read_device(opt, events)) return 1;
+    if (opt.save && !save_events(opt.save, events)) return 1;
+    std::fprintf(stderr, "%zu events\n", events.size());
+    print_chrome_trace(events);
+    return 0;
+}
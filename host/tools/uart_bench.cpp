@@ -0,0 +1,290 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Negotiates UART baud rates with a device ('H' command, see README) and measures the throughput of
+// the device's test stream at each of them.
+//
+//   $ uart_bench [--rates 115200,460800,1000000] [--bytes n] [--flow-control] [--timeout-ms ms]
+//                [--check-revert] <serial port>
+//
+// For every rate, the device is switched with 'H <rate>'. The host follows once the response has
+// arrived and confirms with 'H C' at the new rate. Then 'H T <bytes>' is sent and the test frames are
+// checked for gaps in their sequence numbers and for corrupted payloads. Frames with CRC errors are
+// dropped by the parser and show up as gaps. --check-revert first switches without following and
+// expects the device to return to the old rate by itself. The device is switched back to 115200 at
+// the end. Use fake_dongle to try it without hardware.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "device_connection.h"
+#include "event_loop.h"
+#include "frame.h"
+#include "stream_parser.h"
+
+using namespace absniffer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const unsigned DEFAULT_BAUD_RATE = 115200;
+// UART_BAUD_SWITCH_DELAY and UART_BAUD_CONFIRM_TIMEOUT in uart_cmd.c, with some margin
+const auto SWITCH_DELAY = std::chrono::milliseconds(20);
+const auto REVERT_TIME = std::chrono::milliseconds(2500);
+
+struct Options {
+    std::vector<unsigned> rates = {115200, 230400, 460800, 921600, 1000000};
+    uint32_t bytes = 100000;
+    bool flow_control = false;
+    unsigned timeout_ms = 1000;
+    bool check_revert = false;
+    const char *port = nullptr;
+};
+
+struct TestResult {
+    uint32_t frames = 0;
+    uint64_t payload_bytes = 0;
+    uint64_t wire_bytes = 0;
+    uint64_t timed_bytes = 0;       // wire bytes received between start and end
+    uint32_t lost = 0;              // frames missing from the sequence
+    uint32_t corrupt = 0;           // frames with a valid CRC but an unexpected payload
+    Clock::time_point start;        // arrival of the first and the last frame
+    Clock::time_point end;
+};
+
+class Bench {
+public:
+    explicit Bench(const Options &opt) : opt_(opt), conn_(loop_) {}
+
+    bool open() {
+        if (!conn_.open(opt_.port, DEFAULT_BAUD_RATE)) {
+            std::fprintf(stderr, "%s: %s\n", opt_.port, conn_.error().c_str());
+            return false;
+        }
+        conn_.on_message([this](const Message &msg) { handle_message(msg); });
+        conn_.on_error([this](const std::string &error) {
+            std::fprintf(stderr, "%s: %s\n", opt_.port, error.c_str());
+        });
+        return true;
+    }
+
+    unsigned baud_rate() const { return conn_.baud_rate(); }
+
+    // Sends a command and waits for its response, true if it is OK
+    bool request(const std::string &command, std::string *p_body = nullptr) {
+        has_response_ = false;
+        conn_.send(command);
+        if (!wait([this] { return has_response_; }, std::chrono::milliseconds(opt_.timeout_ms))) {
+            std::fprintf(stderr, "%s: no response to '%s'\n", opt_.port, command.c_str());
+            return false;
+        }
+        if (!response_ok_) {
+            std::fprintf(stderr, "%s: '%s': %s\n", opt_.port, command.c_str(), response_.c_str());
+            return false;
+        }
+        if (p_body) *p_body = response_;
+        return true;
+    }
+
+    bool negotiate(unsigned baud_rate, bool flow_control) {
+        unsigned old_rate = conn_.baud_rate();
+        if (!request("H " + std::to_string(baud_rate) + (flow_control ? " F" : ""))) return false;
+        Clock::time_point switched = Clock::now();
+        std::this_thread::sleep_for(SWITCH_DELAY);
+        if (!conn_.set_baud_rate(baud_rate, flow_control)) {
+            std::fprintf(stderr, "%s: %s\n", opt_.port, conn_.error().c_str());
+        } else if (request("H C")) {
+            return true;
+        }
+        // the device goes back to the old rate by itself
+        std::this_thread::sleep_until(switched + REVERT_TIME);
+        conn_.set_baud_rate(old_rate);
+        return false;
+    }
+
+    // Switches without following, the device has to revert
+    bool check_revert(unsigned baud_rate) {
+        std::string status;
+        if (!request("H " + std::to_string(baud_rate))) return false;
+        std::this_thread::sleep_for(REVERT_TIME);
+        return request("H", &status) && std::strtoul(status.c_str(), nullptr, 10) == conn_.baud_rate();
+    }
+
+    bool run_test(TestResult &result) {
+        test_ = TestResult();
+        next_seq_ = 0;
+        if (!request("H T " + std::to_string(opt_.bytes))) return false;
+        // done when all bytes arrived or the stream stalls
+        while (test_.payload_bytes < opt_.bytes) {
+            uint64_t received = test_.payload_bytes;
+            wait([&] { return test_.payload_bytes != received; }, std::chrono::milliseconds(opt_.timeout_ms));
+            if (test_.payload_bytes == received) break;
+        }
+        result = test_;
+        if (test_.payload_bytes < opt_.bytes) {
+            request("H T 0");
+            return false;
+        }
+        return true;
+    }
+
+private:
+    template<typename Predicate>
+    bool wait(Predicate done, std::chrono::milliseconds timeout) {
+        Clock::time_point deadline = Clock::now() + timeout;
+        while (!done() && conn_.is_open()) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (remaining <= 0) break;
+            if (loop_.poll((int) remaining) < 0) break;
+        }
+        return done();
+    }
+
+    void handle_message(const Message &msg) {
+        if (msg.type == Message::Type::Ok || msg.type == Message::Type::Error) {
+            has_response_ = true;
+            response_ok_ = msg.type == Message::Type::Ok;
+            response_ = std::string(msg.text);
+        } else if (msg.type == Message::Type::Frame && msg.frame.type == FRAME_TEST && msg.frame.length >= 4) {
+            check_test_frame(msg.frame);
+        }
+    }
+
+    void check_test_frame(const Frame &frame) {
+        const uint8_t *p = frame.payload;
+        uint32_t seq = p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+        bool valid = seq >= next_seq_;
+        for (unsigned i = 4; i < frame.length && valid; i++) {
+            valid = p[i] == (uint8_t) (seq + i);
+        }
+        if (!valid) {
+            test_.corrupt++;
+            return;
+        }
+        test_.lost += seq - next_seq_;
+        next_seq_ = seq + 1;
+        test_.frames++;
+        test_.payload_bytes += frame.length;
+        test_.wire_bytes += frame.length + FRAME_OVERHEAD;
+        test_.end = Clock::now();
+        if (test_.frames == 1) {
+            test_.start = test_.end;
+        } else {
+            test_.timed_bytes += frame.length + FRAME_OVERHEAD;
+        }
+    }
+
+    const Options &opt_;
+    EventLoop loop_;
+    DeviceConnection conn_;
+    bool has_response_ = false;
+    bool response_ok_ = false;
+    std::string response_;
+    TestResult test_;
+    uint32_t next_seq_ = 0;
+};
+
+bool parse_rates(const char *list, std::vector<unsigned> &rates) {
+    rates.clear();
+    while (*list) {
+        char *end;
+        unsigned long rate = std::strtoul(list, &end, 10);
+        if (end == list || (*end != ',' && *end != '\0')) return false;
+        rates.push_back((unsigned) rate);
+        list = *end ? end + 1 : end;
+    }
+    return !rates.empty();
+}
+
+bool parse_options(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--", 2) != 0) {
+            if (opt.port) return false;
+            opt.port = argv[i];
+            continue;
+        }
+        if (!std::strcmp(argv[i], "--flow-control")) {
+            opt.flow_control = true;
+            continue;
+        }
+        if (!std::strcmp(argv[i], "--check-revert")) {
+            opt.check_revert = true;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        const char *value = argv[i + 1];
+        if (!std::strcmp(argv[i], "--rates")) {
+            if (!parse_rates(value, opt.rates)) return false;
+        } else if (!std::strcmp(argv[i], "--bytes")) {
+            opt.bytes = (uint32_t) std::strtoul(value, nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--timeout-ms")) {
+            opt.timeout_ms = (unsigned) std::strtoul(value, nullptr, 10);
+        } else {
+            return false;
+        }
+        i++;
+    }
+    return opt.port != nullptr && opt.bytes > 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--rates r1,r2,...] [--bytes n] [--flow-control] [--timeout-ms ms]"
+                             " [--check-revert] <serial port>\n", argv[0]);
+        return 1;
+    }
+
+    Bench bench(opt);
+    if (!bench.open()) return 1;
+    bool ok = true;
+    if (opt.check_revert) {
+        bool reverted = bench.check_revert(opt.rates.back());
+        std::printf("revert from %u: %s\n", opt.rates.back(), reverted ? "ok" : "FAILED");
+        ok = reverted;
+    }
+
+    std::printf("%8s %5s %7s %10s %5s %7s %8s %9s %6s\n", "baud", "flow", "frames", "bytes", "lost", "corrupt",
+                "time_ms", "kB/s", "load");
+    for (unsigned rate : opt.rates) {
+        bool flow_control = opt.flow_control && rate != DEFAULT_BAUD_RATE;
+        if (!bench.negotiate(rate, flow_control)) {
+            std::printf("%8u %5d negotiation failed\n", rate, flow_control);
+            ok = false;
+            continue;
+        }
+        TestResult result;
+        bool complete = bench.run_test(result);
+        double seconds = std::chrono::duration<double>(result.end - result.start).count();
+        double bytes_per_s = seconds > 0 ? result.timed_bytes / seconds : 0;
+        // share of the line rate (10 bits per byte) used by the frames
+        std::printf("%8u %5d %7u %10llu %5u %7u %8.1f %9.1f %5.1f%%%s\n", rate, flow_control, result.frames,
+                    (unsigned long long) result.payload_bytes, result.lost, result.corrupt, seconds * 1000,
+                    bytes_per_s / 1000, bytes_per_s * 1000 / rate, complete ? "" : " incomplete");
+        ok = ok && complete && result.lost == 0 && result.corrupt == 0;
+    }
+    if (bench.baud_rate() != DEFAULT_BAUD_RATE && !bench.negotiate(DEFAULT_BAUD_RATE, false)) {
+        std::fprintf(stderr, "%s: could not return to %u baud\n", opt.port, DEFAULT_BAUD_RATE);
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "mac_derive.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ADDR_BITS                       48
+#define FNV_OFFSET_BASIS                0x811c9dc5UL
+#define FNV_PRIME                       0x01000193UL
+
+static bool parse_number(const char *str, int base, uint32_t max, uint32_t *p_value) {
+    char *end;
+    // strtoul would accept leading spaces and signs
+    if (!isxdigit((unsigned char) *str)) {
+        return false;
+    }
+    unsigned long value = strtoul(str, &end, base);
+    if (*end != 0 || end == str || value > max) {
+        return false;
+    }
+    *p_value = (uint32_t) value;
+    return true;
+}
+
+bool mac_derive_parse(const char *token, mac_derive_rule_t *p_rule, uint16_t *p_value) {
+    uint32_t value;
+
+    if (token == NULL || *token == 0) {
+        return false;
+    }
+    p_rule->shift = 0;
+    p_rule->param = 0;
+    if (token[0] == '@') {
+        const char *colon = token + 1;
+        char shift[4];
+        uint8_t len = 0;
+        while (*colon && *colon != ':' && len < sizeof(shift) - 1) {
+            shift[len++] = *colon++;
+        }
+        shift[len] = 0;
+        if (!parse_number(shift, 10, ADDR_BITS - 1, &value)) {
+            return false;
+        }
+        p_rule->mode = MAC_DERIVE_BITS;
+        p_rule->shift = (uint8_t) value;
+        p_rule->param = 0xFFFF;
+        if (*colon == ':') {
+            if (!parse_number(colon + 1, 16, 0xFFFF, &value)) {
+                return false;
+            }
+            p_rule->param = (uint16_t) value;
+        } else if (*colon != 0) {
+            return false;
+        }
+        return true;
+    }
+    if (token[0] == '#') {
+        p_rule->mode = MAC_DERIVE_HASH;
+        if (token[1] != 0) {
+            if (!parse_number(token + 1, 10, 0xFFFF, &value)) {
+                return false;
+            }
+            p_rule->param = (uint16_t) value;
+        }
+        return true;
+    }
+    if (!parse_number(token, 10, 0xFFFF, &value)) {
+        return false;
+    }
+    p_rule->mode = MAC_DERIVE_FIXED;
+    *p_value = (uint16_t) value;
+    return true;
+}
+
+uint16_t mac_derive_value(const mac_derive_rule_t *p_rule, const uint8_t *addr, uint16_t value) {
+    uint64_t mac = 0;
+    for (int i = 5; i >= 0; i--) {
+        mac = (mac << 8) | addr[i];
+    }
+    if (p_rule->mode == MAC_DERIVE_BITS) {
+        return (uint16_t) ((mac >> p_rule->shift) & p_rule->param);
+    }
+    if (p_rule->mode == MAC_DERIVE_HASH) {
+        // FNV-1a over seed and address, folded to 16 bits
+        uint8_t data[8] = {(uint8_t) p_rule->param, (uint8_t) (p_rule->param >> 8)};
+        uint32_t hash = FNV_OFFSET_BASIS;
+        for (int i = 0; i < 6; i++) {
+            data[2 + i] = addr[i];
+        }
+        for (int i = 0; i < 8; i++) {
+            hash ^= data[i];
+            hash *= FNV_PRIME;
+        }
+        return (uint16_t) ((hash >> 16) ^ hash);
+    }
+    return value;
+}
+
+void mac_derive_format(const mac_derive_rule_t *p_rule, char *buf) {
+    if (p_rule->mode == MAC_DERIVE_BITS) {
+        sprintf(buf, "@%u:%X", (unsigned) p_rule->shift, (unsigned) p_rule->param);
+    } else if (p_rule->mode == MAC_DERIVE_HASH) {
+        sprintf(buf, "#%u", (unsigned) p_rule->param);
+    } else {
+        buf[0] = '-';
+        buf[1] = 0;
+    }
+}
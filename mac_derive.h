@@ -0,0 +1,39 @@
+#ifndef _MAC_DERIVE_H
+#define _MAC_DERIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Derives iBeacon major/minor values from the device address so that a single 'C' template gives
+// every device in a batch a unique identity. A value in the template is one of:
+//
+//   <number>              fixed value
+//   @<shift>[:<mask>]     (address >> shift) & mask, the mask is hex and defaults to FFFF
+//   #[<seed>]             16-bit hash of the address, different seeds give unrelated values
+//
+// The address is taken as a 48-bit number with the last byte of the printed form (AA:BB:..:FF) as
+// its least significant byte, so "@0" is the last two bytes of the printed address.
+
+typedef enum {
+    MAC_DERIVE_FIXED = 0,
+    MAC_DERIVE_BITS,
+    MAC_DERIVE_HASH
+} mac_derive_mode_t;
+
+typedef struct {
+    uint8_t mode;               // mac_derive_mode_t
+    uint8_t shift;              // MAC_DERIVE_BITS
+    uint16_t param;             // MAC_DERIVE_BITS: mask, MAC_DERIVE_HASH: seed
+} mac_derive_rule_t;
+
+// Maximum length of a formatted rule, including the terminator
+#define MAC_DERIVE_RULE_STR_LEN         12
+
+// Parses a template value, for fixed values *p_value is set as well
+bool mac_derive_parse(const char *token, mac_derive_rule_t *p_rule, uint16_t *p_value);
+// addr is in the order of ble_gap_addr_t (least significant byte first), fixed rules return value
+uint16_t mac_derive_value(const mac_derive_rule_t *p_rule, const uint8_t *addr, uint16_t value);
+// Formats a rule the way it is written in a template, fixed rules are formatted as "-"
+void mac_derive_format(const mac_derive_rule_t *p_rule, char *buf);
+
+#endif // _MAC_DERIVE_H
@@ -23,19 +23,96 @@
 #include "nrf_sdh_ble.h"
 #include "ble_advdata.h"
 #include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "app_error.h"
+#include "crc16.h"
 
 // Own modules
 #include "uart_cmd.h"
 #include "nvconfig.h"
 #include "hex_utils.h"
+#include "timebase.h"
+#include "timesync.h"
+#include "scanner.h"
+#include "scan_report.h"
+#include "radio_activity.h"
+#include "bloom.h"
+#include "mac_derive.h"
+#include "stats.h"
+#include "trace.h"
+#include "schedule.h"
+#include "eid.h"
+#include "eddystone.h"
+#include "swarm.h"
+#include "addr_rotation.h"
+#include "dfu.h"
+#include "factory_id.h"
+#include "power.h"
+#include "ram_usage.h"
+#include "fault.h"
 
 #define FIRMWARE_VERSION                "1.0.0"
 
 // Radio transmit power in dBm (accepted values are -40, -20, -16, -12, -8, -4, 0, 3, and 4 dBm).
 #define TX_POWER                        (-16)
 
-// iBeacon specifies an advertising interval of 100ms
-#define NON_CONNECTABLE_ADV_INTERVAL    MSEC_TO_UNITS(100, UNIT_0_625_MS)
+// Limits of the advertising interval for non-connectable advertising in ms
+#define MIN_ADV_INTERVAL_MS             100
+#define MAX_ADV_INTERVAL_MS             10240
+
+// Limits of advertising bursts, Bluetooth 5 allows non-connectable advertising down to 20 ms
+#define MIN_BURST_INTERVAL_MS           20
+#define MAX_BURST_DURATION_MS           60000
+
+// Limits of the scan interval in ms
+#define MIN_SCAN_INTERVAL_MS            3
+#define MAX_SCAN_INTERVAL_MS            10240
+
+// The schedule is re-evaluated at least this often, so corrections of the synchronized clock are picked up
+#define SCHEDULE_MAX_TIMEOUT_MS         60000
+
+// The EID rotation timer is re-armed at least this often, so corrections of the synchronized clock are picked up
+#define EID_MAX_TIMEOUT_MS              60000
+
+// Eddystone ranging data, the received power at 0 m is about 41 dB above APP_MEASURED_RSSI at 1 m
+#define EDDYSTONE_RANGING_DATA          (-40)
+
+// Interleaved TLM frames are re-encoded with fresh counters this often
+#define EDDYSTONE_TLM_UPDATE_INTERVAL   APP_TIMER_TICKS(1000)
+
+// Every advertising event sends the PDU on the three advertising channels
+#define ADV_PDUS_PER_EVENT              3
+
+// Advertising the SoftDevice refuses to start is retried, off air for 5 s it is a fatal error
+#define ADV_START_RETRY_INTERVAL        APP_TIMER_TICKS(100)
+#define ADV_START_MAX_RETRIES           50
+
+// Address rotations wait for the end of a radio event, but not longer than this number of retries
+#define ADDR_ROTATION_RETRY_INTERVAL    APP_TIMER_TICKS(5)
+#define ADDR_ROTATION_MAX_RETRIES       20
+
+// The rotation timer is re-armed at least this often, app_timer cannot time out after a full period of a day
+#define ADDR_ROTATION_MAX_TIMEOUT_MS    60000
+
+// Slot of the alternate burst payload, after the interleaved frames
+#define ADV_FRAME_BURST                 ADV_FRAME_COUNT
+
+// Partially filled scan report frames are sent after this time
+#define SCAN_REPORT_FLUSH_INTERVAL      APP_TIMER_TICKS(100)
+
+// Storage for the allowlist Bloom filter, 24 KB hold ~20000 identities at a false positive rate of 1%.
+// Whole kilobytes of SoftDevice RAM given up by MINIMAL_SOFTDEVICE_RAM builds are added (see CMakeLists.txt).
+#define BLOOM_FILTER_MAX_BYTES          (24 * 1024 + ((FULL_APP_RAM_START - APP_RAM_START) & ~0x3FF))
+
+_Static_assert(APP_RAM_START <= FULL_APP_RAM_START, "APP_RAM_START above FULL_APP_RAM_START shrinks the Bloom filter");
+
+// Statistics are dumped in pages of whole entries ('S <first entry>'), a page leaves most of the TX FIFO
+// to scan reports and always holds the uptime header and the longest entry
+#define STATS_PAGE_SIZE                 480
+
+// Reset into the bootloader after an activated firmware update, once the response has been sent
+#define DFU_RESET_DELAY                 APP_TIMER_TICKS(50)
 
 // tag identifying the SoftDevice BLE configuration
 #define APP_BLE_CONN_CFG_TAG            1
@@ -53,17 +130,99 @@
 // Beacon configuration
 static configuration_t m_beacon_cfg;
 
+// Advertising interval and TX power in effect, from the schedule or the configuration
+static schedule_state_t m_adv_state;
+static bool m_advertising;
+static uint8_t m_adv_start_retries;
+APP_TIMER_DEF(m_schedule_timer);
+APP_TIMER_DEF(m_adv_retry_timer);
+
+// Advertising burst, overrides the interval (and optionally the data) until the timer expires
+typedef struct {
+    bool active;
+    uint16_t interval_ms;
+    uint8_t data_len;               // 0: the regular frames are advertised
+    uint64_t end_us;
+    volatile uint32_t pdus;         // counted by adv_event_handler
+    uint32_t last_pdus;             // PDUs of the last completed burst
+    uint32_t count;
+} adv_burst_t;
+
+static adv_burst_t m_burst;
+APP_TIMER_DEF(m_burst_timer);
+
+// Set while the beacon swarm owns the radio, until its session is closed
+static bool m_swarm_active;
+
+// Address read at startup, major and minor are derived from it even while the address rotates
+static ble_gap_addr_t m_factory_addr;
+static uint32_t m_addr_rotations;
+static uint64_t m_addr_next_rotation_us;
+static uint8_t m_addr_retries;
+APP_TIMER_DEF(m_addr_timer);
+
 static ble_gap_adv_params_t m_adv_params;
 static uint8_t m_beacon_info[APP_BEACON_INFO_LENGTH];
 static ble_advdata_manuf_data_t m_manuf_specific_data;
 
+// Advertising data of the next EID rotation period, computed ahead of time and swapped in by the timer
+static eid_cache_t m_eid_cache;
+static uint8_t m_eid_next_data[BLE_GAP_ADV_SET_DATA_SIZE_MAX];
+static uint16_t m_eid_next_len;
+static uint64_t m_eid_next_rotation_us;
+APP_TIMER_DEF(m_eid_timer);
+
+// Pre-encoded frames, the advertiser moves through the sequence after each advertising event
+static uint8_t m_frames[ADV_FRAME_COUNT + 1][BLE_GAP_ADV_SET_DATA_SIZE_MAX];
+static uint8_t m_frame_lens[ADV_FRAME_COUNT + 1];
+static uint8_t m_frame_sequence[ADV_FRAME_COUNT * ADV_FRAME_MAX_RATIO] = {ADV_FRAME_IBEACON};
+static uint8_t m_frame_sequence_len = 1;
+static uint8_t m_frame_pos;
+APP_TIMER_DEF(m_tlm_timer);
+
 static uart_cmd_client_t m_uart_cmd_client;
 
+// Mapping of the local timebase to host time, fed by time sync commands
+static timesync_t m_timesync;
+
+APP_TIMER_DEF(m_dfu_reset_timer);
+
+static scanner_client_t m_scanner_client;
+static scan_report_encoder_t m_scan_report;
+APP_TIMER_DEF(m_scan_report_timer);
+
+// Allowlist prefilter, uploaded by the host. When enabled, only iBeacons passing it are reported.
+static uint8_t m_bloom_bits[BLOOM_FILTER_MAX_BYTES];
+static bloom_filter_t m_bloom;
+static volatile bool m_bloom_enabled;
+static uint32_t m_bloom_passed;
+static uint32_t m_bloom_rejected;
+
 void assert_nrf_callback(uint16_t line_num, const uint8_t *p_file_name) {
     app_error_handler(DEAD_BEEF, line_num, p_file_name);
 }
 
-static void advertising_init(const uint8_t *beacon_uuid, uint16_t major, uint16_t minor) {
+// Replaces the SDK's handler for fatal errors: records the error in the trace buffer and the fault record,
+// which survive the reset. Errors the firmware can recover from are handled where they occur.
+void app_error_fault_handler(uint32_t id, uint32_t pc, uint32_t info) {
+    uint16_t line = 0;
+    uint32_t err_code = 0;
+
+    if (id == NRF_FAULT_ID_SDK_ERROR) {
+        line = (uint16_t) ((const error_info_t *) info)->line_num;
+        err_code = ((const error_info_t *) info)->err_code;
+    } else if (id == NRF_FAULT_ID_SDK_ASSERT) {
+        line = ((const assert_info_t *) info)->line_num;
+    }
+    trace_record(TRACE_ERROR, 0, line, err_code);
+    trace_record(TRACE_ERROR_PC, 0, (uint16_t) id, pc);
+    fault_record(id, pc, info);
+    NVIC_SystemReset();
+}
+
+// Encodes the iBeacon advertising data for the given identifiers
+static void advertising_data_encode(const uint8_t *beacon_uuid, uint16_t major, uint16_t minor, uint8_t *p_data,
+                                    uint16_t *p_len) {
     uint32_t err_code;
     ble_advdata_t adv_data;
     uint8_t flags = BLE_GAP_ADV_FLAG_BR_EDR_NOT_SUPPORTED;
@@ -88,58 +247,1067 @@ static void advertising_init(const uint8_t *beacon_uuid, uint16_t major, uint16_
     adv_data.name_type = BLE_ADVDATA_NO_NAME;
     adv_data.flags = flags;
     adv_data.p_manuf_specific_data = &m_manuf_specific_data;
-    err_code = ble_advdata_set(&adv_data, NULL); // will set on SD via sd_ble_gap_adv_data_set
+    err_code = adv_data_encode(&adv_data, p_data, p_len);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void eid_block_encrypt(const uint8_t *p_key, const uint8_t *p_cleartext, uint8_t *p_ciphertext) {
+    nrf_ecb_hal_data_t ecb_data;
+
+    memcpy(ecb_data.key, p_key, SOC_ECB_KEY_LENGTH);
+    memcpy(ecb_data.cleartext, p_cleartext, SOC_ECB_CLEARTEXT_LENGTH);
+    ret_code_t err_code = sd_ecb_block_encrypt(&ecb_data);
+    APP_ERROR_CHECK(err_code);
+    memcpy(p_ciphertext, ecb_data.ciphertext, SOC_ECB_CIPHERTEXT_LENGTH);
+}
+
+// Replaces a pre-encoded frame, it is set right away if it is being advertised
+static void adv_frame_store(adv_frame_t frame, const uint8_t *p_data, uint8_t len) {
+    ret_code_t err_code = NRF_SUCCESS;
+
+    // adv_event_handler runs at a higher interrupt priority
+    CRITICAL_REGION_ENTER();
+    memcpy(m_frames[frame], p_data, len);
+    m_frame_lens[frame] = len;
+    if (m_frame_sequence[m_frame_pos] == frame) {
+        err_code = sd_ble_gap_adv_data_set(m_frames[frame], len, NULL, 0);
+    }
+    CRITICAL_REGION_EXIT();
+    APP_ERROR_CHECK(err_code);
+}
+
+// Swaps in the next frame after an advertising event, the SoftDevice copies the data
+static void adv_event_handler(void) {
+    if (m_burst.active) {
+        m_burst.pdus += ADV_PDUS_PER_EVENT;
+    }
+    if (m_frame_sequence_len <= 1) {
+        return;
+    }
+    m_frame_pos = (uint8_t) ((m_frame_pos + 1) % m_frame_sequence_len);
+    uint8_t frame = m_frame_sequence[m_frame_pos];
+    // the previous frame is advertised once more if the SoftDevice does not take the data
+    if (sd_ble_gap_adv_data_set(m_frames[frame], m_frame_lens[frame], NULL, 0) != NRF_SUCCESS) {
+        STATS_INC(ADV_DATA_ERRORS);
+    }
+}
+
+static void eddystone_tlm_update(void) {
+    uint8_t frame[EDDYSTONE_FRAME_MAX_LEN];
+    eddystone_tlm_t tlm;
+    radio_accounting_t accounting;
+    int32_t temperature;
+
+    radio_activity_get_accounting(&accounting);
+    tlm.battery_mv = 0; // USB powered
+    // 0.25 degrees Celsius per LSB, 64 in 8.8 fixed point
+    tlm.temperature = sd_temp_get(&temperature) == NRF_SUCCESS ? (int16_t) (temperature * 64) : INT16_MIN;
+    tlm.adv_count = accounting.events[RADIO_MODE_ADV] * ADV_PDUS_PER_EVENT;
+    tlm.uptime_100ms = (uint32_t) (timebase_now_us() / 100000);
+    adv_frame_store(ADV_FRAME_TLM, frame, eddystone_tlm_encode(&tlm, frame));
+}
+
+static void tlm_timer_handler(void *p_context) {
+    eddystone_tlm_update();
+}
+
+// Encodes the Eddystone frames and restarts the interleave cycle
+static void adv_frames_init(void) {
+    uint8_t frame[EDDYSTONE_FRAME_MAX_LEN];
+    uint8_t ratio[ADV_FRAME_COUNT];
+    const eddystone_config_t *p_eddystone = &m_beacon_cfg.eddystone;
+    ret_code_t err_code;
+
+    adv_frame_store(ADV_FRAME_UID, frame, eddystone_uid_encode(p_eddystone, EDDYSTONE_RANGING_DATA, frame));
+    adv_frame_store(ADV_FRAME_URL, frame, eddystone_url_frame_encode(p_eddystone, EDDYSTONE_RANGING_DATA, frame));
+    eddystone_tlm_update();
+
+    memcpy(ratio, p_eddystone->ratio, sizeof(ratio));
+    if (p_eddystone->url_len == 0) {
+        ratio[ADV_FRAME_URL] = 0;
+    }
+    CRITICAL_REGION_ENTER();
+    if (m_burst.active && m_burst.data_len > 0) {
+        // the alternate payload replaces all frames until the burst ends
+        m_frame_sequence[0] = ADV_FRAME_BURST;
+        m_frame_sequence_len = 1;
+    } else {
+        m_frame_sequence_len = eddystone_build_sequence(ratio, m_frame_sequence);
+    }
+    m_frame_pos = 0;
+    err_code = sd_ble_gap_adv_data_set(m_frames[m_frame_sequence[0]], m_frame_lens[m_frame_sequence[0]], NULL, 0);
+    CRITICAL_REGION_EXIT();
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_stop(m_tlm_timer);
     APP_ERROR_CHECK(err_code);
+    if (ratio[ADV_FRAME_TLM] > 0) {
+        err_code = app_timer_start(m_tlm_timer, EDDYSTONE_TLM_UPDATE_INTERVAL, NULL);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+// Encodes the advertising data for the given host time, with the identifiers replaced by the EID if enabled
+static void advertising_data_build(uint64_t host_time_us, uint8_t *p_data, uint16_t *p_len) {
+    uint8_t uuid[16];
+    uint8_t eid[EID_SIZE];
+    uint16_t major = m_beacon_cfg.beacon_major;
+    uint16_t minor = m_beacon_cfg.beacon_minor;
+
+    memcpy(uuid, m_beacon_cfg.beacon_uuid, sizeof(uuid));
+    if (m_beacon_cfg.eid.mode != EID_MODE_OFF) {
+        eid_compute(&m_beacon_cfg.eid, &m_eid_cache, eid_counter(&m_beacon_cfg.eid, host_time_us), eid_block_encrypt,
+                    eid);
+        eid_apply(m_beacon_cfg.eid.mode, eid, uuid, &major, &minor);
+    }
+    *p_len = BLE_GAP_ADV_SET_DATA_SIZE_MAX;
+    advertising_data_encode(uuid, major, minor, p_data, p_len);
+}
+
+static void eid_timer_start(uint64_t host_time_us) {
+    uint64_t until_ms = (m_eid_next_rotation_us - host_time_us) / 1000;
+    // lands just after the rotation
+    uint32_t timeout_ms = until_ms < EID_MAX_TIMEOUT_MS ? (uint32_t) until_ms + 1 : EID_MAX_TIMEOUT_MS;
+
+    ret_code_t err_code = app_timer_stop(m_eid_timer);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_start(m_eid_timer, APP_TIMER_TICKS(timeout_ms), NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void eid_prepare_next(uint64_t host_time_us) {
+    m_eid_next_rotation_us = eid_next_rotation_us(&m_beacon_cfg.eid, eid_counter(&m_beacon_cfg.eid, host_time_us));
+    advertising_data_build(m_eid_next_rotation_us, m_eid_next_data, &m_eid_next_len);
+    eid_timer_start(host_time_us);
+}
+
+// Sets the advertising data for the current time, also while advertising
+static void advertising_data_update(void) {
+    uint8_t data[BLE_GAP_ADV_SET_DATA_SIZE_MAX];
+    uint16_t len;
+    uint64_t now_us = timesync_local_to_host(&m_timesync, timebase_now_us());
+    ret_code_t err_code;
+
+    advertising_data_build(now_us, data, &len);
+    adv_frame_store(ADV_FRAME_IBEACON, data, (uint8_t) len);
+    if (m_beacon_cfg.eid.mode != EID_MODE_OFF) {
+        eid_prepare_next(now_us);
+    } else {
+        err_code = app_timer_stop(m_eid_timer);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+static void eid_timer_handler(void *p_context) {
+    uint64_t now_us = timesync_local_to_host(&m_timesync, timebase_now_us());
+
+    if (now_us < m_eid_next_rotation_us) {
+        eid_timer_start(now_us);
+    } else if (eid_counter(&m_beacon_cfg.eid, now_us) >> m_beacon_cfg.eid.rotation_exponent !=
+               eid_counter(&m_beacon_cfg.eid, m_eid_next_rotation_us) >> m_beacon_cfg.eid.rotation_exponent) {
+        // more than a period late, the precomputed data is outdated as well
+        advertising_data_update();
+    } else {
+        adv_frame_store(ADV_FRAME_IBEACON, m_eid_next_data, (uint8_t) m_eid_next_len);
+        eid_prepare_next(now_us);
+    }
+}
+
+// Interval in effect, a burst overrides the schedule
+static uint16_t advertising_interval_ms(void) {
+    return m_burst.active ? m_burst.interval_ms : m_adv_state.adv_interval_ms;
+}
+
+static void advertising_init(void) {
+    advertising_data_update();
+    adv_frames_init();
 
     // Initialize advertising parameters (used when starting advertising).
     memset(&m_adv_params, 0, sizeof(m_adv_params));
     m_adv_params.type = BLE_GAP_ADV_TYPE_ADV_NONCONN_IND;
     m_adv_params.p_peer_addr = NULL;    // Undirected advertisement.
     m_adv_params.fp = BLE_GAP_ADV_FP_ANY;
-    m_adv_params.interval = NON_CONNECTABLE_ADV_INTERVAL;
+    m_adv_params.interval = MSEC_TO_UNITS(advertising_interval_ms(), UNIT_0_625_MS);
     m_adv_params.timeout = 0;       // Never time out
 }
 
 static void advertising_stop(void) {
+    if (!m_advertising) {
+        return;
+    }
     ret_code_t err_code = sd_ble_gap_adv_stop();
-    APP_ERROR_CHECK(err_code);
+    // NRF_ERROR_INVALID_STATE: not advertising any more, which is what we want
+    if (err_code != NRF_ERROR_INVALID_STATE) {
+        APP_ERROR_CHECK(err_code);
+    }
+    m_advertising = false;
+    trace_record(TRACE_ADV_STOP, 0, 0, 0);
+    radio_activity_adv_started(0);
 }
 
 static void advertising_start(void) {
     ret_code_t err_code;
+
+    // switched off by the schedule, or the radio belongs to the swarm
+    if (advertising_interval_ms() == 0 || m_swarm_active) {
+        return;
+    }
     err_code = sd_ble_gap_adv_start(&m_adv_params, APP_BLE_CONN_CFG_TAG);
+    if (err_code != NRF_SUCCESS && m_adv_start_retries < ADV_START_MAX_RETRIES) {
+        m_adv_start_retries++;
+        STATS_INC(ADV_START_RETRIES);
+        err_code = app_timer_start(m_adv_retry_timer, ADV_START_RETRY_INTERVAL, NULL);
+        APP_ERROR_CHECK(err_code);
+        return;
+    }
+    APP_ERROR_CHECK(err_code);
+    m_adv_start_retries = 0;
+    m_advertising = true;
+    STATS_INC(ADV_STARTS);
+    trace_record(TRACE_ADV_START, 0, advertising_interval_ms(), 0);
+    radio_activity_adv_started(advertising_interval_ms());
+}
+
+// Applies the advertising state for the current time and arms the timer for the next change. The schedule
+// is only followed once the host time is known, the configured interval is used before that.
+// Advertising is always restarted if restart is set, e.g. for changed advertising data.
+static void schedule_update(bool restart) {
+    ret_code_t err_code;
+    uint32_t timeout_ms = SCHEDULE_MAX_TIMEOUT_MS;
+    schedule_state_t state = {
+            .window = -1,
+            .tx_power = TX_POWER,
+            .adv_interval_ms = m_beacon_cfg.adv_interval_ms
+    };
+
+    if (m_beacon_cfg.schedule.window_count > 0 && timesync_is_synchronized(&m_timesync)) {
+        uint64_t now_us = timesync_local_to_host(&m_timesync, timebase_now_us());
+        schedule_evaluate(&m_beacon_cfg.schedule, now_us, &state);
+        uint64_t until_ms = (schedule_next_change_us(&m_beacon_cfg.schedule, now_us) - now_us) / 1000;
+        if (until_ms < timeout_ms) {
+            // lands just after the change
+            timeout_ms = (uint32_t) until_ms + 1;
+        }
+    }
+    // rotating identifiers need the host time, the configured ones are not advertised meanwhile
+    if (m_beacon_cfg.eid.mode != EID_MODE_OFF && !timesync_is_synchronized(&m_timesync)) {
+        state.adv_interval_ms = 0;
+    }
+
+    if (restart || state.adv_interval_ms != m_adv_state.adv_interval_ms || state.tx_power != m_adv_state.tx_power) {
+        advertising_stop();
+        if (state.tx_power != m_adv_state.tx_power) {
+            err_code = sd_ble_gap_tx_power_set(state.tx_power);
+            APP_ERROR_CHECK(err_code);
+            radio_activity_set_tx_power(state.tx_power);
+        }
+        m_adv_state = state;
+        advertising_init();
+        advertising_start();
+    }
+    m_adv_state.window = state.window;
+
+    err_code = app_timer_stop(m_schedule_timer);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_start(m_schedule_timer, APP_TIMER_TICKS(timeout_ms), NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void schedule_timer_handler(void *p_context) {
+    schedule_update(false);
+}
+
+// advertising_start checks again whether advertising is wanted at all by now
+static void adv_retry_timer_handler(void *p_context) {
+    if (!m_advertising) {
+        advertising_start();
+    }
+}
+
+static void burst_start(uint16_t interval_ms, uint32_t duration_ms, const uint8_t *p_data, uint8_t len) {
+    ret_code_t err_code;
+
+    // a running burst is replaced, its PDUs are carried over
+    m_burst.active = true;
+    m_burst.interval_ms = interval_ms;
+    m_burst.end_us = timebase_now_us() + (uint64_t) duration_ms * 1000;
+    memcpy(m_frames[ADV_FRAME_BURST], p_data, len);
+    m_frame_lens[ADV_FRAME_BURST] = len;
+    m_burst.data_len = len;
+    STATS_INC(ADV_BURSTS);
+
+    err_code = app_timer_stop(m_burst_timer);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_start(m_burst_timer, APP_TIMER_TICKS(duration_ms), NULL);
     APP_ERROR_CHECK(err_code);
+    schedule_update(true);
+}
+
+static void burst_end(void) {
+    ret_code_t err_code;
+
+    if (!m_burst.active) {
+        return;
+    }
+    err_code = app_timer_stop(m_burst_timer);
+    APP_ERROR_CHECK(err_code);
+    // no more advertising events are counted for this burst
+    advertising_stop();
+    m_burst.active = false;
+    m_burst.last_pdus = m_burst.pdus;
+    m_burst.pdus = 0;
+    m_burst.count++;
+    STATS_ADD(ADV_BURST_PDUS, m_burst.last_pdus);
+    schedule_update(true);
+}
+
+static void burst_timer_handler(void *p_context) {
+    burst_end();
+}
+
+static void scanning_start(void) {
+    ret_code_t err_code;
+
+    // the swarm needs the radio for itself
+    uint16_t scan_window_ms = m_swarm_active ? 0 : m_beacon_cfg.scan_window_ms;
+
+    err_code = scanner_start(m_beacon_cfg.scan_interval_ms, scan_window_ms);
+    APP_ERROR_CHECK(err_code);
+    if (scan_window_ms > 0) {
+        trace_record(TRACE_SCAN_START, 0, scan_window_ms, 0);
+        err_code = app_timer_start(m_scan_report_timer, SCAN_REPORT_FLUSH_INTERVAL, NULL);
+    } else {
+        trace_record(TRACE_SCAN_STOP, 0, 0, 0);
+        err_code = app_timer_stop(m_scan_report_timer);
+    }
+    APP_ERROR_CHECK(err_code);
+}
+
+// Sets the next address from the pool, or the factory address if rotation is off. The SoftDevice does not
+// accept a new address while advertising or scanning, both are stopped meanwhile.
+static void addr_rotate(void) {
+    ble_gap_addr_t addr;
+    bool advertising = m_advertising;
+    ret_code_t err_code;
+
+    if (m_beacon_cfg.addr_rotation.mode == ADDR_ROTATION_OFF) {
+        addr = m_factory_addr;
+    } else if (addr_rotation_take(addr.addr)) {
+        addr.addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+    } else {
+        STATS_INC(ADDR_POOL_EMPTY);
+        return;
+    }
+
+    advertising_stop();
+    err_code = scanner_stop();
+    APP_ERROR_CHECK(err_code);
+    err_code = sd_ble_gap_addr_set(&addr);
+    APP_ERROR_CHECK(err_code);
+    scanning_start();
+    if (advertising) {
+        advertising_start();
+    }
+    if (m_beacon_cfg.addr_rotation.mode != ADDR_ROTATION_OFF) {
+        m_addr_rotations++;
+        STATS_INC(ADDR_ROTATIONS);
+    }
+    addr_rotation_fill();
+}
+
+// Arms the timer for the next rotation, or a part of the way there
+static void addr_timer_start(uint64_t now_us) {
+    uint64_t timeout_ms = ADDR_ROTATION_MAX_TIMEOUT_MS;
+    if (m_addr_next_rotation_us < now_us + timeout_ms * 1000) {
+        timeout_ms = m_addr_next_rotation_us > now_us ? (m_addr_next_rotation_us - now_us) / 1000 + 1 : 1;
+    }
+    ret_code_t err_code = app_timer_start(m_addr_timer, APP_TIMER_TICKS((uint32_t) timeout_ms), NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void addr_timer_handler(void *p_context) {
+    uint64_t now_us = timebase_now_us();
+    ret_code_t err_code;
+
+    if (now_us < m_addr_next_rotation_us) {
+        addr_timer_start(now_us);
+        return;
+    }
+    // rotate in the gap between radio events, unless the radio never idles (continuous scanning)
+    if (radio_activity_is_active() && m_addr_retries < ADDR_ROTATION_MAX_RETRIES) {
+        m_addr_retries++;
+        err_code = app_timer_start(m_addr_timer, ADDR_ROTATION_RETRY_INTERVAL, NULL);
+        APP_ERROR_CHECK(err_code);
+        return;
+    }
+    m_addr_retries = 0;
+    addr_rotate();
+    m_addr_next_rotation_us = now_us + m_beacon_cfg.addr_rotation.period_s * 1000000ULL;
+    addr_timer_start(now_us);
+}
+
+// Applies the rotation configuration right away
+static void addr_rotation_update(void) {
+    uint64_t now_us = timebase_now_us();
+    ret_code_t err_code = app_timer_stop(m_addr_timer);
+    APP_ERROR_CHECK(err_code);
+    m_addr_retries = 0;
+    addr_rotate();
+    if (m_beacon_cfg.addr_rotation.mode != ADDR_ROTATION_OFF) {
+        m_addr_next_rotation_us = now_us + m_beacon_cfg.addr_rotation.period_s * 1000000ULL;
+        addr_timer_start(now_us);
+    }
 }
 
 static void handle_information_cmd() {
     char buf[256];
     char mac_addr_str[32];
+    char adv_addr_str[32];
     char uuid_str[33];
+    char major_rule_str[MAC_DERIVE_RULE_STR_LEN];
+    char minor_rule_str[MAC_DERIVE_RULE_STR_LEN];
     ble_gap_addr_t mac_addr;
 
-    // Send firmware version and MAC address
+    // Send firmware version, factory MAC address and the address currently advertised
+    sprintf(mac_addr_str, "%02X:%02X:%02X:%02X:%02X:%02X", m_factory_addr.addr[5], m_factory_addr.addr[4],
+            m_factory_addr.addr[3], m_factory_addr.addr[2], m_factory_addr.addr[1], m_factory_addr.addr[0]);
     sd_ble_gap_addr_get(&mac_addr);
-    sprintf(mac_addr_str, "%2X:%2X:%2X:%2X:%2X:%2X", mac_addr.addr[5], mac_addr.addr[4], mac_addr.addr[3],
+    sprintf(adv_addr_str, "%02X:%02X:%02X:%02X:%02X:%02X", mac_addr.addr[5], mac_addr.addr[4], mac_addr.addr[3],
             mac_addr.addr[2], mac_addr.addr[1], mac_addr.addr[0]);
     for (int i = 0; i < 16; i++) {
         uint8_to_hex_char(m_beacon_cfg.beacon_uuid[i], &uuid_str[2*i]);
     }
     uuid_str[32] = 0;
-    sprintf(buf, "V%s %s %s %d %d", FIRMWARE_VERSION, mac_addr_str, uuid_str, m_beacon_cfg.beacon_major, m_beacon_cfg.beacon_minor);
+    mac_derive_format(&m_beacon_cfg.major_rule, major_rule_str);
+    mac_derive_format(&m_beacon_cfg.minor_rule, minor_rule_str);
+    sprintf(buf, "V%s %s %s %d %d %s %s %s", FIRMWARE_VERSION, mac_addr_str, uuid_str, m_beacon_cfg.beacon_major,
+            m_beacon_cfg.beacon_minor, major_rule_str, minor_rule_str, adv_addr_str);
     uart_cmd_send_information_response(buf);
 }
 
-static void handle_configuration_cmd(const uint8_t *proximity_uuid, uint16_t major, uint16_t minor) {
+static void handle_configuration_cmd(const uint8_t *proximity_uuid, uint16_t major, uint16_t minor,
+                                     const mac_derive_rule_t *p_major_rule, const mac_derive_rule_t *p_minor_rule) {
     ret_code_t err_code;
 
+    // derived values are stored like fixed ones, the rules are only kept to be shown by 'I'
     memcpy(m_beacon_cfg.beacon_uuid, proximity_uuid, 16);
-    m_beacon_cfg.beacon_major = major;
-    m_beacon_cfg.beacon_minor = minor;
+    m_beacon_cfg.beacon_major = mac_derive_value(p_major_rule, m_factory_addr.addr, major);
+    m_beacon_cfg.beacon_minor = mac_derive_value(p_minor_rule, m_factory_addr.addr, minor);
+    m_beacon_cfg.major_rule = *p_major_rule;
+    m_beacon_cfg.minor_rule = *p_minor_rule;
     err_code = nvconfig_save(&m_beacon_cfg);
 
-    advertising_stop();
-    advertising_init(m_beacon_cfg.beacon_uuid, m_beacon_cfg.beacon_major, m_beacon_cfg.beacon_minor);
-    advertising_start();
+    schedule_update(true);
+    uart_cmd_send_configuration_response(err_code);
+}
+
+static void handle_time_sync_cmd(uint64_t host_time_us, uint64_t rx_time_us) {
+    char buf[96];
+    char now_str[21];
+    char offset_str[22];
+
+    timesync_add_sample(&m_timesync, rx_time_us, host_time_us);
+    uint64_to_dec_string(timesync_local_to_host(&m_timesync, timebase_now_us()), now_str);
+    int64_to_dec_string(m_timesync.offset_us, offset_str);
+    sprintf(buf, "%s %s %ld %d", now_str, offset_str, (long) m_timesync.drift_ppb, m_timesync.sample_count);
+    uart_cmd_send_information_response(buf);
+    // the first sample enables the schedule, later ones may step the clock
+    if (m_beacon_cfg.eid.mode != EID_MODE_OFF) {
+        advertising_data_update();
+    }
+    schedule_update(false);
+}
+
+static void handle_airtime_cmd(const int32_t *args, uint8_t arg_count) {
+    char buf[128];
+    radio_activity_counters_t counters;
+
+    if (arg_count == 0) {
+        radio_activity_get_counters(&counters);
+        const scan_report_stats_t *p_report = &m_scan_report.stats;
+        // the compression ratio is raw / encoded bytes
+        sprintf(buf, "%u %u %u %lu %lu %lu %lu %lu %lu %lu", m_beacon_cfg.adv_interval_ms,
+                m_beacon_cfg.scan_interval_ms, m_beacon_cfg.scan_window_ms, counters.adv_events,
+                counters.adv_events_skipped, counters.scan_events, p_report->records, p_report->raw_bytes,
+                p_report->encoded_bytes, p_report->records > 0 ? p_report->cycles / p_report->records : 0);
+        uart_cmd_send_information_response(buf);
+        return;
+    }
+
+    int32_t adv_interval = args[0];
+    int32_t scan_interval = arg_count > 1 ? args[1] : m_beacon_cfg.scan_interval_ms;
+    int32_t scan_window = arg_count > 2 ? args[2] : m_beacon_cfg.scan_window_ms;
+    if (adv_interval < MIN_ADV_INTERVAL_MS || adv_interval > MAX_ADV_INTERVAL_MS ||
+        scan_interval < MIN_SCAN_INTERVAL_MS || scan_interval > MAX_SCAN_INTERVAL_MS ||
+        (scan_window != 0 && (scan_window < RADIO_ACTIVITY_MIN_SCAN_WINDOW_MS || scan_window > scan_interval))) {
+        uart_cmd_send_configuration_response(NRF_ERROR_INVALID_PARAM);
+        return;
+    }
+
+    m_beacon_cfg.adv_interval_ms = (uint16_t) adv_interval;
+    m_beacon_cfg.scan_interval_ms = (uint16_t) scan_interval;
+    m_beacon_cfg.scan_window_ms = (uint16_t) scan_window;
+    ret_code_t err_code = nvconfig_save(&m_beacon_cfg);
+
+    schedule_update(true);
+    scanning_start();
+    uart_cmd_send_configuration_response(err_code);
+}
+
+static bool tx_power_valid(int32_t tx_power) {
+    static const int8_t accepted[] = {-40, -20, -16, -12, -8, -4, 0, 3, 4};
+    for (int i = 0; i < sizeof(accepted); i++) {
+        if (accepted[i] == tx_power) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void handle_schedule_cmd(const uart_cmd_evt_t *p_evt) {
+    char buf[64];
+    const int32_t *args = p_evt->args;
+    schedule_t *p_schedule = &m_beacon_cfg.schedule;
+    schedule_window_t window;
+    bool valid;
+
+    switch (p_evt->subcommand) {
+        case 0:
+            sprintf(buf, "%d %u %d %d %u %d", timesync_is_synchronized(&m_timesync), p_schedule->window_count,
+                    p_schedule->utc_offset_min, m_adv_state.window, m_adv_state.adv_interval_ms, m_adv_state.tx_power);
+            uart_cmd_send_information_response(buf);
+            return;
+        case 'G':
+            if (p_evt->arg_count != 1 || args[0] < 0 || args[0] >= p_schedule->window_count) {
+                uart_cmd_send_configuration_response(NRF_ERROR_INVALID_PARAM);
+                return;
+            }
+            window = p_schedule->windows[args[0]];
+            sprintf(buf, "%u %u %u %u %d", window.days, window.start_min, window.end_min, window.adv_interval_ms,
+                    window.tx_power);
+            uart_cmd_send_information_response(buf);
+            return;
+        case 'S':
+            window.days = (uint8_t) args[1];
+            window.start_min = (uint16_t) args[2];
+            window.end_min = (uint16_t) args[3];
+            window.adv_interval_ms = (uint16_t) args[4];
+            window.tx_power = (int8_t) args[5];
+            valid = p_evt->arg_count == 6 && args[0] >= 0 && args[0] < SCHEDULE_MAX_WINDOWS &&
+                    args[1] >= 0 && args[1] <= SCHEDULE_ALL_DAYS && args[2] >= 0 && args[3] >= 0 &&
+                    (args[4] == 0 || (args[4] >= MIN_ADV_INTERVAL_MS && args[4] <= MAX_ADV_INTERVAL_MS)) &&
+                    tx_power_valid(args[5]) && schedule_set_window(p_schedule, (uint8_t) args[0], &window);
+            break;
+        case 'D':
+            valid = p_evt->arg_count == 1 && args[0] >= 0 && schedule_delete_window(p_schedule, (uint8_t) args[0]);
+            break;
+        case 'C':
+            schedule_clear(p_schedule);
+            valid = true;
+            break;
+        case 'Z':
+            valid = p_evt->arg_count == 1 && args[0] >= SCHEDULE_MIN_UTC_OFFSET && args[0] <= SCHEDULE_MAX_UTC_OFFSET;
+            if (valid) {
+                p_schedule->utc_offset_min = (int16_t) args[0];
+            }
+            break;
+        default:
+            valid = false;
+            break;
+    }
+    if (!valid) {
+        uart_cmd_send_configuration_response(NRF_ERROR_INVALID_PARAM);
+        return;
+    }
+
+    ret_code_t err_code = nvconfig_save(&m_beacon_cfg);
+    schedule_update(false);
+    uart_cmd_send_configuration_response(err_code);
+}
+
+static void handle_eid_cmd(const uart_cmd_evt_t *p_evt) {
+    char buf[64];
+    char eid_str[2 * EID_SIZE + 1];
+    uint8_t eid[EID_SIZE];
+    eid_config_t *p_eid = &m_beacon_cfg.eid;
+
+    if (p_evt->subcommand == 0) {
+        if (p_eid->mode == EID_MODE_OFF || !timesync_is_synchronized(&m_timesync)) {
+            sprintf(buf, "%u %u %lu - -", p_eid->mode, p_eid->rotation_exponent, p_eid->epoch_s);
+        } else {
+            uint32_t counter = eid_counter(p_eid, timesync_local_to_host(&m_timesync, timebase_now_us()));
+            eid_compute(p_eid, &m_eid_cache, counter, eid_block_encrypt, eid);
+            for (int i = 0; i < EID_SIZE; i++) {
+                uint8_to_hex_char(eid[i], &eid_str[2 * i]);
+            }
+            eid_str[2 * EID_SIZE] = 0;
+            sprintf(buf, "%u %u %lu %lu %s", p_eid->mode, p_eid->rotation_exponent, p_eid->epoch_s, counter, eid_str);
+        }
+        uart_cmd_send_information_response(buf);
+        return;
+    }
+
+    if (p_evt->subcommand == 'S') {
+        int32_t mode = p_evt->args[0];
+        int32_t exponent = p_evt->args[1];
+        if (mode <= EID_MODE_OFF || mode >= EID_MODE_COUNT || exponent < EID_MIN_ROTATION_EXPONENT ||
+            exponent > EID_MAX_ROTATION_EXPONENT || p_evt->data_len != EID_KEY_SIZE) {
+            uart_cmd_send_configuration_response(NRF_ERROR_INVALID_PARAM);
+            return;
+        }
+        p_eid->mode = (uint8_t) mode;
+        p_eid->rotation_exponent = (uint8_t) exponent;
+        p_eid->epoch_s = (uint32_t) p_evt->args[2];
+        memcpy(p_eid->identity_key, p_evt->data, EID_KEY_SIZE);
+    } else {
+        // 'O'
+        memset(p_eid, 0, sizeof(*p_eid));
+    }
+    m_eid_cache.valid = false;
+
+    ret_code_t err_code = nvconfig_save(&m_beacon_cfg);
+    schedule_update(true);
+    uart_cmd_send_configuration_response(err_code);
+}
+
+static void handle_eddystone_cmd(const uart_cmd_evt_t *p_evt) {
+    char buf[128];
+    eddystone_config_t *p_eddystone = &m_beacon_cfg.eddystone;
+    bool valid;
+
+    switch (p_evt->subcommand) {
+        case 0: {
+            uint32_t len = sprintf(buf, "%u %u %u %u ", p_eddystone->ratio[ADV_FRAME_IBEACON],
+                                   p_eddystone->ratio[ADV_FRAME_UID], p_eddystone->ratio[ADV_FRAME_URL],
+                                   p_eddystone->ratio[ADV_FRAME_TLM]);
+            for (int i = 0; i < EDDYSTONE_NAMESPACE_SIZE; i++, len += 2) {
+                uint8_to_hex_char(p_eddystone->namespace_id[i], &buf[len]);
+            }
+            for (int i = 0; i < EDDYSTONE_INSTANCE_SIZE; i++, len += 2) {
+                uint8_to_hex_char(p_eddystone->instance_id[i], &buf[len]);
+            }
+            buf[len++] = ' ';
+            if (p_eddystone->url_len == 0) {
+                buf[len++] = '-';
+            }
+            for (int i = 0; i < p_eddystone->url_len; i++, len += 2) {
+                uint8_to_hex_char(p_eddystone->url[i], &buf[len]);
+            }
+            buf[len] = 0;
+            uart_cmd_send_information_response(buf);
+            return;
+        }
+        case 'R':
+            valid = p_evt->arg_count == ADV_FRAME_COUNT;
+            for (int i = 0; valid && i < ADV_FRAME_COUNT; i++) {
+                valid = p_evt->args[i] >= 0 && p_evt->args[i] <= ADV_FRAME_MAX_RATIO;
+            }
+            if (valid) {
+                for (int i = 0; i < ADV_FRAME_COUNT; i++) {
+                    p_eddystone->ratio[i] = (uint8_t) p_evt->args[i];
+                }
+            }
+            break;
+        case 'U':
+            valid = p_evt->data_len == EDDYSTONE_NAMESPACE_SIZE + EDDYSTONE_INSTANCE_SIZE;
+            if (valid) {
+                memcpy(p_eddystone->namespace_id, p_evt->data, EDDYSTONE_NAMESPACE_SIZE);
+                memcpy(p_eddystone->instance_id, &p_evt->data[EDDYSTONE_NAMESPACE_SIZE], EDDYSTONE_INSTANCE_SIZE);
+            }
+            break;
+        case 'L': {
+            // a rejected URL leaves the configured one in place
+            uint8_t url[EDDYSTONE_URL_MAX_LEN];
+            uint8_t url_len;
+            valid = eddystone_url_encode((const char *) p_evt->data, url, &url_len);
+            if (valid) {
+                memcpy(p_eddystone->url, url, url_len);
+                p_eddystone->url_len = url_len;
+            }
+            break;
+        }
+        default:
+            valid = false;
+            break;
+    }
+    if (!valid) {
+        uart_cmd_send_configuration_response(NRF_ERROR_INVALID_PARAM);
+        return;
+    }
+
+    ret_code_t err_code = nvconfig_save(&m_beacon_cfg);
+    adv_frames_init();
+    uart_cmd_send_configuration_response(err_code);
+}
+
+static void handle_burst_cmd(const uart_cmd_evt_t *p_evt) {
+    char buf[64];
+
+    if (p_evt->subcommand == 0) {
+        uint32_t remaining_ms = 0;
+        uint64_t now_us = timebase_now_us();
+        if (m_burst.active && m_burst.end_us > now_us) {
+            remaining_ms = (uint32_t) ((m_burst.end_us - now_us) / 1000);
+        }
+        sprintf(buf, "%u %u %lu %lu %lu %lu", m_burst.active, m_burst.active ? m_burst.interval_ms : 0,
+                remaining_ms, m_burst.pdus, m_burst.last_pdus, m_burst.count);
+        uart_cmd_send_information_response(buf);
+        return;
+    }
+
+    if (p_evt->subcommand == 'S') {
+        int32_t interval_ms = p_evt->args[0];
+        int32_t duration_ms = p_evt->args[1];
+        if (p_evt->arg_count != 2 || interval_ms < MIN_BURST_INTERVAL_MS || interval_ms > MAX_ADV_INTERVAL_MS ||
+            duration_ms <= 0 || duration_ms > MAX_BURST_DURATION_MS || p_evt->data_len > BLE_GAP_ADV_SET_DATA_SIZE_MAX) {
+            uart_cmd_send_configuration_response(NRF_ERROR_INVALID_PARAM);
+            return;
+        }
+        // the configured identifiers must not leak while the rotating ones wait for the time
+        if (p_evt->data_len == 0 && m_beacon_cfg.eid.mode != EID_MODE_OFF && !timesync_is_synchronized(&m_timesync)) {
+            uart_cmd_send_configuration_response(NRF_ERROR_INVALID_STATE);
+            return;
+        }
+        burst_start((uint16_t) interval_ms, (uint32_t) duration_ms, p_evt->data, p_evt->data_len);
+    } else {
+        // 'C'
+        burst_end();
+    }
+    uart_cmd_send_configuration_response(NRF_SUCCESS);
+}
+
+// Returns the radio to the SoftDevice advertiser and scanner
+static void swarm_stopped_handler(void) {
+    m_swarm_active = false;
+    schedule_update(true);
+    scanning_start();
+}
+
+static void handle_swarm_cmd(const uart_cmd_evt_t *p_evt) {
+    char buf[128];
+    swarm_status_t status;
+    ret_code_t err_code;
+
+    if (p_evt->subcommand == 0) {
+        uint32_t pdus_per_s = 0;
+        swarm_get_status(&status);
+        uint64_t elapsed_us = timebase_now_us() - status.started_us;
+        if (status.running && elapsed_us > 0) {
+            pdus_per_s = (uint32_t) ((uint64_t) status.pdus * 1000000 / elapsed_us);
+        }
+        sprintf(buf, "%u %u %u %lu %lu %lu %lu %lu %lu", status.running, status.count, status.interval_ms,
+                status.pdus, pdus_per_s, status.events, status.dropped, status.slots, status.blocked);
+        uart_cmd_send_information_response(buf);
+        return;
+    }
+
+    if (p_evt->subcommand == 'S') {
+        int32_t count = p_evt->args[0];
+        int32_t interval_ms = p_evt->args[1];
+        uint32_t seed = p_evt->arg_count > 2 ? (uint32_t) p_evt->args[2] : 0;
+        if (p_evt->arg_count < 2 || count <= 0 || count > SWARM_PLAN_MAX_IDENTITIES ||
+            interval_ms < MIN_BURST_INTERVAL_MS || interval_ms > MAX_ADV_INTERVAL_MS) {
+            uart_cmd_send_configuration_response(NRF_ERROR_INVALID_PARAM);
+            return;
+        }
+        if (m_swarm_active) {
+            uart_cmd_send_configuration_response(NRF_ERROR_BUSY);
+            return;
+        }
+        m_swarm_active = true;
+        advertising_stop();
+        scanning_start();
+        // the identities share the configured UUID and major, the minor counts up from the configured one
+        err_code = swarm_start((uint16_t) count, (uint16_t) interval_ms, seed, m_beacon_cfg.beacon_uuid,
+                               m_beacon_cfg.beacon_major, m_beacon_cfg.beacon_minor, (int8_t) APP_MEASURED_RSSI,
+                               m_adv_state.tx_power);
+        if (err_code != NRF_SUCCESS) {
+            // not called by the swarm module for a failed start
+            swarm_stopped_handler();
+        }
+    } else {
+        // 'C'
+        err_code = swarm_stop();
+    }
+    uart_cmd_send_configuration_response(err_code);
+}
+
+static void handle_addr_rotation_cmd(const uart_cmd_evt_t *p_evt) {
+    char buf[64];
+    ble_gap_addr_t addr;
+    addr_rotation_config_t *p_rotation = &m_beacon_cfg.addr_rotation;
+
+    switch (p_evt->subcommand) {
+        case 0:
+            sd_ble_gap_addr_get(&addr);
+            sprintf(buf, "%u %lu %lu %u %02X:%02X:%02X:%02X:%02X:%02X", p_rotation->mode, p_rotation->period_s,
+                    m_addr_rotations, addr_rotation_fill(), addr.addr[5], addr.addr[4], addr.addr[3], addr.addr[2],
+                    addr.addr[1], addr.addr[0]);
+            uart_cmd_send_information_response(buf);
+            return;
+        case 'S':
+            if (p_evt->arg_count != 1 || p_evt->args[0] < ADDR_ROTATION_MIN_PERIOD_S ||
+                p_evt->args[0] > ADDR_ROTATION_MAX_PERIOD_S) {
+                uart_cmd_send_configuration_response(NRF_ERROR_INVALID_PARAM);
+                return;
+            }
+            p_rotation->mode = ADDR_ROTATION_STATIC;
+            p_rotation->period_s = (uint32_t) p_evt->args[0];
+            break;
+        case 'O':
+            p_rotation->mode = ADDR_ROTATION_OFF;
+            break;
+        default:
+            uart_cmd_send_configuration_response(NRF_ERROR_INVALID_PARAM);
+            return;
+    }
+
+    ret_code_t err_code = nvconfig_save(&m_beacon_cfg);
+    addr_rotation_update();
+    uart_cmd_send_configuration_response(err_code);
+}
+
+// Responses to 'F N', 'F W' and 'F E' are sent once the flash operations have completed
+static void dfu_evt_handler(const dfu_evt_t *p_evt) {
+    char buf[16];
+
+    switch (p_evt->type) {
+        case DFU_EVT_STARTED:
+        case DFU_EVT_WRITTEN:
+            sprintf(buf, "%lu", p_evt->offset);
+            uart_cmd_send_information_response(buf);
+            break;
+        case DFU_EVT_ACTIVATED:
+            uart_cmd_send_configuration_response(NRF_SUCCESS);
+            APP_ERROR_CHECK(app_timer_start(m_dfu_reset_timer, DFU_RESET_DELAY, NULL));
+            break;
+        case DFU_EVT_ERROR:
+            uart_cmd_send_configuration_response(p_evt->result);
+            break;
+    }
+}
+
+static void dfu_reset_timer_handler(void *p_context) {
+    // the new firmware may lay out the configuration differently
+    nvconfig_invalidate_cache();
+    NVIC_SystemReset();
+}
+
+static void handle_dfu_cmd(const uart_cmd_evt_t *p_evt) {
+    char buf[64];
+    dfu_status_t status;
+    ret_code_t err_code;
+
+    switch (p_evt->subcommand) {
+        case 0:
+            dfu_get_status(&status);
+            sprintf(buf, "%u %lu %lu %lu %u", status.state, status.image_size, status.image_crc, status.written,
+                    status.pending);
+            uart_cmd_send_information_response(buf);
+            return;
+        case 'N':
+            // page erases need long gaps between radio events, the swarm leaves none
+            err_code = m_swarm_active ? NRF_ERROR_INVALID_STATE
+                                      : dfu_start((uint32_t) p_evt->args[0], (uint32_t) p_evt->args[1]);
+            break;
+        case 'W':
+            if (crc16_compute(p_evt->data, p_evt->data_len, NULL) != (uint16_t) p_evt->args[1]) {
+                STATS_INC(DFU_CHUNKS_REJECTED);
+                err_code = NRF_ERROR_INVALID_DATA;
+            } else {
+                err_code = dfu_write((uint32_t) p_evt->args[0], p_evt->data, p_evt->data_len);
+            }
+            break;
+        case 'E':
+            err_code = dfu_activate();
+            break;
+        case 'C':
+            uart_cmd_send_configuration_response(dfu_cancel());
+            return;
+        default:
+            err_code = NRF_ERROR_INVALID_PARAM;
+            break;
+    }
+    // otherwise answered by dfu_evt_handler
+    if (err_code != NRF_SUCCESS) {
+        uart_cmd_send_configuration_response(err_code);
+    }
+}
+
+static void handle_stats_cmd(const uart_cmd_evt_t *p_evt) {
+    // static to keep the dump off the stack of the UART interrupt
+    static char buf[STATS_PAGE_SIZE];
+    // room for " next=<entry>"
+    static const uint32_t next_size = 12;
+    char uptime_str[21];
+    uint32_t first = p_evt->arg_count > 0 ? (uint32_t) p_evt->args[0] : 0;
+    uint32_t next;
+    uint32_t len = 0;
+
+    if (p_evt->arg_count > 1 || p_evt->args[0] < 0 || first >= STATS_ENTRY_COUNT) {
+        uart_cmd_send_configuration_response(NRF_ERROR_INVALID_PARAM);
+        return;
+    }
+    if (first == 0) {
+        uint64_to_dec_string(timebase_now_us(), uptime_str);
+        len = sprintf(buf, "uptime_us=%s boots_cold=%lu boots_warm=%lu ", uptime_str, nvconfig_cold_boots(),
+                      nvconfig_warm_boots());
+    }
+    len += stats_format(&buf[len], sizeof(buf) - len - next_size, first, &next);
+    // the host continues with 'S <next>'
+    if (next < STATS_ENTRY_COUNT) {
+        sprintf(&buf[len], " next=%lu", next);
+    }
+    uart_cmd_send_information_response(buf);
+}
+
+static void handle_cpu_load_cmd() {
+    char buf[60];
+    power_load_t load;
+
+    power_get_load(&load);
+    sprintf(buf, "%u %u %u %lu", load.load_permille, load.wakeups, load.average_load_permille, load.total_wakeups);
+    uart_cmd_send_information_response(buf);
+}
+
+static void handle_fault_cmd(const uart_cmd_evt_t *p_evt) {
+    char buf[96];
+    fault_info_t info;
+
+    if (p_evt->subcommand == 'C') {
+        fault_clear();
+        uart_cmd_send_configuration_response(NRF_SUCCESS);
+        return;
+    }
+    if (fault_last(&info)) {
+        sprintf(buf, "%lu %lu %lu 0x%08lX %lu %s:%lu %lu", fault_count(), info.boot, info.id, info.pc, info.info,
+                info.file[0] ? info.file : "-", info.line, info.uptime_ms);
+    } else {
+        sprintf(buf, "%lu", fault_count());
+    }
+    uart_cmd_send_information_response(buf);
+}
+
+static void handle_ram_usage_cmd(const uart_cmd_evt_t *p_evt) {
+    // static to keep the report off the stack it measures
+    static char buf[RAM_MAP_MAX_ENTRIES * (RAM_MAP_NAME_LEN + 12) + 32];
+    ram_usage_t usage;
+    const volatile ram_map_t *p_map;
+
+    if (p_evt->subcommand == 'R') {
+        p_map = ram_usage_map();
+        if (p_map == NULL) {
+            uart_cmd_send_configuration_response(NRF_ERROR_NOT_FOUND);
+            return;
+        }
+        uint32_t len = sprintf(buf, "total=%lu", p_map->total_bytes);
+        for (uint16_t i = 0; i < p_map->count && i < RAM_MAP_MAX_ENTRIES; i++) {
+            char name[RAM_MAP_NAME_LEN];
+            for (uint8_t j = 0; j < RAM_MAP_NAME_LEN; j++) {
+                name[j] = p_map->entries[i].name[j];
+            }
+            name[RAM_MAP_NAME_LEN - 1] = 0;
+            len += sprintf(&buf[len], " %s=%lu", name, p_map->entries[i].bytes);
+        }
+        uart_cmd_send_information_response(buf);
+        return;
+    }
+    ram_usage_get(&usage);
+    sprintf(buf, "%lu %lu %lu %lu %lu", usage.stack_used, usage.stack_size, usage.static_bytes, usage.heap_size,
+            usage.unused_bytes);
+    uart_cmd_send_information_response(buf);
+}
+
+static void handle_radio_cmd(const uart_cmd_evt_t *p_evt) {
+    char buf[160];
+    char period_str[21];
+    char adv_str[21];
+    char scan_str[21];
+    char charge_str[21];
+    radio_accounting_t accounting;
+
+    if (p_evt->subcommand == 'C') {
+        radio_activity_reset_accounting();
+        uart_cmd_send_configuration_response(NRF_SUCCESS);
+        return;
+    }
+
+    radio_activity_get_accounting(&accounting);
+    uint64_t now_us = timebase_now_us();
+    uint64_to_dec_string(now_us - accounting.since_us, period_str);
+    uint64_to_dec_string(accounting.active_us[RADIO_MODE_ADV], adv_str);
+    uint64_to_dec_string(accounting.active_us[RADIO_MODE_SCAN], scan_str);
+    uint64_to_dec_string(radio_accounting_charge_uc(&accounting), charge_str);
+    sprintf(buf, "%s %lu %s %lu %lu %s %lu %lu %s %lu", period_str,
+            accounting.events[RADIO_MODE_ADV], adv_str, accounting.longest_us[RADIO_MODE_ADV],
+            accounting.events[RADIO_MODE_SCAN], scan_str, accounting.longest_us[RADIO_MODE_SCAN],
+            accounting.unpaired, charge_str, radio_accounting_average_ua(&accounting, now_us));
+    uart_cmd_send_information_response(buf);
+}
+
+static void handle_trace_cmd(const uart_cmd_evt_t *p_evt) {
+    char buf[48];
+    trace_event_t events[TRACE_EVENTS_PER_FRAME];
+    // sequence number and events of one frame
+    uint8_t payload[4 + sizeof(events)];
+    uint32_t first_seq;
+    uint32_t count;
+
+    if (p_evt->subcommand == 'C') {
+        trace_clear();
+        uart_cmd_send_configuration_response(NRF_SUCCESS);
+    } else if (p_evt->arg_count == 0) {
+        sprintf(buf, "%lu %lu %lu %u", trace_first_seq(), trace_next_seq(), trace_boot_count(), TRACE_CAPACITY);
+        uart_cmd_send_information_response(buf);
+    } else {
+        // one frame per command, the TX FIFO has no room for the whole buffer
+        count = trace_read((uint32_t) p_evt->args[0], events, TRACE_EVENTS_PER_FRAME, &first_seq);
+        uint32_encode(first_seq, payload);
+        memcpy(&payload[4], events, count * sizeof(trace_event_t));
+        uart_cmd_send_frame(UART_FRAME_TRACE, payload, (uint8_t) (4 + count * sizeof(trace_event_t)));
+        sprintf(buf, "%lu %lu", first_seq, count);
+        uart_cmd_send_information_response(buf);
+    }
+}
+
+static void handle_bloom_cmd(const uart_cmd_evt_t *p_evt) {
+    char buf[64];
+    ret_code_t err_code = NRF_SUCCESS;
+
+    switch (p_evt->subcommand) {
+        case 'N': // new filter: clear and set geometry, stays disabled until the upload is complete
+            m_bloom_enabled = false;
+            err_code = p_evt->arg_count == 2 && p_evt->args[0] > 0 && p_evt->args[1] > 0 && p_evt->args[1] <= 32
+                       ? bloom_configure(&m_bloom, (uint32_t) p_evt->args[0], (uint8_t) p_evt->args[1])
+                       : NRF_ERROR_INVALID_PARAM;
+            break;
+        case 'W':
+            err_code = m_bloom_enabled || p_evt->args[0] < 0
+                       ? NRF_ERROR_INVALID_STATE
+                       : bloom_write(&m_bloom, (uint32_t) p_evt->args[0], p_evt->data, p_evt->data_len);
+            break;
+        case 'E': // enable, after verifying the uploaded filter against the host's checksum
+            if (p_evt->arg_count != 1 || m_bloom.num_bits == 0 ||
+                crc16_compute(m_bloom_bits, bloom_size_bytes(&m_bloom), NULL) != (uint16_t) p_evt->args[0]) {
+                err_code = NRF_ERROR_INVALID_DATA;
+            } else {
+                m_bloom_passed = 0;
+                m_bloom_rejected = 0;
+                m_bloom_enabled = true;
+            }
+            break;
+        case 'D':
+            m_bloom_enabled = false;
+            break;
+        case 0:
+            sprintf(buf, "%d %lu %u %lu %lu", m_bloom_enabled, m_bloom.num_bits, m_bloom.num_hashes, m_bloom_passed,
+                    m_bloom_rejected);
+            uart_cmd_send_information_response(buf);
+            return;
+        default:
+            err_code = NRF_ERROR_INVALID_PARAM;
+            break;
+    }
     uart_cmd_send_configuration_response(err_code);
 }
 
@@ -149,13 +1317,105 @@ static void uart_cmd_evt_handler(const uart_cmd_evt_t *p_uart_cmd_evt) {
             handle_information_cmd();
             break;
         case CONFIGURATION:
-            handle_configuration_cmd(p_uart_cmd_evt->proximity_uuid, p_uart_cmd_evt->major, p_uart_cmd_evt->minor);
+            handle_configuration_cmd(p_uart_cmd_evt->proximity_uuid, p_uart_cmd_evt->major, p_uart_cmd_evt->minor,
+                                     &p_uart_cmd_evt->major_rule, &p_uart_cmd_evt->minor_rule);
+            break;
+        case TIME_SYNC:
+            handle_time_sync_cmd(p_uart_cmd_evt->host_time_us, p_uart_cmd_evt->rx_time_us);
+            break;
+        case AIRTIME:
+            handle_airtime_cmd(p_uart_cmd_evt->args, p_uart_cmd_evt->arg_count);
+            break;
+        case BLOOM_FILTER:
+            handle_bloom_cmd(p_uart_cmd_evt);
+            break;
+        case STATISTICS:
+            handle_stats_cmd(p_uart_cmd_evt);
+            break;
+        case TRACE_DUMP:
+            handle_trace_cmd(p_uart_cmd_evt);
+            break;
+        case RADIO_ACCOUNTING:
+            handle_radio_cmd(p_uart_cmd_evt);
+            break;
+        case SCHEDULE:
+            handle_schedule_cmd(p_uart_cmd_evt);
+            break;
+        case EID:
+            handle_eid_cmd(p_uart_cmd_evt);
+            break;
+        case EDDYSTONE:
+            handle_eddystone_cmd(p_uart_cmd_evt);
+            break;
+        case BURST:
+            handle_burst_cmd(p_uart_cmd_evt);
+            break;
+        case SWARM:
+            handle_swarm_cmd(p_uart_cmd_evt);
+            break;
+        case ADDR_ROTATION:
+            handle_addr_rotation_cmd(p_uart_cmd_evt);
+            break;
+        case FIRMWARE_UPDATE:
+            handle_dfu_cmd(p_uart_cmd_evt);
+            break;
+        case CPU_LOAD:
+            handle_cpu_load_cmd();
+            break;
+        case RAM_USAGE:
+            handle_ram_usage_cmd(p_uart_cmd_evt);
+            break;
+        case FAULT_RECORD:
+            handle_fault_cmd(p_uart_cmd_evt);
             break;
         default:
             break;
     }
 }
 
+static void scan_report_write(const uint8_t *p_payload, uint16_t len) {
+    uart_cmd_send_frame(UART_FRAME_SCAN_REPORT, p_payload, (uint8_t) len);
+}
+
+// Returns true if the record passes the allowlist (or no allowlist is active)
+static bool bloom_filter_passes(const scan_record_t *p_record) {
+    uint8_t key[BLOOM_IBEACON_KEY_SIZE];
+
+    if (!m_bloom_enabled) {
+        return true;
+    }
+    if (p_record->is_ibeacon) {
+        bloom_ibeacon_key(p_record->uuid, p_record->major, p_record->minor, key);
+        if (bloom_contains(&m_bloom, key, sizeof(key))) {
+            m_bloom_passed++;
+            return true;
+        }
+    }
+    m_bloom_rejected++;
+    return false;
+}
+
+static void scanner_evt_handler(scan_record_t *p_record) {
+    uint32_t start = stats_cycles();
+
+    STATS_INC(SCAN_REPORTS);
+    if (!bloom_filter_passes(p_record)) {
+        return;
+    }
+    p_record->timestamp_us = timesync_local_to_host(&m_timesync, p_record->timestamp_us);
+    // the encoder is shared with the flush timer
+    CRITICAL_REGION_ENTER();
+    scan_report_add(&m_scan_report, p_record);
+    CRITICAL_REGION_EXIT();
+    stats_hist_record(STATS_HIST_SCAN_REPORT, start);
+}
+
+static void scan_report_timer_handler(void *p_context) {
+    CRITICAL_REGION_ENTER();
+    scan_report_flush(&m_scan_report);
+    CRITICAL_REGION_EXIT();
+}
+
 static void ble_stack_init(void) {
     ret_code_t err_code;
 
@@ -167,14 +1427,28 @@ static void ble_stack_init(void) {
     uint32_t ram_start = 0;
     err_code = nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start);
     APP_ERROR_CHECK(err_code);
+#if defined(MINIMAL_SOFTDEVICE_RAM)
+    // without links nrf_sdh_ble_default_cfg_set leaves the roles at the SoftDevice's defaults, which
+    // include connections; advertising and scanning do not need any
+    ble_cfg_t ble_cfg;
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    err_code = sd_ble_cfg_set(BLE_GAP_CFG_ROLE_COUNT, &ble_cfg, ram_start);
+    APP_ERROR_CHECK(err_code);
+#endif
 
-    // Enable BLE stack.
+    // Enable BLE stack. Fails if the application RAM starts too low, otherwise ram_start is the
+    // minimum for this configuration afterwards.
     err_code = nrf_sdh_ble_enable(&ram_start);
     APP_ERROR_CHECK(err_code);
+    // RAM between the minimum and APP_RAM_START is wasted, the trace tells which start to link at
+    trace_record(TRACE_RAM_LAYOUT, ram_start != APP_RAM_START, 0, ram_start);
 
     // Set transmission power
     err_code = sd_ble_gap_tx_power_set(TX_POWER);
     APP_ERROR_CHECK(err_code);
+
+    err_code = sd_ble_gap_addr_get(&m_factory_addr);
+    APP_ERROR_CHECK(err_code);
 }
 
 static void timer_init(void) {
@@ -182,6 +1456,94 @@ static void timer_init(void) {
     APP_ERROR_CHECK(err_code);
 }
 
+static void timebase_start(void) {
+    ret_code_t err_code = timebase_init();
+    APP_ERROR_CHECK(err_code);
+    timesync_init(&m_timesync);
+}
+
+static void scan_init() {
+    ret_code_t err_code;
+
+    err_code = radio_activity_init(adv_event_handler, TX_POWER);
+    APP_ERROR_CHECK(err_code);
+    swarm_init(swarm_stopped_handler);
+
+    scan_report_init(&m_scan_report, scan_report_write);
+    bloom_init(&m_bloom, m_bloom_bits, sizeof(m_bloom_bits));
+    err_code = app_timer_create(&m_scan_report_timer, APP_TIMER_MODE_REPEATED, scan_report_timer_handler);
+    APP_ERROR_CHECK(err_code);
+
+    memset(&m_scanner_client, 0, sizeof(scanner_client_t));
+    m_scanner_client.evt_handler = scanner_evt_handler;
+    scanner_init(&m_scanner_client);
+}
+
+static void eid_init() {
+    ret_code_t err_code = app_timer_create(&m_eid_timer, APP_TIMER_MODE_SINGLE_SHOT, eid_timer_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void eddystone_init() {
+    ret_code_t err_code = app_timer_create(&m_tlm_timer, APP_TIMER_MODE_REPEATED, tlm_timer_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void addr_rotation_init() {
+    ret_code_t err_code = app_timer_create(&m_addr_timer, APP_TIMER_MODE_SINGLE_SHOT, addr_timer_handler);
+    APP_ERROR_CHECK(err_code);
+    if (m_beacon_cfg.addr_rotation.mode != ADDR_ROTATION_OFF) {
+        // the factory address must not be advertised, wait for the RNG to provide the first address
+        while (addr_rotation_fill() == 0) {
+        }
+        addr_rotation_update();
+    }
+}
+
+static void schedule_init() {
+    ret_code_t err_code;
+
+    err_code = app_timer_create(&m_schedule_timer, APP_TIMER_MODE_SINGLE_SHOT, schedule_timer_handler);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_create(&m_burst_timer, APP_TIMER_MODE_SINGLE_SHOT, burst_timer_handler);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_create(&m_adv_retry_timer, APP_TIMER_MODE_SINGLE_SHOT, adv_retry_timer_handler);
+    APP_ERROR_CHECK(err_code);
+    // set by ble_stack_init
+    m_adv_state.tx_power = TX_POWER;
+    schedule_update(true);
+}
+
+// An identity baked into the factory image replaces the defaults, which are stored at the first boot
+static void factory_id_init() {
+    const factory_id_t *p_id = (const factory_id_t *) FACTORY_ID_ADDR;
+    configuration_t *p_defaults = nvconfig_defaults();
+
+    if (!factory_id_valid(p_id)) {
+        return;
+    }
+    memcpy(p_defaults->beacon_uuid, p_id->beacon_uuid, 16);
+    p_defaults->beacon_major = mac_derive_value(&p_id->major_rule, m_factory_addr.addr, p_id->beacon_major);
+    p_defaults->beacon_minor = mac_derive_value(&p_id->minor_rule, m_factory_addr.addr, p_id->beacon_minor);
+    p_defaults->major_rule = p_id->major_rule;
+    p_defaults->minor_rule = p_id->minor_rule;
+    if (p_id->adv_interval_ms >= MIN_ADV_INTERVAL_MS && p_id->adv_interval_ms <= MAX_ADV_INTERVAL_MS) {
+        p_defaults->adv_interval_ms = p_id->adv_interval_ms;
+    }
+}
+
+static void update_init() {
+    ret_code_t err_code = dfu_init(dfu_evt_handler);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_create(&m_dfu_reset_timer, APP_TIMER_MODE_SINGLE_SHOT, dfu_reset_timer_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void idle_init() {
+    ret_code_t err_code = power_init();
+    APP_ERROR_CHECK(err_code);
+}
+
 static void uart_init() {
     uint32_t err_code;
     memset(&m_uart_cmd_client, 0, sizeof(uart_cmd_client_t));
@@ -193,20 +1555,31 @@ static void uart_init() {
 int main(void) {
     ret_code_t err_code;
 
+    ram_usage_init();
+    trace_init();
+    fault_init();
+    stats_init();
     timer_init();
     uart_init();
     ble_stack_init();
+    timebase_start(); // uses PPI, which is owned by the SoftDevice once it is enabled
+    idle_init(); // the scheduler is used by the modules below
 
     // initialize and wait for storage, load configuration
     err_code = nvconfig_init();
     APP_ERROR_CHECK(err_code);
+    factory_id_init();
     err_code = nvconfig_load(&m_beacon_cfg);
     APP_ERROR_CHECK(err_code);
 
-    advertising_init(m_beacon_cfg.beacon_uuid, m_beacon_cfg.beacon_major, m_beacon_cfg.beacon_minor);
-    advertising_start();
+    scan_init();
+    eid_init();
+    eddystone_init();
+    addr_rotation_init();
+    schedule_init();
+    update_init();
+    scanning_start();
     while (true) {
-        err_code = sd_app_evt_wait();
-        APP_ERROR_CHECK(err_code);
+        power_idle();
     }
 }
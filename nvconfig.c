@@ -17,15 +17,24 @@
 
 #include <string.h>
 #include "fds.h"
+#include "crc16.h"
+
+#include "stats.h"
+#include "trace.h"
 
 #define CONFIG_FILE     (0xF010)
 #define CONFIG_REC_KEY  (0x7010)
 
+#define CACHE_MAGIC     (0x43464743UL) // "CGFC"
+
 // The default beacon configuration
 static configuration_t m_default_cfg = {
         .beacon_uuid = {0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc},
         .beacon_major = 1,
-        .beacon_minor = 1
+        .beacon_minor = 1,
+        .adv_interval_ms = 100, // iBeacon specifies an advertising interval of 100ms
+        .scan_interval_ms = 1000,
+        .scan_window_ms = 0
 };
 
 // The default configuration record
@@ -37,22 +46,84 @@ static fds_record_t const m_default_record = {
         .data.length_words = (sizeof(m_default_cfg) + 3) / sizeof(uint32_t)
 };
 
+// Copy of the configuration kept across soft resets, the CRC covers size and configuration
+typedef struct {
+    uint32_t magic;
+    uint32_t cold_boots;
+    uint32_t warm_boots;
+    uint16_t crc;
+    uint16_t size;
+    configuration_t cfg;
+} config_cache_t;
+
+// not initialized by the startup code (see gcc_nrf52.ld.in)
+static config_cache_t m_cache __attribute__((section(".config_cache")));
+
 // Flash data storage initialization is asynchronous, this holds its result
 static bool volatile m_fds_initialized;
 
+// A save FDS could not queue (queues full, busy, not initialized yet after a warm boot, or waiting for
+// garbage collection) is retried after the next FDS event. Garbage collection runs once per save.
+static configuration_t *mp_pending_save;
+static bool m_gc_done;
+
+static void save_retry(void) {
+    configuration_t *cfg = mp_pending_save;
+
+    if (cfg != NULL) {
+        mp_pending_save = NULL;
+        nvconfig_save(cfg);
+    }
+}
+
 // handler for asynchronous flash data storage events
 static void fds_evt_handler(fds_evt_t const *p_evt) {
     switch (p_evt->id) {
         case FDS_EVT_INIT:
             if (p_evt->result == FDS_SUCCESS) {
                 m_fds_initialized = true;
+                save_retry();
+            }
+            break;
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            trace_record(TRACE_FDS_END, p_evt->id == FDS_EVT_WRITE ? TRACE_FDS_WRITE : TRACE_FDS_UPDATE, 0,
+                         p_evt->result);
+            // the write was queued successfully but failed in flash
+            if (p_evt->result != FDS_SUCCESS) {
+                STATS_INC(FLASH_WRITE_ERRORS);
             }
+            save_retry();
+            break;
+        case FDS_EVT_GC:
+            trace_record(TRACE_FDS_END, TRACE_FDS_GC, 0, p_evt->result);
+            save_retry();
             break;
         default:
             break;
     }
 }
 
+static uint16_t cache_crc() {
+    return crc16_compute((const uint8_t *) &m_cache.size, sizeof(m_cache.size) + sizeof(m_cache.cfg), NULL);
+}
+
+// also false after power-on, when the RAM content is random
+static bool cache_valid() {
+    return m_cache.magic == CACHE_MAGIC && m_cache.size == sizeof(configuration_t) && m_cache.crc == cache_crc();
+}
+
+static void cache_store(const configuration_t *cfg) {
+    if (m_cache.magic != CACHE_MAGIC) {
+        m_cache.magic = CACHE_MAGIC;
+        m_cache.cold_boots = 0;
+        m_cache.warm_boots = 0;
+    }
+    m_cache.size = sizeof(configuration_t);
+    memcpy(&m_cache.cfg, cfg, sizeof(configuration_t));
+    m_cache.crc = cache_crc();
+}
+
 uint32_t nvconfig_init() {
     ret_code_t err_code;
     err_code = fds_register(fds_evt_handler);
@@ -62,14 +133,19 @@ uint32_t nvconfig_init() {
     err_code = fds_init();
     if (err_code != FDS_SUCCESS) return err_code;
 
-    // wait for initialization to finish
-    while (!m_fds_initialized) {
+    // wait for initialization to finish, a warm boot does not read flash and finishes it in the background
+    // (saves fail with FDS_ERR_NOT_INITIALIZED until then)
+    while (!m_fds_initialized && !cache_valid()) {
         sd_app_evt_wait();
     }
 
     return 0;
 }
 
+configuration_t *nvconfig_defaults() {
+    return &m_default_cfg;
+}
+
 uint32_t nvconfig_save(configuration_t *cfg) {
     ret_code_t err_code;
     fds_record_desc_t desc = {0};
@@ -84,12 +160,32 @@ uint32_t nvconfig_save(configuration_t *cfg) {
 
     err_code = fds_record_find(CONFIG_FILE, CONFIG_REC_KEY, &desc, &token);
     if (err_code == FDS_SUCCESS) {
-        return fds_record_update(&desc, &record);
+        trace_record(TRACE_FDS_BEGIN, TRACE_FDS_UPDATE, 0, 0);
+        err_code = fds_record_update(&desc, &record);
     } else if (err_code == FDS_ERR_NOT_FOUND) {
-        return fds_record_write(&desc, &record);
+        trace_record(TRACE_FDS_BEGIN, TRACE_FDS_WRITE, 0, 0);
+        err_code = fds_record_write(&desc, &record);
+    }
+    if (err_code == FDS_ERR_NO_SPACE_IN_FLASH && !m_gc_done) {
+        // reclaims the space of the records replaced by updates
+        trace_record(TRACE_FDS_BEGIN, TRACE_FDS_GC, 0, 0);
+        m_gc_done = fds_gc() == FDS_SUCCESS;
+        err_code = m_gc_done ? FDS_ERR_BUSY : FDS_ERR_NO_SPACE_IN_FLASH;
+    }
+    if (err_code == FDS_ERR_NO_SPACE_IN_QUEUES || err_code == FDS_ERR_BUSY || err_code == FDS_ERR_NOT_INITIALIZED) {
+        STATS_INC(FLASH_WRITE_RETRIES);
+        mp_pending_save = cfg;
+        cache_store(cfg);
+        return FDS_SUCCESS;
+    }
+    m_gc_done = false;
+    if (err_code == FDS_SUCCESS) {
+        STATS_INC(FLASH_WRITES);
+        cache_store(cfg);
     } else {
-        return err_code;
+        STATS_INC(FLASH_WRITE_ERRORS);
     }
+    return err_code;
 }
 
 uint32_t nvconfig_load(configuration_t *cfg) {
@@ -97,21 +193,44 @@ uint32_t nvconfig_load(configuration_t *cfg) {
     fds_record_desc_t desc = {0};
     fds_find_token_t token = {0};
 
+    if (cache_valid()) {
+        memcpy(cfg, &m_cache.cfg, sizeof(configuration_t));
+        m_cache.warm_boots++;
+        return 0;
+    }
+
     err_code = fds_record_find(CONFIG_FILE, CONFIG_REC_KEY, &desc, &token);
     if (err_code == FDS_SUCCESS) {
         fds_flash_record_t record = {0};
         err_code = fds_record_open(&desc, &record);
         APP_ERROR_CHECK(err_code);
 
-        memcpy(cfg, record.p_data, sizeof(configuration_t));
+        // records written by older firmware are shorter, their missing fields keep the defaults
+        uint32_t len = record.p_header->tl.length_words * sizeof(uint32_t);
+        memcpy(cfg, &m_default_cfg, sizeof(configuration_t));
+        memcpy(cfg, record.p_data, len < sizeof(configuration_t) ? len : sizeof(configuration_t));
         err_code = fds_record_close(&desc);
         APP_ERROR_CHECK(err_code);
-        return 0;
     } else if (err_code == FDS_ERR_NOT_FOUND) { // config not found, write and return default config
+        trace_record(TRACE_FDS_BEGIN, TRACE_FDS_WRITE, 0, 0);
         fds_record_write(&desc, &m_default_record);
         memcpy(cfg, &m_default_cfg, sizeof(configuration_t));
-        return 0;
     } else {
         return err_code;
     }
+    cache_store(cfg);
+    m_cache.cold_boots++;
+    return 0;
+}
+
+void nvconfig_invalidate_cache() {
+    m_cache.crc = ~cache_crc();
+}
+
+uint32_t nvconfig_cold_boots() {
+    return m_cache.cold_boots;
+}
+
+uint32_t nvconfig_warm_boots() {
+    return m_cache.warm_boots;
 }
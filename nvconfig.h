@@ -3,14 +3,45 @@
 
 #include <stdint.h>
 
+#include "mac_derive.h"
+#include "schedule.h"
+#include "eid.h"
+#include "eddystone.h"
+#include "addr_rotation.h"
+
 typedef struct {
     uint8_t beacon_uuid[16];
     uint16_t beacon_major;
     uint16_t beacon_minor;
+    // airtime split between advertising and scanning (a scan window of 0 disables scanning)
+    uint16_t adv_interval_ms;
+    uint16_t scan_interval_ms;
+    uint16_t scan_window_ms;
+    // rules the major and minor above were derived from the device address with
+    mac_derive_rule_t major_rule;
+    mac_derive_rule_t minor_rule;
+    // weekly advertising schedule, advertising follows the interval above while it is empty
+    schedule_t schedule;
+    // rotating ephemeral identifiers, replace the identifiers above when enabled
+    eid_config_t eid;
+    // Eddystone frames interleaved with the iBeacon frame
+    eddystone_config_t eddystone;
+    // rotation of the device address, the factory address is used while it is off
+    addr_rotation_config_t addr_rotation;
 } configuration_t;
 
+// The configuration loaded last is kept in RAM which is not initialized by the startup code. After a
+// soft reset (warm boot) it is restored from there without reading flash, flash data storage is only
+// read after power-on or when the copy is damaged (cold boot).
 uint32_t nvconfig_init();
+// The configuration written at the first boot, may be changed before nvconfig_load (see factory_id.h)
+configuration_t *nvconfig_defaults();
 uint32_t nvconfig_save(configuration_t* cfg);
 uint32_t nvconfig_load(configuration_t* cfg);
+// Forces the next boot to be a cold one, e.g. before a reset into different firmware
+void nvconfig_invalidate_cache();
+// Boots since power-on which loaded the configuration from flash or restored it from RAM
+uint32_t nvconfig_cold_boots();
+uint32_t nvconfig_warm_boots();
 
 #endif // _NVCONFIG_H
@@ -0,0 +1,102 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "power.h"
+
+#include "app_scheduler.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "nrf_pwr_mgmt.h"
+
+#include "stats.h"
+#include "timebase.h"
+
+#define CPU_CYCLES_PER_US               64
+// The cycle counter wraps after 67 s, it is sampled at least once per window
+#define LOAD_WINDOW                     APP_TIMER_TICKS(1000)
+
+APP_TIMER_DEF(m_load_timer);
+
+// Module state
+static uint32_t m_last_cycles;
+static uint64_t m_awake_cycles;         // since boot
+static uint64_t m_window_start_us;
+static uint64_t m_window_start_awake_cycles;
+static uint32_t m_window_start_wakeups;
+static uint32_t m_wakeups;
+static uint32_t m_awake_ms_counted;     // in the statistics
+static power_load_t m_load;
+
+// Adds the cycles since the last sample to the awake time
+static void sample_cycles(void) {
+    CRITICAL_REGION_ENTER();
+    uint32_t cycles = stats_cycles();
+    m_awake_cycles += cycles - m_last_cycles;
+    m_last_cycles = cycles;
+    CRITICAL_REGION_EXIT();
+}
+
+static void load_timer_handler(void *p_context) {
+    uint64_t now_us = timebase_now_us();
+    uint64_t elapsed_us = now_us - m_window_start_us;
+
+    sample_cycles();
+    if (elapsed_us > 0) {
+        uint64_t awake_us = (m_awake_cycles - m_window_start_awake_cycles) / CPU_CYCLES_PER_US;
+        m_load.load_permille = (uint16_t) (awake_us * 1000 / elapsed_us);
+        m_load.wakeups = (uint16_t) ((m_wakeups - m_window_start_wakeups) * 1000000ULL / elapsed_us);
+    }
+    if (now_us > 0) {
+        m_load.average_load_permille = (uint16_t) (m_awake_cycles / CPU_CYCLES_PER_US * 1000 / now_us);
+    }
+    m_load.total_wakeups = m_wakeups;
+    uint32_t awake_ms = (uint32_t) (m_awake_cycles / (CPU_CYCLES_PER_US * 1000));
+    STATS_ADD(CPU_AWAKE_MS, awake_ms - m_awake_ms_counted);
+    m_awake_ms_counted = awake_ms;
+    m_window_start_us = now_us;
+    m_window_start_awake_cycles = m_awake_cycles;
+    m_window_start_wakeups = m_wakeups;
+}
+
+uint32_t power_init(void) {
+    ret_code_t err_code;
+
+    // the cycle counter has been running since stats_init, everything up to now counts as awake
+    m_last_cycles = stats_cycles();
+    m_window_start_us = timebase_now_us();
+    m_awake_cycles = m_window_start_us * CPU_CYCLES_PER_US;
+    m_window_start_awake_cycles = m_awake_cycles;
+    m_awake_ms_counted = 0;
+
+    err_code = nrf_pwr_mgmt_init();
+    if (err_code != NRF_SUCCESS) return err_code;
+    APP_SCHED_INIT(POWER_SCHED_MAX_EVENT_SIZE, POWER_SCHED_QUEUE_SIZE);
+    err_code = app_timer_create(&m_load_timer, APP_TIMER_MODE_REPEATED, load_timer_handler);
+    if (err_code != NRF_SUCCESS) return err_code;
+    return app_timer_start(m_load_timer, LOAD_WINDOW, NULL);
+}
+
+void power_idle(void) {
+    app_sched_execute();
+    nrf_pwr_mgmt_run();
+    m_wakeups++;
+    STATS_INC(CPU_WAKEUPS);
+}
+
+void power_get_load(power_load_t *p_load) {
+    CRITICAL_REGION_ENTER();
+    *p_load = m_load;
+    CRITICAL_REGION_EXIT();
+}
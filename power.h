@@ -0,0 +1,28 @@
+#ifndef _POWER_H
+#define _POWER_H
+
+#include <stdint.h>
+
+// Idle loop: runs the work deferred to the app_scheduler, then sleeps in nrf_pwr_mgmt until the next
+// event. The CPU load is measured with the cycle counter (DWT CYCCNT), which stops while the CPU
+// sleeps, against the RTC based timebase. Time spent in interrupt handlers and in the SoftDevice
+// therefore counts as awake, wherever the CPU was woken up.
+
+// Deferred work items carry at most this much data (see app_sched_event_put)
+#define POWER_SCHED_MAX_EVENT_SIZE      8
+#define POWER_SCHED_QUEUE_SIZE          8
+
+typedef struct {
+    uint16_t load_permille;         // awake time in the last complete second
+    uint16_t wakeups;               // returns from sleep in the last complete second
+    uint16_t average_load_permille; // since boot
+    uint32_t total_wakeups;         // since boot
+} power_load_t;
+
+// Module interface
+uint32_t power_init(void);
+// Runs deferred work and sleeps until the next event, call in a loop
+void power_idle(void);
+void power_get_load(power_load_t *p_load);
+
+#endif // _POWER_H
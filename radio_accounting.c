@@ -0,0 +1,108 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "radio_accounting.h"
+
+#include <string.h>
+
+typedef struct {
+    int8_t tx_power;
+    uint32_t current_ua;
+} tx_current_t;
+
+// nRF52832 TX run current with the LDO regulator, ascending TX power
+static const tx_current_t m_tx_currents[] = {
+    {-40, 5900},
+    {-20, 7000},
+    {-16, 7300},
+    {-12, 7700},
+    {-8,  8400},
+    {-4,  9300},
+    {0,   11600},
+    {3,   15400},
+    {4,   16600},
+};
+
+#define TX_CURRENT_COUNT    (sizeof(m_tx_currents) / sizeof(m_tx_currents[0]))
+
+uint32_t radio_accounting_tx_current_ua(int8_t tx_power) {
+    for (uint32_t i = 0; i < TX_CURRENT_COUNT; i++) {
+        if (tx_power <= m_tx_currents[i].tx_power) {
+            return m_tx_currents[i].current_ua;
+        }
+    }
+    return m_tx_currents[TX_CURRENT_COUNT - 1].current_ua;
+}
+
+void radio_accounting_reset(radio_accounting_t *p_acc, uint64_t now_us) {
+    uint32_t tx_current_ua = p_acc->tx_current_ua;
+
+    memset(p_acc, 0, sizeof(*p_acc));
+    p_acc->since_us = now_us;
+    p_acc->tx_current_ua = tx_current_ua;
+}
+
+void radio_accounting_set_tx_power(radio_accounting_t *p_acc, int8_t tx_power) {
+    p_acc->tx_current_ua = radio_accounting_tx_current_ua(tx_power);
+}
+
+radio_mode_t radio_accounting_classify(uint64_t duration_us) {
+    return duration_us < RADIO_ACCOUNTING_ADV_EVENT_MAX_US ? RADIO_MODE_ADV : RADIO_MODE_SCAN;
+}
+
+void radio_accounting_notify(radio_accounting_t *p_acc, bool radio_active, uint64_t now_us) {
+    if (radio_active) {
+        // a missed INACTIVE notification, the length of the previous event is unknown
+        if (p_acc->event_start_us != 0) {
+            p_acc->unpaired++;
+        }
+        p_acc->event_start_us = now_us + RADIO_ACCOUNTING_NOTIFICATION_DISTANCE_US;
+        return;
+    }
+    if (p_acc->event_start_us == 0) {
+        p_acc->unpaired++;
+        return;
+    }
+
+    uint64_t duration_us = now_us > p_acc->event_start_us ? now_us - p_acc->event_start_us : 0;
+    radio_mode_t mode = radio_accounting_classify(duration_us);
+    p_acc->active_us[mode] += duration_us;
+    p_acc->charge_pc[mode] += duration_us * (mode == RADIO_MODE_ADV ? p_acc->tx_current_ua : RADIO_ACCOUNTING_RX_CURRENT_UA);
+    p_acc->events[mode]++;
+    if (duration_us > p_acc->longest_us[mode]) {
+        p_acc->longest_us[mode] = duration_us > UINT32_MAX ? UINT32_MAX : (uint32_t) duration_us;
+    }
+    p_acc->event_start_us = 0;
+}
+
+// microamperes times microseconds are picocoulombs
+static uint64_t charge_pc(const radio_accounting_t *p_acc) {
+    uint64_t charge = 0;
+    for (int mode = 0; mode < RADIO_MODE_COUNT; mode++) {
+        charge += p_acc->charge_pc[mode];
+    }
+    return charge;
+}
+
+uint64_t radio_accounting_charge_uc(const radio_accounting_t *p_acc) {
+    return charge_pc(p_acc) / 1000000;
+}
+
+uint32_t radio_accounting_average_ua(const radio_accounting_t *p_acc, uint64_t now_us) {
+    if (now_us <= p_acc->since_us) {
+        return 0;
+    }
+    return (uint32_t) (charge_pc(p_acc) / (now_us - p_acc->since_us));
+}
@@ -0,0 +1,53 @@
+#ifndef _RADIO_ACCOUNTING_H
+#define _RADIO_ACCOUNTING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Accumulates radio on-time per mode from the SoftDevice radio notifications. Kept free of SDK
+// dependencies, so the host can feed it with simulated notifications.
+
+// The ACTIVE notification arrives this long before the radio event starts
+#define RADIO_ACCOUNTING_NOTIFICATION_DISTANCE_US   800
+
+// Events shorter than this are counted as advertising events (three non-connectable PDUs take
+// roughly 1.2 ms), longer ones as scan windows
+#define RADIO_ACCOUNTING_ADV_EVENT_MAX_US           2500
+
+// Supply current while the radio receives at 1 Mbps in microamperes, nRF52832 datasheet value for the
+// LDO regulator (the DC/DC converter is not enabled). The TX current depends on the TX power, see
+// radio_accounting_tx_current_ua.
+#define RADIO_ACCOUNTING_RX_CURRENT_UA              11700
+
+typedef enum {
+    RADIO_MODE_ADV,
+    RADIO_MODE_SCAN,
+    RADIO_MODE_COUNT
+} radio_mode_t;
+
+typedef struct {
+    uint64_t active_us[RADIO_MODE_COUNT];
+    uint64_t charge_pc[RADIO_MODE_COUNT];   // microamperes times microseconds
+    uint32_t events[RADIO_MODE_COUNT];
+    uint32_t longest_us[RADIO_MODE_COUNT];
+    uint32_t unpaired;              // notifications without their counterpart, the event is not accounted
+    uint64_t event_start_us;        // start of the current radio event, 0 while the radio is idle
+    uint64_t since_us;              // start of the accounting period
+    uint32_t tx_current_ua;         // charged for advertising events, kept by radio_accounting_reset
+} radio_accounting_t;
+
+// Datasheet TX current for a TX power accepted by the SoftDevice (LDO regulator), powers between the
+// levels get the current of the next higher one
+uint32_t radio_accounting_tx_current_ua(int8_t tx_power);
+void radio_accounting_reset(radio_accounting_t *p_acc, uint64_t now_us);
+// Advertising events ending from now on are charged with the current of this TX power
+void radio_accounting_set_tx_power(radio_accounting_t *p_acc, int8_t tx_power);
+// Called with the time of each ACTIVE and INACTIVE notification
+void radio_accounting_notify(radio_accounting_t *p_acc, bool radio_active, uint64_t now_us);
+radio_mode_t radio_accounting_classify(uint64_t duration_us);
+// Estimated charge drawn by the radio since the start of the accounting period, in microcoulombs
+uint64_t radio_accounting_charge_uc(const radio_accounting_t *p_acc);
+// Average radio supply current over the accounting period in microamperes
+uint32_t radio_accounting_average_ua(const radio_accounting_t *p_acc, uint64_t now_us);
+
+#endif // _RADIO_ACCOUNTING_H
@@ -0,0 +1,106 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "radio_activity.h"
+
+#include <stdbool.h>
+
+#include "nrf_soc.h"
+#include "app_util_platform.h"
+#include "ble_radio_notification.h"
+
+#include "timebase.h"
+
+// The ACTIVE notification arrives RADIO_ACCOUNTING_NOTIFICATION_DISTANCE_US before the radio event starts
+#define NOTIFICATION_DISTANCE           NRF_RADIO_NOTIFICATION_DISTANCE_800US
+
+// The advertiser adds a pseudo-random delay of 0-10 ms to every advertising interval
+#define ADV_DELAY_AVERAGE_US            5000
+
+// Module state
+static radio_accounting_t m_accounting;
+static radio_activity_adv_event_handler_t m_adv_event_handler;
+// events of the accounting when advertising was (re)started
+static uint32_t m_adv_events_base;
+static uint32_t m_scan_events_base;
+static uint64_t m_adv_started_us;
+static uint32_t m_adv_interval_us;
+
+static void radio_notification_handler(bool radio_active) {
+    uint32_t adv_events = m_accounting.events[RADIO_MODE_ADV];
+
+    radio_accounting_notify(&m_accounting, radio_active, timebase_now_us());
+    if (m_adv_event_handler && m_accounting.events[RADIO_MODE_ADV] != adv_events) {
+        m_adv_event_handler();
+    }
+}
+
+uint32_t radio_activity_init(radio_activity_adv_event_handler_t adv_event_handler, int8_t tx_power) {
+    m_adv_event_handler = adv_event_handler;
+    radio_accounting_reset(&m_accounting, timebase_now_us());
+    radio_accounting_set_tx_power(&m_accounting, tx_power);
+    return ble_radio_notification_init(APP_IRQ_PRIORITY_LOW, NOTIFICATION_DISTANCE, radio_notification_handler);
+}
+
+void radio_activity_adv_started(uint16_t adv_interval_ms) {
+    CRITICAL_REGION_ENTER();
+    m_adv_events_base = m_accounting.events[RADIO_MODE_ADV];
+    m_scan_events_base = m_accounting.events[RADIO_MODE_SCAN];
+    m_adv_interval_us = adv_interval_ms * 1000UL;
+    m_adv_started_us = timebase_now_us();
+    CRITICAL_REGION_EXIT();
+}
+
+void radio_activity_get_counters(radio_activity_counters_t *p_counters) {
+    uint64_t elapsed_us;
+
+    CRITICAL_REGION_ENTER();
+    p_counters->adv_events = m_accounting.events[RADIO_MODE_ADV] - m_adv_events_base;
+    p_counters->scan_events = m_accounting.events[RADIO_MODE_SCAN] - m_scan_events_base;
+    elapsed_us = timebase_now_us() - m_adv_started_us;
+    CRITICAL_REGION_EXIT();
+
+    // the SoftDevice does not report skipped advertising events, estimate them from the schedule
+    uint32_t expected = 0;
+    if (m_adv_interval_us != 0) {
+        expected = (uint32_t) (elapsed_us / (m_adv_interval_us + ADV_DELAY_AVERAGE_US));
+    }
+    p_counters->adv_events_skipped = expected > p_counters->adv_events ? expected - p_counters->adv_events : 0;
+}
+
+void radio_activity_get_accounting(radio_accounting_t *p_accounting) {
+    CRITICAL_REGION_ENTER();
+    *p_accounting = m_accounting;
+    CRITICAL_REGION_EXIT();
+}
+
+bool radio_activity_is_active(void) {
+    return m_accounting.event_start_us != 0;
+}
+
+void radio_activity_reset_accounting(void) {
+    CRITICAL_REGION_ENTER();
+    // keeps the counters since the advertising start, the bases may wrap around
+    m_adv_events_base -= m_accounting.events[RADIO_MODE_ADV];
+    m_scan_events_base -= m_accounting.events[RADIO_MODE_SCAN];
+    radio_accounting_reset(&m_accounting, timebase_now_us());
+    CRITICAL_REGION_EXIT();
+}
+
+void radio_activity_set_tx_power(int8_t tx_power) {
+    CRITICAL_REGION_ENTER();
+    radio_accounting_set_tx_power(&m_accounting, tx_power);
+    CRITICAL_REGION_EXIT();
+}
@@ -0,0 +1,36 @@
+#ifndef _RADIO_ACTIVITY_H
+#define _RADIO_ACTIVITY_H
+
+#include <stdint.h>
+
+#include "radio_accounting.h"
+
+// Radio events are reported by the SoftDevice radio notification and told apart by their duration,
+// see radio_accounting.h
+
+// Shortest scan window accepted, so scan windows are not mistaken for advertising events
+#define RADIO_ACTIVITY_MIN_SCAN_WINDOW_MS   3
+
+typedef struct {
+    uint32_t adv_events;            // advertising events since advertising was (re)started
+    uint32_t adv_events_skipped;    // expected but missing advertising events, i.e. lost to scanning
+    uint32_t scan_events;           // scan windows since advertising was (re)started
+} radio_activity_counters_t;
+
+// Called after each advertising event, from the radio notification interrupt (APP_IRQ_PRIORITY_LOW)
+typedef void (*radio_activity_adv_event_handler_t)(void);
+
+// Module interface
+uint32_t radio_activity_init(radio_activity_adv_event_handler_t adv_event_handler, int8_t tx_power);
+// Resets the counters, must be called whenever advertising is (re)started, with 0 when it is stopped
+void radio_activity_adv_started(uint16_t adv_interval_ms);
+void radio_activity_get_counters(radio_activity_counters_t *p_counters);
+// Radio on-time since boot or the last reset of the accounting
+void radio_activity_get_accounting(radio_accounting_t *p_accounting);
+void radio_activity_reset_accounting(void);
+// Must be called whenever the advertising TX power changes, it determines the charge of advertising events
+void radio_activity_set_tx_power(int8_t tx_power);
+// True from the ACTIVE notification until the end of the radio event
+bool radio_activity_is_active(void);
+
+#endif // _RADIO_ACTIVITY_H
@@ -0,0 +1,29 @@
+#ifndef _RAM_MAP_H
+#define _RAM_MAP_H
+
+#include <stdint.h>
+
+// Static RAM per module, taken from the linker map after linking and stored in the firmware by the
+// ram_map host tool (see host/tools/ram_map.cpp), so the device can report it ('M R'). The table has a
+// fixed size and lives in its own flash section, storing it does not move anything else. Modules are
+// object files and libraries, sorted by size; the smallest ones are summed up in the last entry if
+// there are more.
+
+#define RAM_MAP_MAGIC                   0x50414D52UL    // "RMAP", 0 if the table was not filled in
+#define RAM_MAP_MAX_ENTRIES             24
+#define RAM_MAP_NAME_LEN                16              // including the terminating 0
+
+typedef struct {
+    char name[RAM_MAP_NAME_LEN];
+    uint32_t bytes;
+} ram_map_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t count;
+    uint16_t reserved;
+    uint32_t total_bytes;           // all of the application's RAM in the map, including stack and heap
+    ram_map_entry_t entries[RAM_MAP_MAX_ENTRIES];
+} ram_map_t;
+
+#endif // _RAM_MAP_H
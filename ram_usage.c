@@ -0,0 +1,58 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ram_usage.h"
+
+#include <nrf.h>
+
+#define STACK_PAINT                     0xA5A5A5A5UL
+// Left unpainted below the stack pointer of the caller
+#define STACK_PAINT_MARGIN              64
+
+// Defined by the linker script (see nrf5x_common.ld in the SDK)
+extern uint32_t __StackTop;
+extern uint32_t __StackLimit;
+extern uint32_t __HeapBase;
+extern uint32_t __HeapLimit;
+
+// Filled in after linking, volatile so the compiler does not fold the all-zero initializer
+__attribute__((section(".ram_map"), used))
+static const volatile ram_map_t m_ram_map = {0};
+
+void ram_usage_init(void) {
+    uint32_t *p_end = (uint32_t *) (__get_MSP() - STACK_PAINT_MARGIN);
+
+    for (volatile uint32_t *p = &__StackLimit; p < p_end; p++) {
+        *p = STACK_PAINT;
+    }
+}
+
+void ram_usage_get(ram_usage_t *p_usage) {
+    const uint32_t *p = &__StackLimit;
+
+    // the stack grows down, the lowest word which is not painted any more is the high-water mark
+    while (p < &__StackTop && *p == STACK_PAINT) {
+        p++;
+    }
+    p_usage->stack_size = (uint32_t) &__StackTop - (uint32_t) &__StackLimit;
+    p_usage->stack_used = (uint32_t) &__StackTop - (uint32_t) p;
+    p_usage->static_bytes = (uint32_t) &__HeapBase - APP_RAM_START;
+    p_usage->heap_size = (uint32_t) &__HeapLimit - (uint32_t) &__HeapBase;
+    p_usage->unused_bytes = (uint32_t) &__StackLimit - (uint32_t) &__HeapLimit;
+}
+
+const volatile ram_map_t *ram_usage_map(void) {
+    return m_ram_map.magic == RAM_MAP_MAGIC ? &m_ram_map : NULL;
+}
@@ -0,0 +1,27 @@
+#ifndef _RAM_USAGE_H
+#define _RAM_USAGE_H
+
+#include <stdint.h>
+
+#include "ram_map.h"
+
+// Stack high-water mark and RAM layout. The unused part of the stack is painted with a pattern at boot,
+// the deepest word no longer holding it marks the most stack ever used. Interrupt handlers of the
+// application and the SoftDevice run on the same (main) stack, so it covers everything.
+
+typedef struct {
+    uint32_t stack_used;            // high-water mark in bytes
+    uint32_t stack_size;
+    uint32_t static_bytes;          // data, bss and no-init sections
+    uint32_t heap_size;
+    uint32_t unused_bytes;          // between the heap and the stack
+} ram_usage_t;
+
+// Paints the stack below the caller's frame, call first thing in main
+void ram_usage_init(void);
+// Scans the stack for the high-water mark
+void ram_usage_get(ram_usage_t *p_usage);
+// The static RAM per module, NULL if the build did not fill in the table (see CMake_nRF52.cmake)
+const volatile ram_map_t *ram_usage_map(void);
+
+#endif // _RAM_USAGE_H
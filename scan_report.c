@@ -0,0 +1,196 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "scan_report.h"
+
+#include <string.h>
+
+#ifdef NRF52
+#include "nrf.h"
+#define CYCLE_COUNT()   (DWT->CYCCNT)
+#else
+#define CYCLE_COUNT()   0
+#endif
+
+static void reset_dictionaries(scan_report_encoder_t *p_enc) {
+    p_enc->addr_count = 0;
+    p_enc->addr_next = 0;
+    p_enc->uuid_count = 0;
+    p_enc->uuid_next = 0;
+}
+
+void scan_report_init(scan_report_encoder_t *p_enc, scan_report_write_t write) {
+    memset(p_enc, 0, sizeof(scan_report_encoder_t));
+    p_enc->write = write;
+    // the first record starts with a keyframe
+    p_enc->records_since_keyframe = SCAN_REPORT_KEYFRAME_INTERVAL;
+#ifdef NRF52
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+uint16_t scan_report_raw_size(const scan_record_t *p_record) {
+    // timestamp, address type, address, RSSI and optionally UUID, major and minor
+    return p_record->is_ibeacon ? 8 + 1 + 6 + 1 + 16 + 2 + 2 : 8 + 1 + 6 + 1;
+}
+
+void scan_report_flush(scan_report_encoder_t *p_enc) {
+    if (p_enc->frame_len <= 1) {
+        return; // nothing but the sequence number
+    }
+    p_enc->write(p_enc->frame, p_enc->frame_len);
+    p_enc->stats.frames++;
+    p_enc->stats.encoded_bytes += p_enc->frame_len;
+    p_enc->frame_len = 0;
+    p_enc->seq++;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t value) {
+    while (value >= 0x80) {
+        *p++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t) value;
+    return p;
+}
+
+static int find_addr(const scan_report_encoder_t *p_enc, const scan_record_t *p_record) {
+    for (int i = 0; i < p_enc->addr_count; i++) {
+        const scan_report_addr_entry_t *p_entry = &p_enc->addr_dict[i];
+        if (p_entry->addr_type == p_record->addr_type && memcmp(p_entry->addr, p_record->addr, 6) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int find_uuid(const scan_report_encoder_t *p_enc, const uint8_t *uuid) {
+    for (int i = 0; i < p_enc->uuid_count; i++) {
+        if (memcmp(p_enc->uuid_dict[i], uuid, 16) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Dictionaries are replaced round-robin, which the decoder can mirror without any extra information
+static int insert_addr(scan_report_encoder_t *p_enc, const scan_record_t *p_record) {
+    int index = p_enc->addr_next;
+    scan_report_addr_entry_t *p_entry = &p_enc->addr_dict[index];
+    memset(p_entry, 0, sizeof(scan_report_addr_entry_t));
+    p_entry->addr_type = p_record->addr_type;
+    memcpy(p_entry->addr, p_record->addr, 6);
+    p_enc->addr_next = (uint8_t) ((p_enc->addr_next + 1) % SCAN_REPORT_ADDR_DICT_SIZE);
+    if (p_enc->addr_count < SCAN_REPORT_ADDR_DICT_SIZE) p_enc->addr_count++;
+    return index;
+}
+
+static int insert_uuid(scan_report_encoder_t *p_enc, const uint8_t *uuid) {
+    int index = p_enc->uuid_next;
+    memcpy(p_enc->uuid_dict[index], uuid, 16);
+    p_enc->uuid_next = (uint8_t) ((p_enc->uuid_next + 1) % SCAN_REPORT_UUID_DICT_SIZE);
+    if (p_enc->uuid_count < SCAN_REPORT_UUID_DICT_SIZE) p_enc->uuid_count++;
+    return index;
+}
+
+void scan_report_add(scan_report_encoder_t *p_enc, const scan_record_t *p_record) {
+    uint32_t start = CYCLE_COUNT();
+
+    if (p_enc->frame_len + SCAN_REPORT_MAX_RECORD_SIZE > SCAN_REPORT_MAX_PAYLOAD) {
+        scan_report_flush(p_enc);
+    }
+    if (p_enc->frame_len == 0) {
+        p_enc->frame[p_enc->frame_len++] = p_enc->seq;
+        // keyframes are only placed at the start of a frame, so a decoder can join at any such frame
+        if (p_enc->records_since_keyframe >= SCAN_REPORT_KEYFRAME_INTERVAL) {
+            uint8_t *p = &p_enc->frame[p_enc->frame_len];
+            *p++ = SCAN_REPORT_KEYFRAME;
+            for (int i = 0; i < 8; i++) {
+                *p++ = (uint8_t) (p_record->timestamp_us >> (8 * i));
+            }
+            p_enc->frame_len = (uint16_t) (p - p_enc->frame);
+            p_enc->last_timestamp_us = p_record->timestamp_us;
+            p_enc->records_since_keyframe = 0;
+            reset_dictionaries(p_enc);
+        }
+    }
+
+    uint8_t *p_header = &p_enc->frame[p_enc->frame_len];
+    uint8_t *p = p_header + 1;
+    uint8_t header = SCAN_REPORT_FLAG_RECORD;
+    uint8_t rssi_code = SCAN_REPORT_RSSI_EXPLICIT;
+    scan_report_addr_entry_t *p_entry;
+
+    int addr_index = find_addr(p_enc, p_record);
+    if (addr_index >= 0) {
+        header |= SCAN_REPORT_FLAG_ADDR_REF;
+        *p++ = (uint8_t) addr_index;
+        p_entry = &p_enc->addr_dict[addr_index];
+        int rssi_delta = p_record->rssi - p_entry->rssi;
+        if (rssi_delta >= -3 && rssi_delta <= 3) {
+            rssi_code = (uint8_t) (rssi_delta + 3);
+        }
+    } else {
+        *p++ = p_record->addr_type;
+        memcpy(p, p_record->addr, 6);
+        p += 6;
+        p_entry = &p_enc->addr_dict[insert_addr(p_enc, p_record)];
+    }
+
+    if (p_record->is_ibeacon) {
+        if (p_entry->has_ident && p_entry->major == p_record->major && p_entry->minor == p_record->minor &&
+            memcmp(p_enc->uuid_dict[p_entry->uuid_index], p_record->uuid, 16) == 0) {
+            header |= SCAN_REPORT_FLAG_IDENT_SAME;
+        } else {
+            header |= SCAN_REPORT_FLAG_IDENT;
+            int uuid_index = find_uuid(p_enc, p_record->uuid);
+            if (uuid_index >= 0) {
+                header |= SCAN_REPORT_FLAG_UUID_REF;
+                *p++ = (uint8_t) uuid_index;
+            } else {
+                memcpy(p, p_record->uuid, 16);
+                p += 16;
+                uuid_index = insert_uuid(p_enc, p_record->uuid);
+            }
+            *p++ = (uint8_t) (p_record->major >> 8);
+            *p++ = (uint8_t) p_record->major;
+            *p++ = (uint8_t) (p_record->minor >> 8);
+            *p++ = (uint8_t) p_record->minor;
+            p_entry->has_ident = true;
+            p_entry->uuid_index = (uint8_t) uuid_index;
+            p_entry->major = p_record->major;
+            p_entry->minor = p_record->minor;
+        }
+    }
+
+    header |= (uint8_t) (rssi_code << SCAN_REPORT_RSSI_SHIFT);
+    if (rssi_code == SCAN_REPORT_RSSI_EXPLICIT) {
+        *p++ = (uint8_t) p_record->rssi;
+    }
+    p_entry->rssi = p_record->rssi;
+
+    // zigzag, timestamps may jump back when the time synchronization is corrected
+    int64_t ts_delta = (int64_t) (p_record->timestamp_us - p_enc->last_timestamp_us);
+    p = put_varint(p, ((uint64_t) ts_delta << 1) ^ (uint64_t) (ts_delta >> 63));
+    p_enc->last_timestamp_us = p_record->timestamp_us;
+
+    *p_header = header;
+    p_enc->frame_len = (uint16_t) (p - p_enc->frame);
+    p_enc->records_since_keyframe++;
+    p_enc->stats.records++;
+    p_enc->stats.raw_bytes += scan_report_raw_size(p_record);
+    p_enc->stats.cycles += CYCLE_COUNT() - start;
+}
@@ -0,0 +1,96 @@
+#ifndef _SCAN_REPORT_H
+#define _SCAN_REPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Compressed scan report stream.
+//
+// Records are packed into frames of at most SCAN_REPORT_MAX_PAYLOAD bytes. Recently seen addresses
+// and proximity UUIDs are replaced by dictionary indices, timestamps and RSSI values are delta encoded.
+// Frame payload: <seq> <record>...
+//
+// Record header byte:
+//   0x00           keyframe, followed by the absolute timestamp (8 bytes, little endian);
+//                  resets both dictionaries, the decoder can join the stream at a frame starting with it
+//   bit 0          always set for advertisement records
+//   bit 1          address is a dictionary index (1 byte), otherwise <type> <6 bytes> follows and
+//                  the address is added to the dictionary
+//   bit 2          iBeacon identity is the same as the last one seen for this address
+//   bit 3          iBeacon identity follows: UUID (index or 16 bytes, see bit 4), major, minor (big endian)
+//   bit 4          UUID is a dictionary index (1 byte), otherwise the 16 bytes follow and are added
+//   bits 5-7       RSSI delta + 3 to the last RSSI of this address, 7: RSSI follows as signed byte
+// followed by the timestamp delta to the previous record in microseconds (zigzag LEB128).
+
+#define SCAN_REPORT_MAX_PAYLOAD         200
+#define SCAN_REPORT_ADDR_DICT_SIZE      64
+#define SCAN_REPORT_UUID_DICT_SIZE      8
+#define SCAN_REPORT_KEYFRAME_INTERVAL   512     // records between keyframes
+#define SCAN_REPORT_MAX_RECORD_SIZE     40
+
+#define SCAN_REPORT_KEYFRAME            0x00
+#define SCAN_REPORT_FLAG_RECORD         0x01
+#define SCAN_REPORT_FLAG_ADDR_REF       0x02
+#define SCAN_REPORT_FLAG_IDENT_SAME     0x04
+#define SCAN_REPORT_FLAG_IDENT          0x08
+#define SCAN_REPORT_FLAG_UUID_REF       0x10
+#define SCAN_REPORT_RSSI_SHIFT          5
+#define SCAN_REPORT_RSSI_EXPLICIT       7
+
+// A received advertisement
+typedef struct {
+    uint64_t timestamp_us;
+    uint8_t addr_type;
+    uint8_t addr[6];
+    int8_t rssi;
+    bool is_ibeacon;
+    uint8_t uuid[16];
+    uint16_t major;
+    uint16_t minor;
+} scan_record_t;
+
+// Called with every completed frame payload
+typedef void (*scan_report_write_t)(const uint8_t *p_payload, uint16_t len);
+
+typedef struct {
+    uint8_t addr_type;
+    uint8_t addr[6];
+    int8_t rssi;
+    bool has_ident;
+    uint8_t uuid_index;
+    uint16_t major;
+    uint16_t minor;
+} scan_report_addr_entry_t;
+
+typedef struct {
+    uint32_t records;
+    uint32_t frames;
+    uint32_t raw_bytes;         // size of the records in their uncompressed form
+    uint32_t encoded_bytes;     // size of the frame payloads
+    uint32_t cycles;            // CPU cycles spent in scan_report_add (DWT CYCCNT, target only), reported by 'A'
+} scan_report_stats_t;
+
+typedef struct {
+    scan_report_write_t write;
+    scan_report_addr_entry_t addr_dict[SCAN_REPORT_ADDR_DICT_SIZE];
+    uint8_t uuid_dict[SCAN_REPORT_UUID_DICT_SIZE][16];
+    uint8_t addr_count;
+    uint8_t addr_next;
+    uint8_t uuid_count;
+    uint8_t uuid_next;
+    uint64_t last_timestamp_us;
+    uint16_t records_since_keyframe;
+    uint8_t seq;
+    uint8_t frame[SCAN_REPORT_MAX_PAYLOAD];
+    uint16_t frame_len;
+    scan_report_stats_t stats;
+} scan_report_encoder_t;
+
+void scan_report_init(scan_report_encoder_t *p_enc, scan_report_write_t write);
+void scan_report_add(scan_report_encoder_t *p_enc, const scan_record_t *p_record);
+void scan_report_flush(scan_report_encoder_t *p_enc);
+
+// Size of a record in uncompressed form, used for the compression statistics
+uint16_t scan_report_raw_size(const scan_record_t *p_record);
+
+#endif // _SCAN_REPORT_H
@@ -0,0 +1,120 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "scanner.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "ble_gap.h"
+#include "nrf_sdh_ble.h"
+#include "app_util.h"
+
+#include "timebase.h"
+
+// Priority of the scanner's BLE event observer (must be below NRF_SDH_BLE_OBSERVER_PRIO_LEVELS)
+#define SCANNER_BLE_OBSERVER_PRIO       3
+
+// Manufacturer specific data of an iBeacon: company 0x004c, type 0x02, length 0x15, UUID, major, minor, power
+#define AD_TYPE_MANUFACTURER_SPECIFIC   0xff
+#define IBEACON_AD_LENGTH               0x1a
+#define IBEACON_COMPANY_IDENTIFIER      0x004c
+#define IBEACON_DEVICE_TYPE             0x02
+#define IBEACON_DATA_LENGTH             0x15
+
+// Module state
+static scanner_client_t *client;
+static ble_gap_scan_params_t m_scan_params;
+static bool m_scanning;
+
+// Looks for iBeacon data in the advertisement and copies the identity into the record
+static void parse_ibeacon(const uint8_t *p_data, uint8_t len, scan_record_t *p_record) {
+    uint8_t pos = 0;
+    while (pos + 1 < len) {
+        uint8_t ad_len = p_data[pos];
+        if (ad_len == 0 || pos + 1 + ad_len > len) {
+            return;
+        }
+        const uint8_t *p_ad = &p_data[pos + 1];
+        if (ad_len == IBEACON_AD_LENGTH && p_ad[0] == AD_TYPE_MANUFACTURER_SPECIFIC &&
+            uint16_decode(&p_ad[1]) == IBEACON_COMPANY_IDENTIFIER &&
+            p_ad[3] == IBEACON_DEVICE_TYPE && p_ad[4] == IBEACON_DATA_LENGTH) {
+            memcpy(p_record->uuid, &p_ad[5], 16);
+            p_record->major = uint16_big_decode(&p_ad[21]);
+            p_record->minor = uint16_big_decode(&p_ad[23]);
+            p_record->is_ibeacon = true;
+            return;
+        }
+        pos += ad_len + 1;
+    }
+}
+
+static void handle_adv_report(const ble_gap_evt_adv_report_t *p_report) {
+    scan_record_t record;
+
+    memset(&record, 0, sizeof(record));
+    record.timestamp_us = timebase_now_us();
+    record.addr_type = p_report->peer_addr.addr_type;
+    memcpy(record.addr, p_report->peer_addr.addr, 6);
+    record.rssi = p_report->rssi;
+    parse_ibeacon(p_report->data, p_report->dlen, &record);
+    client->evt_handler(&record);
+}
+
+static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context) {
+    switch (p_ble_evt->header.evt_id) {
+        case BLE_GAP_EVT_ADV_REPORT:
+            handle_adv_report(&p_ble_evt->evt.gap_evt.params.adv_report);
+            break;
+        default:
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_scanner_observer, SCANNER_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+void scanner_init(scanner_client_t *scanner_client) {
+    client = scanner_client;
+    m_scanning = false;
+}
+
+uint32_t scanner_stop(void) {
+    if (!m_scanning) {
+        return NRF_SUCCESS;
+    }
+    m_scanning = false;
+    return sd_ble_gap_scan_stop();
+}
+
+uint32_t scanner_start(uint16_t interval_ms, uint16_t window_ms) {
+    uint32_t err_code = scanner_stop();
+    if (err_code != NRF_SUCCESS || window_ms == 0) {
+        return err_code;
+    }
+
+    memset(&m_scan_params, 0, sizeof(m_scan_params));
+    m_scan_params.active = 0;           // passive, scan requests would add to the airtime
+    m_scan_params.use_whitelist = 0;
+    m_scan_params.adv_dir_report = 0;
+    m_scan_params.interval = MSEC_TO_UNITS(interval_ms, UNIT_0_625_MS);
+    m_scan_params.window = MSEC_TO_UNITS(window_ms, UNIT_0_625_MS);
+    m_scan_params.timeout = 0;          // Never time out
+
+    err_code = sd_ble_gap_scan_start(&m_scan_params);
+    if (err_code == NRF_SUCCESS) {
+        m_scanning = true;
+    }
+    return err_code;
+}
@@ -0,0 +1,23 @@
+#ifndef _SCANNER_H
+#define _SCANNER_H
+
+#include <stdint.h>
+
+#include "scan_report.h"
+
+// Event handler type, called for every received advertisement (in SoftDevice event context).
+// The record's timestamp is the local timebase value at reception.
+typedef void (*scanner_evt_handler_t)(scan_record_t *p_record);
+
+// Client data structure
+typedef struct {
+    scanner_evt_handler_t evt_handler;
+} scanner_client_t;
+
+// Module interface
+void scanner_init(scanner_client_t *scanner_client);
+// Starts passive scanning, a window of 0 stops scanning
+uint32_t scanner_start(uint16_t interval_ms, uint16_t window_ms);
+uint32_t scanner_stop(void);
+
+#endif // _SCANNER_H
@@ -0,0 +1,122 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "schedule.h"
+
+#include <string.h>
+
+#define US_PER_MINUTE                   60000000ULL
+
+// 1970-01-01 was a Thursday
+#define EPOCH_DAY_OF_WEEK               3
+
+void schedule_clear(schedule_t *p_schedule) {
+    memset(p_schedule, 0, sizeof(*p_schedule));
+}
+
+bool schedule_set_window(schedule_t *p_schedule, uint8_t index, const schedule_window_t *p_window) {
+    if (index > p_schedule->window_count || index >= SCHEDULE_MAX_WINDOWS) {
+        return false;
+    }
+    if ((p_window->days & SCHEDULE_ALL_DAYS) == 0 || (p_window->days & ~SCHEDULE_ALL_DAYS) != 0 ||
+        p_window->start_min >= SCHEDULE_MINUTES_PER_DAY || p_window->end_min >= SCHEDULE_MINUTES_PER_DAY) {
+        return false;
+    }
+    p_schedule->windows[index] = *p_window;
+    if (index == p_schedule->window_count) {
+        p_schedule->window_count++;
+    }
+    return true;
+}
+
+bool schedule_delete_window(schedule_t *p_schedule, uint8_t index) {
+    if (index >= p_schedule->window_count) {
+        return false;
+    }
+    memmove(&p_schedule->windows[index], &p_schedule->windows[index + 1],
+            (p_schedule->window_count - index - 1) * sizeof(schedule_window_t));
+    p_schedule->window_count--;
+    return true;
+}
+
+uint32_t schedule_minute_of_week(const schedule_t *p_schedule, uint64_t unix_time_us) {
+    int64_t minutes = (int64_t) (unix_time_us / US_PER_MINUTE) + p_schedule->utc_offset_min;
+    int64_t minute_of_week = (minutes + EPOCH_DAY_OF_WEEK * SCHEDULE_MINUTES_PER_DAY) % SCHEDULE_MINUTES_PER_WEEK;
+    return (uint32_t) (minute_of_week < 0 ? minute_of_week + SCHEDULE_MINUTES_PER_WEEK : minute_of_week);
+}
+
+static bool window_covers(const schedule_window_t *p_window, uint32_t minute_of_week) {
+    uint32_t day = minute_of_week / SCHEDULE_MINUTES_PER_DAY;
+    uint32_t minute = minute_of_week % SCHEDULE_MINUTES_PER_DAY;
+    uint32_t previous_day = (day + 6) % 7;
+
+    if (p_window->end_min > p_window->start_min) {
+        return (p_window->days & (1 << day)) && minute >= p_window->start_min && minute < p_window->end_min;
+    }
+    // runs past midnight, the part after midnight belongs to the window started the day before
+    return ((p_window->days & (1 << day)) && minute >= p_window->start_min) ||
+           ((p_window->days & (1 << previous_day)) && minute < p_window->end_min);
+}
+
+void schedule_evaluate(const schedule_t *p_schedule, uint64_t unix_time_us, schedule_state_t *p_state) {
+    uint32_t minute_of_week = schedule_minute_of_week(p_schedule, unix_time_us);
+
+    for (uint8_t i = 0; i < p_schedule->window_count; i++) {
+        const schedule_window_t *p_window = &p_schedule->windows[i];
+        if (window_covers(p_window, minute_of_week)) {
+            p_state->window = (int8_t) i;
+            p_state->tx_power = p_window->tx_power;
+            p_state->adv_interval_ms = p_window->adv_interval_ms;
+            return;
+        }
+    }
+    p_state->window = -1;
+    p_state->tx_power = 0;
+    p_state->adv_interval_ms = 0;
+}
+
+// minutes from minute_of_week to the next occurrence of boundary, a full week if they are equal
+static uint32_t minutes_until(uint32_t minute_of_week, uint32_t boundary) {
+    uint32_t delta = (boundary % SCHEDULE_MINUTES_PER_WEEK + SCHEDULE_MINUTES_PER_WEEK - minute_of_week) %
+                     SCHEDULE_MINUTES_PER_WEEK;
+    return delta == 0 ? SCHEDULE_MINUTES_PER_WEEK : delta;
+}
+
+uint64_t schedule_next_change_us(const schedule_t *p_schedule, uint64_t unix_time_us) {
+    uint32_t minute_of_week = schedule_minute_of_week(p_schedule, unix_time_us);
+    uint32_t next = UINT32_MAX;
+
+    for (uint8_t i = 0; i < p_schedule->window_count; i++) {
+        const schedule_window_t *p_window = &p_schedule->windows[i];
+        uint32_t length = p_window->end_min > p_window->start_min ? p_window->end_min - p_window->start_min
+                                                                   : p_window->end_min + SCHEDULE_MINUTES_PER_DAY -
+                                                                     p_window->start_min;
+        for (uint32_t day = 0; day < 7; day++) {
+            if (!(p_window->days & (1 << day))) {
+                continue;
+            }
+            uint32_t start = day * SCHEDULE_MINUTES_PER_DAY + p_window->start_min;
+            uint32_t delta = minutes_until(minute_of_week, start);
+            next = delta < next ? delta : next;
+            delta = minutes_until(minute_of_week, start + length);
+            next = delta < next ? delta : next;
+        }
+    }
+    if (next == UINT32_MAX) {
+        return UINT64_MAX;
+    }
+    // the UTC offset is a whole number of minutes, local and UTC minutes start at the same time
+    return (unix_time_us / US_PER_MINUTE + next) * US_PER_MINUTE;
+}
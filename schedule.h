@@ -0,0 +1,52 @@
+#ifndef _SCHEDULE_H
+#define _SCHEDULE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Weekly advertising schedule in local time. Windows are evaluated in order and the first one
+// covering the current minute wins, advertising is off outside all windows. An empty schedule is
+// not evaluated at all.
+
+#define SCHEDULE_MAX_WINDOWS            8
+#define SCHEDULE_MINUTES_PER_DAY        1440
+#define SCHEDULE_MINUTES_PER_WEEK       (7 * SCHEDULE_MINUTES_PER_DAY)
+#define SCHEDULE_ALL_DAYS               0x7F
+
+// Limits of the UTC offset of the local time in minutes
+#define SCHEDULE_MIN_UTC_OFFSET         (-12 * 60)
+#define SCHEDULE_MAX_UTC_OFFSET         (14 * 60)
+
+typedef struct {
+    uint8_t days;                   // days the window starts on, bit 0: Monday ... bit 6: Sunday
+    int8_t tx_power;                // dBm
+    uint16_t start_min;             // minutes after midnight
+    uint16_t end_min;               // exclusive, windows ending at or before their start run past midnight
+    uint16_t adv_interval_ms;       // 0: advertising off
+} schedule_window_t;
+
+typedef struct {
+    int16_t utc_offset_min;
+    uint8_t window_count;
+    uint8_t reserved;
+    schedule_window_t windows[SCHEDULE_MAX_WINDOWS];
+} schedule_t;
+
+typedef struct {
+    int8_t window;                  // index of the matching window, -1 if none
+    int8_t tx_power;
+    uint16_t adv_interval_ms;       // 0: advertising off
+} schedule_state_t;
+
+void schedule_clear(schedule_t *p_schedule);
+// Replaces the window at index or appends it if index is the window count, false if the index is out of range.
+// The advertising interval and TX power are validated by the caller.
+bool schedule_set_window(schedule_t *p_schedule, uint8_t index, const schedule_window_t *p_window);
+bool schedule_delete_window(schedule_t *p_schedule, uint8_t index);
+// Minute of the week in local time, 0 is Monday 00:00
+uint32_t schedule_minute_of_week(const schedule_t *p_schedule, uint64_t unix_time_us);
+void schedule_evaluate(const schedule_t *p_schedule, uint64_t unix_time_us, schedule_state_t *p_state);
+// Time of the next window start or end after unix_time_us, UINT64_MAX for an empty schedule
+uint64_t schedule_next_change_us(const schedule_t *p_schedule, uint64_t unix_time_us);
+
+#endif // _SCHEDULE_H
@@ -0,0 +1,106 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nrf.h"
+
+#include "hex_utils.h"
+
+typedef struct {
+    uint64_t sum;
+    uint32_t buckets[STATS_HIST_BUCKETS];
+} histogram_t;
+
+uint32_t stats_counters[STAT_COUNT];
+
+static histogram_t m_histograms[STATS_HIST_COUNT];
+
+static const char *const m_counter_names[STAT_COUNT] = {
+#define STATS_COUNTER_NAME(id, name) name,
+    STATS_COUNTERS(STATS_COUNTER_NAME)
+#undef STATS_COUNTER_NAME
+};
+
+static const char *const m_hist_names[STATS_HIST_COUNT] = {
+#define STATS_HIST_NAME(id, name) name,
+    STATS_HISTOGRAMS(STATS_HIST_NAME)
+#undef STATS_HIST_NAME
+};
+
+void stats_init(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t stats_cycles(void) {
+    return DWT->CYCCNT;
+}
+
+void stats_hist_record(stats_hist_t hist, uint32_t start) {
+    uint32_t cycles = DWT->CYCCNT - start;
+    int32_t bucket = (cycles ? 31 - __CLZ(cycles) : 0) - STATS_HIST_MIN_LOG2;
+
+    if (bucket < 0) {
+        bucket = 0;
+    } else if (bucket >= STATS_HIST_BUCKETS) {
+        bucket = STATS_HIST_BUCKETS - 1;
+    }
+    m_histograms[hist].buckets[bucket]++;
+    m_histograms[hist].sum += cycles;
+}
+
+// formats one entry, returns its length
+static uint32_t format_entry(uint32_t index, char *entry) {
+    char num[21];
+
+    if (index < STAT_COUNT) {
+        return (uint32_t) sprintf(entry, "%s=%lu", m_counter_names[index], (unsigned long) stats_counters[index]);
+    }
+    const histogram_t *p_hist = &m_histograms[index - STAT_COUNT];
+    int last = STATS_HIST_BUCKETS - 1;
+    while (last > 0 && p_hist->buckets[last] == 0) {
+        last--;
+    }
+    uint64_to_dec_string(p_hist->sum, num);
+    uint32_t len = (uint32_t) sprintf(entry, "%s=%s", m_hist_names[index - STAT_COUNT], num);
+    for (int b = 0; b <= last; b++) {
+        len += (uint32_t) sprintf(&entry[len], "%c%lu", b == 0 ? ':' : ',', (unsigned long) p_hist->buckets[b]);
+    }
+    return len;
+}
+
+uint32_t stats_format(char *buf, uint32_t size, uint32_t first, uint32_t *p_next) {
+    char entry[STATS_ENTRY_MAX_LEN + 1];
+    uint32_t len = 0;
+    uint32_t index;
+
+    buf[0] = 0;
+    for (index = first; index < STATS_ENTRY_COUNT; index++) {
+        uint32_t entry_len = format_entry(index, entry);
+        uint32_t separator = len > 0 ? 1 : 0;
+        if (len + separator + entry_len + 1 > size) {
+            break;
+        }
+        if (separator) buf[len++] = ' ';
+        memcpy(&buf[len], entry, entry_len + 1);
+        len += entry_len;
+    }
+    *p_next = index;
+    return len;
+}
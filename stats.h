@@ -0,0 +1,95 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+
+// Registry of runtime counters, dumped by the 'S' command as <name>=<value>. To add a counter, add
+// it to the list and increment it with STATS_INC(<id>) / STATS_ADD(<id>, n). Increments are not
+// atomic, a count may be lost when an interrupt of higher priority increments the same counter.
+#define STATS_COUNTERS(X) \
+    X(UART_RX_BYTES,        "uart_rx_bytes") \
+    X(UART_TX_BYTES,        "uart_tx_bytes") \
+    X(UART_TX_DROPPED,      "uart_tx_dropped") \
+    X(UART_ERRORS,          "uart_errors") \
+    X(UART_RX_OVERFLOWS,    "uart_rx_overflows") \
+    X(UART_SUSPENDS,        "uart_suspends") \
+    X(UART_SUSPENDED_MS,    "uart_suspended_ms") \
+    X(UART_WAKE_DISCARDED,  "uart_wake_discarded") \
+    X(UART_BAUD_CHANGES,    "uart_baud_changes") \
+    X(UART_BAUD_REVERTS,    "uart_baud_reverts") \
+    X(CMD_RECEIVED,         "cmd_received") \
+    X(CMD_UNKNOWN,          "cmd_unknown") \
+    X(CMD_INVALID,          "cmd_invalid") \
+    X(CMD_TRUNCATED,        "cmd_truncated") \
+    X(FRAMES_SENT,          "frames_sent") \
+    X(FLASH_WRITES,         "flash_writes") \
+    X(FLASH_WRITE_ERRORS,   "flash_write_errors") \
+    X(FLASH_WRITE_RETRIES,  "flash_write_retries") \
+    X(ADV_STARTS,           "adv_starts") \
+    X(ADV_START_RETRIES,    "adv_start_retries") \
+    X(ADV_DATA_ERRORS,      "adv_data_errors") \
+    X(ADV_BURSTS,           "adv_bursts") \
+    X(ADV_BURST_PDUS,       "adv_burst_pdus") \
+    X(ADDR_ROTATIONS,       "addr_rotations") \
+    X(ADDR_POOL_EMPTY,      "addr_pool_empty") \
+    X(DFU_CHUNKS,           "dfu_chunks") \
+    X(DFU_CHUNKS_REJECTED,  "dfu_chunks_rejected") \
+    X(CPU_WAKEUPS,          "cpu_wakeups") \
+    X(CPU_AWAKE_MS,         "cpu_awake_ms") \
+    X(SCAN_REPORTS,         "scan_reports")
+
+// Histograms of CPU cycles (DWT CYCCNT) spent in hot paths, dumped by 'S' as
+// <name>=<sum of cycles>:<count of bucket 0>,<count of bucket 1>,... with trailing empty buckets
+// omitted. Bucket i counts durations below 2^(i + STATS_HIST_MIN_LOG2 + 1) cycles, the last bucket
+// everything above.
+#define STATS_HISTOGRAMS(X) \
+    X(CMD_I,                "cycles_cmd_i") \
+    X(CMD_C,                "cycles_cmd_c") \
+    X(CMD_T,                "cycles_cmd_t") \
+    X(CMD_A,                "cycles_cmd_a") \
+    X(CMD_B,                "cycles_cmd_b") \
+    X(CMD_S,                "cycles_cmd_s") \
+    X(CMD_OTHER,            "cycles_cmd_other") \
+    X(SCAN_REPORT,          "cycles_scan_report") \
+    X(UART_WAKE,            "cycles_uart_wake")
+
+#define STATS_HIST_BUCKETS              16
+#define STATS_HIST_MIN_LOG2             6
+
+// Longest formatted entry: a histogram with a 20 digit sum and all buckets at 10 digits, names have up
+// to 23 characters
+#define STATS_NAME_MAX_LEN              23
+#define STATS_ENTRY_MAX_LEN             (STATS_NAME_MAX_LEN + 1 + 20 + STATS_HIST_BUCKETS * 11)
+
+typedef enum {
+#define STATS_COUNTER_ID(id, name) STAT_##id,
+    STATS_COUNTERS(STATS_COUNTER_ID)
+#undef STATS_COUNTER_ID
+    STAT_COUNT
+} stats_counter_t;
+
+typedef enum {
+#define STATS_HIST_ID(id, name) STATS_HIST_##id,
+    STATS_HISTOGRAMS(STATS_HIST_ID)
+#undef STATS_HIST_ID
+    STATS_HIST_COUNT
+} stats_hist_t;
+
+// Counters and histograms are numbered as one list of entries, counters first
+#define STATS_ENTRY_COUNT               (STAT_COUNT + STATS_HIST_COUNT)
+
+extern uint32_t stats_counters[STAT_COUNT];
+
+#define STATS_INC(id)                   (stats_counters[STAT_##id]++)
+#define STATS_ADD(id, n)                (stats_counters[STAT_##id] += (n))
+
+// Enables the cycle counter
+void stats_init(void);
+uint32_t stats_cycles(void);
+// Adds the cycles elapsed since start (a value of stats_cycles) to a histogram
+void stats_hist_record(stats_hist_t hist, uint32_t start);
+// Formats the entries from first on separated by spaces, as many as fit into size - 1 characters, and
+// returns the length. An entry is never cut, *p_next is the first one left out (STATS_ENTRY_COUNT if none).
+uint32_t stats_format(char *buf, uint32_t size, uint32_t first, uint32_t *p_next);
+
+#endif // _STATS_H
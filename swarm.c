@@ -0,0 +1,265 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "swarm.h"
+
+#include <string.h>
+
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "nrf_sdh_soc.h"
+#include "app_error.h"
+
+#include "timebase.h"
+
+// Priority of the swarm's SoC event observer (must be below NRF_SDH_SOC_OBSERVER_PRIO_LEVELS)
+#define SWARM_SOC_OBSERVER_PRIO         1
+
+// An "earliest possible" request fails with NRF_EVT_RADIO_BLOCKED if no timeslot is free within this time
+#define SWARM_EARLIEST_TIMEOUT_US       100000
+
+// Advertising channel access address and CRC initial value
+#define BLE_ADV_ACCESS_ADDRESS          0x8E89BED6UL
+#define BLE_ADV_CRC_INIT                0x555555UL
+#define BLE_CRC_POLY                    0x00065BUL
+
+#define ADV_CHANNEL_COUNT               3
+#define ADV_CHANNEL_FIRST               37
+
+typedef enum {
+    SWARM_IDLE,
+    SWARM_RUNNING,
+    SWARM_CLOSING,                  // waiting for NRF_EVT_RADIO_SESSION_CLOSED
+    SWARM_ABORTING                  // same after a failed start, which the caller cleans up after itself
+} swarm_state_t;
+
+// RADIO frequency (offset from 2400 MHz) of the channels 37, 38 and 39
+static const uint8_t m_channel_frequency[ADV_CHANNEL_COUNT] = {2, 26, 80};
+
+// Module state
+static swarm_stopped_handler_t m_stopped_handler;
+static volatile swarm_state_t m_state;
+static swarm_status_t m_status;
+static swarm_plan_t m_plan;
+static int8_t m_tx_power;
+// pre-encoded PDUs, the radio transmits them in place
+static uint8_t m_pdus[SWARM_PLAN_MAX_IDENTITIES][SWARM_PLAN_PDU_SIZE];
+
+// Timeslot state, only touched by the signal handler (highest interrupt priority) once the session is open
+static uint64_t m_slot_start_us;
+static uint64_t m_slot_end_us;
+static uint16_t m_identity;
+static uint8_t m_channel;
+static nrf_radio_request_t m_request;
+static nrf_radio_signal_callback_return_param_t m_return_param;
+
+static void request_earliest(void) {
+    m_request.request_type = NRF_RADIO_REQ_TYPE_EARLIEST;
+    m_request.params.earliest.hfclk = NRF_RADIO_HFCLK_CFG_XTAL_GUARANTEED;
+    m_request.params.earliest.priority = NRF_RADIO_PRIORITY_NORMAL;
+    m_request.params.earliest.length_us = SWARM_PLAN_SLOT_LENGTH_US;
+    m_request.params.earliest.timeout_us = SWARM_EARLIEST_TIMEOUT_US;
+}
+
+static void request_from_plan(const swarm_plan_request_t *p_plan_request) {
+    if (p_plan_request->earliest) {
+        request_earliest();
+        return;
+    }
+    m_request.request_type = NRF_RADIO_REQ_TYPE_NORMAL;
+    m_request.params.normal.hfclk = NRF_RADIO_HFCLK_CFG_XTAL_GUARANTEED;
+    m_request.params.normal.priority = NRF_RADIO_PRIORITY_NORMAL;
+    m_request.params.normal.distance_us = p_plan_request->distance_us;
+    m_request.params.normal.length_us = SWARM_PLAN_SLOT_LENGTH_US;
+}
+
+// The radio is reset at the start of every timeslot
+static void radio_configure(void) {
+    NRF_RADIO->MODE = RADIO_MODE_MODE_Ble_1Mbit << RADIO_MODE_MODE_Pos;
+    NRF_RADIO->MODECNF0 = RADIO_MODECNF0_RU_Fast << RADIO_MODECNF0_RU_Pos;
+    NRF_RADIO->TXPOWER = (uint8_t) m_tx_power;
+    // S0 holds the PDU header, LENGTH the payload length, no S1
+    NRF_RADIO->PCNF0 = (1UL << RADIO_PCNF0_S0LEN_Pos) | (8UL << RADIO_PCNF0_LFLEN_Pos);
+    NRF_RADIO->PCNF1 = ((SWARM_PLAN_PDU_SIZE - 2) << RADIO_PCNF1_MAXLEN_Pos) | (3UL << RADIO_PCNF1_BALEN_Pos) |
+                       (RADIO_PCNF1_WHITEEN_Enabled << RADIO_PCNF1_WHITEEN_Pos);
+    NRF_RADIO->BASE0 = (BLE_ADV_ACCESS_ADDRESS & 0x00FFFFFFUL) << 8;
+    NRF_RADIO->PREFIX0 = BLE_ADV_ACCESS_ADDRESS >> 24;
+    NRF_RADIO->TXADDRESS = 0;
+    NRF_RADIO->CRCCNF = (RADIO_CRCCNF_LEN_Three << RADIO_CRCCNF_LEN_Pos) |
+                        (RADIO_CRCCNF_SKIPADDR_Skip << RADIO_CRCCNF_SKIPADDR_Pos);
+    NRF_RADIO->CRCPOLY = BLE_CRC_POLY;
+    NRF_RADIO->CRCINIT = BLE_ADV_CRC_INIT;
+    NRF_RADIO->SHORTS = RADIO_SHORTS_READY_START_Msk | RADIO_SHORTS_END_DISABLE_Msk;
+    NRF_RADIO->INTENSET = RADIO_INTENSET_DISABLED_Msk;
+}
+
+static void channel_start(void) {
+    NRF_RADIO->FREQUENCY = m_channel_frequency[m_channel];
+    NRF_RADIO->DATAWHITEIV = ADV_CHANNEL_FIRST + m_channel;
+    NRF_RADIO->PACKETPTR = (uint32_t) m_pdus[m_identity];
+    NRF_RADIO->EVENTS_DISABLED = 0;
+    NRF_RADIO->TASKS_TXEN = 1;
+}
+
+// Starts the next event of the plan or ends the timeslot with the request of the following one
+static nrf_radio_signal_callback_return_param_t *slot_continue(void) {
+    uint64_t now_us = timebase_now_us();
+    uint64_t tx_us;
+    swarm_plan_request_t plan_request;
+
+    m_return_param.callback_action = NRF_RADIO_SIGNAL_CALLBACK_ACTION_NONE;
+    if (m_state != SWARM_RUNNING) {
+        m_return_param.callback_action = NRF_RADIO_SIGNAL_CALLBACK_ACTION_END;
+        return &m_return_param;
+    }
+    if (swarm_plan_next(&m_plan, now_us, m_slot_end_us, &m_identity, &tx_us)) {
+        m_channel = 0;
+        if (tx_us <= now_us) {
+            channel_start();
+        } else {
+            // TIMER0 counts microseconds since the start of the timeslot
+            NRF_TIMER0->EVENTS_COMPARE[0] = 0;
+            NRF_TIMER0->CC[0] = (uint32_t) (tx_us - m_slot_start_us);
+            NRF_TIMER0->INTENSET = TIMER_INTENSET_COMPARE0_Msk;
+        }
+        return &m_return_param;
+    }
+
+    swarm_plan_request(&m_plan, m_slot_start_us, now_us, &plan_request);
+    request_from_plan(&plan_request);
+    m_return_param.callback_action = NRF_RADIO_SIGNAL_CALLBACK_ACTION_REQUEST_AND_END;
+    m_return_param.params.request.p_next = &m_request;
+    return &m_return_param;
+}
+
+static nrf_radio_signal_callback_return_param_t *radio_signal_handler(uint8_t signal_type) {
+    switch (signal_type) {
+        case NRF_RADIO_CALLBACK_SIGNAL_TYPE_START:
+            m_slot_start_us = timebase_now_us();
+            m_slot_end_us = m_slot_start_us + SWARM_PLAN_SLOT_LENGTH_US - SWARM_PLAN_SLOT_MARGIN_US;
+            m_status.slots++;
+            radio_configure();
+            return slot_continue();
+        case NRF_RADIO_CALLBACK_SIGNAL_TYPE_TIMER0:
+            NRF_TIMER0->EVENTS_COMPARE[0] = 0;
+            NRF_TIMER0->INTENCLR = TIMER_INTENCLR_COMPARE0_Msk;
+            channel_start();
+            break;
+        case NRF_RADIO_CALLBACK_SIGNAL_TYPE_RADIO:
+            if (NRF_RADIO->EVENTS_DISABLED) {
+                NRF_RADIO->EVENTS_DISABLED = 0;
+                m_status.pdus++;
+                if (++m_channel < ADV_CHANNEL_COUNT) {
+                    channel_start();
+                } else {
+                    return slot_continue();
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    m_return_param.callback_action = NRF_RADIO_SIGNAL_CALLBACK_ACTION_NONE;
+    return &m_return_param;
+}
+
+static void soc_evt_handler(uint32_t evt_id, void *p_context) {
+    ret_code_t err_code;
+
+    switch (evt_id) {
+        case NRF_EVT_RADIO_BLOCKED:
+        case NRF_EVT_RADIO_CANCELED:
+        case NRF_EVT_RADIO_SIGNAL_CALLBACK_INVALID_RETURN:
+        case NRF_EVT_RADIO_SESSION_IDLE:
+            if (m_state != SWARM_RUNNING) {
+                break;
+            }
+            if (evt_id != NRF_EVT_RADIO_SESSION_IDLE) {
+                m_status.blocked++;
+            }
+            // start over as soon as possible, late events are dropped by the plan
+            request_earliest();
+            err_code = sd_radio_request(&m_request);
+            APP_ERROR_CHECK(err_code);
+            break;
+        case NRF_EVT_RADIO_SESSION_CLOSED:
+            if (m_state == SWARM_CLOSING) {
+                m_state = SWARM_IDLE;
+                m_stopped_handler();
+            } else if (m_state == SWARM_ABORTING) {
+                m_state = SWARM_IDLE;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+NRF_SDH_SOC_OBSERVER(m_swarm_soc_observer, SWARM_SOC_OBSERVER_PRIO, soc_evt_handler, NULL);
+
+void swarm_init(swarm_stopped_handler_t stopped_handler) {
+    m_stopped_handler = stopped_handler;
+    m_state = SWARM_IDLE;
+}
+
+uint32_t swarm_start(uint16_t count, uint16_t interval_ms, uint32_t seed, const uint8_t *p_uuid, uint16_t major,
+                     uint16_t first_minor, int8_t measured_rssi, int8_t tx_power) {
+    ret_code_t err_code;
+
+    if (m_state != SWARM_IDLE) {
+        return NRF_ERROR_BUSY;
+    }
+    if (count == 0 || count > SWARM_PLAN_MAX_IDENTITIES || interval_ms == 0) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        swarm_plan_encode(seed, i, p_uuid, major, first_minor, measured_rssi, m_pdus[i]);
+    }
+    memset(&m_status, 0, sizeof(m_status));
+    m_status.count = count;
+    m_status.interval_ms = interval_ms;
+    m_status.started_us = timebase_now_us();
+    m_tx_power = tx_power;
+    swarm_plan_init(&m_plan, count, interval_ms * 1000UL, m_status.started_us);
+
+    err_code = sd_radio_session_open(radio_signal_handler);
+    if (err_code != NRF_SUCCESS) {
+        return err_code;
+    }
+    m_state = SWARM_RUNNING;
+    request_earliest();
+    err_code = sd_radio_request(&m_request);
+    if (err_code != NRF_SUCCESS) {
+        m_state = SWARM_ABORTING;
+        (void) sd_radio_session_close();
+    }
+    return err_code;
+}
+
+uint32_t swarm_stop(void) {
+    if (m_state != SWARM_RUNNING) {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    // a running timeslot ends with its next signal, pending requests are canceled
+    m_state = SWARM_CLOSING;
+    return sd_radio_session_close();
+}
+
+void swarm_get_status(swarm_status_t *p_status) {
+    *p_status = m_status;
+    p_status->running = m_state == SWARM_RUNNING;
+    p_status->events = m_plan.events;
+    p_status->dropped = m_plan.dropped;
+}
@@ -0,0 +1,36 @@
+#ifndef _SWARM_H
+#define _SWARM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "swarm_plan.h"
+
+// Transmits a beacon swarm (see swarm_plan.h) from radio timeslots requested from the SoftDevice.
+// The SoftDevice advertiser and scanner compete for the radio, they should be stopped meanwhile.
+
+typedef struct {
+    bool running;
+    uint16_t count;
+    uint16_t interval_ms;
+    uint64_t started_us;
+    uint32_t pdus;
+    uint32_t events;
+    uint32_t dropped;               // events later than SWARM_PLAN_MAX_LATE_US
+    uint32_t slots;
+    uint32_t blocked;               // timeslot requests blocked or canceled by the SoftDevice
+} swarm_status_t;
+
+// Called once the radio session is closed after swarm_stop, not after a failed swarm_start
+typedef void (*swarm_stopped_handler_t)(void);
+
+// Module interface
+void swarm_init(swarm_stopped_handler_t stopped_handler);
+// Encodes the identity table and opens the radio session, NRF_ERROR_BUSY while a session is open or closing.
+// On errors the stopped handler is not called, the caller restores the radio itself.
+uint32_t swarm_start(uint16_t count, uint16_t interval_ms, uint32_t seed, const uint8_t *p_uuid, uint16_t major,
+                     uint16_t first_minor, int8_t measured_rssi, int8_t tx_power);
+uint32_t swarm_stop(void);
+void swarm_get_status(swarm_status_t *p_status);
+
+#endif // _SWARM_H
@@ -0,0 +1,116 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "swarm_plan.h"
+
+#include <string.h>
+
+// ADV_NONCONN_IND with a random advertiser address (TxAdd)
+#define PDU_HEADER                      0x42
+#define PDU_ADDR_SIZE                   6
+#define PDU_PAYLOAD_SIZE                (SWARM_PLAN_PDU_SIZE - 2)
+
+static const uint8_t m_ibeacon_prefix[] = {
+    0x02, 0x01, 0x06,                   // flags: LE general discoverable, BR/EDR not supported
+    0x1a, 0xff, 0x4c, 0x00,             // manufacturer specific data of Apple
+    0x02, 0x15                          // iBeacon type and length
+};
+
+// murmur3 finalizer, spreads the seed and index over all bits
+static uint32_t mix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+void swarm_plan_encode(uint32_t seed, uint16_t index, const uint8_t *p_uuid, uint16_t major, uint16_t first_minor,
+                       int8_t measured_rssi, uint8_t *p_pdu) {
+    uint32_t low = mix32(seed ^ mix32(index));
+    uint32_t high = mix32(low + 0x9e3779b9);
+    uint16_t minor = (uint16_t) (first_minor + index);
+    uint8_t *p = p_pdu;
+
+    *p++ = PDU_HEADER;
+    *p++ = PDU_PAYLOAD_SIZE;
+    // least significant byte first, the two most significant bits of a random static address are set
+    *p++ = (uint8_t) low;
+    *p++ = (uint8_t) (low >> 8);
+    *p++ = (uint8_t) (low >> 16);
+    *p++ = (uint8_t) (low >> 24);
+    *p++ = (uint8_t) high;
+    *p++ = (uint8_t) ((high >> 8) | 0xc0);
+    memcpy(p, m_ibeacon_prefix, sizeof(m_ibeacon_prefix));
+    p += sizeof(m_ibeacon_prefix);
+    memcpy(p, p_uuid, 16);
+    p += 16;
+    *p++ = (uint8_t) (major >> 8);
+    *p++ = (uint8_t) major;
+    *p++ = (uint8_t) (minor >> 8);
+    *p++ = (uint8_t) minor;
+    *p = (uint8_t) measured_rssi;
+}
+
+void swarm_plan_init(swarm_plan_t *p_plan, uint16_t count, uint32_t interval_us, uint64_t start_us) {
+    memset(p_plan, 0, sizeof(*p_plan));
+    p_plan->count = count;
+    p_plan->interval_us = interval_us;
+    p_plan->cycle_start_us = start_us;
+    p_plan->next_due_us = start_us;
+}
+
+static void advance(swarm_plan_t *p_plan) {
+    if (++p_plan->next_identity == p_plan->count) {
+        p_plan->next_identity = 0;
+        p_plan->cycle_start_us += p_plan->interval_us;
+    }
+    // computed from the cycle start, so the spacing does not accumulate rounding errors
+    p_plan->next_due_us = p_plan->cycle_start_us +
+                          (uint64_t) p_plan->next_identity * p_plan->interval_us / p_plan->count;
+}
+
+bool swarm_plan_next(swarm_plan_t *p_plan, uint64_t now_us, uint64_t slot_end_us, uint16_t *p_identity,
+                     uint64_t *p_tx_us) {
+    if (p_plan->count == 0) {
+        return false;
+    }
+    while (p_plan->next_due_us + SWARM_PLAN_MAX_LATE_US < now_us) {
+        p_plan->dropped++;
+        advance(p_plan);
+    }
+
+    uint64_t tx_us = p_plan->next_due_us > now_us ? p_plan->next_due_us : now_us;
+    if (tx_us + SWARM_PLAN_EVENT_AIRTIME_US > slot_end_us) {
+        return false;
+    }
+    *p_identity = p_plan->next_identity;
+    *p_tx_us = tx_us;
+    p_plan->events++;
+    advance(p_plan);
+    return true;
+}
+
+void swarm_plan_request(const swarm_plan_t *p_plan, uint64_t slot_start_us, uint64_t now_us,
+                        swarm_plan_request_t *p_request) {
+    p_request->earliest = p_plan->next_due_us <= now_us + SWARM_PLAN_EARLIEST_THRESHOLD_US;
+    p_request->distance_us = 0;
+    if (!p_request->earliest) {
+        uint64_t distance_us = p_plan->next_due_us - slot_start_us;
+        p_request->distance_us = distance_us < SWARM_PLAN_MAX_DISTANCE_US ? (uint32_t) distance_us
+                                                                           : SWARM_PLAN_MAX_DISTANCE_US;
+    }
+}
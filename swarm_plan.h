@@ -0,0 +1,65 @@
+#ifndef _SWARM_PLAN_H
+#define _SWARM_PLAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Beacon swarm emulation: a table of identities, each with its own random static address and
+// iBeacon payload, is advertised from radio timeslots instead of the SoftDevice advertiser.
+// This module encodes the PDUs and plans the advertising events and timeslot requests.
+//
+// Every identity advertises once per interval on the three advertising channels. The events of
+// consecutive identities are spaced evenly (interval / count), so the swarm is a single round robin
+// timeline. Events which cannot be sent within SWARM_PLAN_MAX_LATE_US of their due time are dropped
+// instead of delaying all following ones.
+
+#define SWARM_PLAN_MAX_IDENTITIES       256
+
+// Advertising PDU in the RADIO's RAM layout: header, length, AdvA, 30 bytes of advertising data
+#define SWARM_PLAN_PDU_SIZE             38
+
+// On-air time of one event: three packets of 1 + 4 + 38 + 3 bytes at 1 Mbps (368 us) with the fast
+// ramp-up (40 us) and the disable (about 10 us) in between
+#define SWARM_PLAN_PDU_AIRTIME_US       418
+#define SWARM_PLAN_EVENT_AIRTIME_US     (3 * SWARM_PLAN_PDU_AIRTIME_US)
+
+#define SWARM_PLAN_MAX_LATE_US          10000
+
+// Timeslots are requested with this length, and end this long before their end at the latest
+#define SWARM_PLAN_SLOT_LENGTH_US       20000
+#define SWARM_PLAN_SLOT_MARGIN_US       200
+
+// The next timeslot is requested as "earliest possible" if the next event is due within this time,
+// otherwise with a distance to the start of the current one. The SoftDevice allows distances up to 128 s.
+#define SWARM_PLAN_EARLIEST_THRESHOLD_US    (2 * SWARM_PLAN_SLOT_LENGTH_US)
+#define SWARM_PLAN_MAX_DISTANCE_US          120000000UL
+
+typedef struct {
+    uint16_t count;                 // identities
+    uint16_t next_identity;
+    uint32_t interval_us;
+    uint64_t cycle_start_us;        // due time of the event of identity 0 in the current cycle
+    uint64_t next_due_us;
+    uint32_t events;                // events handed out for transmission
+    uint32_t dropped;               // events later than SWARM_PLAN_MAX_LATE_US
+} swarm_plan_t;
+
+typedef struct {
+    bool earliest;                  // as soon as possible, otherwise distance_us after the slot start
+    uint32_t distance_us;
+} swarm_plan_request_t;
+
+// Encodes the PDU of one identity: a random static address derived from the seed and the index,
+// an iBeacon with the given UUID and major, and the index added to the first minor
+void swarm_plan_encode(uint32_t seed, uint16_t index, const uint8_t *p_uuid, uint16_t major, uint16_t first_minor,
+                       int8_t measured_rssi, uint8_t *p_pdu);
+void swarm_plan_init(swarm_plan_t *p_plan, uint16_t count, uint32_t interval_us, uint64_t start_us);
+// Hands out the next event if it can be completed before slot_end_us. Drops late events on the way.
+// *p_tx_us is when the event should start, not before now_us.
+bool swarm_plan_next(swarm_plan_t *p_plan, uint64_t now_us, uint64_t slot_end_us, uint16_t *p_identity,
+                     uint64_t *p_tx_us);
+// The request of the timeslot following the one starting at slot_start_us, when it ends at now_us
+void swarm_plan_request(const swarm_plan_t *p_plan, uint64_t slot_start_us, uint64_t now_us,
+                        swarm_plan_request_t *p_request);
+
+#endif // _SWARM_PLAN_H
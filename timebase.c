@@ -0,0 +1,119 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "timebase.h"
+
+#include <stdbool.h>
+
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "nrf_drv_common.h"
+#include "app_util_platform.h"
+
+// RTC0 and TIMER0 belong to the SoftDevice, RTC1 to app_timer
+#define TIMEBASE_RTC                    NRF_RTC2
+#define TIMEBASE_RTC_IRQn               RTC2_IRQn
+#define TIMEBASE_TIMER                  NRF_TIMER1
+
+// PPI channels 0-13 are available to the application when the SoftDevice is enabled
+#define TIMEBASE_PPI_CHANNEL            0
+
+#define RTC_COUNTER_BITS                24
+#define RTC_FREQUENCY_HZ                32768
+
+// Number of RTC overflows since timebase_init (the RTC counter itself is only 24 bit wide)
+static volatile uint32_t m_rtc_overflows;
+
+static uint64_t ticks_to_us(uint64_t ticks) {
+    // 1000000 / 32768 = 15625 / 512
+    return (ticks * 15625) >> 9;
+}
+
+void RTC2_IRQHandler(void) {
+    if (TIMEBASE_RTC->EVENTS_OVRFLW) {
+        TIMEBASE_RTC->EVENTS_OVRFLW = 0;
+        (void) TIMEBASE_RTC->EVENTS_OVRFLW; // flush the write before returning from the ISR
+        m_rtc_overflows++;
+    }
+}
+
+uint32_t timebase_init(void) {
+    uint32_t err_code;
+
+    // TIMER1 counts microseconds since the last RTC tick
+    TIMEBASE_TIMER->TASKS_STOP = 1;
+    TIMEBASE_TIMER->MODE = TIMER_MODE_MODE_Timer;
+    TIMEBASE_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+    TIMEBASE_TIMER->PRESCALER = 4; // 16 MHz / 2^4 = 1 MHz
+    TIMEBASE_TIMER->TASKS_CLEAR = 1;
+
+    // the RTC runs from the LFCLK which the SoftDevice already started
+    TIMEBASE_RTC->TASKS_STOP = 1;
+    TIMEBASE_RTC->PRESCALER = 0;
+    TIMEBASE_RTC->TASKS_CLEAR = 1;
+    TIMEBASE_RTC->EVTENSET = RTC_EVTEN_TICK_Msk;
+    TIMEBASE_RTC->INTENSET = RTC_INTENSET_OVRFLW_Msk;
+    m_rtc_overflows = 0;
+
+    err_code = sd_ppi_channel_assign(TIMEBASE_PPI_CHANNEL, &TIMEBASE_RTC->EVENTS_TICK, &TIMEBASE_TIMER->TASKS_CLEAR);
+    if (err_code != NRF_SUCCESS) return err_code;
+    err_code = sd_ppi_channel_enable_set(1UL << TIMEBASE_PPI_CHANNEL);
+    if (err_code != NRF_SUCCESS) return err_code;
+
+    nrf_drv_common_irq_enable(TIMEBASE_RTC_IRQn, APP_IRQ_PRIORITY_HIGH);
+
+    TIMEBASE_TIMER->TASKS_START = 1;
+    TIMEBASE_RTC->TASKS_START = 1;
+    return NRF_SUCCESS;
+}
+
+uint64_t timebase_now_us(void) {
+    uint32_t counter;
+    uint32_t fine;
+    uint64_t overflows;
+
+    CRITICAL_REGION_ENTER();
+    do {
+        counter = TIMEBASE_RTC->COUNTER;
+        TIMEBASE_TIMER->TASKS_CAPTURE[0] = 1;
+        fine = TIMEBASE_TIMER->CC[0];
+        overflows = m_rtc_overflows;
+        // the overflow interrupt may be pending while we are in the critical region
+        if (TIMEBASE_RTC->EVENTS_OVRFLW && counter < (1UL << (RTC_COUNTER_BITS - 1))) {
+            overflows++;
+        }
+        // retry if a tick cleared the timer between reading the counter and the capture
+    } while (counter != TIMEBASE_RTC->COUNTER);
+    CRITICAL_REGION_EXIT();
+
+    uint64_t ticks = (overflows << RTC_COUNTER_BITS) | counter;
+    uint64_t coarse_us = ticks_to_us(ticks);
+    uint64_t next_us = ticks_to_us(ticks + 1);
+
+    // never report a time which belongs to the next tick, this keeps the timebase monotonic
+    if (coarse_us + fine >= next_us) {
+        return next_us - 1;
+    }
+    return coarse_us + fine;
+}
+
+void timebase_fine_enable(bool enable) {
+    // a stopped TIMER1 is still cleared by the next tick, its count never exceeds the time since the tick
+    if (enable) {
+        TIMEBASE_TIMER->TASKS_START = 1;
+    } else {
+        TIMEBASE_TIMER->TASKS_STOP = 1;
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef _TIMEBASE_H
+#define _TIMEBASE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Monotonic 64-bit microsecond timebase.
+//
+// The coarse part comes from RTC2 (32768 Hz, 24 bit) extended to 64 bit by counting overflows,
+// the fine part from TIMER1 (1 MHz), which is cleared on every RTC tick via PPI. A timestamp is
+// therefore "RTC ticks converted to microseconds" plus "microseconds since the last tick",
+// which gives 1 us resolution with the long term stability of the 32 kHz crystal.
+//
+// TIMER1 keeps the 16 MHz clock requested while it runs. It can be stopped while no fine timestamps
+// are needed (the UART does while it is suspended), timestamps then have the RTC's resolution of
+// 30.5 us and stay monotonic.
+uint32_t timebase_init(void);
+uint64_t timebase_now_us(void);
+void timebase_fine_enable(bool enable);
+
+#endif // _TIMEBASE_H
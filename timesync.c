@@ -0,0 +1,95 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "timesync.h"
+
+#include <string.h>
+
+void timesync_init(timesync_t *p_sync) {
+    memset(p_sync, 0, sizeof(timesync_t));
+}
+
+bool timesync_is_synchronized(const timesync_t *p_sync) {
+    return p_sync->sample_count > 0;
+}
+
+uint64_t timesync_local_to_host(const timesync_t *p_sync, uint64_t local_us) {
+    int64_t elapsed = (int64_t) (local_us - p_sync->ref_local_us);
+    int64_t correction = (elapsed * p_sync->drift_ppb) / 1000000000LL;
+    return local_us + p_sync->offset_us + correction;
+}
+
+// Least squares fit of the offset (host - local) over the local time. The regression only runs
+// when a sync command arrives, so doubles are fine here; conversions stay in integer arithmetic.
+// The UART/USB latency only ever delays the local stamp, so it would bias the fitted offset by its
+// mean. The drift is taken from the fit, which the latency does not bias, and the offset from the
+// least delayed sample, the one furthest above the fitted line.
+static void estimate(timesync_t *p_sync) {
+    const timesync_sample_t *p_newest = &p_sync->samples[(p_sync->next_sample + TIMESYNC_MAX_SAMPLES - 1) % TIMESYNC_MAX_SAMPLES];
+    uint8_t n = p_sync->sample_count;
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+
+    // use the newest sample as reference to keep the numbers small
+    int64_t ref_offset = (int64_t) (p_newest->host_us - p_newest->local_us);
+    for (uint8_t i = 0; i < n; i++) {
+        const timesync_sample_t *p_sample = &p_sync->samples[i];
+        double x = (double) (int64_t) (p_sample->local_us - p_newest->local_us);
+        double y = (double) ((int64_t) (p_sample->host_us - p_sample->local_us) - ref_offset);
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+    }
+
+    double drift = 0;
+    double denominator = n * sum_xx - sum_x * sum_x;
+    if (n >= 2 && denominator > 0) {
+        drift = (n * sum_xy - sum_x * sum_y) / denominator;
+    }
+    if (drift > TIMESYNC_MAX_DRIFT_PPB / 1e9) drift = TIMESYNC_MAX_DRIFT_PPB / 1e9;
+    if (drift < -TIMESYNC_MAX_DRIFT_PPB / 1e9) drift = -TIMESYNC_MAX_DRIFT_PPB / 1e9;
+
+    // the line with the fitted drift through the least delayed sample, evaluated at the newest one (x = 0)
+    double intercept = 0;
+    for (uint8_t i = 0; i < n; i++) {
+        const timesync_sample_t *p_sample = &p_sync->samples[i];
+        double x = (double) (int64_t) (p_sample->local_us - p_newest->local_us);
+        double y = (double) ((int64_t) (p_sample->host_us - p_sample->local_us) - ref_offset);
+        if (i == 0 || y - drift * x > intercept) {
+            intercept = y - drift * x;
+        }
+    }
+    p_sync->ref_local_us = p_newest->local_us;
+    p_sync->offset_us = ref_offset + (int64_t) intercept;
+    p_sync->drift_ppb = (int32_t) (drift * 1e9);
+}
+
+void timesync_add_sample(timesync_t *p_sync, uint64_t local_us, uint64_t host_us) {
+    if (timesync_is_synchronized(p_sync)) {
+        int64_t residual = (int64_t) (host_us - timesync_local_to_host(p_sync, local_us));
+        if (residual > TIMESYNC_MAX_RESIDUAL_US || residual < -TIMESYNC_MAX_RESIDUAL_US) {
+            // the host clock was stepped, old samples are worthless
+            timesync_init(p_sync);
+        }
+    }
+
+    p_sync->samples[p_sync->next_sample].local_us = local_us;
+    p_sync->samples[p_sync->next_sample].host_us = host_us;
+    p_sync->next_sample = (uint8_t) ((p_sync->next_sample + 1) % TIMESYNC_MAX_SAMPLES);
+    if (p_sync->sample_count < TIMESYNC_MAX_SAMPLES) {
+        p_sync->sample_count++;
+    }
+    estimate(p_sync);
+}
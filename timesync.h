@@ -0,0 +1,38 @@
+#ifndef _TIMESYNC_H
+#define _TIMESYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Number of sync samples used for estimating offset and drift. The more samples, the less the
+// least delayed one is delayed by the UART/USB latency.
+#define TIMESYNC_MAX_SAMPLES            16
+
+// Samples deviating more than this from the current estimate restart the estimation (host clock step)
+#define TIMESYNC_MAX_RESIDUAL_US        20000
+
+// Drift estimates are limited to what a 32 kHz crystal can plausibly do
+#define TIMESYNC_MAX_DRIFT_PPB          500000
+
+typedef struct {
+    uint64_t local_us;
+    uint64_t host_us;
+} timesync_sample_t;
+
+// Estimator state, maps local timebase values to host time:
+//   host = local + offset_us + (local - ref_local_us) * drift_ppb / 1e9
+typedef struct {
+    timesync_sample_t samples[TIMESYNC_MAX_SAMPLES];
+    uint8_t sample_count;
+    uint8_t next_sample;
+    uint64_t ref_local_us;
+    int64_t offset_us;
+    int32_t drift_ppb;
+} timesync_t;
+
+void timesync_init(timesync_t *p_sync);
+void timesync_add_sample(timesync_t *p_sync, uint64_t local_us, uint64_t host_us);
+bool timesync_is_synchronized(const timesync_t *p_sync);
+uint64_t timesync_local_to_host(const timesync_t *p_sync, uint64_t local_us);
+
+#endif // _TIMESYNC_H
@@ -0,0 +1,96 @@
+/*
+ *    Copyright 2018 Classy Code GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "trace.h"
+
+#include <string.h>
+
+#include "nrf.h"
+#include "app_util_platform.h"
+
+#include "timebase.h"
+
+#define TRACE_MAGIC                     0x54524345UL // "TRCE"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t next_seq;
+    uint32_t boot_count;
+    trace_event_t events[TRACE_CAPACITY];
+} trace_buffer_t;
+
+// not initialized by the startup code, the content is kept across resets
+static trace_buffer_t m_trace __attribute__((section(".noinit")));
+
+void trace_init(void) {
+    uint32_t reset_reason = NRF_POWER->RESETREAS;
+
+    // no reset reason is set after power-on, RAM content is random then
+    if (m_trace.magic != TRACE_MAGIC || reset_reason == 0) {
+        trace_clear();
+    }
+    NRF_POWER->RESETREAS = reset_reason; // write 1s to clear
+    m_trace.boot_count++;
+    trace_record(TRACE_BOOT, 0, 0, reset_reason);
+}
+
+void trace_clear(void) {
+    CRITICAL_REGION_ENTER();
+    memset(&m_trace, 0, sizeof(m_trace));
+    m_trace.magic = TRACE_MAGIC;
+    CRITICAL_REGION_EXIT();
+}
+
+void trace_record(uint8_t type, uint8_t arg8, uint16_t arg16, uint32_t arg32) {
+    uint32_t timestamp_us = (uint32_t) timebase_now_us();
+
+    CRITICAL_REGION_ENTER();
+    trace_event_t *p_event = &m_trace.events[m_trace.next_seq % TRACE_CAPACITY];
+    p_event->timestamp_us = timestamp_us;
+    p_event->type = type;
+    p_event->arg8 = arg8;
+    p_event->arg16 = arg16;
+    p_event->arg32 = arg32;
+    m_trace.next_seq++;
+    CRITICAL_REGION_EXIT();
+}
+
+uint32_t trace_first_seq(void) {
+    return m_trace.next_seq > TRACE_CAPACITY ? m_trace.next_seq - TRACE_CAPACITY : 0;
+}
+
+uint32_t trace_next_seq(void) {
+    return m_trace.next_seq;
+}
+
+uint32_t trace_boot_count(void) {
+    return m_trace.boot_count;
+}
+
+uint32_t trace_read(uint32_t seq, trace_event_t *p_events, uint32_t max_events, uint32_t *p_first_seq) {
+    uint32_t count = 0;
+
+    CRITICAL_REGION_ENTER();
+    if (seq < trace_first_seq()) {
+        seq = trace_first_seq();
+    }
+    while (count < max_events && seq + count < m_trace.next_seq) {
+        p_events[count] = m_trace.events[(seq + count) % TRACE_CAPACITY];
+        count++;
+    }
+    CRITICAL_REGION_EXIT();
+    *p_first_seq = seq;
+    return count;
+}
@@ -0,0 +1,65 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+// Ring buffer of timestamped binary events for post-mortem analysis. It lives in the .noinit section
+// (see gcc_nrf52.ld.in), so it survives soft resets, watchdog resets and resets after errors. Every boot
+// starts with a TRACE_BOOT event. Events are numbered by a sequence number which keeps counting
+// across resets, the buffer holds the last TRACE_CAPACITY of them.
+//
+// The dump ('D' command) sends events as UART_FRAME_TRACE frames: <first sequence number, uint32>
+// followed by up to TRACE_EVENTS_PER_FRAME events in the layout of trace_event_t (little endian).
+
+#define TRACE_CAPACITY                  256
+#define TRACE_EVENTS_PER_FRAME          20
+
+// Event types, the meaning of the arguments is given in brackets
+typedef enum {
+    TRACE_BOOT = 1,             // arg32: RESETREAS
+    TRACE_UART_RX_LINE,         // arg16: line length
+    TRACE_CMD_BEGIN,            // arg8: command letter
+    TRACE_CMD_END,              // arg8: command letter
+    TRACE_FDS_BEGIN,            // arg8: trace_fds_op_t
+    TRACE_FDS_END,              // arg8: trace_fds_op_t, arg32: result
+    TRACE_ADV_START,            // arg16: interval in ms
+    TRACE_ADV_STOP,
+    TRACE_SCAN_START,           // arg16: window in ms
+    TRACE_SCAN_STOP,
+    TRACE_ERROR,                // arg16: line, arg32: error code (SDK errors only)
+    TRACE_ERROR_PC,             // arg16: fault id (NRF_FAULT_ID_*), arg32: program counter
+    TRACE_UART_SUSPEND,
+    TRACE_UART_RESUME,          // arg32: suspended time in us
+    TRACE_UART_BAUD,            // arg8: 1 if reverted, arg16: flow control, arg32: baud rate
+    TRACE_RAM_LAYOUT            // arg8: 1 if the application RAM is not linked there, arg32: minimum
+                                // application RAM start reported by the SoftDevice
+} trace_event_type_t;
+
+typedef enum {
+    TRACE_FDS_WRITE = 1,
+    TRACE_FDS_UPDATE,
+    TRACE_FDS_GC
+} trace_fds_op_t;
+
+typedef struct {
+    uint32_t timestamp_us;      // low 32 bits of the timebase (restarts at 0 with every boot)
+    uint8_t type;
+    uint8_t arg8;
+    uint16_t arg16;
+    uint32_t arg32;
+} trace_event_t;
+
+// Validates the buffer retained from before the reset (clears it after a power-on reset) and
+// records TRACE_BOOT. Must be called before the SoftDevice is enabled, it reads RESETREAS.
+void trace_init(void);
+void trace_record(uint8_t type, uint8_t arg8, uint16_t arg16, uint32_t arg32);
+void trace_clear(void);
+// Sequence numbers of the oldest event in the buffer and of the next event to be recorded
+uint32_t trace_first_seq(void);
+uint32_t trace_next_seq(void);
+uint32_t trace_boot_count(void);
+// Copies up to max_events events starting at seq (clamped to the oldest one), returns the number
+// copied and sets *p_first_seq to the sequence number of the first one
+uint32_t trace_read(uint32_t seq, trace_event_t *p_events, uint32_t max_events, uint32_t *p_first_seq);
+
+#endif // _TRACE_H
@@ -16,57 +16,461 @@
 #include "uart_cmd.h"
 
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 #include <nrf_uart.h>
+#include <nrf_drv_gpiote.h>
 #include <app_uart.h>
+#include <app_timer.h>
+#include <crc16.h>
+#include <app_util_platform.h>
 
 #include "hex_utils.h"
+#include "timebase.h"
+#include "stats.h"
+#include "trace.h"
 
 // On the ABSniffer, nRF52 and CP2104 are wired like this
 // http://wiki.aprbrother.com/wiki/ABSniffer_USB_Dongle_528
 #define UART_RX_PIN                     8
 #define UART_TX_PIN                     6
+// RTS and CTS of the CP2104 are not connected on the ABSniffer. Boards which wire them define the
+// nRF52 pins here, hardware flow control can then be enabled together with a baud rate ('H' command).
+// #define UART_RTS_PIN                 5
+// #define UART_CTS_PIN                 7
+#if defined(UART_RTS_PIN) && defined(UART_CTS_PIN)
+#define UART_FLOW_CONTROL_AVAILABLE     1
+#else
+#define UART_FLOW_CONTROL_AVAILABLE     0
+#define UART_RTS_PIN                    0 // ignored if flow control is disabled
+#define UART_CTS_PIN                    0
+#endif
 
 // Command buffer for receiving commands via UART
 #define UART_RX_BUF_SIZE 256
-#define UART_TX_BUF_SIZE 256
+#define UART_TX_BUF_SIZE 1024 // room for binary frames
 #define CMD_BUF_SIZE 256
 
+// The enabled UART receiver keeps the HFCLK running. After this long without traffic in either
+// direction, the UART is powered down until a falling edge on the RX pin (the start bit of the
+// next byte) wakes it again. 0 keeps the UART enabled.
+#define UART_IDLE_TIMEOUT_MS            10000
+#define UART_IDLE_CHECK_INTERVAL        APP_TIMER_TICKS(1000)
+// Bytes received this long after the wake up are dropped, the byte which woke the UART is lost
+// or garbled. Hosts send a preamble of line breaks (e.g. 32 at 115200 baud) before the first command.
+#define UART_WAKE_GUARD_US              1000
+
+// Baud rate negotiation: the response to 'H <rate>' is sent at the old rate, the UART switches this
+// long after it has left the TX FIFO (the last byte is still being shifted out). The host has to
+// confirm with 'H C' at the new rate within the confirmation timeout, otherwise the old rate is restored.
+#define UART_BAUD_SWITCH_DELAY          APP_TIMER_TICKS(2)
+#define UART_BAUD_CONFIRM_TIMEOUT       APP_TIMER_TICKS(2000)
+#define UART_DEFAULT_BAUD_RATE          115200
+
+// Throughput test ('H T'): frames are queued in batches whenever the TX FIFO runs empty, leaving
+// room in UART_TX_BUF_SIZE for responses and scan reports sent in between
+#define UART_TEST_FRAME_PAYLOAD         200
+#define UART_TEST_FRAMES_PER_BATCH      4
+
 // Module state
 static uart_cmd_client_t *client;
 static uint8_t cmd_buf[256 + 1];
 static uint8_t *p_buf = &cmd_buf[0];
+static uint64_t cmd_rx_time_us;
+static volatile bool m_suspended;
+static volatile bool m_tx_pending;
+static uint64_t m_last_activity_us;
+static uint64_t m_suspend_time_us;
+static uint64_t m_discard_until_us;
+APP_TIMER_DEF(m_idle_timer);
+
+typedef enum {
+    BAUD_IDLE,
+    BAUD_DRAINING,              // waiting for the response to leave, output is dropped
+    BAUD_SWITCHING,             // waiting for the last byte to be shifted out, output is dropped
+    BAUD_CONFIRMING             // running at the new rate, waiting for 'H C'
+} baud_state_t;
+
+typedef struct {
+    uint32_t baud_rate;
+    nrf_uart_baudrate_t setting;
+} baud_rate_t;
 
-// Helper for sending null-terminated strings
+// The nRF52 generates 941176 baud for 921600 (+2.1%), 1000000 is exact
+static const baud_rate_t m_baud_rates[] = {
+        {115200,  NRF_UART_BAUDRATE_115200},
+        {230400,  NRF_UART_BAUDRATE_230400},
+        {460800,  NRF_UART_BAUDRATE_460800},
+        {921600,  NRF_UART_BAUDRATE_921600},
+        {1000000, NRF_UART_BAUDRATE_1000000},
+};
+
+static const baud_rate_t *mp_baud = &m_baud_rates[0];
+static bool m_flow_control;
+static const baud_rate_t *mp_prev_baud;
+static bool m_prev_flow_control;
+static baud_state_t m_baud_state;
+static uint32_t m_test_remaining;
+static uint32_t m_test_seq;
+APP_TIMER_DEF(m_baud_timer);
+
+static void uart_resume(void);
+
+// Helper for sending a byte, bytes are dropped when the TX FIFO is full
+static void uart_put(uint8_t byte) {
+    if (m_baud_state == BAUD_DRAINING || m_baud_state == BAUD_SWITCHING) {
+        STATS_INC(UART_TX_DROPPED);
+        return;
+    }
+    if (m_suspended) {
+        uart_resume();
+    }
+    if (app_uart_put(byte) == NRF_SUCCESS) {
+        m_tx_pending = true;
+        STATS_INC(UART_TX_BYTES);
+    } else {
+        STATS_INC(UART_TX_DROPPED);
+    }
+}
+
+// Helper for sending null-terminated strings. Frames are sent from other interrupt contexts,
+// the critical region keeps them from ending up in the middle of a text response.
 static void uart_put_string(const char *str) {
     size_t len = strlen(str);
+    CRITICAL_REGION_ENTER();
     for (int i = 0; i < len; i++) {
-        app_uart_put((uint8_t) str[i]);
+        uart_put((uint8_t) str[i]);
     }
+    CRITICAL_REGION_EXIT();
 }
 
 static const char *response_ok = "OK\n";
 static const char *response_err_configuration = "ERR: Configuration not accepted\n";
 static const char *response_err_unknown_cmd = "ERR: Unknown command\n";
+static const char *response_err_invalid_args = "ERR: Invalid arguments\n";
 
 // parse the command: C<SP>UUID<SP>MAJOR<SP>MINOR
-// no input validation whatsoever and unsafe memory handling ahead...
-static void process_configuration_command(char *cmd, uart_cmd_evt_t *p_uart_cmd_evt) {
+// the UUID must be exactly 32 hex digits, major and minor are fixed values or rules to derive them from
+// the device address (see mac_derive.h), returns false if an argument is missing or malformed
+static bool process_configuration_command(char *cmd, uart_cmd_evt_t *p_uart_cmd_evt) {
     uint8_t uuid[16];
 
     memset(uuid, 0, sizeof(uuid));
     p_uart_cmd_evt->evt_type = CONFIGURATION;
     strtok(cmd, " "); // skip 'C'
     const char *uuid_hex = strtok(NULL, " ");
+    if (!uuid_hex || strlen(uuid_hex) != 2 * sizeof(uuid) ||
+        strspn(uuid_hex, "0123456789abcdefABCDEF") != 2 * sizeof(uuid)) return false;
     hex_string_to_uint8_array(uuid_hex, strlen(uuid_hex), uuid);
     memcpy(p_uart_cmd_evt->proximity_uuid, uuid, sizeof(uuid));
 
-    const char *major = strtok(NULL, " ");
-    p_uart_cmd_evt->major = (uint16_t) atoi(major);
-    const char *minor = strtok(NULL, " ");
-    p_uart_cmd_evt->minor = (uint16_t) atoi(minor);
+    const char *major = strtok(NULL, " \r\n");
+    if (!mac_derive_parse(major, &p_uart_cmd_evt->major_rule, &p_uart_cmd_evt->major)) return false;
+    const char *minor = strtok(NULL, " \r\n");
+    return mac_derive_parse(minor, &p_uart_cmd_evt->minor_rule, &p_uart_cmd_evt->minor);
+}
+
+// parse the command: T<SP>HOST_TIME_US
+// returns false unless the time is a non-zero decimal number, a bad sample would step the clock
+static bool process_time_sync_command(char *cmd, uart_cmd_evt_t *p_uart_cmd_evt) {
+    char *end;
+
+    p_uart_cmd_evt->evt_type = TIME_SYNC;
+    strtok(cmd, " "); // skip 'T'
+    const char *host_time = strtok(NULL, " \r\n");
+    if (!host_time || *host_time < '0' || *host_time > '9') return false;
+    p_uart_cmd_evt->host_time_us = strtoull(host_time, &end, 10);
+    return *end == '\0' && p_uart_cmd_evt->host_time_us != 0;
+}
+
+// parse a command with integer arguments: <CMD>[<SP>ARG]...
+static void process_args_command(char *cmd, uart_cmd_evt_type_t evt_type, uart_cmd_evt_t *p_uart_cmd_evt) {
+    const char *arg;
+
+    p_uart_cmd_evt->evt_type = evt_type;
+    strtok(cmd, " \r\n"); // skip command
+    while (p_uart_cmd_evt->arg_count < UART_CMD_MAX_ARGS && (arg = strtok(NULL, " \r\n")) != NULL) {
+        p_uart_cmd_evt->args[p_uart_cmd_evt->arg_count++] = (int32_t) strtol(arg, NULL, 10);
+    }
+}
+
+// parse a command with an optional subcommand letter and integer arguments: <CMD>[<SP>SUB][<SP>ARG]...
+static void process_subcommand_args(char *cmd, uart_cmd_evt_type_t evt_type, uart_cmd_evt_t *p_uart_cmd_evt) {
+    const char *arg;
+
+    p_uart_cmd_evt->evt_type = evt_type;
+    strtok(cmd, " \r\n"); // skip command
+    arg = strtok(NULL, " \r\n");
+    if (arg && ((arg[0] >= 'A' && arg[0] <= 'Z') || (arg[0] >= 'a' && arg[0] <= 'z'))) {
+        p_uart_cmd_evt->subcommand = arg[0];
+        arg = strtok(NULL, " \r\n");
+    }
+    while (arg && p_uart_cmd_evt->arg_count < UART_CMD_MAX_ARGS) {
+        p_uart_cmd_evt->args[p_uart_cmd_evt->arg_count++] = (int32_t) strtol(arg, NULL, 10);
+        arg = strtok(NULL, " \r\n");
+    }
+}
+
+// decode a hex-encoded data argument into the event, returns false if it is malformed or too long
+static bool process_data_arg(const char *hex, uart_cmd_evt_t *p_uart_cmd_evt) {
+    size_t len = hex ? strlen(hex) : 0;
+    if (len == 0 || len % 2 != 0 || len / 2 > UART_CMD_MAX_DATA) {
+        return false;
+    }
+    hex_string_to_uint8_array(hex, (int) len, p_uart_cmd_evt->data);
+    p_uart_cmd_evt->data_len = (uint8_t) (len / 2);
+    return true;
+}
+
+// parse the command: B[<SP>N<SP>BITS<SP>HASHES | <SP>W<SP>OFFSET<SP>HEX | <SP>E<SP>CRC16 | <SP>D]
+static bool process_bloom_command(char *cmd, uart_cmd_evt_t *p_uart_cmd_evt) {
+    const char *arg;
+
+    p_uart_cmd_evt->evt_type = BLOOM_FILTER;
+    strtok(cmd, " \r\n"); // skip 'B'
+    arg = strtok(NULL, " \r\n");
+    p_uart_cmd_evt->subcommand = arg ? arg[0] : 0;
+    if (p_uart_cmd_evt->subcommand == 'W') {
+        arg = strtok(NULL, " \r\n");
+        if (!arg) return false;
+        p_uart_cmd_evt->args[p_uart_cmd_evt->arg_count++] = (int32_t) strtol(arg, NULL, 10);
+        return process_data_arg(strtok(NULL, " \r\n"), p_uart_cmd_evt);
+    }
+    while (p_uart_cmd_evt->arg_count < UART_CMD_MAX_ARGS && (arg = strtok(NULL, " \r\n")) != NULL) {
+        p_uart_cmd_evt->args[p_uart_cmd_evt->arg_count++] = (int32_t) strtol(arg, NULL, 10);
+    }
+    return true;
+}
+
+// parse the command: E[<SP>S<SP>MODE<SP>EXPONENT<SP>EPOCH<SP>KEY | <SP>O]
+static bool process_eid_command(char *cmd, uart_cmd_evt_t *p_uart_cmd_evt) {
+    const char *arg;
+
+    p_uart_cmd_evt->evt_type = EID;
+    strtok(cmd, " \r\n"); // skip 'E'
+    arg = strtok(NULL, " \r\n");
+    p_uart_cmd_evt->subcommand = arg ? arg[0] : 0;
+    if (p_uart_cmd_evt->subcommand == 0 || p_uart_cmd_evt->subcommand == 'O') {
+        return true;
+    }
+    if (p_uart_cmd_evt->subcommand != 'S') {
+        return false;
+    }
+    while (p_uart_cmd_evt->arg_count < 3) {
+        arg = strtok(NULL, " \r\n");
+        if (!arg) return false;
+        // the epoch is unsigned
+        p_uart_cmd_evt->args[p_uart_cmd_evt->arg_count++] = (int32_t) strtoul(arg, NULL, 10);
+    }
+    return process_data_arg(strtok(NULL, " \r\n"), p_uart_cmd_evt);
+}
+
+// parse the command: Y[<SP>R<SP>IBEACON<SP>UID<SP>URL<SP>TLM | <SP>U<SP>HEX | <SP>L<SP>URL]
+static bool process_eddystone_command(char *cmd, uart_cmd_evt_t *p_uart_cmd_evt) {
+    const char *arg;
+
+    p_uart_cmd_evt->evt_type = EDDYSTONE;
+    strtok(cmd, " \r\n"); // skip 'Y'
+    arg = strtok(NULL, " \r\n");
+    p_uart_cmd_evt->subcommand = arg ? arg[0] : 0;
+    switch (p_uart_cmd_evt->subcommand) {
+        case 0:
+            return true;
+        case 'U':
+            return process_data_arg(strtok(NULL, " \r\n"), p_uart_cmd_evt);
+        case 'L':
+            // the URL text is passed as is, it is compressed by the handler
+            arg = strtok(NULL, " \r\n");
+            if (!arg || strlen(arg) >= UART_CMD_MAX_DATA) return false;
+            p_uart_cmd_evt->data_len = (uint8_t) strlen(arg);
+            memcpy(p_uart_cmd_evt->data, arg, p_uart_cmd_evt->data_len + 1);
+            return true;
+        case 'R':
+            while (p_uart_cmd_evt->arg_count < UART_CMD_MAX_ARGS && (arg = strtok(NULL, " \r\n")) != NULL) {
+                p_uart_cmd_evt->args[p_uart_cmd_evt->arg_count++] = (int32_t) strtol(arg, NULL, 10);
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+// parse the command: X[<SP>S<SP>INTERVAL<SP>DURATION[<SP>HEX] | <SP>C]
+static bool process_burst_command(char *cmd, uart_cmd_evt_t *p_uart_cmd_evt) {
+    const char *arg;
+
+    p_uart_cmd_evt->evt_type = BURST;
+    strtok(cmd, " \r\n"); // skip 'X'
+    arg = strtok(NULL, " \r\n");
+    p_uart_cmd_evt->subcommand = arg ? arg[0] : 0;
+    if (p_uart_cmd_evt->subcommand == 0 || p_uart_cmd_evt->subcommand == 'C') {
+        return true;
+    }
+    if (p_uart_cmd_evt->subcommand != 'S') {
+        return false;
+    }
+    while (p_uart_cmd_evt->arg_count < 2) {
+        arg = strtok(NULL, " \r\n");
+        if (!arg) return false;
+        p_uart_cmd_evt->args[p_uart_cmd_evt->arg_count++] = (int32_t) strtol(arg, NULL, 10);
+    }
+    // the alternate payload is optional
+    arg = strtok(NULL, " \r\n");
+    return !arg || process_data_arg(arg, p_uart_cmd_evt);
+}
+
+// parse the command: F[<SP>N<SP>SIZE<SP>CRC32 | <SP>W<SP>OFFSET<SP>CRC16<SP>HEX | <SP>E | <SP>C]
+static bool process_update_command(char *cmd, uart_cmd_evt_t *p_uart_cmd_evt) {
+    const char *arg;
+
+    p_uart_cmd_evt->evt_type = FIRMWARE_UPDATE;
+    strtok(cmd, " \r\n"); // skip 'F'
+    arg = strtok(NULL, " \r\n");
+    p_uart_cmd_evt->subcommand = arg ? arg[0] : 0;
+    switch (p_uart_cmd_evt->subcommand) {
+        case 0:
+        case 'E':
+        case 'C':
+            return true;
+        case 'N':
+        case 'W':
+            while (p_uart_cmd_evt->arg_count < 2) {
+                arg = strtok(NULL, " \r\n");
+                if (!arg) return false;
+                // sizes, offsets and CRCs are unsigned
+                p_uart_cmd_evt->args[p_uart_cmd_evt->arg_count++] = (int32_t) strtoul(arg, NULL, 10);
+            }
+            return p_uart_cmd_evt->subcommand == 'N' || process_data_arg(strtok(NULL, " \r\n"), p_uart_cmd_evt);
+        default:
+            return false;
+    }
+}
+
+static const baud_rate_t *find_baud_rate(uint32_t baud_rate) {
+    for (int i = 0; i < sizeof(m_baud_rates) / sizeof(m_baud_rates[0]); i++) {
+        if (m_baud_rates[i].baud_rate == baud_rate) {
+            return &m_baud_rates[i];
+        }
+    }
+    return NULL;
+}
+
+// Queues the next batch of test frames: <sequence number, uint32> followed by the bytes
+// (sequence number + index) & 0xFF
+static void test_stream_fill(void) {
+    uint8_t payload[UART_TEST_FRAME_PAYLOAD];
+
+    for (int n = 0; n < UART_TEST_FRAMES_PER_BATCH && m_test_remaining > 0; n++) {
+        uint8_t len = m_test_remaining < sizeof(payload) ? (uint8_t) m_test_remaining : sizeof(payload);
+        if (len < 4) {
+            len = 4;
+        }
+        for (int i = 0; i < len; i++) {
+            payload[i] = (uint8_t) (m_test_seq + i);
+        }
+        payload[0] = (uint8_t) m_test_seq;
+        payload[1] = (uint8_t) (m_test_seq >> 8);
+        payload[2] = (uint8_t) (m_test_seq >> 16);
+        payload[3] = (uint8_t) (m_test_seq >> 24);
+        uart_cmd_send_frame(UART_FRAME_TEST, payload, len);
+        m_test_seq++;
+        m_test_remaining = m_test_remaining > len ? m_test_remaining - len : 0;
+    }
+}
+
+static ret_code_t uart_open(void);
+
+// Closes the UART and opens it again with the current baud rate and flow control setting
+static void uart_reopen(void) {
+    ret_code_t err_code;
+
+    err_code = app_uart_close();
+    APP_ERROR_CHECK(err_code);
+    p_buf = &cmd_buf[0];
+    err_code = uart_open();
+    APP_ERROR_CHECK(err_code);
+    m_last_activity_us = timebase_now_us();
+}
+
+static void baud_timer_handler(void *p_context) {
+    ret_code_t err_code;
+
+    if (m_baud_state == BAUD_SWITCHING) {
+        uart_reopen();
+        m_baud_state = BAUD_CONFIRMING;
+        trace_record(TRACE_UART_BAUD, 0, m_flow_control, mp_baud->baud_rate);
+        err_code = app_timer_start(m_baud_timer, UART_BAUD_CONFIRM_TIMEOUT, NULL);
+        APP_ERROR_CHECK(err_code);
+    } else if (m_baud_state == BAUD_CONFIRMING) {
+        // the host did not get through at the new rate
+        mp_baud = mp_prev_baud;
+        m_flow_control = m_prev_flow_control;
+        uart_reopen();
+        m_baud_state = BAUD_IDLE;
+        STATS_INC(UART_BAUD_REVERTS);
+        trace_record(TRACE_UART_BAUD, 1, m_flow_control, mp_baud->baud_rate);
+    }
+}
+
+// parse and execute the command: H[<SP>RATE[<SP>F] | <SP>C | <SP>T<SP>BYTES]
+static void process_baud_command(char *cmd) {
+    char info[48];
+    const char *arg;
+
+    strtok(cmd, " \r\n"); // skip 'H'
+    arg = strtok(NULL, " \r\n");
+    if (!arg) {
+        snprintf(info, sizeof(info), "%lu %d %d %lu", (unsigned long) mp_baud->baud_rate, m_flow_control,
+                 m_baud_state != BAUD_IDLE, (unsigned long) m_test_remaining);
+        uart_cmd_send_information_response(info);
+    } else if (arg[0] == 'C') {
+        if (m_baud_state != BAUD_CONFIRMING) {
+            uart_put_string(response_err_configuration);
+            return;
+        }
+        app_timer_stop(m_baud_timer);
+        m_baud_state = BAUD_IDLE;
+        STATS_INC(UART_BAUD_CHANGES);
+        uart_put_string(response_ok);
+    } else if (arg[0] == 'T') {
+        arg = strtok(NULL, " \r\n");
+        if (!arg) {
+            STATS_INC(CMD_INVALID);
+            uart_put_string(response_err_invalid_args);
+            return;
+        }
+        if (m_baud_state != BAUD_IDLE) {
+            uart_put_string(response_err_configuration);
+            return;
+        }
+        // a running test is replaced, 0 stops it
+        m_test_remaining = strtoul(arg, NULL, 10);
+        m_test_seq = 0;
+        uart_put_string(response_ok);
+        test_stream_fill();
+    } else {
+        const baud_rate_t *p_baud = find_baud_rate(strtoul(arg, NULL, 10));
+        arg = strtok(NULL, " \r\n");
+        bool flow_control = arg && arg[0] == 'F';
+        if (!p_baud || (arg && !flow_control)) {
+            STATS_INC(CMD_INVALID);
+            uart_put_string(response_err_invalid_args);
+            return;
+        }
+        if ((flow_control && !UART_FLOW_CONTROL_AVAILABLE) || m_baud_state != BAUD_IDLE || m_test_remaining > 0) {
+            uart_put_string(response_err_configuration);
+            return;
+        }
+        uart_put_string(response_ok);
+        mp_prev_baud = mp_baud;
+        m_prev_flow_control = m_flow_control;
+        mp_baud = p_baud;
+        m_flow_control = flow_control;
+        // continues on APP_UART_TX_EMPTY
+        m_baud_state = BAUD_DRAINING;
+    }
 }
 
 /**
@@ -75,20 +479,136 @@ static void process_configuration_command(char *cmd, uart_cmd_evt_t *p_uart_cmd_
  * Available commands:
  *
  * 'I' : Information about the device
- * 'C <hex-encoded proximity UUID> <Major> <Value>': Set iBeacon configuration
+ * 'C <hex-encoded proximity UUID> <Major> <Minor>': Set iBeacon configuration, major and minor may be derived
+ *     from the device address: @<shift>[:<hex mask>] or #[<seed>]
+ * 'T <host time in microseconds>': Time synchronization sample
+ * 'A [<adv interval> <scan interval> <scan window>]': Get/set the airtime split (milliseconds)
+ * 'B [N <bits> <hashes> | W <offset> <hex data> | E <crc16> | D]': Bloom filter upload and control
+ * 'S [<first entry>]': Runtime statistics, one page of entries followed by next=<entry> if more are left
+ * 'L': CPU load (per mille) and wakeups per second in the last second, average load and wakeups since boot
+ * 'M [R]': Stack high-water mark and size, static RAM, heap size and unused RAM (bytes), static RAM per module
+ * 'K [C]': Fatal error count and the record of the last fatal error (see fault.h), clear the record
+ * 'D [<sequence number> | C]': Trace buffer status, dump events from the sequence number, clear
+ * 'R [C]': Radio on-time and charge estimate, reset
+ * 'W [G <index> | S <index> <days> <start> <end> <interval> <tx power> | D <index> | C | Z <utc offset>]': Weekly
+ *     advertising schedule status, get/set/delete a window, clear, set the UTC offset of local time (minutes)
+ * 'E [S <mode> <rotation exponent> <epoch> <hex-encoded identity key> | O]': Rotating identifier status, enable, off
+ * 'Y [R <iBeacon> <UID> <URL> <TLM> | U <hex-encoded namespace and instance> | L <URL>]': Eddystone frame
+ *     status, set the interleave ratio (advertising events per cycle), the UID frame identifiers, the URL
+ * 'X [S <interval> <duration> [<hex-encoded advertising data>] | C]': Advertising burst status, start (milliseconds),
+ *     cancel
+ * 'Z [S <identities> <interval> [<seed>] | C]': Beacon swarm status, start (interval in milliseconds), stop
+ * 'P [S <period> | O]': Address rotation status, rotate random static addresses every period (seconds), off
+ * 'H [<baud rate> [F] | C | T <bytes>]': UART status, switch the baud rate (F: with RTS/CTS), confirm the
+ *     switch at the new rate, send test frames
+ * 'F [N <size> <crc32> | W <offset> <crc16> <hex data> | E | C]': Firmware update status, start or resume the
+ *     transfer of an image, write a chunk, verify the image and install it at the next reset, cancel
  */
 static void process_command(char *cmd) {
     uart_cmd_evt_t uart_cmd_evt;
+    uint32_t start = stats_cycles();
+    stats_hist_t hist = STATS_HIST_CMD_OTHER;
+
+    STATS_INC(CMD_RECEIVED);
+    trace_record(TRACE_CMD_BEGIN, (uint8_t) *cmd, 0, 0);
     memset(&uart_cmd_evt, 0, sizeof(uart_cmd_evt_t));
+    uart_cmd_evt.rx_time_us = cmd_rx_time_us;
     if (*cmd == 'C') {
-        process_configuration_command(cmd, &uart_cmd_evt);
-        client->evt_handler(&uart_cmd_evt);
+        hist = STATS_HIST_CMD_C;
+        if (process_configuration_command(cmd, &uart_cmd_evt)) {
+            client->evt_handler(&uart_cmd_evt);
+        } else {
+            STATS_INC(CMD_INVALID);
+            uart_put_string(response_err_invalid_args);
+        }
     } else if (*cmd == 'I') {
+        hist = STATS_HIST_CMD_I;
         uart_cmd_evt.evt_type = INFORMATION;
         client->evt_handler(&uart_cmd_evt);
+    } else if (*cmd == 'T') {
+        hist = STATS_HIST_CMD_T;
+        if (process_time_sync_command(cmd, &uart_cmd_evt)) {
+            client->evt_handler(&uart_cmd_evt);
+        } else {
+            STATS_INC(CMD_INVALID);
+            uart_put_string(response_err_invalid_args);
+        }
+    } else if (*cmd == 'A') {
+        hist = STATS_HIST_CMD_A;
+        process_args_command(cmd, AIRTIME, &uart_cmd_evt);
+        client->evt_handler(&uart_cmd_evt);
+    } else if (*cmd == 'B') {
+        hist = STATS_HIST_CMD_B;
+        if (process_bloom_command(cmd, &uart_cmd_evt)) {
+            client->evt_handler(&uart_cmd_evt);
+        } else {
+            STATS_INC(CMD_INVALID);
+            uart_put_string(response_err_invalid_args);
+        }
+    } else if (*cmd == 'S') {
+        hist = STATS_HIST_CMD_S;
+        process_args_command(cmd, STATISTICS, &uart_cmd_evt);
+        client->evt_handler(&uart_cmd_evt);
+    } else if (*cmd == 'L') {
+        uart_cmd_evt.evt_type = CPU_LOAD;
+        client->evt_handler(&uart_cmd_evt);
+    } else if (*cmd == 'M') {
+        process_subcommand_args(cmd, RAM_USAGE, &uart_cmd_evt);
+        client->evt_handler(&uart_cmd_evt);
+    } else if (*cmd == 'K') {
+        process_subcommand_args(cmd, FAULT_RECORD, &uart_cmd_evt);
+        client->evt_handler(&uart_cmd_evt);
+    } else if (*cmd == 'D') {
+        process_subcommand_args(cmd, TRACE_DUMP, &uart_cmd_evt);
+        client->evt_handler(&uart_cmd_evt);
+    } else if (*cmd == 'R') {
+        process_subcommand_args(cmd, RADIO_ACCOUNTING, &uart_cmd_evt);
+        client->evt_handler(&uart_cmd_evt);
+    } else if (*cmd == 'E') {
+        if (process_eid_command(cmd, &uart_cmd_evt)) {
+            client->evt_handler(&uart_cmd_evt);
+        } else {
+            STATS_INC(CMD_INVALID);
+            uart_put_string(response_err_invalid_args);
+        }
+    } else if (*cmd == 'Y') {
+        if (process_eddystone_command(cmd, &uart_cmd_evt)) {
+            client->evt_handler(&uart_cmd_evt);
+        } else {
+            STATS_INC(CMD_INVALID);
+            uart_put_string(response_err_invalid_args);
+        }
+    } else if (*cmd == 'X') {
+        if (process_burst_command(cmd, &uart_cmd_evt)) {
+            client->evt_handler(&uart_cmd_evt);
+        } else {
+            STATS_INC(CMD_INVALID);
+            uart_put_string(response_err_invalid_args);
+        }
+    } else if (*cmd == 'Z') {
+        process_subcommand_args(cmd, SWARM, &uart_cmd_evt);
+        client->evt_handler(&uart_cmd_evt);
+    } else if (*cmd == 'P') {
+        process_subcommand_args(cmd, ADDR_ROTATION, &uart_cmd_evt);
+        client->evt_handler(&uart_cmd_evt);
+    } else if (*cmd == 'W') {
+        process_subcommand_args(cmd, SCHEDULE, &uart_cmd_evt);
+        client->evt_handler(&uart_cmd_evt);
+    } else if (*cmd == 'H') {
+        process_baud_command(cmd);
+    } else if (*cmd == 'F') {
+        if (process_update_command(cmd, &uart_cmd_evt)) {
+            client->evt_handler(&uart_cmd_evt);
+        } else {
+            STATS_INC(CMD_INVALID);
+            uart_put_string(response_err_invalid_args);
+        }
     } else {
+        STATS_INC(CMD_UNKNOWN);
         uart_put_string(response_err_unknown_cmd);
     }
+    stats_hist_record(hist, start);
+    trace_record(TRACE_CMD_END, (uint8_t) *cmd, 0, 0);
 }
 
 void uart_cmd_send_configuration_response(int error) {
@@ -100,48 +620,191 @@ void uart_cmd_send_configuration_response(int error) {
 }
 
 void uart_cmd_send_information_response(const char *info) {
+    CRITICAL_REGION_ENTER();
     uart_put_string("OK ");
     uart_put_string(info);
     uart_put_string("\n");
+    CRITICAL_REGION_EXIT();
+}
+
+void uart_cmd_send_frame(uint8_t type, const uint8_t *p_payload, uint8_t len) {
+    uint8_t header[2] = {type, len};
+    uint16_t crc = crc16_compute(header, sizeof(header), NULL);
+    crc = crc16_compute(p_payload, len, &crc);
+
+    CRITICAL_REGION_ENTER();
+    uart_put(UART_FRAME_SYNC);
+    uart_put(type);
+    uart_put(len);
+    for (int i = 0; i < len; i++) {
+        uart_put(p_payload[i]);
+    }
+    uart_put((uint8_t) crc);
+    uart_put((uint8_t) (crc >> 8));
+    STATS_INC(FRAMES_SENT);
+    CRITICAL_REGION_EXIT();
 }
 
 static void handle_uart_evt(app_uart_evt_t *p_event) {
+    uint64_t now_us;
+
     switch (p_event->evt_type) {
         case APP_UART_DATA_READY:
             app_uart_get(p_buf);
+            STATS_INC(UART_RX_BYTES);
+            now_us = timebase_now_us();
+            m_last_activity_us = now_us;
+            if (now_us < m_discard_until_us) {
+                STATS_INC(UART_WAKE_DISCARDED);
+                break;
+            }
             p_buf++;
+            if (p_buf - cmd_buf >= CMD_BUF_SIZE && *(p_buf - 1) != '\n' && *(p_buf - 1) != '\r') {
+                STATS_INC(CMD_TRUNCATED);
+            }
             if ((*(p_buf - 1) == '\n') || (*(p_buf - 1) == '\r') || (p_buf - cmd_buf >= CMD_BUF_SIZE)) {
                 *p_buf = '\0';
+                // empty lines are wake up preambles or the second half of CR LF
+                bool empty = p_buf - cmd_buf == 1;
+                if (!empty) {
+                    trace_record(TRACE_UART_RX_LINE, 0, (uint16_t) (p_buf - cmd_buf), 0);
+                }
                 p_buf = &cmd_buf[0];
-                process_command((char *) p_buf);
+                cmd_rx_time_us = now_us;
+                if (!empty) {
+                    process_command((char *) p_buf);
+                }
+            }
+            break;
+        case APP_UART_TX_EMPTY:
+            m_tx_pending = false;
+            m_last_activity_us = timebase_now_us();
+            if (m_baud_state == BAUD_DRAINING) {
+                m_baud_state = BAUD_SWITCHING;
+                APP_ERROR_CHECK(app_timer_start(m_baud_timer, UART_BAUD_SWITCH_DELAY, NULL));
+            } else if (m_test_remaining > 0) {
+                test_stream_fill();
             }
             break;
         case APP_UART_COMMUNICATION_ERROR:
-            APP_ERROR_HANDLER(p_event->data.error_communication);
+            // framing errors are expected right after a wake up, drop the garbled line
+            STATS_INC(UART_ERRORS);
+            p_buf = &cmd_buf[0];
             break;
-        case APP_UART_FIFO_ERROR:
-            APP_ERROR_HANDLER(p_event->data.error_code);
+        case APP_UART_FIFO_ERROR: {
+            // the RX FIFO overflowed and reception stopped, emptying it starts reception again; the line
+            // in progress has lost a byte and is dropped
+            uint8_t byte;
+            while (app_uart_get(&byte) == NRF_SUCCESS) {
+            }
+            STATS_INC(UART_RX_OVERFLOWS);
+            p_buf = &cmd_buf[0];
             break;
+        }
         default:
             break;
     }
 }
 
-ret_code_t uart_cmd_init(uart_cmd_client_t *uart_cmd_client) {
+static ret_code_t uart_open(void) {
     ret_code_t err_code;
 
     app_uart_comm_params_t const comm_params = {
             .rx_pin_no    = UART_RX_PIN,
             .tx_pin_no    = UART_TX_PIN,
-            .rts_pin_no   = 0, // ignored if flow control is disabled
-            .cts_pin_no   = 0, // ignored if flow control is disabled
-            .flow_control = APP_UART_FLOW_CONTROL_DISABLED,
+            .rts_pin_no   = UART_RTS_PIN,
+            .cts_pin_no   = UART_CTS_PIN,
+            .flow_control = m_flow_control ? APP_UART_FLOW_CONTROL_ENABLED : APP_UART_FLOW_CONTROL_DISABLED,
             .use_parity   = false,
-            .baud_rate    = NRF_UART_BAUDRATE_115200
+            .baud_rate    = mp_baud->setting
     };
 
     APP_UART_FIFO_INIT(&comm_params, UART_RX_BUF_SIZE, UART_TX_BUF_SIZE, handle_uart_evt, APP_IRQ_PRIORITY_LOWEST,
                        err_code);
-    client = uart_cmd_client;
     return err_code;
 }
+
+// Powers the UART up again, called for the wake up edge on the RX pin and for output while suspended
+static void uart_resume(void) {
+    uint32_t start = stats_cycles();
+    ret_code_t err_code;
+
+    CRITICAL_REGION_ENTER();
+    if (m_suspended) {
+        timebase_fine_enable(true);
+        nrf_drv_gpiote_in_event_disable(UART_RX_PIN);
+        nrf_drv_gpiote_in_uninit(UART_RX_PIN);
+        err_code = uart_open();
+        APP_ERROR_CHECK(err_code);
+        m_suspended = false;
+
+        uint64_t now_us = timebase_now_us();
+        m_last_activity_us = now_us;
+        m_discard_until_us = now_us + UART_WAKE_GUARD_US;
+        STATS_ADD(UART_SUSPENDED_MS, (uint32_t) ((now_us - m_suspend_time_us) / 1000));
+        stats_hist_record(STATS_HIST_UART_WAKE, start);
+        trace_record(TRACE_UART_RESUME, 0, 0, (uint32_t) (now_us - m_suspend_time_us));
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+static void rx_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action) {
+    uart_resume();
+}
+
+static void uart_suspend(void) {
+    ret_code_t err_code;
+
+    CRITICAL_REGION_ENTER();
+    // the RX FIFO is empty once DATA_READY has been handled, a command line may be incomplete though
+    if (!m_suspended && !m_tx_pending && p_buf == cmd_buf) {
+        err_code = app_uart_close();
+        APP_ERROR_CHECK(err_code);
+
+        // PORT event (low accuracy), which does not need the HFCLK
+        nrf_drv_gpiote_in_config_t config = GPIOTE_CONFIG_IN_SENSE_HITOLO(false);
+        config.pull = NRF_GPIO_PIN_PULLUP;
+        err_code = nrf_drv_gpiote_in_init(UART_RX_PIN, &config, rx_pin_handler);
+        APP_ERROR_CHECK(err_code);
+        nrf_drv_gpiote_in_event_enable(UART_RX_PIN, true);
+
+        m_suspended = true;
+        m_suspend_time_us = timebase_now_us();
+        // nothing is stamped until the UART wakes up, the TIMER would keep the HFCLK running
+        timebase_fine_enable(false);
+        STATS_INC(UART_SUSPENDS);
+        trace_record(TRACE_UART_SUSPEND, 0, 0, 0);
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+static void idle_timer_handler(void *p_context) {
+    if (!m_suspended && m_baud_state == BAUD_IDLE && timebase_now_us() - m_last_activity_us >= UART_IDLE_TIMEOUT_MS * 1000ULL) {
+        uart_suspend();
+    }
+}
+
+ret_code_t uart_cmd_init(uart_cmd_client_t *uart_cmd_client) {
+    ret_code_t err_code;
+
+    client = uart_cmd_client;
+    m_suspended = false;
+    // the negotiated rate is not persisted, every reset starts at the default
+    mp_baud = find_baud_rate(UART_DEFAULT_BAUD_RATE);
+    m_flow_control = false;
+    m_baud_state = BAUD_IDLE;
+    err_code = uart_open();
+    if (err_code != NRF_SUCCESS) return err_code;
+    err_code = app_timer_create(&m_baud_timer, APP_TIMER_MODE_SINGLE_SHOT, baud_timer_handler);
+    if (err_code != NRF_SUCCESS || UART_IDLE_TIMEOUT_MS == 0) {
+        return err_code;
+    }
+
+    if (!nrf_drv_gpiote_is_init()) {
+        err_code = nrf_drv_gpiote_init();
+        if (err_code != NRF_SUCCESS) return err_code;
+    }
+    err_code = app_timer_create(&m_idle_timer, APP_TIMER_MODE_REPEATED, idle_timer_handler);
+    if (err_code != NRF_SUCCESS) return err_code;
+    return app_timer_start(m_idle_timer, UART_IDLE_CHECK_INTERVAL, NULL);
+}
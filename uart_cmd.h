@@ -3,18 +3,61 @@
 
 #include <stdint.h>
 
+#include "mac_derive.h"
+
+// Binary frames are sent in between the text responses: 0xFE <type> <length> <payload> <CRC16>
+// The CRC16 (CCITT, little endian) covers type, length and payload. Text responses never contain 0xFE.
+#define UART_FRAME_SYNC                 0xFE
+#define UART_FRAME_MAX_PAYLOAD          250
+
+// Types of binary frames
+#define UART_FRAME_SCAN_REPORT          0x01
+#define UART_FRAME_TRACE                0x02
+#define UART_FRAME_TEST                 0x03
+
 // Types of commands received
 typedef enum {
     CONFIGURATION,
-    INFORMATION
+    INFORMATION,
+    TIME_SYNC,
+    AIRTIME,
+    BLOOM_FILTER,
+    STATISTICS,
+    TRACE_DUMP,
+    RADIO_ACCOUNTING,
+    SCHEDULE,
+    EID,
+    EDDYSTONE,
+    BURST,
+    SWARM,
+    ADDR_ROTATION,
+    FIRMWARE_UPDATE,
+    CPU_LOAD,
+    RAM_USAGE,
+    FAULT_RECORD
 } uart_cmd_evt_type_t;
 
+// Maximum number of integer arguments of a command
+#define UART_CMD_MAX_ARGS               8
+
+// Maximum length of binary data sent hex-encoded with a command
+#define UART_CMD_MAX_DATA               100
+
 // Event data structure
 typedef struct {
     uart_cmd_evt_type_t evt_type;
     uint16_t major;
     uint16_t minor;
+    mac_derive_rule_t major_rule;
+    mac_derive_rule_t minor_rule;
     uint8_t proximity_uuid[16];
+    uint64_t host_time_us;      // host time sent with a time sync command
+    uint64_t rx_time_us;        // local timebase value when the command line was terminated
+    char subcommand;            // letter following the command, 0 if none
+    int32_t args[UART_CMD_MAX_ARGS];
+    uint8_t arg_count;
+    uint8_t data[UART_CMD_MAX_DATA];
+    uint8_t data_len;
 } uart_cmd_evt_t;
 
 // Event handler type
@@ -29,5 +72,6 @@ typedef struct uart_cmd {
 uint32_t uart_cmd_init(uart_cmd_client_t* uart_cmd_client);
 void uart_cmd_send_configuration_response(int error);
 void uart_cmd_send_information_response(const char *info);
+void uart_cmd_send_frame(uint8_t type, const uint8_t *p_payload, uint8_t len);
 
 #endif //_UART_CMD_H